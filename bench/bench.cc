@@ -0,0 +1,117 @@
+#include "bench.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <clean-core/assert.hh>
+
+bool pr::bench::runner::is_enabled(const char* name) const { return mConfig.filter == nullptr || std::strstr(name, mConfig.filter) != nullptr; }
+
+void pr::bench::runner::runBatchesImpl(const char* name, unsigned num_threads, double bytes_per_op, const batch_func& func)
+{
+    using clock = std::chrono::steady_clock;
+
+    auto f_time_batch_ms = [&](uint64_t num_ops) -> double {
+        auto const start = clock::now();
+        func.invoke(func.userdata, num_ops);
+        return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    };
+
+    // grow the batch until it takes long enough to be measured reliably (this also warms up caches)
+    uint64_t num_ops = 1;
+    double batch_ms = f_time_batch_ms(num_ops);
+    while (batch_ms < mConfig.min_batch_ms && num_ops < (uint64_t(1) << 40))
+    {
+        num_ops = batch_ms <= 0. ? num_ops * 16 : uint64_t(double(num_ops) * 1.2 * mConfig.min_batch_ms / batch_ms) + 1;
+        batch_ms = f_time_batch_ms(num_ops);
+    }
+
+    double best_ms = batch_ms;
+    for (auto i = 1u; i < mConfig.num_batches; ++i)
+    {
+        double const ms = f_time_batch_ms(num_ops);
+        best_ms = ms < best_ms ? ms : best_ms;
+    }
+
+    add_result(name, num_ops * num_threads, num_threads, best_ms * 1e6, bytes_per_op);
+}
+
+void pr::bench::runner::add_result(const char* name, uint64_t num_ops, uint32_t num_threads, double total_ns, double bytes_per_op)
+{
+    CC_ASSERT(num_ops > 0 && "benchmark result without operations");
+
+    result& res = mResults.emplace_back();
+    std::snprintf(res.name, sizeof(res.name), "%s", name);
+    res.num_ops = num_ops;
+    res.num_threads = num_threads;
+    res.ns_per_op = total_ns / double(num_ops);
+    res.bytes_per_op = bytes_per_op;
+}
+
+void pr::bench::runner::runOnThreadsImpl(unsigned num_threads, uint64_t num_ops, const thread_func& func)
+{
+    CC_ASSERT(num_threads > 0 && "invalid amount of threads");
+
+    // spin until all threads are started so they contend from the first operation
+    std::atomic<unsigned> num_ready = {0};
+    cc::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+
+    for (auto i = 1u; i < num_threads; ++i)
+    {
+        threads.emplace_back([&, i] {
+            num_ready.fetch_add(1, std::memory_order_acq_rel);
+            while (num_ready.load(std::memory_order_acquire) < num_threads)
+                std::this_thread::yield();
+
+            func.invoke(func.userdata, i, num_ops);
+        });
+    }
+
+    num_ready.fetch_add(1, std::memory_order_acq_rel);
+    while (num_ready.load(std::memory_order_acquire) < num_threads)
+        std::this_thread::yield();
+
+    func.invoke(func.userdata, 0, num_ops);
+
+    for (std::thread& t : threads)
+        t.join();
+}
+
+void pr::bench::runner::write_json(const char* path) const
+{
+    std::FILE* const file = path != nullptr ? std::fopen(path, "wb") : stdout;
+    if (file == nullptr)
+    {
+        std::fprintf(stderr, "failed to open %s for writing\n", path);
+        return;
+    }
+
+    std::fputs("{\"benchmarks\":[", file);
+    for (auto i = 0u; i < mResults.size(); ++i)
+    {
+        result const& res = mResults[i];
+        double const bytes_per_second = res.bytes_per_op > 0. ? res.bytes_per_op * 1e9 / res.ns_per_op : 0.;
+
+        std::fprintf(file, "%s\n{\"name\":\"%s\",\"threads\":%u,\"operations\":%llu,\"ns_per_op\":%.4f,\"bytes_per_second\":%.1f}", i == 0 ? "" : ",",
+                     res.name, res.num_threads, static_cast<unsigned long long>(res.num_ops), res.ns_per_op, bytes_per_second);
+    }
+    std::fputs("\n]}\n", file);
+
+    if (file != stdout)
+        std::fclose(file);
+}
+
+void pr::bench::runner::print_summary() const
+{
+    for (result const& res : mResults)
+    {
+        if (res.bytes_per_op > 0.)
+            std::fprintf(stderr, "%-56s %12.3f ns/op %10.2f GB/s\n", res.name, res.ns_per_op, res.bytes_per_op / res.ns_per_op);
+        else
+            std::fprintf(stderr, "%-56s %12.3f ns/op\n", res.name, res.ns_per_op);
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+
+#include <clean-core/vector.hh>
+
+#include <phantasm-renderer/fwd.hh>
+
+// minimal headless microbenchmark harness
+// every benchmark is a callable running a batch of n operations, batches are grown until they take at least
+// the configured minimum time and the fastest of several batches is reported
+namespace pr::bench
+{
+/// per-thread sink for results that must not be optimized away
+inline thread_local volatile uint64_t g_sink = 0;
+inline void consume(uint64_t value) { g_sink = g_sink + value; }
+
+/// a valid (non-null) PHI handle of type HandleT with the given index, not referring to an actual object
+template <class HandleT>
+HandleT make_handle(unsigned i)
+{
+    HandleT res;
+    res._value = decltype(res._value)(i + 1);
+    return res;
+}
+
+struct result
+{
+    char name[96] = {};
+    uint64_t num_ops = 0;      ///< operations in the fastest batch
+    uint32_t num_threads = 1;  ///< threads running operations concurrently
+    double ns_per_op = 0.;     ///< wall time per operation, over all threads
+    double bytes_per_op = 0.;  ///< bytes processed per operation, 0 if not applicable
+};
+
+struct config
+{
+    char const* filter = nullptr; ///< only benchmarks with names containing this are run, all if null
+    double min_batch_ms = 20;     ///< minimum duration of a measured batch
+    unsigned num_batches = 5;     ///< measured batches, the fastest is reported
+};
+
+class runner
+{
+public:
+    explicit runner(config const& cfg) : mConfig(cfg) {}
+
+    /// runs func(uint64_t num_ops) on the calling thread
+    template <class F>
+    void run(char const* name, F&& func, double bytes_per_op = 0.)
+    {
+        if (!is_enabled(name))
+            return;
+
+        runBatches(name, 1, bytes_per_op, [&](uint64_t num_ops) { func(num_ops); });
+    }
+
+    /// runs func(unsigned thread_index, uint64_t num_ops) on num_threads threads at once, num_ops being per thread
+    template <class F>
+    void run_threaded(char const* name, unsigned num_threads, F&& func, double bytes_per_op = 0.)
+    {
+        if (!is_enabled(name))
+            return;
+
+        runBatches(name, num_threads, bytes_per_op, [&](uint64_t num_ops) { runOnThreads(num_threads, num_ops, func); });
+    }
+
+    /// records the result of a benchmark timed by the caller
+    void add_result(char const* name, uint64_t num_ops, uint32_t num_threads, double total_ns, double bytes_per_op = 0.);
+
+    /// whether a benchmark of this name passes the filter
+    bool is_enabled(char const* name) const;
+
+    cc::vector<result> const& get_results() const { return mResults; }
+
+    /// writes all results as JSON
+    void write_json(char const* path) const;
+
+    /// prints all results as a table to stderr
+    void print_summary() const;
+
+private:
+    struct batch_func
+    {
+        void* userdata;
+        void (*invoke)(void* userdata, uint64_t num_ops);
+    };
+
+    struct thread_func
+    {
+        void* userdata;
+        void (*invoke)(void* userdata, unsigned thread_index, uint64_t num_ops);
+    };
+
+    template <class F>
+    void runBatches(char const* name, unsigned num_threads, double bytes_per_op, F&& func)
+    {
+        batch_func const bf = {&func, [](void* ud, uint64_t n) { (*static_cast<F*>(ud))(n); }};
+        runBatchesImpl(name, num_threads, bytes_per_op, bf);
+    }
+
+    template <class F>
+    void runOnThreads(unsigned num_threads, uint64_t num_ops, F& func)
+    {
+        thread_func const tf = {&func, [](void* ud, unsigned i, uint64_t n) { (*static_cast<F*>(ud))(i, n); }};
+        runOnThreadsImpl(num_threads, num_ops, tf);
+    }
+
+    void runBatchesImpl(char const* name, unsigned num_threads, double bytes_per_op, batch_func const& func);
+    static void runOnThreadsImpl(unsigned num_threads, uint64_t num_ops, thread_func const& func);
+
+private:
+    config mConfig;
+    cc::vector<result> mResults;
+};
+
+/// parameters of the synthetic frame workload
+struct workload_config
+{
+    unsigned num_draws = 10000;      ///< drawcalls per frame, split evenly among the recording threads
+    unsigned num_psos = 16;          ///< unique PSOs, drawcalls are grouped by PSO
+    unsigned num_arguments = 256;    ///< unique arguments (shader views), bound per drawcall
+    unsigned upload_bytes = 1 << 20; ///< bytes uploaded to a buffer per frame
+    unsigned num_frames = 200;       ///< measured frames per thread count, after as many warmup frames
+    unsigned max_threads = 0;        ///< recording threads are scaled in powers of two up to this, 0 for all hardware threads
+    bool compile_shaders = true;     ///< false to create PSOs from placeholder binaries, for backends that never read them
+};
+
+/// records, compiles and submits frames through the full Context / Frame / Framebuffer / GraphicsPass path
+/// for each amount of recording threads, reports the CPU time per drawcall
+void run_frame_workload(runner& r, Context& ctx, workload_config const& cfg);
+
+// benchmark groups, see the respective source files
+void run_cache_benchmarks(runner& r);
+void run_hash_benchmarks(runner& r);
+void run_recording_benchmarks(runner& r);
+void run_copy_benchmarks(runner& r);
+}
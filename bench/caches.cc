@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <thread>
+
+#include <clean-core/utility.hh>
+
+#include <phantasm-renderer/common/multi_cache.hh>
+#include <phantasm-renderer/common/single_cache.hh>
+
+#include "bench.hh"
+
+namespace
+{
+constexpr unsigned gc_num_keys = 256;
+
+uint64_t get_key(unsigned i) { return (uint64_t(i) + 1) * 0x9E3779B97F4A7C15ull; }
+
+pr::buffer_info get_buffer_info(unsigned i)
+{
+    pr::buffer_info res = {};
+    res.size_bytes = (i + 1) * 256;
+    return res;
+}
+}
+
+void pr::bench::run_cache_benchmarks(runner& r)
+{
+    unsigned const max_threads = cc::max(2u, std::thread::hardware_concurrency());
+    unsigned const thread_counts[] = {2, 4, max_threads};
+
+    // single_cache, as used for PSOs and shader views: acquire a hit and release it again
+    {
+        single_cache<phi::handle::pipeline_state> cache;
+        cache.reserve(gc_num_keys);
+        for (auto i = 0u; i < gc_num_keys; ++i)
+            cache.insert(pr::bench::make_handle<phi::handle::pipeline_state>(i), get_key(i));
+
+        r.run("single_cache/acquire_free", [&](uint64_t num_ops) {
+            for (auto i = 0ull; i < num_ops; ++i)
+            {
+                uint64_t const key = get_key(unsigned(i % gc_num_keys));
+                consume(uint64_t(cache.acquire(key)._value));
+                cache.free(key, i);
+            }
+        });
+
+        for (unsigned const num_threads : thread_counts)
+        {
+            char name[96];
+            std::snprintf(name, sizeof(name), "single_cache/acquire_free/contended/threads=%u", num_threads);
+
+            r.run_threaded(name, num_threads, [&](unsigned thread_index, uint64_t num_ops) {
+                for (auto i = 0ull; i < num_ops; ++i)
+                {
+                    uint64_t const key = get_key(unsigned((i + thread_index * 17) % gc_num_keys));
+                    consume(uint64_t(cache.acquire(key)._value));
+                    cache.free(key, i);
+                }
+            });
+        }
+
+        cache.cull_all(~gpu_epoch_t(0), [](phi::handle::pipeline_state) {});
+    }
+
+    // multi_cache, as used for textures and buffers: return a resource and take it back once it is no longer in flight
+    {
+        multi_cache<buffer_info> cache;
+        cache.reserve(gc_num_keys);
+
+        r.run("multi_cache/free_acquire", [&](uint64_t num_ops) {
+            for (auto i = 0ull; i < num_ops; ++i)
+            {
+                buffer_info const info = get_buffer_info(unsigned(i % gc_num_keys));
+                cache.free({pr::bench::make_handle<phi::handle::resource>(unsigned(i % gc_num_keys)), i}, info, 1);
+                consume(cache.acquire(info, 1).guid);
+            }
+        });
+
+        for (unsigned const num_threads : thread_counts)
+        {
+            char name[96];
+            std::snprintf(name, sizeof(name), "multi_cache/free_acquire/contended/threads=%u", num_threads);
+
+            r.run_threaded(name, num_threads, [&](unsigned thread_index, uint64_t num_ops) {
+                for (auto i = 0ull; i < num_ops; ++i)
+                {
+                    auto const key_index = unsigned((i + thread_index * 17) % gc_num_keys);
+                    buffer_info const info = get_buffer_info(key_index);
+                    cache.free({pr::bench::make_handle<phi::handle::resource>(key_index), i}, info, 1);
+                    consume(cache.acquire(info, 1).guid);
+                }
+            });
+        }
+
+        cache.cull_all(~gpu_epoch_t(0), [](phi::handle::resource) {});
+    }
+}
@@ -0,0 +1,180 @@
+#include <cstdio>
+
+#include <phantasm-renderer/common/bc_encode.hh>
+#include <phantasm-renderer/common/lz4_block.hh>
+#include <phantasm-renderer/common/pixel_convert.hh>
+#include <phantasm-renderer/common/rowwise_copy.hh>
+
+#include "bench.hh"
+
+void pr::bench::run_copy_benchmarks(runner& r)
+{
+    struct copy_config
+    {
+        size_t row_size_bytes;
+        size_t row_pitch_bytes; ///< destination row stride, 256 byte aligned as on D3D12
+        unsigned num_rows;
+    };
+
+    copy_config const configs[] = {
+        {64, 256, 4096},            // 16px wide RGBA8 (or a row of 4x4 blocks of a 64px BC7 texture)
+        {1000 * 4, 4096, 1000},     // unaligned RGBA8 rows
+        {1024 * 4, 4096, 1024},     // aligned RGBA8 rows, the copy is contiguous
+        {1920 * 8, 1920 * 8, 1080}, // RGBA16F 1080p
+        {4096 * 4, 4096 * 4, 4096}, // 64 MiB, exceeds the last level cache
+    };
+
+    for (copy_config const& cfg : configs)
+    {
+        cc::vector<std::byte> src;
+        cc::vector<std::byte> dest;
+        src.resize(cfg.row_size_bytes * cfg.num_rows);
+        dest.resize(cfg.row_pitch_bytes * cfg.num_rows);
+
+        for (auto i = 0u; i < src.size(); ++i)
+            src[i] = std::byte(i * 31);
+
+        char name[96];
+        std::snprintf(name, sizeof(name), "rowwise_copy/row=%zu/pitch=%zu/rows=%u", cfg.row_size_bytes, cfg.row_pitch_bytes, cfg.num_rows);
+
+        // one operation is a full surface
+        r.run(
+            name,
+            [&](uint64_t num_ops) {
+                for (auto i = 0ull; i < num_ops; ++i)
+                    consume(rowwise_copy(src.data(), dest.data(), cfg.row_pitch_bytes, cfg.row_size_bytes, cfg.num_rows));
+            },
+            double(src.size()));
+
+        // destination is regular cached memory here, write-combined upload memory favors streaming stores further
+        std::snprintf(name, sizeof(name), "rowwise_copy_streaming/%s/row=%zu/pitch=%zu/rows=%u", get_rowwise_copy_streaming_isa(), cfg.row_size_bytes,
+                      cfg.row_pitch_bytes, cfg.num_rows);
+
+        r.run(
+            name,
+            [&](uint64_t num_ops) {
+                for (auto i = 0ull; i < num_ops; ++i)
+                    consume(rowwise_copy_streaming(src.data(), dest.data(), cfg.row_pitch_bytes, cfg.row_size_bytes, cfg.num_rows));
+            },
+            double(src.size()));
+    }
+
+    struct conversion_config
+    {
+        char const* name;
+        pixel_format src;
+        pixel_format dest;
+        bool srgb_encode;
+    };
+
+    conversion_config const conversions[] = {
+        {"rgb8un->rgba8un", pixel_format::rgb8un, pixel_format::rgba8un, false},
+        {"rgba8un->bgra8un", pixel_format::rgba8un, pixel_format::bgra8un, false},
+        {"rgba32f->rgba16f", pixel_format::rgba32f, pixel_format::rgba16f, false},
+        {"r16un->r16f", pixel_format::r16un, pixel_format::r16f, false},
+        {"rgba32f->rgba8un/srgb", pixel_format::rgba32f, pixel_format::rgba8un, true}, // generic path
+    };
+
+    // one operation is a 1024 pixel row
+    constexpr uint32_t num_pixels = 1024;
+
+    for (conversion_config const& cfg : conversions)
+    {
+        pixel_conversion conv;
+        conv.src = cfg.src;
+        conv.dest = cfg.dest;
+        conv.srgb_encode = cfg.srgb_encode;
+
+        cc::vector<std::byte> src;
+        cc::vector<std::byte> dest;
+        src.resize(num_pixels * get_pixel_format_size_bytes(cfg.src));
+        dest.resize(num_pixels * get_pixel_format_size_bytes(cfg.dest));
+
+        for (auto i = 0u; i < src.size(); ++i)
+            src[i] = std::byte(i * 31);
+
+        char name[96];
+        std::snprintf(name, sizeof(name), "convert_pixel_row/%s", cfg.name);
+
+        r.run(
+            name,
+            [&](uint64_t num_ops) {
+                for (auto i = 0ull; i < num_ops; ++i)
+                {
+                    convert_pixel_row(conv, src.data(), dest.data(), num_pixels);
+                    consume(uint64_t(dest[0]));
+                }
+            },
+            double(src.size()));
+    }
+
+    struct bc_config
+    {
+        char const* name;
+        format fmt;
+        uint32_t bytes_per_block;
+        bc_quality quality;
+    };
+
+    bc_config const bc_configs[] = {
+        {"bc1/fast", format::bc1_8un, 8, bc_quality::fast},     //
+        {"bc1/high", format::bc1_8un, 8, bc_quality::high},     //
+        {"bc3/normal", format::bc3_8un, 16, bc_quality::normal}, //
+        {"bc7/fast", format::bc7_8un, 16, bc_quality::fast},     //
+        {"bc7/high", format::bc7_8un, 16, bc_quality::high},
+    };
+
+    // one operation is a row of 4x4 blocks of a 1024 pixel wide RGBA8 image
+    for (bc_config const& cfg : bc_configs)
+    {
+        cc::vector<std::byte> src;
+        cc::vector<std::byte> dest;
+        src.resize(num_pixels * 4 * 4);
+        dest.resize(num_pixels / 4 * cfg.bytes_per_block);
+
+        for (auto i = 0u; i < src.size(); ++i)
+            src[i] = std::byte(i * 31 + (i >> 12) * 7);
+
+        char name[96];
+        std::snprintf(name, sizeof(name), "encode_bc_block_row/%s", cfg.name);
+
+        r.run(
+            name,
+            [&](uint64_t num_ops) {
+                for (auto i = 0ull; i < num_ops; ++i)
+                {
+                    encode_bc_block_row(cfg.fmt, cfg.quality, src.data(), num_pixels * 4, num_pixels, 4, dest.data());
+                    consume(uint64_t(dest[0]));
+                }
+            },
+            double(src.size()));
+    }
+
+    // one operation decompresses a texture container chunk of smooth RGBA8 gradients with noise in the low bits
+    {
+        size_t const chunk_size = 256u << 10;
+
+        cc::vector<std::byte> src;
+        cc::vector<std::byte> compressed;
+        cc::vector<std::byte> dest;
+        src.resize(chunk_size);
+        compressed.resize(get_lz4_compress_bound(chunk_size));
+        dest.resize(chunk_size);
+
+        for (auto i = 0u; i < src.size(); ++i)
+            src[i] = std::byte(((i >> 2) % 1024) / 4 + ((i * 2654435761u) >> 31));
+
+        size_t const compressed_size = lz4_compress_block(src.data(), src.size(), compressed.data(), compressed.size());
+
+        r.run(
+            "lz4_decompress_block/256k",
+            [&](uint64_t num_ops) {
+                for (auto i = 0ull; i < num_ops; ++i)
+                {
+                    lz4_decompress_block(compressed.data(), compressed_size, dest.data(), dest.size());
+                    consume(uint64_t(dest[0]));
+                }
+            },
+            double(chunk_size));
+    }
+}
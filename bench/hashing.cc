@@ -0,0 +1,50 @@
+#include <cstdio>
+
+#include <phantasm-renderer/common/hashable_storage.hh>
+#include <phantasm-renderer/common/state_info.hh>
+
+#include "bench.hh"
+
+namespace
+{
+template <class T>
+void run_hash_benchmark(pr::bench::runner& r, char const* type_name)
+{
+    // a small ring of distinct values so the hashed bytes are not constant
+    pr::hashable_storage<T> values[8];
+    for (auto i = 0u; i < 8; ++i)
+        reinterpret_cast<std::byte*>(&values[i].get())[0] = std::byte(i);
+
+    char name[96];
+
+    std::snprintf(name, sizeof(name), "hashable_storage/xxh3/%s/%zu_bytes", type_name, sizeof(T));
+    r.run(
+        name,
+        [&](uint64_t num_ops) {
+            for (auto i = 0ull; i < num_ops; ++i)
+                pr::bench::consume(values[i % 8].get_xxhash());
+        },
+        double(sizeof(T)));
+
+    std::snprintf(name, sizeof(name), "hashable_storage/murmur3_x64_128/%s/%zu_bytes", type_name, sizeof(T));
+    r.run(
+        name,
+        [&](uint64_t num_ops) {
+            for (auto i = 0ull; i < num_ops; ++i)
+            {
+                pr::murmur_hash hash;
+                values[i % 8].get_murmur(hash);
+                pr::bench::consume(hash.value[0] ^ hash.value[1]);
+            }
+        },
+        double(sizeof(T)));
+}
+}
+
+void pr::bench::run_hash_benchmarks(runner& r)
+{
+    run_hash_benchmark<shader_view_info>(r, "shader_view_info");
+    run_hash_benchmark<graphics_pass_info_data>(r, "graphics_pass_info_data");
+    run_hash_benchmark<compute_pass_info_data>(r, "compute_pass_info_data");
+    run_hash_benchmark<phi::arg::framebuffer_config>(r, "framebuffer_config");
+}
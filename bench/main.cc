@@ -0,0 +1,112 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <phantasm-renderer/Context.hh>
+#include <phantasm-renderer/enums.hh>
+
+#include "bench.hh"
+#include "stub_backend.hh"
+
+namespace
+{
+void print_usage(char const* exe)
+{
+    std::fprintf(stderr,
+                 "usage: %s [--filter <substring>] [--min-batch-ms <ms>] [--batches <n>] [--json <path>]\n"
+                 "       %s --workload [--backend stub|vulkan|d3d12] [--draws <n>] [--psos <n>] [--arguments <n>] [--upload-bytes <n>] [--frames <n>] "
+                 "[--max-threads <n>] [--filter <substring>] [--json <path>]\n",
+                 exe, exe);
+}
+}
+
+// phantasm-renderer-bench runs the microbenchmarks headless on the CPU
+// with --workload, it instead runs the synthetic frame workload, by default headless on a stub backend, or on a GPU backend
+// results are written as JSON to stdout (or the given path) and summarized on stderr
+int main(int argc, char** argv)
+{
+    pr::bench::config cfg;
+    pr::bench::workload_config workload_cfg;
+    char const* workload_backend = "stub";
+    bool run_workload = false;
+    char const* json_path = nullptr;
+
+    for (auto i = 1; i < argc; ++i)
+    {
+        bool const has_value = i + 1 < argc;
+        char const* const arg = argv[i];
+
+        if (std::strcmp(arg, "--workload") == 0)
+            run_workload = true;
+        else if (has_value && std::strcmp(arg, "--filter") == 0)
+            cfg.filter = argv[++i];
+        else if (has_value && std::strcmp(arg, "--min-batch-ms") == 0)
+            cfg.min_batch_ms = std::atof(argv[++i]);
+        else if (has_value && std::strcmp(arg, "--batches") == 0)
+            cfg.num_batches = unsigned(std::atoi(argv[++i]));
+        else if (has_value && std::strcmp(arg, "--json") == 0)
+            json_path = argv[++i];
+        else if (has_value && std::strcmp(arg, "--backend") == 0)
+            workload_backend = argv[++i];
+        else if (has_value && std::strcmp(arg, "--draws") == 0)
+            workload_cfg.num_draws = unsigned(std::atoi(argv[++i]));
+        else if (has_value && std::strcmp(arg, "--psos") == 0)
+            workload_cfg.num_psos = unsigned(std::atoi(argv[++i]));
+        else if (has_value && std::strcmp(arg, "--arguments") == 0)
+            workload_cfg.num_arguments = unsigned(std::atoi(argv[++i]));
+        else if (has_value && std::strcmp(arg, "--upload-bytes") == 0)
+            workload_cfg.upload_bytes = unsigned(std::atoi(argv[++i]));
+        else if (has_value && std::strcmp(arg, "--frames") == 0)
+            workload_cfg.num_frames = unsigned(std::atoi(argv[++i]));
+        else if (has_value && std::strcmp(arg, "--max-threads") == 0)
+            workload_cfg.max_threads = unsigned(std::atoi(argv[++i]));
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (cfg.num_batches == 0)
+        cfg.num_batches = 1;
+
+    if (run_workload && (workload_cfg.num_draws == 0 || workload_cfg.num_psos == 0 || workload_cfg.num_arguments == 0 || workload_cfg.num_frames == 0))
+    {
+        std::fprintf(stderr, "draws, psos, arguments and frames must be positive\n");
+        return 1;
+    }
+
+    bool const use_stub_backend = std::strcmp(workload_backend, "stub") == 0;
+    if (run_workload && !use_stub_backend && std::strcmp(workload_backend, "vulkan") != 0 && std::strcmp(workload_backend, "d3d12") != 0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    pr::bench::runner r(cfg);
+
+    if (run_workload && use_stub_backend)
+    {
+        // the stub never reads shaders, placeholder binaries skip the compiler
+        pr::bench::StubBackend backend;
+        pr::Context ctx(&backend);
+        workload_cfg.compile_shaders = false;
+        pr::bench::run_frame_workload(r, ctx, workload_cfg);
+    }
+    else if (run_workload)
+    {
+        pr::Context ctx(std::strcmp(workload_backend, "d3d12") == 0 ? pr::backend::d3d12 : pr::backend::vulkan);
+        pr::bench::run_frame_workload(r, ctx, workload_cfg);
+    }
+    else
+    {
+        pr::bench::run_cache_benchmarks(r);
+        pr::bench::run_hash_benchmarks(r);
+        pr::bench::run_recording_benchmarks(r);
+        pr::bench::run_copy_benchmarks(r);
+    }
+
+    r.print_summary();
+    r.write_json(json_path);
+    return 0;
+}
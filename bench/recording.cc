@@ -0,0 +1,205 @@
+#include <cstdio>
+
+#include <clean-core/utility.hh>
+
+#include <phantasm-renderer/Context.hh>
+#include <phantasm-renderer/Frame.hh>
+#include <phantasm-renderer/GraphicsPass.hh>
+#include <phantasm-renderer/argument.hh>
+#include <phantasm-renderer/common/circular_buffer.hh>
+#include <phantasm-renderer/common/draw_delta_stream.hh>
+#include <phantasm-renderer/common/growing_writer.hh>
+#include <phantasm-renderer/pass_info.hh>
+
+#include "bench.hh"
+#include "stub_backend.hh"
+
+namespace
+{
+/// amount of commands recorded into a writer or stream before it is reset, like a frame
+constexpr unsigned gc_commands_per_frame = 4096;
+
+/// amount of deferred frees between submitted frames
+constexpr unsigned gc_frees_per_frame = 256;
+
+template <class CmdT>
+void run_writer_benchmark(pr::bench::runner& r, char const* cmd_name, CmdT const& cmd)
+{
+    char name[96];
+    std::snprintf(name, sizeof(name), "growing_writer/add_command/%s", cmd_name);
+
+    // starts small so the benchmark includes growing by new chunks
+    pr::growing_writer writer(4096);
+
+    r.run(
+        name,
+        [&](uint64_t num_ops) {
+            for (auto i = 0ull; i < num_ops; ++i)
+            {
+                if (i % gc_commands_per_frame == 0)
+                    writer.reset();
+
+                writer.add_command(cmd);
+            }
+            pr::bench::consume(writer.size());
+        },
+        double(sizeof(CmdT)));
+}
+
+phi::cmd::draw make_draw(uint64_t i)
+{
+    // typical sorted drawcalls: the PSO changes rarely, buffers and counts change per mesh
+    phi::cmd::draw dcmd;
+    dcmd.pipeline_state = pr::bench::make_handle<phi::handle::pipeline_state>(unsigned(i / 256));
+    dcmd.vertex_buffers[0] = pr::bench::make_handle<phi::handle::resource>(unsigned(i % 64));
+    dcmd.index_buffer = pr::bench::make_handle<phi::handle::resource>(unsigned(i % 64) + 64);
+    dcmd.num_indices = 36 + unsigned(i % 7) * 3;
+    dcmd.num_instances = 1;
+    return dcmd;
+}
+}
+
+void pr::bench::run_recording_benchmarks(runner& r)
+{
+    // raw command stream writing
+    run_writer_benchmark(r, "draw", phi::cmd::draw{});
+    run_writer_benchmark(r, "dispatch", phi::cmd::dispatch{});
+    run_writer_benchmark(r, "transition_resources", phi::cmd::transition_resources{});
+
+    // Frame recording, deferred destruction and submission through a Context on the stub backend, nothing reaches a GPU
+    {
+        StubBackend backend;
+        Context ctx(&backend);
+
+        // the stub never reads shaders, the binaries only have to differ
+        uint32_t const placeholder_binaries[] = {0, 1};
+        auto vs = ctx.make_shader({reinterpret_cast<std::byte const*>(&placeholder_binaries[0]), sizeof(uint32_t)}, shader::vertex);
+        auto ps = ctx.make_shader({reinterpret_cast<std::byte const*>(&placeholder_binaries[1]), sizeof(uint32_t)}, shader::pixel);
+
+        auto target = ctx.make_target({256, 256}, format::rgba8un);
+        graphics_pass_info const gp_draw = graphics_pass(vs, ps);
+        graphics_pass_info const gp_bind = graphics_pass(vs, ps).arg(1);
+
+        constexpr unsigned num_arguments = 64;
+        cc::vector<auto_texture> textures;
+        cc::vector<argument> arguments;
+        textures.reserve(num_arguments);
+        arguments.reserve(num_arguments);
+        for (auto i = 0u; i < num_arguments; ++i)
+        {
+            textures.push_back(ctx.make_texture({4, 4}, format::rgba8un, 1));
+            arguments.emplace_back().add(textures.back());
+        }
+
+        // creates the PSOs and fills the shader view cache
+        {
+            auto frame = ctx.make_frame();
+            {
+                auto fb = frame.make_framebuffer(target);
+                (void)fb.make_pass(gp_draw);
+
+                auto pass = fb.make_pass(gp_bind);
+                for (argument const& arg : arguments)
+                    pass.bind(arg).draw(3);
+            }
+            ctx.submit(cc::move(frame));
+        }
+
+        // drawcall recording, what raii::GraphicsPass::draw costs past the PSO lookup (which happens once per pass)
+        r.run(
+            "frame/record_draw",
+            [&](uint64_t num_ops) {
+                for (uint64_t frame_start = 0; frame_start < num_ops; frame_start += gc_commands_per_frame)
+                {
+                    auto frame = ctx.make_frame();
+                    {
+                        auto fb = frame.make_framebuffer(target);
+                        auto pass = fb.make_pass(gp_draw);
+
+                        auto const frame_end = cc::min(num_ops, frame_start + gc_commands_per_frame);
+                        for (auto i = frame_start; i < frame_end; ++i)
+                            pass.draw(3);
+                    }
+                    consume(frame.is_empty() ? 0 : 1);
+                }
+            },
+            double(sizeof(phi::cmd::draw)));
+
+        // argument binding per drawcall, what raii::GraphicsPass::bind adds: hashing the argument and a shader view cache hit
+        r.run("frame/bind_draw", [&](uint64_t num_ops) {
+            for (uint64_t frame_start = 0; frame_start < num_ops; frame_start += gc_commands_per_frame)
+            {
+                auto frame = ctx.make_frame();
+                {
+                    auto fb = frame.make_framebuffer(target);
+                    auto pass = fb.make_pass(gp_bind);
+
+                    auto const frame_end = cc::min(num_ops, frame_start + gc_commands_per_frame);
+                    for (auto i = frame_start; i < frame_end; ++i)
+                        pass.bind(arguments[i % num_arguments]).draw(3);
+                }
+                consume(frame.is_empty() ? 0 : 1);
+            }
+        });
+
+        // deferred destruction churn, a frame is submitted every gc_frees_per_frame frees so the queue is culled as the GPU epoch advances
+        r.run("context/free_deferred", [&](uint64_t num_ops) {
+            for (auto i = 0ull; i < num_ops; ++i)
+            {
+                if (i % gc_frees_per_frame == 0)
+                {
+                    auto frame = ctx.make_frame();
+                    (void)frame.make_framebuffer(target); // an empty render pass
+                    ctx.submit(cc::move(frame));
+                }
+
+                ctx.free_deferred(pr::bench::make_handle<phi::handle::resource>(unsigned(i)));
+            }
+        });
+
+        ctx.flush();
+    }
+
+    // expanding the recorded drawcalls into the phi command stream in Context::compile
+    {
+        growing_writer writer(4096);
+        draw_delta_stream draws(4096, cc::system_allocator);
+        for (auto i = 0u; i < gc_commands_per_frame; ++i)
+            draws.add(make_draw(i), writer.size());
+
+        cc::vector<std::byte> expanded;
+        expanded.resize(draws.get_expanded_size(writer));
+
+        r.run(
+            "frame/expand_draws",
+            [&](uint64_t num_ops) {
+                for (auto frame = 0ull; frame * gc_commands_per_frame < num_ops; ++frame)
+                    draws.expand(writer, expanded.data());
+
+                consume(uint64_t(expanded[0]));
+            },
+            double(sizeof(phi::cmd::draw)));
+    }
+
+    // circular_buffer, the in-flight queue of multi_cache elements
+    {
+        struct in_flight_val
+        {
+            uint64_t handle;
+            uint64_t epoch;
+        };
+
+        circular_buffer<in_flight_val> buffer(512);
+        for (auto i = 0u; i < 256; ++i)
+            buffer.enqueue({i, i});
+
+        r.run("circular_buffer/enqueue_pop", [&](uint64_t num_ops) {
+            for (auto i = 0ull; i < num_ops; ++i)
+            {
+                buffer.enqueue({i, i});
+                consume(buffer.get_tail().handle);
+                buffer.pop_tail();
+            }
+        });
+    }
+}
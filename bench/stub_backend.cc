@@ -0,0 +1,75 @@
+#include "stub_backend.hh"
+
+#include <clean-core/assert.hh>
+
+void pr::bench::StubBackend::destroy()
+{
+    auto const lg = std::lock_guard(mMutex);
+    mMappableBuffers = {};
+}
+
+phi::handle::swapchain pr::bench::StubBackend::createSwapchain(phi::window_handle const&, tg::isize2 initial_size, phi::present_mode, unsigned num_backbuffers)
+{
+    mBackbufferSize = initial_size;
+    mNumBackbuffers = num_backbuffers;
+    return nextHandle<phi::handle::swapchain>();
+}
+
+phi::handle::resource pr::bench::StubBackend::createBuffer(phi::arg::buffer_description const& description, char const*)
+{
+    auto const res = nextHandle<phi::handle::resource>();
+
+    if (description.heap != phi::resource_heap::gpu)
+    {
+        auto const lg = std::lock_guard(mMutex);
+        mMappableBuffers[uint32_t(res._value)].resize(description.size_bytes);
+    }
+
+    return res;
+}
+
+std::byte* pr::bench::StubBackend::mapBuffer(phi::handle::resource res, int, int)
+{
+    auto const lg = std::lock_guard(mMutex);
+    CC_ASSERT(mMappableBuffers.contains_key(uint32_t(res._value)) && "mapped a texture or a buffer on the GPU heap");
+    return mMappableBuffers[uint32_t(res._value)].data();
+}
+
+void pr::bench::StubBackend::free(phi::handle::resource res)
+{
+    auto const lg = std::lock_guard(mMutex);
+    mMappableBuffers.remove_key(uint32_t(res._value));
+}
+
+void pr::bench::StubBackend::freeRange(cc::span<phi::handle::resource const> resources)
+{
+    auto const lg = std::lock_guard(mMutex);
+    for (phi::handle::resource const res : resources)
+        mMappableBuffers.remove_key(uint32_t(res._value));
+}
+
+void pr::bench::StubBackend::submit(cc::span<phi::handle::command_list const>,
+                                    phi::queue_type,
+                                    cc::span<phi::fence_operation const>,
+                                    cc::span<phi::fence_operation const> fence_signals_after)
+{
+    // the submitted work is complete right away
+    for (phi::fence_operation const& op : fence_signals_after)
+        signalFenceCPU(op.fence, op.value);
+}
+
+phi::handle::fence pr::bench::StubBackend::createFence()
+{
+    uint32_t const index = mNumFences.fetch_add(1, std::memory_order_relaxed);
+    CC_RUNTIME_ASSERT(index < sc_max_fences && "too many fences");
+
+    phi::handle::fence res;
+    res._value = decltype(res._value)(index + 1);
+    return res;
+}
+
+std::atomic<uint64_t>& pr::bench::StubBackend::getFence(phi::handle::fence fence)
+{
+    CC_ASSERT(fence._value > 0 && uint32_t(fence._value) <= mNumFences.load(std::memory_order_relaxed) && "invalid fence");
+    return mFenceValues[uint32_t(fence._value) - 1];
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <clean-core/map.hh>
+#include <clean-core/vector.hh>
+
+#include <phantasm-hardware-interface/Backend.hh>
+
+namespace pr::bench
+{
+/// CPU-only stand-in for a PHI backend, attached via Context(phi::Backend*)
+/// hands out unique handles, records and submits nothing and completes every submission immediately
+/// upload and readback buffers are backed by host memory so mapping works
+/// measures the CPU cost of the renderer alone, independent of drivers and GPUs
+class StubBackend final : public phi::Backend
+{
+public:
+    void initialize(phi::backend_config const&) override {}
+    void destroy() override;
+
+    // swapchain interface
+
+    [[nodiscard]] phi::handle::swapchain createSwapchain(phi::window_handle const&, tg::isize2 initial_size, phi::present_mode, unsigned num_backbuffers) override;
+    void free(phi::handle::swapchain) override {}
+    [[nodiscard]] phi::handle::resource acquireBackbuffer(phi::handle::swapchain) override { return nextHandle<phi::handle::resource>(); }
+    void present(phi::handle::swapchain) override {}
+    void onResize(phi::handle::swapchain, tg::isize2 size) override { mBackbufferSize = size; }
+    [[nodiscard]] phi::format getBackbufferFormat(phi::handle::swapchain) const override { return phi::format::bgra8un; }
+    [[nodiscard]] tg::isize2 getBackbufferSize(phi::handle::swapchain) const override { return mBackbufferSize; }
+    [[nodiscard]] unsigned getNumBackbuffers(phi::handle::swapchain) const override { return mNumBackbuffers; }
+    [[nodiscard]] bool clearPendingResize(phi::handle::swapchain) override { return false; }
+
+    // resource interface
+
+    [[nodiscard]] phi::handle::resource createTexture(phi::arg::texture_description const&, char const*) override { return nextHandle<phi::handle::resource>(); }
+    [[nodiscard]] phi::handle::resource createBuffer(phi::arg::buffer_description const& description, char const*) override;
+    [[nodiscard]] std::byte* mapBuffer(phi::handle::resource res, int, int) override;
+    void unmapBuffer(phi::handle::resource, int, int) override {}
+    void free(phi::handle::resource res) override;
+    void freeRange(cc::span<phi::handle::resource const> resources) override;
+
+    // shader view interface
+
+    [[nodiscard]] phi::handle::shader_view createShaderView(cc::span<phi::resource_view const>,
+                                                            cc::span<phi::resource_view const>,
+                                                            cc::span<phi::sampler_config const>,
+                                                            bool) override
+    {
+        return nextHandle<phi::handle::shader_view>();
+    }
+    void free(phi::handle::shader_view) override {}
+    void freeRange(cc::span<phi::handle::shader_view const>) override {}
+
+    // pipeline state interface
+
+    [[nodiscard]] phi::handle::pipeline_state createPipelineState(phi::arg::vertex_format,
+                                                                  phi::arg::framebuffer_config const&,
+                                                                  phi::arg::shader_arg_shapes,
+                                                                  bool,
+                                                                  phi::arg::graphics_shaders,
+                                                                  phi::pipeline_config const&) override
+    {
+        return nextHandle<phi::handle::pipeline_state>();
+    }
+    [[nodiscard]] phi::handle::pipeline_state createComputePipelineState(phi::arg::shader_arg_shapes, phi::arg::shader_binary, bool) override
+    {
+        return nextHandle<phi::handle::pipeline_state>();
+    }
+    void free(phi::handle::pipeline_state) override {}
+
+    // command list interface
+
+    [[nodiscard]] phi::handle::command_list recordCommandList(std::byte*, size_t, phi::queue_type) override { return nextHandle<phi::handle::command_list>(); }
+    void discard(cc::span<phi::handle::command_list const>) override {}
+    void submit(cc::span<phi::handle::command_list const>,
+                phi::queue_type,
+                cc::span<phi::fence_operation const>,
+                cc::span<phi::fence_operation const> fence_signals_after) override;
+
+    // fence interface
+
+    [[nodiscard]] phi::handle::fence createFence() override;
+    [[nodiscard]] uint64_t getFenceValue(phi::handle::fence fence) override { return getFence(fence).load(std::memory_order_acquire); }
+    void signalFenceCPU(phi::handle::fence fence, uint64_t new_value) override { getFence(fence).store(new_value, std::memory_order_release); }
+    void waitFenceCPU(phi::handle::fence, uint64_t) override {} // signals are immediate
+    void free(cc::span<phi::handle::fence const>) override {}
+
+    // query interface
+
+    [[nodiscard]] phi::handle::query_range createQueryRange(phi::query_type, unsigned) override { return nextHandle<phi::handle::query_range>(); }
+    void free(phi::handle::query_range) override {}
+
+    // raytracing interface, unsupported
+
+    [[nodiscard]] phi::handle::pipeline_state createRaytracingPipelineState(phi::arg::raytracing_shader_libraries,
+                                                                            phi::arg::raytracing_argument_associations,
+                                                                            phi::arg::raytracing_hit_groups,
+                                                                            unsigned,
+                                                                            unsigned,
+                                                                            unsigned) override
+    {
+        return phi::handle::null_pipeline_state;
+    }
+    [[nodiscard]] phi::handle::accel_struct createTopLevelAccelStruct(unsigned, phi::accel_struct_build_flags_t) override
+    {
+        return phi::handle::null_accel_struct;
+    }
+    [[nodiscard]] phi::handle::accel_struct createBottomLevelAccelStruct(cc::span<phi::arg::blas_element const>, phi::accel_struct_build_flags_t, uint64_t*) override
+    {
+        return phi::handle::null_accel_struct;
+    }
+    void uploadTopLevelInstances(phi::handle::accel_struct, cc::span<phi::accel_struct_geometry_instance const>) override {}
+    [[nodiscard]] phi::handle::resource getAccelStructBuffer(phi::handle::accel_struct) override { return phi::handle::null_resource; }
+    [[nodiscard]] phi::shader_table_strides calculateShaderTableStrides(phi::arg::shader_table_record const&,
+                                                                        phi::arg::shader_table_records,
+                                                                        phi::arg::shader_table_records,
+                                                                        phi::arg::shader_table_records) override
+    {
+        return {};
+    }
+    void writeShaderTable(std::byte*, phi::handle::pipeline_state, unsigned, phi::arg::shader_table_records) override {}
+    void free(phi::handle::accel_struct) override {}
+    void freeRange(cc::span<phi::handle::accel_struct const>) override {}
+
+    // debug interface
+
+    void setDebugName(phi::handle::resource, cc::string_view) override {}
+    void printInformation(phi::handle::resource) const override {}
+    bool startForcedDiagnosticCapture() override { return false; }
+    bool endForcedDiagnosticCapture() override { return false; }
+    [[nodiscard]] uint64_t getGPUTimestampFrequency() const override { return 1'000'000'000; }
+    [[nodiscard]] bool isRaytracingEnabled() const override { return false; }
+    [[nodiscard]] phi::backend_type getBackendType() const override { return phi::backend_type::vulkan; }
+    [[nodiscard]] phi::gpu_info const& getGPUInfo() const override { return mGPUInfo; }
+    void flushGPU() override {}
+
+public:
+    StubBackend() = default;
+    StubBackend(StubBackend const&) = delete;
+    StubBackend& operator=(StubBackend const&) = delete;
+    ~StubBackend() override { destroy(); }
+
+private:
+    /// handles of all types but fences share one counter, they are never reused
+    template <class HandleT>
+    HandleT nextHandle()
+    {
+        HandleT res;
+        res._value = decltype(res._value)(mNextHandle.fetch_add(1, std::memory_order_relaxed));
+        return res;
+    }
+
+    std::atomic<uint64_t>& getFence(phi::handle::fence fence);
+
+private:
+    static constexpr unsigned sc_max_fences = 64;
+
+    std::atomic<uint32_t> mNextHandle = {1};
+
+    std::atomic<uint64_t> mFenceValues[sc_max_fences] = {}; ///< indexed by the fence handle value - 1
+    std::atomic<uint32_t> mNumFences = {0};
+
+    cc::map<uint32_t, cc::vector<std::byte>> mMappableBuffers; ///< host memory of upload and readback buffers, guarded by mMutex
+    std::mutex mMutex;
+
+    tg::isize2 mBackbufferSize = {0, 0};
+    unsigned mNumBackbuffers = 0;
+    phi::gpu_info mGPUInfo = {};
+};
+}
@@ -0,0 +1,232 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include <clean-core/utility.hh>
+
+#include <phantasm-renderer/CompiledFrame.hh>
+#include <phantasm-renderer/Context.hh>
+#include <phantasm-renderer/Frame.hh>
+#include <phantasm-renderer/GraphicsPass.hh>
+#include <phantasm-renderer/argument.hh>
+#include <phantasm-renderer/pass_info.hh>
+
+#include "bench.hh"
+
+namespace
+{
+using clock = std::chrono::steady_clock;
+
+constexpr char const* gc_vertex_shader = R"(
+float4 main_vs(uint vertex_id : SV_VertexID) : SV_POSITION
+{
+    return float4(float(vertex_id & 1) * 0.01, float(vertex_id >> 1) * 0.01, 0.5, 1.0);
+}
+)";
+
+// every PSO gets its own pixel shader, differing in a constant
+constexpr char const* gc_pixel_shader_format = R"(
+Texture2D g_texture : register(t0, space0);
+
+float4 main_ps() : SV_TARGET
+{
+    return g_texture.Load(int3(0, 0, 0)) * %u.0;
+}
+)";
+
+/// frames each recording thread keeps in flight before waiting on the GPU
+constexpr unsigned gc_frames_in_flight = 2;
+
+struct workload_state
+{
+    pr::texture target;
+    pr::buffer upload_dest;
+    cc::vector<std::byte> upload_data;
+    cc::vector<pr::texture> textures;
+    cc::vector<pr::argument> arguments;
+    cc::vector<pr::auto_shader_binary> shaders; ///< must outlive the pass infos
+    cc::vector<uint32_t> placeholder_binaries;  ///< data of the shaders if not compiled, one distinct word per shader
+    cc::vector<pr::graphics_pass_info> passes;
+};
+
+pr::CompiledFrame record_slice(pr::Context& ctx, workload_state const& st, pr::bench::workload_config const& cfg, unsigned first_draw, unsigned num_draws, bool upload)
+{
+    auto frame = ctx.make_frame();
+
+    if (upload && cfg.upload_bytes > 0)
+        frame.auto_upload_buffer_data(st.upload_data, st.upload_dest);
+
+    {
+        auto fb = frame.make_framebuffer(st.target);
+
+        // drawcalls are grouped by PSO, as after sorting
+        unsigned const draws_per_pso = (cfg.num_draws + cfg.num_psos - 1) / cfg.num_psos;
+        unsigned const end_draw = first_draw + num_draws;
+
+        for (auto draw_i = first_draw; draw_i < end_draw;)
+        {
+            unsigned const pso_i = draw_i / draws_per_pso;
+            unsigned const group_end = cc::min(end_draw, (pso_i + 1) * draws_per_pso);
+
+            auto pass = fb.make_pass(st.passes[pso_i]);
+            for (; draw_i < group_end; ++draw_i)
+                pass.bind(st.arguments[draw_i % cfg.num_arguments]).draw(3);
+        }
+    }
+
+    return ctx.compile(cc::move(frame));
+}
+
+/// runs num_frames frames on num_threads threads, returns the wall time and the summed busy time of all threads (excluding waits on the GPU)
+void run_frames(pr::Context& ctx, workload_state const& st, pr::bench::workload_config const& cfg, unsigned num_threads, unsigned num_frames, double& out_wall_ns, double& out_busy_ns)
+{
+    std::atomic<int64_t> busy_ns = {0};
+
+    auto f_thread = [&](unsigned thread_index) {
+        unsigned const first_draw = cfg.num_draws * thread_index / num_threads;
+        unsigned const num_draws = cfg.num_draws * (thread_index + 1) / num_threads - first_draw;
+
+        pr::gpu_epoch_t epochs[gc_frames_in_flight] = {};
+        int64_t thread_busy_ns = 0;
+
+        for (auto frame_i = 0u; frame_i < num_frames; ++frame_i)
+        {
+            // keep a bounded amount of frames in flight so the GPU queue does not grow without bounds
+            pr::gpu_epoch_t const oldest_epoch = epochs[frame_i % gc_frames_in_flight];
+            while (!ctx.is_gpu_epoch_reached(oldest_epoch))
+                std::this_thread::yield();
+
+            auto const start = clock::now();
+            pr::CompiledFrame cf = record_slice(ctx, st, cfg, first_draw, num_draws, thread_index == 0);
+            epochs[frame_i % gc_frames_in_flight] = ctx.submit(cc::move(cf));
+            thread_busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+        }
+
+        busy_ns.fetch_add(thread_busy_ns, std::memory_order_relaxed);
+    };
+
+    auto const start = clock::now();
+
+    cc::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (auto i = 1u; i < num_threads; ++i)
+        threads.emplace_back(f_thread, i);
+
+    f_thread(0);
+
+    for (std::thread& t : threads)
+        t.join();
+
+    out_wall_ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+    out_busy_ns = double(busy_ns.load());
+}
+}
+
+void pr::bench::run_frame_workload(runner& r, Context& ctx, workload_config const& cfg)
+{
+    CC_ASSERT(cfg.num_draws > 0 && cfg.num_psos > 0 && cfg.num_arguments > 0 && cfg.num_frames > 0 && "invalid workload configuration");
+
+    workload_state st;
+
+    // resources
+    st.target = ctx.make_target({256, 256}, format::rgba8un).disown();
+
+    if (cfg.upload_bytes > 0)
+    {
+        st.upload_dest = ctx.make_buffer(cfg.upload_bytes).disown();
+        st.upload_data.resize(cfg.upload_bytes);
+    }
+
+    st.textures.reserve(cfg.num_arguments);
+    st.arguments.reserve(cfg.num_arguments);
+    for (auto i = 0u; i < cfg.num_arguments; ++i)
+    {
+        st.textures.push_back(ctx.make_texture({4, 4}, format::rgba8un, 1).disown());
+        st.arguments.emplace_back().add(st.textures.back());
+    }
+
+    // pipeline states, created up front so the workload only measures cache hits
+    // placeholder binaries must differ per shader, PSOs are cached by shader hash
+    st.placeholder_binaries.resize(cfg.num_psos + 1);
+    for (auto i = 0u; i < st.placeholder_binaries.size(); ++i)
+        st.placeholder_binaries[i] = i;
+
+    auto const f_placeholder = [&](unsigned i, shader stage) {
+        return ctx.make_shader({reinterpret_cast<std::byte const*>(&st.placeholder_binaries[i]), sizeof(uint32_t)}, stage);
+    };
+
+    auto vs = cfg.compile_shaders ? ctx.make_shader(gc_vertex_shader, "main_vs", shader::vertex) : f_placeholder(cfg.num_psos, shader::vertex);
+    st.passes.reserve(cfg.num_psos);
+    st.shaders.reserve(cfg.num_psos);
+    for (auto i = 0u; i < cfg.num_psos; ++i)
+    {
+        if (cfg.compile_shaders)
+        {
+            char code[512];
+            std::snprintf(code, sizeof(code), gc_pixel_shader_format, i + 1);
+            st.shaders.push_back(ctx.make_shader(code, "main_ps", shader::pixel));
+        }
+        else
+        {
+            st.shaders.push_back(f_placeholder(i, shader::pixel));
+        }
+
+        st.passes.push_back(graphics_pass(vs, st.shaders.back()).arg(1));
+    }
+
+    {
+        auto frame = ctx.make_frame();
+        for (texture const& tex : st.textures)
+            frame.transition(tex, state::shader_resource, shader::pixel);
+
+        {
+            auto fb = frame.make_framebuffer(st.target);
+            for (graphics_pass_info const& gp : st.passes)
+                (void)fb.make_pass(gp); // creates the PSO
+        }
+
+        ctx.submit(cc::move(frame));
+    }
+
+    // scale recording threads in powers of two, and to the maximum
+    unsigned const max_threads = cfg.max_threads > 0 ? cfg.max_threads : cc::max(1u, std::thread::hardware_concurrency());
+
+    cc::vector<unsigned> thread_counts;
+    for (auto n = 1u; n < max_threads; n *= 2)
+        thread_counts.push_back(n);
+    thread_counts.push_back(max_threads);
+
+    for (unsigned const num_threads : thread_counts)
+    {
+        char name_wall[96];
+        char name_cpu[96];
+        std::snprintf(name_wall, sizeof(name_wall), "workload/draws=%u/psos=%u/args=%u/wall/threads=%u", cfg.num_draws, cfg.num_psos, cfg.num_arguments, num_threads);
+        std::snprintf(name_cpu, sizeof(name_cpu), "workload/draws=%u/psos=%u/args=%u/cpu/threads=%u", cfg.num_draws, cfg.num_psos, cfg.num_arguments, num_threads);
+
+        if (!r.is_enabled(name_wall) && !r.is_enabled(name_cpu))
+            continue;
+
+        double wall_ns = 0.;
+        double busy_ns = 0.;
+
+        // warmup, fills the shader view cache
+        run_frames(ctx, st, cfg, num_threads, cfg.num_frames, wall_ns, busy_ns);
+        ctx.flush();
+
+        run_frames(ctx, st, cfg, num_threads, cfg.num_frames, wall_ns, busy_ns);
+        ctx.flush();
+
+        uint64_t const num_draws_total = uint64_t(cfg.num_draws) * cfg.num_frames;
+        r.add_result(name_wall, num_draws_total, num_threads, wall_ns);
+        r.add_result(name_cpu, num_draws_total, num_threads, busy_ns);
+    }
+
+    ctx.flush();
+
+    ctx.free(st.target);
+    if (cfg.upload_bytes > 0)
+        ctx.free(st.upload_dest);
+    for (texture const& tex : st.textures)
+        ctx.free(tex);
+}
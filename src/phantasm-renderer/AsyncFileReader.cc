@@ -0,0 +1,648 @@
+#include "AsyncFileReader.hh"
+
+#include <cstdio>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+#include <phantasm-renderer/Context.hh>
+#include <phantasm-renderer/common/log.hh>
+#include <phantasm-renderer/common/trace.hh>
+
+using namespace pr;
+
+namespace
+{
+/// reads are split into chunks of about this size, keeping multiple requests of a large file in flight
+constexpr size_t gc_read_chunk_bytes = 1u << 20;
+}
+
+AsyncFileReader::AsyncFileReader(Context& ctx, async_file_reader_config const& config) : mCtx(&ctx)
+{
+    CC_ASSERT(config.queue_depth > 0 && "invalid AsyncFileReader configuration");
+
+    mQueue.initialize(config.queue_depth, config.num_workers, config.allow_io_uring);
+
+    mInFlightReads.resize(config.queue_depth);
+    mFreeInFlight.reserve(config.queue_depth);
+    for (auto i = config.queue_depth; i > 0; --i)
+        mFreeInFlight.push_back(i - 1);
+
+    mDecodeWorkers.reserve(config.num_decompression_workers);
+    for (auto i = 0u; i < config.num_decompression_workers; ++i)
+        mDecodeWorkers.push_back(std::thread([this] { decodeWorkerMain(); }));
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+    flush();
+    mQueue.destroy();
+
+    {
+        auto lg = std::lock_guard(mDecodeMutex);
+        mIsShuttingDown = true;
+    }
+    mDecodeAvailable.notify_all();
+
+    for (std::thread& worker : mDecodeWorkers)
+        worker.join();
+
+    for (open_file_entry const& file : mFiles)
+    {
+        if (file.native != gc_invalid_native_file)
+            async_io_queue::close_file(file.native);
+    }
+}
+
+async_file AsyncFileReader::open_file(const char* path)
+{
+    native_file_t const native = async_io_queue::open_file(path);
+    if (native == gc_invalid_native_file)
+        return {};
+
+    uint32_t index;
+    if (!mFreeFiles.empty())
+    {
+        index = mFreeFiles.back();
+        mFreeFiles.pop_back();
+    }
+    else
+    {
+        index = uint32_t(mFiles.size());
+        mFiles.emplace_back();
+    }
+
+    mFiles[index] = open_file_entry{native, 1, false}; // the handle is a reference until closed
+    return async_file{index};
+}
+
+void AsyncFileReader::close_file(async_file file)
+{
+    CC_ASSERT(file.is_valid() && file._index < mFiles.size() && !mFiles[file._index].is_close_requested && "invalid or closed file");
+
+    mFiles[file._index].is_close_requested = true;
+    releaseFileRead(file._index);
+}
+
+void AsyncFileReader::read(async_file file, uint64_t file_offset, std::byte* dest, size_t num_bytes, file_read_callback callback, void* userdata)
+{
+    CC_ASSERT(file.is_valid() && file._index < mFiles.size() && !mFiles[file._index].is_close_requested && "invalid or closed file");
+    CC_ASSERT(callback != nullptr && "reads require a callback");
+
+    uint32_t const group_index = createGroup();
+    mGroups[group_index].callback = callback;
+    mGroups[group_index].userdata = userdata;
+
+    queueContiguousRead(file._index, group_index, file_offset, dest, num_bytes);
+    if (mGroups[group_index].num_pending_reads == 0)
+        completeGroup(group_index); // empty read, completes with the next poll
+    else
+        submitQueued();
+}
+
+void AsyncFileReader::read_rows(async_file file,
+                                uint64_t file_offset,
+                                std::byte* dest,
+                                uint32_t row_size_bytes,
+                                uint32_t dest_row_stride_bytes,
+                                uint32_t num_rows,
+                                file_read_callback callback,
+                                void* userdata)
+{
+    CC_ASSERT(file.is_valid() && file._index < mFiles.size() && !mFiles[file._index].is_close_requested && "invalid or closed file");
+    CC_ASSERT(callback != nullptr && "reads require a callback");
+
+    uint32_t const group_index = createGroup();
+    mGroups[group_index].callback = callback;
+    mGroups[group_index].userdata = userdata;
+
+    queueRead(file._index, group_index, file_offset, dest, row_size_bytes, dest_row_stride_bytes, num_rows);
+    if (mGroups[group_index].num_pending_reads == 0)
+        completeGroup(group_index);
+    else
+        submitQueued();
+}
+
+bool AsyncFileReader::load_texture_file(const char* path, texture_load_callback callback, void* userdata, const char* debug_name)
+{
+    PR_TRACE_SCOPE("AsyncFileReader::load_texture_file");
+    CC_ASSERT(callback != nullptr && "texture loads require a callback");
+
+    // headers are small, they are parsed synchronously
+    texture_info info;
+    cc::vector<size_t> subresource_offsets;
+    {
+        std::FILE* const header_file = std::fopen(path, "rb");
+        if (header_file == nullptr)
+        {
+            PR_LOG_WARN("unable to open texture file {}", path);
+            return false;
+        }
+
+        bool const parse_ok = parse_texture_file(header_file, info, subresource_offsets);
+        std::fclose(header_file);
+
+        if (!parse_ok)
+        {
+            PR_LOG_WARN("texture file {} not loaded", path);
+            return false;
+        }
+    }
+
+    async_file const file = open_file(path);
+    if (!file.is_valid())
+    {
+        PR_LOG_WARN("unable to open texture file {}", path);
+        return false;
+    }
+
+    uint32_t const group_index = createGroup();
+    read_group& group = mGroups[group_index];
+    group.texture_callback = callback;
+    group.userdata = userdata;
+
+    texture_file_upload& upload = group.upload;
+    upload.layout.initialize(info, info.num_mips, mCtx->get_backend_type() == pr::backend::d3d12);
+    upload.upload_buffer = mCtx->make_upload_buffer(uint32_t(upload.layout.dest_size_bytes), 0, debug_name).disown();
+    upload.dest_texture = mCtx->make_texture(info, debug_name).disown();
+
+    // stays mapped until all subresources arrived
+    std::byte* const upload_buffer_map = mCtx->map_buffer(upload.upload_buffer, 0, 0); // no invalidate
+
+    for (auto i = 0u; i < upload.layout.subresources.size(); ++i)
+    {
+        texture_subresource_upload const& subres = upload.layout.subresources[i];
+        queueRead(file._index, group_index, subresource_offsets[i], upload_buffer_map + subres.dest_offset_bytes, subres.row_size_bytes,
+                  subres.dest_row_stride_bytes, subres.num_rows);
+    }
+
+    close_file(file);
+    submitQueued();
+    return true;
+}
+
+bool AsyncFileReader::load_texture_container(const char* path, texture_load_callback callback, void* userdata, const char* debug_name)
+{
+    PR_TRACE_SCOPE("AsyncFileReader::load_texture_container");
+    CC_ASSERT(callback != nullptr && "texture loads require a callback");
+
+    texture_container_header header;
+    texture_upload_layout layout;
+    cc::vector<texture_container_chunk> chunks;
+    {
+        std::FILE* const header_file = std::fopen(path, "rb");
+        if (header_file == nullptr)
+        {
+            PR_LOG_WARN("unable to open texture container {}", path);
+            return false;
+        }
+
+        bool const header_ok = read_texture_container_header(header_file, mCtx->get_backend_type() == pr::backend::d3d12, header, layout, chunks);
+        std::fclose(header_file);
+
+        if (!header_ok)
+        {
+            PR_LOG_WARN("texture container {} not loaded", path);
+            return false;
+        }
+    }
+
+    async_file const file = open_file(path);
+    if (!file.is_valid())
+    {
+        PR_LOG_WARN("unable to open texture container {}", path);
+        return false;
+    }
+
+    uint32_t const group_index = createGroup();
+    read_group& group = mGroups[group_index];
+    group.texture_callback = callback;
+    group.userdata = userdata;
+
+    texture_file_upload& upload = group.upload;
+    upload.layout = cc::move(layout);
+    upload.upload_buffer = mCtx->make_upload_buffer(uint32_t(header.data_size_bytes), 0, debug_name).disown();
+    upload.dest_texture = mCtx->make_texture(get_texture_container_info(header), debug_name).disown();
+
+    std::byte* const upload_buffer_map = mCtx->map_buffer(upload.upload_buffer, 0, 0); // no invalidate
+
+    if (chunks.empty())
+    {
+        // the data section is the upload buffer contents, read it in place
+        queueContiguousRead(file._index, group_index, header.data_offset_bytes, upload_buffer_map, size_t(header.data_size_bytes));
+    }
+    else
+    {
+        group.stored_data.resize(size_t(header.stored_size_bytes));
+
+        for (auto i = 0u; i < chunks.size(); ++i)
+        {
+            texture_container_chunk const& chunk = chunks[i];
+            uint64_t const file_offset = header.data_offset_bytes + chunk.stored_offset_bytes;
+            std::byte* const dest = upload_buffer_map + size_t(i) * header.chunk_size_bytes;
+
+            if (chunk.stored_size_bytes == chunk.size_bytes)
+            {
+                // stored as is, read in place
+                queueContiguousRead(file._index, group_index, file_offset, dest, chunk.size_bytes);
+                continue;
+            }
+
+            uint32_t job_index;
+            if (!mFreeDecodeJobs.empty())
+            {
+                job_index = mFreeDecodeJobs.back();
+                mFreeDecodeJobs.pop_back();
+            }
+            else
+            {
+                job_index = uint32_t(mDecodeJobs.size());
+                mDecodeJobs.emplace_back();
+            }
+
+            decode_job& job = mDecodeJobs[job_index];
+            job = decode_job{};
+            job.compression = texture_container_compression(header.compression);
+            job.chunk = chunk;
+            job.stored_chunk = mGroups[group_index].stored_data.data() + chunk.stored_offset_bytes;
+            job.dest = dest;
+            job.group_index = group_index;
+
+            // the decompression completes the chunk, not its reads
+            ++mGroups[group_index].num_pending_reads;
+            queueContiguousRead(file._index, group_index, file_offset, mGroups[group_index].stored_data.data() + chunk.stored_offset_bytes,
+                                chunk.stored_size_bytes, job_index);
+        }
+    }
+
+    close_file(file);
+    if (mGroups[group_index].num_pending_reads == 0)
+        completeGroup(group_index);
+    else
+        submitQueued();
+    return true;
+}
+
+unsigned AsyncFileReader::poll()
+{
+    unsigned const num_callbacks_before = mNumInvokedCallbacks;
+
+    do
+    {
+        submitQueued();
+    } while (processCompletions(false) > 0);
+
+    invokeCallbacks();
+    return mNumInvokedCallbacks - num_callbacks_before;
+}
+
+unsigned AsyncFileReader::flush()
+{
+    PR_TRACE_SCOPE("AsyncFileReader::flush");
+
+    unsigned const num_callbacks_before = mNumInvokedCallbacks;
+
+    while (mNumLiveGroups > 0)
+    {
+        submitQueued();
+        if (mQueue.get_num_in_flight() > 0 || mNumDecodesInFlight > 0)
+            processCompletions(true);
+
+        invokeCallbacks();
+    }
+
+    return mNumInvokedCallbacks - num_callbacks_before;
+}
+
+uint32_t AsyncFileReader::createGroup()
+{
+    uint32_t index;
+    if (!mFreeGroups.empty())
+    {
+        index = mFreeGroups.back();
+        mFreeGroups.pop_back();
+    }
+    else
+    {
+        index = uint32_t(mGroups.size());
+        mGroups.emplace_back();
+    }
+
+    mGroups[index] = read_group{};
+    ++mNumLiveGroups;
+    return index;
+}
+
+void AsyncFileReader::queueRead(
+    uint32_t file_index, uint32_t group_index, uint64_t file_offset, std::byte* dest, uint32_t row_size_bytes, uint32_t dest_row_stride_bytes, uint32_t num_rows)
+{
+    if (row_size_bytes == 0 || num_rows == 0)
+        return;
+
+    // unpitched rows are one contiguous range
+    if (row_size_bytes == dest_row_stride_bytes || num_rows == 1)
+    {
+        queueContiguousRead(file_index, group_index, file_offset, dest, size_t(row_size_bytes) * num_rows);
+        return;
+    }
+
+    uint32_t const rows_per_read = uint32_t(cc::clamp(gc_read_chunk_bytes / row_size_bytes, size_t(1), size_t(gc_async_io_max_rows)));
+    for (uint32_t row = 0; row < num_rows; row += rows_per_read)
+    {
+        pending_read read;
+        read.file_index = file_index;
+        read.group_index = group_index;
+        read.file_offset = file_offset + uint64_t(row) * row_size_bytes;
+        read.dest = dest + size_t(row) * dest_row_stride_bytes;
+        read.row_size_bytes = row_size_bytes;
+        read.dest_row_stride_bytes = dest_row_stride_bytes;
+        read.num_rows = cc::min(rows_per_read, num_rows - row);
+        pushRead(read);
+    }
+}
+
+void AsyncFileReader::queueContiguousRead(
+    uint32_t file_index, uint32_t group_index, uint64_t file_offset, std::byte* dest, size_t num_bytes, uint32_t decode_job_index)
+{
+    for (size_t offset = 0; offset < num_bytes; offset += gc_read_chunk_bytes)
+    {
+        pending_read read;
+        read.file_index = file_index;
+        read.group_index = group_index;
+        read.file_offset = file_offset + offset;
+        read.dest = dest + offset;
+        read.row_size_bytes = uint32_t(cc::min(gc_read_chunk_bytes, num_bytes - offset));
+        read.dest_row_stride_bytes = read.row_size_bytes;
+        read.num_rows = 1;
+        read.decode_job_index = decode_job_index;
+        pushRead(read);
+    }
+}
+
+void AsyncFileReader::pushRead(pending_read const& read)
+{
+    ++mGroups[read.group_index].num_pending_reads;
+    ++mFiles[read.file_index].num_references;
+    if (read.decode_job_index != uint32_t(-1))
+        ++mDecodeJobs[read.decode_job_index].num_pending_reads;
+    mQueuedReads.push_back(read);
+}
+
+void AsyncFileReader::submitQueued()
+{
+    async_io_read reads[64];
+
+    while (mQueuedHead < mQueuedReads.size() && mQueue.get_num_free() > 0)
+    {
+        unsigned const max_num_reads = cc::min(mQueue.get_num_free(), unsigned(sizeof(reads) / sizeof(reads[0])));
+        unsigned num_reads = 0;
+
+        while (num_reads < max_num_reads && mQueuedHead < mQueuedReads.size())
+        {
+            pending_read const& read = mQueuedReads[mQueuedHead++];
+
+            // the remaining reads of failed groups are dropped, their groups complete once the reads in flight did
+            if (mGroups[read.group_index].has_failed)
+            {
+                onReadFinished(read, false);
+                continue;
+            }
+
+            uint32_t const in_flight_index = mFreeInFlight.back();
+            mFreeInFlight.pop_back();
+            mInFlightReads[in_flight_index] = read;
+
+            async_io_read& io_read = reads[num_reads++];
+            io_read.file = mFiles[read.file_index].native;
+            io_read.file_offset = read.file_offset;
+            io_read.dest = read.dest;
+            io_read.row_size_bytes = read.row_size_bytes;
+            io_read.dest_row_stride_bytes = read.dest_row_stride_bytes;
+            io_read.num_rows = read.num_rows;
+            io_read.user_data = in_flight_index;
+        }
+
+        mQueue.submit(cc::span<async_io_read const>(reads, num_reads));
+    }
+
+    // drop consumed reads once they make up most of the FIFO
+    if (mQueuedHead > 0 && mQueuedHead * 2 >= mQueuedReads.size())
+    {
+        size_t const num_remaining = mQueuedReads.size() - mQueuedHead;
+        for (size_t i = 0; i < num_remaining; ++i)
+            mQueuedReads[i] = mQueuedReads[mQueuedHead + i];
+
+        mQueuedReads.resize(num_remaining);
+        mQueuedHead = 0;
+    }
+}
+
+unsigned AsyncFileReader::processCompletions(bool wait)
+{
+    bool const wait_for_reads = wait && mQueue.get_num_in_flight() > 0;
+
+    async_io_completion completions[64];
+    unsigned const num_completions = mQueue.reap(completions, wait_for_reads);
+
+    for (auto i = 0u; i < num_completions; ++i)
+    {
+        uint32_t const in_flight_index = uint32_t(completions[i].user_data);
+        pending_read const read = mInFlightReads[in_flight_index];
+        mFreeInFlight.push_back(in_flight_index);
+
+        int64_t const num_read = completions[i].num_bytes;
+        uint64_t const num_expected = uint64_t(read.row_size_bytes) * read.num_rows;
+
+        if (num_read <= 0 || uint64_t(num_read) >= num_expected)
+        {
+            // zero bytes is the end of the file
+            onReadFinished(read, num_read > 0);
+            continue;
+        }
+
+        // short read, queue the remainder
+        uint32_t const num_full_rows = uint32_t(uint64_t(num_read) / read.row_size_bytes);
+        uint32_t const partial_row_bytes = uint32_t(uint64_t(num_read) % read.row_size_bytes);
+        uint32_t next_row = num_full_rows;
+
+        if (partial_row_bytes > 0)
+        {
+            pending_read row_rest = read;
+            row_rest.file_offset = read.file_offset + uint64_t(num_read);
+            row_rest.dest = read.dest + size_t(num_full_rows) * read.dest_row_stride_bytes + partial_row_bytes;
+            row_rest.row_size_bytes = read.row_size_bytes - partial_row_bytes;
+            row_rest.dest_row_stride_bytes = row_rest.row_size_bytes;
+            row_rest.num_rows = 1;
+            pushRead(row_rest);
+            ++next_row;
+        }
+
+        if (next_row < read.num_rows)
+        {
+            pending_read rows_rest = read;
+            rows_rest.file_offset = read.file_offset + uint64_t(next_row) * read.row_size_bytes;
+            rows_rest.dest = read.dest + size_t(next_row) * read.dest_row_stride_bytes;
+            rows_rest.num_rows = read.num_rows - next_row;
+            pushRead(rows_rest);
+        }
+
+        onReadFinished(read, true);
+    }
+
+    // finished decompressions
+    if (mNumDecodesInFlight == 0)
+        return num_completions;
+
+    cc::vector<decode_task> decoded;
+    {
+        auto lk = std::unique_lock(mDecodeMutex);
+        if (wait && !wait_for_reads)
+            mDecodeFinished.wait(lk, [&] { return !mDecodeCompleted.empty(); });
+
+        decoded = cc::move(mDecodeCompleted);
+        mDecodeCompleted = {};
+    }
+
+    for (decode_task const& task : decoded)
+    {
+        --mNumDecodesInFlight;
+        finishDecode(task.job_index, task.success);
+    }
+
+    return num_completions + unsigned(decoded.size());
+}
+
+void AsyncFileReader::onReadFinished(pending_read const& read, bool success)
+{
+    read_group& group = mGroups[read.group_index];
+    group.has_failed |= !success;
+
+    CC_ASSERT(group.num_pending_reads > 0 && "read group accounting mismatch");
+    if (--group.num_pending_reads == 0)
+        completeGroup(read.group_index);
+
+    releaseFileRead(read.file_index);
+
+    if (read.decode_job_index != uint32_t(-1) && --mDecodeJobs[read.decode_job_index].num_pending_reads == 0)
+    {
+        if (mGroups[read.group_index].has_failed)
+            finishDecode(read.decode_job_index, false);
+        else
+            dispatchDecode(read.decode_job_index);
+    }
+}
+
+void AsyncFileReader::releaseFileRead(uint32_t file_index)
+{
+    open_file_entry& file = mFiles[file_index];
+
+    CC_ASSERT(file.num_references > 0 && "file reference mismatch");
+    if (--file.num_references > 0)
+        return;
+
+    async_io_queue::close_file(file.native);
+    file = open_file_entry{};
+    mFreeFiles.push_back(file_index);
+}
+
+void AsyncFileReader::dispatchDecode(uint32_t job_index)
+{
+    decode_job const& job = mDecodeJobs[job_index];
+
+    if (mDecodeWorkers.empty())
+    {
+        bool const success = decompress_texture_container_chunk(job.compression, job.chunk, job.stored_chunk, job.dest, mDecodeScratch);
+        finishDecode(job_index, success);
+        return;
+    }
+
+    {
+        auto lg = std::lock_guard(mDecodeMutex);
+        mDecodeQueue.push_back(decode_task{job, job_index, false});
+    }
+    ++mNumDecodesInFlight;
+    mDecodeAvailable.notify_one();
+}
+
+void AsyncFileReader::finishDecode(uint32_t job_index, bool success)
+{
+    uint32_t const group_index = mDecodeJobs[job_index].group_index;
+    mFreeDecodeJobs.push_back(job_index);
+
+    read_group& group = mGroups[group_index];
+    group.has_failed |= !success;
+
+    CC_ASSERT(group.num_pending_reads > 0 && "read group accounting mismatch");
+    if (--group.num_pending_reads == 0)
+        completeGroup(group_index);
+}
+
+void AsyncFileReader::decodeWorkerMain()
+{
+    cc::vector<std::byte> scratch;
+
+    while (true)
+    {
+        decode_task task;
+
+        {
+            auto lk = std::unique_lock(mDecodeMutex);
+            mDecodeAvailable.wait(lk, [&] { return mIsShuttingDown || !mDecodeQueue.empty(); });
+
+            if (mDecodeQueue.empty())
+                return;
+
+            task = mDecodeQueue.back();
+            mDecodeQueue.pop_back();
+        }
+
+        decode_job const& job = task.job;
+        task.success = decompress_texture_container_chunk(job.compression, job.chunk, job.stored_chunk, job.dest, scratch);
+
+        {
+            auto lg = std::lock_guard(mDecodeMutex);
+            mDecodeCompleted.push_back(task);
+        }
+        mDecodeFinished.notify_one();
+    }
+}
+
+void AsyncFileReader::completeGroup(uint32_t group_index) { mCompletedGroups.push_back(group_index); }
+
+void AsyncFileReader::invokeCallbacks()
+{
+    while (!mCompletedGroups.empty())
+    {
+        uint32_t const group_index = mCompletedGroups.back();
+        mCompletedGroups.pop_back();
+
+        // the slot is released first, callbacks can issue further reads
+        read_group const group = cc::move(mGroups[group_index]);
+        mGroups[group_index] = read_group{};
+        mFreeGroups.push_back(group_index);
+        --mNumLiveGroups;
+
+        if (group.texture_callback != nullptr)
+        {
+            texture_file_upload const& upload = group.upload;
+            mCtx->unmap_buffer(upload.upload_buffer, 0, int32_t(upload.layout.dest_size_bytes)); // flush written range
+
+            if (group.has_failed)
+            {
+                mCtx->free(upload.dest_texture);
+                mCtx->free(upload.upload_buffer);
+                group.texture_callback(false, texture_file_upload{}, group.userdata);
+            }
+            else
+            {
+                group.texture_callback(true, upload, group.userdata);
+            }
+        }
+        else
+        {
+            group.callback(!group.has_failed, group.userdata);
+        }
+
+        ++mNumInvokedCallbacks;
+    }
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include <clean-core/vector.hh>
+
+#include <phantasm-renderer/common/api.hh>
+#include <phantasm-renderer/common/resource_info.hh>
+#include <phantasm-renderer/common/texture_container.hh>
+#include <phantasm-renderer/common/texture_file.hh>
+#include <phantasm-renderer/detail/async_io_queue.hh>
+#include <phantasm-renderer/fwd.hh>
+
+namespace pr
+{
+/// a file opened by AsyncFileReader::open_file
+struct async_file
+{
+    uint32_t _index = uint32_t(-1);
+
+    bool is_valid() const { return _index != uint32_t(-1); }
+};
+
+/// called from AsyncFileReader::poll once all bytes of a read arrived, or once it failed (error or end of file)
+using file_read_callback = void (*)(bool success, void* userdata);
+
+/// called from AsyncFileReader::poll once a texture load completed
+/// on success the texture and the filled upload buffer are owned by the callee, record the copies with Frame::upload_texture_file
+/// on failure nothing was created and the upload is empty
+using texture_load_callback = void (*)(bool success, texture_file_upload const& upload, void* userdata);
+
+struct async_file_reader_config
+{
+    unsigned queue_depth = 64;              ///< reads in flight at once, further reads are queued
+    unsigned num_workers = 4;               ///< threads performing reads without io_uring
+    bool allow_io_uring = true;             ///< false to always use the worker threads
+    unsigned num_decompression_workers = 2; ///< threads decompressing chunks of compressed containers, 0 to decompress during poll
+};
+
+/// Asynchronous file reads directly into mapped memory, usually upload buffers
+/// on Linux, reads are submitted to an io_uring, elsewhere (or if io_uring is unavailable) worker threads perform positioned reads
+/// any amount of reads can be outstanding, large reads are split into chunks so a single file keeps multiple requests in flight
+/// completion callbacks are invoked from poll and flush on the calling thread, in no particular order
+///
+/// usage:
+///     AsyncFileReader reader(ctx);
+///     reader.load_texture_file("albedo.dds", &on_texture_loaded, &scene);
+///     ...
+///     reader.poll(); // once per frame, on_texture_loaded calls frame.upload_texture_file(upload)
+///
+/// not synchronized, use from one thread, must be destroyed before the Context
+class PR_API AsyncFileReader
+{
+public:
+    /// opens a file for reading, returns an invalid handle on failure
+    [[nodiscard]] async_file open_file(char const* path);
+
+    /// closes a file, outstanding reads of it still complete
+    void close_file(async_file file);
+
+    /// reads num_bytes at file_offset to dest, which must stay valid until the callback
+    void read(async_file file, uint64_t file_offset, std::byte* dest, size_t num_bytes, file_read_callback callback, void* userdata = nullptr);
+
+    /// reads num_rows consecutive rows of row_size_bytes at file_offset, row i to dest + i * dest_row_stride_bytes
+    void read_rows(async_file file,
+                   uint64_t file_offset,
+                   std::byte* dest,
+                   uint32_t row_size_bytes,
+                   uint32_t dest_row_stride_bytes,
+                   uint32_t num_rows,
+                   file_read_callback callback,
+                   void* userdata = nullptr);
+
+    /// asynchronous Context::load_texture_file, the header is parsed right away and the subresources are read into the upload buffer in the background
+    /// returns false without invoking the callback if the file is missing or unsupported
+    [[nodiscard]] bool load_texture_file(char const* path, texture_load_callback callback, void* userdata = nullptr, char const* debug_name = nullptr);
+
+    /// asynchronous Context::load_texture_container, the data section is read with multiple requests in flight
+    /// chunks of compressed containers are decompressed by the decompression workers as soon as they arrived,
+    /// chunks stored uncompressed are read straight into the upload buffer
+    /// returns false without invoking the callback if the container is missing, invalid or built for the other backend
+    [[nodiscard]] bool load_texture_container(char const* path, texture_load_callback callback, void* userdata = nullptr, char const* debug_name = nullptr);
+
+    /// submits queued reads and invokes the callbacks of completed ones, never blocks
+    /// returns the amount of invoked callbacks
+    unsigned poll();
+
+    /// waits for all outstanding reads and invokes their callbacks, including those of reads issued by the callbacks
+    /// returns the amount of invoked callbacks
+    unsigned flush();
+
+    /// reads and texture loads whose callback is pending
+    size_t get_num_outstanding() const { return mNumLiveGroups; }
+
+    bool is_using_io_uring() const { return mQueue.is_using_io_uring(); }
+
+public:
+    explicit AsyncFileReader(Context& ctx, async_file_reader_config const& config = {});
+
+    AsyncFileReader(AsyncFileReader const&) = delete;
+    AsyncFileReader& operator=(AsyncFileReader const&) = delete;
+
+    /// waits for outstanding reads, invoking their callbacks
+    ~AsyncFileReader();
+
+private:
+    struct open_file_entry
+    {
+        native_file_t native = gc_invalid_native_file;
+        uint32_t num_references = 0; ///< queued and in-flight reads, plus one until close_file
+        bool is_close_requested = false;
+    };
+
+    /// the reads of one call, completing together
+    struct read_group
+    {
+        file_read_callback callback = nullptr;
+        texture_load_callback texture_callback = nullptr; ///< set for texture loads
+        void* userdata = nullptr;
+        uint32_t num_pending_reads = 0;
+        bool has_failed = false;
+
+        // texture loads
+        texture_file_upload upload;
+        cc::vector<std::byte> stored_data; ///< compressed chunks of compressed containers
+    };
+
+    /// decompression of a chunk, dispatched once all of its reads arrived
+    struct decode_job
+    {
+        texture_container_compression compression = texture_container_compression::none;
+        texture_container_chunk chunk;
+        std::byte const* stored_chunk = nullptr;
+        std::byte* dest = nullptr;
+        uint32_t group_index = 0;
+        uint32_t num_pending_reads = 0;
+    };
+
+    /// a dispatched decode_job, copied as the job storage is not synchronized
+    struct decode_task
+    {
+        decode_job job;
+        uint32_t job_index = 0;
+        bool success = false;
+    };
+
+    /// a range of rows, contiguous in the file
+    struct pending_read
+    {
+        uint32_t file_index = 0;
+        uint32_t group_index = 0;
+        uint64_t file_offset = 0;
+        std::byte* dest = nullptr;
+        uint32_t row_size_bytes = 0;
+        uint32_t dest_row_stride_bytes = 0;
+        uint32_t num_rows = 0;
+        uint32_t decode_job_index = uint32_t(-1); ///< decompressed once all reads of the job arrived
+    };
+
+    uint32_t createGroup();
+    /// splits a read into chunks and queues them
+    void queueRead(uint32_t file_index, uint32_t group_index, uint64_t file_offset, std::byte* dest, uint32_t row_size_bytes, uint32_t dest_row_stride_bytes, uint32_t num_rows);
+    void queueContiguousRead(
+        uint32_t file_index, uint32_t group_index, uint64_t file_offset, std::byte* dest, size_t num_bytes, uint32_t decode_job_index = uint32_t(-1));
+    void pushRead(pending_read const& read);
+
+    /// hands queued reads to the I/O queue as long as it has free slots
+    void submitQueued();
+    /// returns the amount of reaped read and decompression completions
+    unsigned processCompletions(bool wait);
+    /// accounts a finished (or dropped) read, completing its group once it was the last
+    void onReadFinished(pending_read const& read, bool success);
+    /// closes the file with its last reference
+    void releaseFileRead(uint32_t file_index);
+
+    void dispatchDecode(uint32_t job_index);
+    void finishDecode(uint32_t job_index, bool success);
+    void decodeWorkerMain();
+
+    /// callbacks are deferred to invokeCallbacks, they can issue further reads
+    void completeGroup(uint32_t group_index);
+    void invokeCallbacks();
+
+private:
+    Context* mCtx = nullptr;
+    async_io_queue mQueue;
+
+    cc::vector<open_file_entry> mFiles;
+    cc::vector<uint32_t> mFreeFiles;
+
+    cc::vector<read_group> mGroups;
+    cc::vector<uint32_t> mFreeGroups;
+    cc::vector<uint32_t> mCompletedGroups;
+    size_t mNumLiveGroups = 0;
+    unsigned mNumInvokedCallbacks = 0;
+
+    // FIFO of reads waiting for a free queue slot, consumed from mQueuedHead
+    cc::vector<pending_read> mQueuedReads;
+    size_t mQueuedHead = 0;
+
+    // reads submitted to mQueue, indexed by the user data of their completion
+    cc::vector<pending_read> mInFlightReads;
+    cc::vector<uint32_t> mFreeInFlight;
+
+    cc::vector<decode_job> mDecodeJobs;
+    cc::vector<uint32_t> mFreeDecodeJobs;
+    cc::vector<std::byte> mDecodeScratch; ///< decompression without workers
+    unsigned mNumDecodesInFlight = 0;
+
+    // decompression workers
+    cc::vector<std::thread> mDecodeWorkers;
+    cc::vector<decode_task> mDecodeQueue;     ///< guarded by mDecodeMutex
+    cc::vector<decode_task> mDecodeCompleted; ///< guarded by mDecodeMutex
+    bool mIsShuttingDown = false;             ///< guarded by mDecodeMutex
+    std::mutex mDecodeMutex;
+    std::condition_variable mDecodeAvailable;
+    std::condition_variable mDecodeFinished;
+};
+}
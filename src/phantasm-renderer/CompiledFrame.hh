@@ -6,12 +6,13 @@
 
 #include <phantasm-renderer/common/api.hh>
 #include <phantasm-renderer/common/state_info.hh>
+#include <phantasm-renderer/resource_types.hh>
 
 namespace pr
 {
 class Context;
 
-/// A compiled command list ready for submission, as received from Context::compile(frame)
+/// Compiled command lists ready for submission, as received from Context::compile(frame)
 /// move-only, must be submitted or discarded via the Context before destruction
 class PR_API CompiledFrame
 {
@@ -26,10 +27,13 @@ public:
 
     CompiledFrame(CompiledFrame&& rhs) noexcept
       : _valid(rhs._valid),
-        _cmdlist(rhs._cmdlist),
+        _cmdlists(cc::move(rhs._cmdlists)),
         _freeables(cc::move(rhs._freeables)),
         _deferred_free_resources(cc::move(rhs._deferred_free_resources)),
-        _present_after_submit_swapchain(rhs._present_after_submit_swapchain)
+        _present_after_submit_swapchain(rhs._present_after_submit_swapchain),
+        _assumed_states(cc::move(rhs._assumed_states)),
+        _final_states(cc::move(rhs._final_states)),
+        _readbacks(cc::move(rhs._readbacks))
     {
         rhs.invalidate();
     }
@@ -42,10 +46,13 @@ public:
             CC_ASSERT(!is_valid() && "all compiled frames must be submitted or discarded via the Context");
 
             _valid = rhs._valid;
-            _cmdlist = rhs._cmdlist;
+            _cmdlists = cc::move(rhs._cmdlists);
             _freeables = cc::move(rhs._freeables);
             _deferred_free_resources = cc::move(rhs._deferred_free_resources);
             _present_after_submit_swapchain = rhs._present_after_submit_swapchain;
+            _assumed_states = cc::move(rhs._assumed_states);
+            _final_states = cc::move(rhs._final_states);
+            _readbacks = cc::move(rhs._readbacks);
 
             rhs.invalidate();
         }
@@ -57,24 +64,33 @@ public:
 
 private:
     friend class Context;
-    CompiledFrame(phi::handle::command_list cmdlist,
+    CompiledFrame(cc::alloc_vector<phi::handle::command_list>&& cmdlists,
                   cc::alloc_vector<freeable_cached_obj>&& freeables,
                   cc::alloc_vector<phi::handle::resource>&& deferred_free_resources,
-                  phi::handle::swapchain present_after_submit_sc)
+                  phi::handle::swapchain present_after_submit_sc,
+                  cc::alloc_vector<resource_state_entry>&& assumed_states,
+                  cc::alloc_vector<resource_state_entry>&& final_states,
+                  cc::alloc_vector<readback>&& readbacks)
       : _valid(true),
-        _cmdlist(cmdlist),
+        _cmdlists(cc::move(cmdlists)),
         _freeables(cc::move(freeables)),
         _deferred_free_resources(cc::move(deferred_free_resources)),
-        _present_after_submit_swapchain(present_after_submit_sc)
+        _present_after_submit_swapchain(present_after_submit_sc),
+        _assumed_states(cc::move(assumed_states)),
+        _final_states(cc::move(final_states)),
+        _readbacks(cc::move(readbacks))
     {
     }
 
     void invalidate() { _valid = false; }
 
     bool _valid = false;
-    phi::handle::command_list _cmdlist = phi::handle::null_command_list;
+    cc::alloc_vector<phi::handle::command_list> _cmdlists; ///< in submission order, empty if the frame had no commands
     cc::alloc_vector<freeable_cached_obj> _freeables;
     cc::alloc_vector<phi::handle::resource> _deferred_free_resources;
     phi::handle::swapchain _present_after_submit_swapchain = phi::handle::null_swapchain;
+    cc::alloc_vector<resource_state_entry> _assumed_states; ///< states the recording relied on without transitioning
+    cc::alloc_vector<resource_state_entry> _final_states;   ///< states the recording leaves resources in
+    cc::alloc_vector<readback> _readbacks;                  ///< completing at the epoch of this submit
 };
 }
@@ -1,10 +1,12 @@
 #include "Context.hh"
 
 #include <atomic>
+#include <chrono>
 #include <mutex>
 
 #include <typed-geometry/tg.hh>
 
+#include <clean-core/utility.hh>
 #include <clean-core/xxHash.hh>
 
 #include <dxc-wrapper/compiler.hh>
@@ -16,10 +18,18 @@
 #include <phantasm-hardware-interface/util.hh>
 #include <phantasm-hardware-interface/window_handle.hh>
 
+#include <phantasm-renderer/common/context_stats.hh>
 #include <phantasm-renderer/common/gpu_epoch_tracker.hh>
 #include <phantasm-renderer/common/multi_cache.hh>
+#include <phantasm-renderer/common/resource_state_cache.hh>
 #include <phantasm-renderer/common/single_cache.hh>
+#include <phantasm-renderer/common/texture_container.hh>
+#include <phantasm-renderer/common/texture_file.hh>
+#include <phantasm-renderer/common/texture_upload.hh>
+#include <phantasm-renderer/common/trace.hh>
 #include <phantasm-renderer/detail/deferred_destruction_queue.hh>
+#include <phantasm-renderer/detail/frame_capture.hh>
+#include <phantasm-renderer/detail/readback_pool.hh>
 
 #include <phantasm-renderer/CompiledFrame.hh>
 #include <phantasm-renderer/Frame.hh>
@@ -53,6 +63,32 @@ dxcw::target stage_to_dxcw_target(phi::shader_stage stage)
         return dxcw::target::pixel;
     }
 }
+
+enum stat_counter : unsigned
+{
+    sc_texture_hits,
+    sc_texture_misses,
+    sc_buffer_hits,
+    sc_buffer_misses,
+    sc_graphics_pso_hits,
+    sc_graphics_pso_misses,
+    sc_compute_pso_hits,
+    sc_compute_pso_misses,
+    sc_graphics_sv_hits,
+    sc_graphics_sv_misses,
+    sc_compute_sv_hits,
+    sc_compute_sv_misses,
+    sc_psos_created,
+    sc_shader_views_created,
+    sc_resources_created,
+    sc_resources_freed,
+    sc_deferred_frees,
+    sc_bytes_compiled,
+    sc_submits,
+    sc_record_time_ns,
+
+    sc_num_counters
+};
 }
 
 struct pr::Context::Implementation
@@ -68,6 +104,7 @@ struct pr::Context::Implementation
     std::atomic<uint64_t> mResourceGUID = {1}; // GUID 0 is invalid
     std::atomic<bool> mIsShuttingDown = {false};
     deferred_destruction_queue mDeferredQueue;
+    readback_pool mReadbacks;
 
     // caches (have dtors, members must be below backend ptr)
     multi_cache<texture_info> mCacheTextures;
@@ -79,6 +116,22 @@ struct pr::Context::Implementation
     single_cache<phi::handle::shader_view> mCacheGraphicsSVs;
     single_cache<phi::handle::shader_view> mCacheComputeSVs;
 
+    // last known resource states (no dtor)
+    resource_state_cache mResourceStates;
+
+    // descriptions of created objects for frame capture (inactive unless enabled)
+    capture_registry mCaptureRegistry;
+
+    // performance counters (relaxed, no ordering with other state)
+    std::atomic<uint64_t> mStatCounters[sc_num_counters] = {};
+
+    void count(stat_counter counter, uint64_t amount = 1) { mStatCounters[counter].fetch_add(amount, std::memory_order_relaxed); }
+
+    uint64_t read_counter(stat_counter counter, bool reset)
+    {
+        return reset ? mStatCounters[counter].exchange(0, std::memory_order_relaxed) : mStatCounters[counter].load(std::memory_order_relaxed);
+    }
+
     // safety/assert state
 #ifdef CC_ENABLE_ASSERTIONS
     struct
@@ -182,7 +235,8 @@ auto_shader_binary Context::make_shader(cc::string_view code, cc::string_view en
     auto const sc_output = mBackend->getBackendType() == phi::backend_type::d3d12 ? dxcw::output::dxil : dxcw::output::spirv;
 
     {
-        auto lg = std::lock_guard(mImpl->mMutexShaderCompilation); // unsynced, mutex: compilation
+        auto lg = trace::lock(mImpl->mMutexShaderCompilation, "wait: shader compilation mutex"); // unsynced, mutex: compilation
+        PR_TRACE_SCOPE("shader compilation");
         bin = mImpl->mShaderCompiler.compile_shader(code.data(), entrypoint.data(), sc_target, sc_output, build_debug, nullptr, nullptr, {}, scratch_alloc);
     }
 
@@ -202,27 +256,39 @@ auto_shader_binary Context::make_shader(cc::string_view code, cc::string_view en
 auto_prebuilt_argument Context::make_graphics_argument(const argument& arg)
 {
     auto const& info = arg._info.get();
-    return {prebuilt_argument{mBackend->createShaderView(info.srvs, info.uavs, info.samplers, false)}, this};
+    mImpl->count(sc_shader_views_created);
+    auto const sv = mBackend->createShaderView(info.srvs, info.uavs, info.samplers, false);
+    mImpl->mCaptureRegistry.add_shader_view(sv, info.srvs, info.uavs, info.samplers, false);
+    return {prebuilt_argument{sv}, this};
 }
 
 auto_prebuilt_argument Context::make_graphics_argument(cc::span<const phi::resource_view> srvs,
                                                        cc::span<const phi::resource_view> uavs,
                                                        cc::span<const phi::sampler_config> samplers)
 {
-    return {prebuilt_argument{mBackend->createShaderView(srvs, uavs, samplers, false)}, this};
+    mImpl->count(sc_shader_views_created);
+    auto const sv = mBackend->createShaderView(srvs, uavs, samplers, false);
+    mImpl->mCaptureRegistry.add_shader_view(sv, srvs, uavs, samplers, false);
+    return {prebuilt_argument{sv}, this};
 }
 
 auto_prebuilt_argument Context::make_compute_argument(const argument& arg)
 {
     auto const& info = arg._info.get();
-    return {prebuilt_argument{mBackend->createShaderView(info.srvs, info.uavs, info.samplers, true)}, this};
+    mImpl->count(sc_shader_views_created);
+    auto const sv = mBackend->createShaderView(info.srvs, info.uavs, info.samplers, true);
+    mImpl->mCaptureRegistry.add_shader_view(sv, info.srvs, info.uavs, info.samplers, true);
+    return {prebuilt_argument{sv}, this};
 }
 
 auto_prebuilt_argument Context::make_compute_argument(cc::span<const phi::resource_view> srvs,
                                                       cc::span<const phi::resource_view> uavs,
                                                       cc::span<const phi::sampler_config> samplers)
 {
-    return {prebuilt_argument{mBackend->createShaderView(srvs, uavs, samplers, true)}, this};
+    mImpl->count(sc_shader_views_created);
+    auto const sv = mBackend->createShaderView(srvs, uavs, samplers, true);
+    mImpl->mCaptureRegistry.add_shader_view(sv, srvs, uavs, samplers, true);
+    return {prebuilt_argument{sv}, this};
 }
 
 argument_builder Context::build_argument(cc::allocator* temp_alloc) { return {this, temp_alloc}; }
@@ -235,14 +301,21 @@ auto_graphics_pipeline_state Context::make_pipeline_state(const graphics_pass_in
     vert_format.attributes = gp.vertex_attributes;
     vert_format.vertex_sizes_bytes[0] = gp.vertex_size_bytes;
 
-    return auto_graphics_pipeline_state{
-        {{mBackend->createPipelineState(vert_format, fb._storage.get(), gp.arg_shapes, gp.has_root_consts, gp_wrap._shaders, gp.graphics_config)}}, this};
+    mImpl->count(sc_psos_created);
+    PR_TRACE_SCOPE("PSO creation");
+    auto const pso = mBackend->createPipelineState(vert_format, fb._storage.get(), gp.arg_shapes, gp.has_root_consts, gp_wrap._shaders, gp.graphics_config);
+    mImpl->mCaptureRegistry.add_graphics_pso(pso, gp_wrap, fb);
+    return auto_graphics_pipeline_state{{{pso}}, this};
 }
 
 auto_compute_pipeline_state Context::make_pipeline_state(const compute_pass_info& cp_wrap)
 {
     auto const& cp = cp_wrap._storage.get();
-    return auto_compute_pipeline_state{{{mBackend->createComputePipelineState(cp.arg_shapes, cp_wrap._shader, cp.has_root_consts)}}, this};
+    mImpl->count(sc_psos_created);
+    PR_TRACE_SCOPE("PSO creation");
+    auto const pso = mBackend->createComputePipelineState(cp.arg_shapes, cp_wrap._shader, cp.has_root_consts);
+    mImpl->mCaptureRegistry.add_compute_pso(pso, cp_wrap);
+    return auto_compute_pipeline_state{{{pso}}, this};
 }
 
 auto_fence Context::make_fence() { return auto_fence{{mBackend->createFence()}, this}; }
@@ -250,6 +323,7 @@ auto_fence Context::make_fence() { return auto_fence{{mBackend->createFence()},
 auto_query_range Context::make_query_range(phi::query_type type, uint32_t num_queries)
 {
     auto const handle = mBackend->createQueryRange(type, num_queries);
+    mImpl->mCaptureRegistry.add_query_range(handle, type, num_queries);
     return auto_query_range{{handle, type, num_queries}, this};
 }
 
@@ -258,8 +332,18 @@ auto_swapchain Context::make_swapchain(const phi::window_handle& window_handle,
     return {{mBackend->createSwapchain(window_handle, initial_size, mode, num_backbuffers)}, this};
 }
 
-void Context::free_untyped(phi::handle::resource resource) { mBackend->free(resource); }
-void Context::free_range(cc::span<const phi::handle::resource> res_range) { mBackend->freeRange(res_range); }
+void Context::free_untyped(phi::handle::resource resource)
+{
+    mImpl->count(sc_resources_freed);
+    mImpl->mResourceStates.forget(resource);
+    mBackend->free(resource);
+}
+void Context::free_range(cc::span<const phi::handle::resource> res_range)
+{
+    mImpl->count(sc_resources_freed, res_range.size());
+    mImpl->mResourceStates.forget_range(res_range);
+    mBackend->freeRange(res_range);
+}
 
 void Context::free_range(cc::span<const prebuilt_argument> arg_range)
 {
@@ -287,12 +371,23 @@ void Context::free_deferred(raw_resource const& res) { free_deferred(res.handle)
 void Context::free_deferred(graphics_pipeline_state const& gpso) { free_deferred(gpso._handle); }
 void Context::free_deferred(compute_pipeline_state const& cpso) { free_deferred(cpso._handle); }
 
-void Context::free_deferred(phi::handle::resource res) { mImpl->mDeferredQueue.free(*this, res); }
-void Context::free_deferred(phi::handle::shader_view sv) { mImpl->mDeferredQueue.free(*this, sv); }
-void Context::free_deferred(phi::handle::pipeline_state pso) { mImpl->mDeferredQueue.free(*this, pso); }
+void Context::free_deferred(phi::handle::resource res)
+{
+    mImpl->mResourceStates.forget(res);
+    mImpl->count(sc_deferred_frees, mImpl->mDeferredQueue.free(*this, res));
+}
+void Context::free_deferred(phi::handle::shader_view sv) { mImpl->count(sc_deferred_frees, mImpl->mDeferredQueue.free(*this, sv)); }
+void Context::free_deferred(phi::handle::pipeline_state pso) { mImpl->count(sc_deferred_frees, mImpl->mDeferredQueue.free(*this, pso)); }
 
-void Context::free_range_deferred(cc::span<const phi::handle::resource> res_range) { mImpl->mDeferredQueue.free_range(*this, res_range); }
-void Context::free_range_deferred(cc::span<const phi::handle::shader_view> sv_range) { mImpl->mDeferredQueue.free_range(*this, sv_range); }
+void Context::free_range_deferred(cc::span<const phi::handle::resource> res_range)
+{
+    mImpl->mResourceStates.forget_range(res_range);
+    mImpl->count(sc_deferred_frees, mImpl->mDeferredQueue.free_range(*this, res_range));
+}
+void Context::free_range_deferred(cc::span<const phi::handle::shader_view> sv_range)
+{
+    mImpl->count(sc_deferred_frees, mImpl->mDeferredQueue.free_range(*this, sv_range));
+}
 
 void Context::free_to_cache_untyped(const raw_resource& resource, const generic_resource_info& info)
 {
@@ -354,6 +449,38 @@ void Context::unmap_buffer(const buffer& buffer, int32_t flush_begin, int32_t fl
     mBackend->unmapBuffer(buffer.res.handle, flush_begin, flush_end);
 }
 
+bool Context::is_readback_ready(readback const& rb)
+{
+    return mImpl->mReadbacks.is_ready(rb, mImpl->mGpuEpochTracker.get_current_epoch_gpu(mBackend));
+}
+
+bool Context::is_readback_discarded(readback const& rb) { return mImpl->mReadbacks.is_discarded(rb); }
+
+cc::span<std::byte const> Context::get_readback_data(readback const& rb)
+{
+    return mImpl->mReadbacks.get_data(*this, rb, mImpl->mGpuEpochTracker.get_current_epoch_gpu(mBackend));
+}
+
+void Context::set_readback_callback(readback const& rb, readback_callback callback, void* userdata)
+{
+    mImpl->mReadbacks.set_callback(rb, callback, userdata);
+}
+
+unsigned Context::poll_readbacks() { return mImpl->mReadbacks.poll(*this, mImpl->mGpuEpochTracker.get_current_epoch_gpu(mBackend)); }
+
+void Context::free(readback const& rb) { mImpl->mReadbacks.free(*this, rb); }
+
+readback Context::addReadback(buffer const& buf, uint32_t row_size_bytes, uint32_t row_pitch_bytes, uint32_t num_rows)
+{
+    return mImpl->mReadbacks.add(buf, {row_size_bytes, row_pitch_bytes, num_rows});
+}
+
+void Context::discardReadbacks(cc::span<readback const> readbacks)
+{
+    if (!readbacks.empty())
+        mImpl->mReadbacks.on_discard(readbacks);
+}
+
 cached_texture Context::get_target(tg::isize2 size, phi::format format, uint32_t num_samples, uint32_t array_size)
 {
     auto const info = texture_info::create_rt(format, size, num_samples, array_size);
@@ -421,16 +548,59 @@ raw_resource Context::get_untyped_unlocked(const generic_resource_info& info)
 
 CompiledFrame Context::compile(raii::Frame&& frame)
 {
+    trace::end_span("Frame recording", frame.mRecordingBeginNs);
+    PR_TRACE_SCOPE("Context::compile");
+
     frame.finalize();
 
     if (frame.is_empty())
     {
-        return CompiledFrame(phi::handle::null_command_list, cc::move(frame.mFreeables), cc::move(frame.mDeferredFreeResources), phi::handle::null_swapchain);
+        return CompiledFrame({}, cc::move(frame.mFreeables), cc::move(frame.mDeferredFreeResources),
+                             phi::handle::null_swapchain, {}, {}, cc::move(frame.mReadbacks));
     }
     else
     {
-        auto const cmdlist = mBackend->recordCommandList(frame.getMemory(), frame.getSize()); // intern. synced
-        return CompiledFrame(cmdlist, cc::move(frame.mFreeables), cc::move(frame.mDeferredFreeResources), frame.mPresentAfterSubmitRequest);
+        growing_writer const& writer = frame.getWriter();
+        draw_delta_stream const& draws = frame.getDrawStream();
+
+        cc::alloc_vector<phi::handle::command_list> cmdlists;
+        cmdlists.reset_reserve(writer.allocator(), draws.num_pieces());
+
+        if (draws.is_empty() && writer.num_chunks() == 1)
+        {
+            // the stream is contiguous and complete
+            cmdlists.push_back(recordCommandStream(writer.current_chunk().buffer, writer.size()));
+        }
+        else
+        {
+            // phi records each command list from a contiguous stream, the stream is split between render passes into pieces
+            // of at least draw_delta_stream::min_piece_size (every command list takes from a fixed-size pool),
+            // which are expanded one after another into a buffer sized for the largest one
+            size_t scratch_size = 0;
+            for (auto i = 0u; i < draws.num_pieces(); ++i)
+                scratch_size = cc::max(scratch_size, draws.get_expanded_piece_size(writer, i));
+
+            std::byte* const scratch = writer.allocator()->alloc(scratch_size);
+            draw_delta_stream::piece_cursor cursor;
+
+            for (auto i = 0u; i < draws.num_pieces(); ++i)
+            {
+                size_t const piece_size = draws.get_expanded_piece_size(writer, i);
+                draws.expand_next_piece(writer, cursor, scratch);
+
+                // the last piece is empty if the frame ends with a render pass
+                if (piece_size > 0)
+                    cmdlists.push_back(recordCommandStream(scratch, piece_size));
+            }
+
+            writer.allocator()->free(scratch);
+        }
+
+        cc::alloc_vector<resource_state_entry> final_states;
+        frame.collectFinalStates(final_states);
+
+        return CompiledFrame(cc::move(cmdlists), cc::move(frame.mFreeables), cc::move(frame.mDeferredFreeResources), frame.mPresentAfterSubmitRequest,
+                             cc::move(frame.mAssumedStates), cc::move(final_states), cc::move(frame.mReadbacks));
     }
 }
 
@@ -440,9 +610,10 @@ gpu_epoch_t Context::submit(CompiledFrame&& frame)
 {
     CC_ASSERT(!mImpl->mIsShuttingDown.load(std::memory_order_relaxed) && "attempted to submit frames during global shutdown");
     CC_ASSERT(frame.is_valid() && "submitted an invalid CompiledFrame");
+    PR_TRACE_SCOPE("Context::submit");
     gpu_epoch_t res = 0;
 
-    if (frame._cmdlist.is_valid()) // CompiledFrame doesn't always hold a commandlist
+    if (!frame._cmdlists.empty()) // CompiledFrame doesn't always hold command lists
     {
         mImpl->mGpuEpochTracker._cached_epoch_gpu = mImpl->mGpuEpochTracker.get_current_epoch_gpu(mBackend);
 
@@ -451,14 +622,40 @@ gpu_epoch_t Context::submit(CompiledFrame&& frame)
 
         {
             // unsynced, mutex: submission
-            auto const lg = std::lock_guard<std::mutex>(mImpl->mMutexSubmission);
-            mBackend->submit(cc::span{frame._cmdlist}, phi::queue_type::direct, {}, cc::span{signal_op});
+            auto const lg = trace::lock(mImpl->mMutexSubmission, "wait: submission mutex");
+
+            // the frame dropped transitions based on the resource states known when it was recorded,
+            // if frames were submitted out of order since, restore these states first
+            phi::handle::command_list const fixup_cmdlist = recordStateFixup(frame._assumed_states);
+            auto const frame_cmdlists = cc::span<phi::handle::command_list const>(frame._cmdlists.data(), frame._cmdlists.size());
+
+            if (fixup_cmdlist.is_valid())
+            {
+                cc::vector<phi::handle::command_list> cmdlists;
+                cmdlists.reserve(frame_cmdlists.size() + 1);
+                cmdlists.push_back(fixup_cmdlist);
+                for (phi::handle::command_list const cmdlist : frame_cmdlists)
+                    cmdlists.push_back(cmdlist);
+
+                mBackend->submit(cmdlists, phi::queue_type::direct, {}, cc::span{signal_op});
+            }
+            else
+            {
+                mBackend->submit(frame_cmdlists, phi::queue_type::direct, {}, cc::span{signal_op});
+            }
+
+            mImpl->mResourceStates.update_range(frame._final_states);
         }
 
         // increment CPU epoch after signalling
         ++mImpl->mGpuEpochTracker._current_epoch_cpu;
+        mImpl->count(sc_submits);
 
         res = mImpl->mGpuEpochTracker._current_epoch_cpu;
+        trace::frame_marker(res);
+
+        if (!frame._readbacks.empty())
+            mImpl->mReadbacks.on_submit(frame._readbacks, res);
 
         if (frame._present_after_submit_swapchain.is_valid())
         {
@@ -469,7 +666,7 @@ gpu_epoch_t Context::submit(CompiledFrame&& frame)
     free_all(frame._freeables);
 
     if (!frame._deferred_free_resources.empty())
-        mImpl->mDeferredQueue.free_range(*this, frame._deferred_free_resources);
+        free_range_deferred(frame._deferred_free_resources);
 
     frame.invalidate();
 
@@ -478,12 +675,13 @@ gpu_epoch_t Context::submit(CompiledFrame&& frame)
 
 void Context::discard(CompiledFrame&& frame)
 {
-    if (frame._cmdlist.is_valid())
-        mBackend->discard(cc::span{frame._cmdlist});
+    if (!frame._cmdlists.empty())
+        mBackend->discard(cc::span<phi::handle::command_list const>(frame._cmdlists.data(), frame._cmdlists.size()));
     free_all(frame._freeables);
+    discardReadbacks(frame._readbacks);
 
     if (!frame._deferred_free_resources.empty())
-        mImpl->mDeferredQueue.free_range(*this, frame._deferred_free_resources);
+        free_range_deferred(frame._deferred_free_resources);
 
     frame.invalidate();
 }
@@ -517,6 +715,28 @@ void Context::flush_and_shutdown()
 bool Context::start_capture() { return mBackend->startForcedDiagnosticCapture(); }
 bool Context::stop_capture() { return mBackend->endForcedDiagnosticCapture(); }
 
+void Context::enable_frame_capture() { mImpl->mCaptureRegistry.enable(); }
+
+bool Context::capture_frame(raii::Frame const& frame, char const* path)
+{
+    PR_TRACE_SCOPE("Context::capture_frame");
+
+    growing_writer const& writer = frame.getWriter();
+    draw_delta_stream const& draws = frame.getDrawStream();
+
+    // the same contiguous stream compile would record, plus the transitions that have not been flushed yet
+    size_t const expanded_size = draws.get_expanded_size(writer);
+    size_t const pending_size = frame.mPendingTransitionCommand.transitions.size() > 0 ? sizeof(phi::cmd::transition_resources) : 0;
+
+    cc::vector<std::byte> stream;
+    stream.resize(expanded_size + pending_size);
+    draws.expand(writer, stream.data());
+    if (pending_size > 0)
+        std::memcpy(stream.data() + expanded_size, &frame.mPendingTransitionCommand, pending_size);
+
+    return mImpl->mCaptureRegistry.write_capture(*this, stream, cc::span<resource_state_entry const>(frame.mAssumedStates.data(), frame.mAssumedStates.size()), path);
+}
+
 /// uint64 incremented after every finished commandlist, GPU timeline, always less or equal to CPU
 
 
@@ -538,7 +758,17 @@ uint32_t Context::get_num_backbuffers(swapchain const& sc) const { return mBacke
 
 uint32_t Context::calculate_texture_upload_size(tg::isize3 size, phi::format fmt, uint32_t num_mips) const
 {
-    return phi::util::get_texture_size_bytes(size, fmt, num_mips, mBackendType == pr::backend::d3d12);
+    // same placement as raii::Frame::upload_texture_data
+    texture_info info;
+    info.fmt = fmt;
+    info.width = size.width;
+    info.height = size.height;
+    info.depth_or_array_size = unsigned(size.depth);
+    info.num_mips = num_mips;
+
+    texture_upload_layout layout;
+    layout.initialize(info, num_mips, mBackendType == pr::backend::d3d12);
+    return uint32_t(layout.dest_size_bytes);
 }
 
 uint32_t Context::calculate_texture_pixel_offset(tg::isize2 size, format fmt, tg::ivec2 pixel) const
@@ -561,7 +791,13 @@ texture Context::acquire_backbuffer(swapchain const& sc)
     mImpl->mSafetyState.did_acquire_before_present = true;
 #endif
 
-    return {{backbuffer, backbuffer.is_valid() ? acquireGuid() : 0}, texture_info::create_rt(mBackend->getBackbufferFormat(sc.handle), size)};
+    // backbuffers change state outside of recorded frames
+    mImpl->mResourceStates.forget(backbuffer);
+
+    auto const info = texture_info::create_rt(mBackend->getBackbufferFormat(sc.handle), size);
+    mImpl->mCaptureRegistry.add_texture(backbuffer, info);
+
+    return {{backbuffer, backbuffer.is_valid() ? acquireGuid() : 0}, info};
 }
 
 uint32_t Context::clear_resource_caches()
@@ -574,6 +810,8 @@ uint32_t Context::clear_resource_caches()
     mImpl->mCacheTextures.cull_all(gpu_epoch, [&](phi::handle::resource rt) { freeable.push_back(rt); });
     mImpl->mCacheBuffers.cull_all(gpu_epoch, [&](phi::handle::resource rt) { freeable.push_back(rt); });
 
+    mImpl->mResourceStates.forget_range(freeable);
+    mImpl->count(sc_resources_freed, freeable.size());
     mBackend->freeRange(freeable);
     return uint32_t(freeable.size());
 }
@@ -609,7 +847,12 @@ uint32_t Context::clear_pipeline_state_cache()
     return num_frees;
 }
 
-uint32_t Context::clear_pending_deferred_frees() { return mImpl->mDeferredQueue.free_all_pending(*this); }
+uint32_t Context::clear_pending_deferred_frees()
+{
+    auto const num_freed = mImpl->mDeferredQueue.free_all_pending(*this);
+    mImpl->count(sc_deferred_frees, num_freed);
+    return num_freed;
+}
 
 void Context::initialize(backend type, cc::allocator* alloc)
 {
@@ -655,6 +898,9 @@ void Context::destroy()
             // flush GPU
             mBackend->flushGPU();
 
+            // free readbacks that were never freed, their buffers are not in the cache
+            mImpl->mReadbacks.destroy(*this);
+
             // empty all caches, this could be way optimized
             mImpl->mCacheGraphicsPSOs.iterate_values([&](phi::handle::pipeline_state pso) { mBackend->free(pso); });
             mImpl->mCacheComputePSOs.iterate_values([&](phi::handle::pipeline_state pso) { mBackend->free(pso); });
@@ -699,6 +945,7 @@ void Context::internalInitialize(cc::allocator* alloc, bool ownsBackend)
     mImpl->mCacheTextures.reserve(256);
     mImpl->mShaderCompiler.initialize();
     mImpl->mDeferredQueue.initialize(alloc);
+    mImpl->mReadbacks.initialize(alloc);
 
     mGPUTimestampFrequency = mBackend->getGPUTimestampFrequency();
     mBackendType = mBackend->getBackendType() == phi::backend_type::d3d12 ? pr::backend::d3d12 : pr::backend::vulkan;
@@ -706,14 +953,19 @@ void Context::internalInitialize(cc::allocator* alloc, bool ownsBackend)
 
 texture Context::createTexture(const texture_info& info, const char* dbg_name)
 {
-    return {{mBackend->createTexture(info, dbg_name), acquireGuid()}, info};
+    mImpl->count(sc_resources_created);
+    phi::handle::resource handle = mBackend->createTexture(info, dbg_name);
+    mImpl->mCaptureRegistry.add_texture(handle, info);
+    return {{handle, acquireGuid()}, info};
 }
 
 buffer Context::createBuffer(const buffer_info& info, char const* dbg_name)
 {
     CC_ASSERT((info.allow_uav ? info.heap == phi::resource_heap::gpu : true) && "mapped buffers cannot be created with UAV support");
 
+    mImpl->count(sc_resources_created);
     phi::handle::resource handle = mBackend->createBuffer(info, dbg_name);
+    mImpl->mCaptureRegistry.add_buffer(handle, info);
     return {{handle, acquireGuid()}, info};
 }
 
@@ -722,10 +974,12 @@ texture Context::acquireTexture(const texture_info& info)
     auto lookup = mImpl->mCacheTextures.acquire(info, mImpl->mGpuEpochTracker._cached_epoch_gpu);
     if (lookup.handle.is_valid())
     {
+        mImpl->count(sc_texture_hits);
         return {lookup, info};
     }
     else
     {
+        mImpl->count(sc_texture_misses);
         return createTexture(info);
     }
 }
@@ -735,10 +989,12 @@ buffer Context::acquireBuffer(const buffer_info& info)
     auto lookup = mImpl->mCacheBuffers.acquire(info, mImpl->mGpuEpochTracker._cached_epoch_gpu);
     if (lookup.handle.is_valid())
     {
+        mImpl->count(sc_buffer_hits);
         return {lookup, info};
     }
     else
     {
+        mImpl->count(sc_buffer_misses);
         return createBuffer(info);
     }
 }
@@ -768,12 +1024,19 @@ phi::handle::pipeline_state Context::acquire_graphics_pso(uint64_t hash, graphic
 {
     phi::handle::pipeline_state pso = mImpl->mCacheGraphicsPSOs.acquire(hash);
 
-
-    if (!pso.is_valid())
+    if (pso.is_valid())
     {
+        mImpl->count(sc_graphics_pso_hits);
+    }
+    else
+    {
+        mImpl->count(sc_graphics_pso_misses);
+        mImpl->count(sc_psos_created);
+        PR_TRACE_SCOPE("PSO creation");
         graphics_pass_info_data const& info = gp._storage.get();
         pso = mBackend->createPipelineState({info.vertex_attributes, info.vertex_size_bytes}, fb._storage.get(), info.arg_shapes,
                                             info.has_root_consts, gp._shaders, info.graphics_config);
+        mImpl->mCaptureRegistry.add_graphics_pso(pso, gp, fb);
 
         mImpl->mCacheGraphicsPSOs.insert(pso, hash);
     }
@@ -783,10 +1046,18 @@ phi::handle::pipeline_state Context::acquire_graphics_pso(uint64_t hash, graphic
 phi::handle::pipeline_state Context::acquire_compute_pso(uint64_t hash, const compute_pass_info& cp)
 {
     phi::handle::pipeline_state pso = mImpl->mCacheComputePSOs.acquire(hash);
-    if (!pso.is_valid())
+    if (pso.is_valid())
+    {
+        mImpl->count(sc_compute_pso_hits);
+    }
+    else
     {
+        mImpl->count(sc_compute_pso_misses);
+        mImpl->count(sc_psos_created);
+        PR_TRACE_SCOPE("PSO creation");
         compute_pass_info_data const& info = cp._storage.get();
         pso = mBackend->createComputePipelineState(info.arg_shapes, cp._shader, info.has_root_consts);
+        mImpl->mCaptureRegistry.add_compute_pso(pso, cp);
         mImpl->mCacheComputePSOs.insert(pso, hash);
     }
     return pso;
@@ -795,10 +1066,18 @@ phi::handle::pipeline_state Context::acquire_compute_pso(uint64_t hash, const co
 phi::handle::shader_view Context::acquire_graphics_sv(uint64_t hash, const hashable_storage<shader_view_info>& info_storage)
 {
     phi::handle::shader_view sv = mImpl->mCacheGraphicsSVs.acquire(hash);
-    if (!sv.is_valid())
+    if (sv.is_valid())
     {
+        mImpl->count(sc_graphics_sv_hits);
+    }
+    else
+    {
+        mImpl->count(sc_graphics_sv_misses);
+        mImpl->count(sc_shader_views_created);
+        PR_TRACE_SCOPE("shader view creation");
         shader_view_info const& info = info_storage.get();
         sv = mBackend->createShaderView(info.srvs, info.uavs, info.samplers, false);
+        mImpl->mCaptureRegistry.add_shader_view(sv, info.srvs, info.uavs, info.samplers, false);
         mImpl->mCacheGraphicsSVs.insert(sv, hash);
     }
     return sv;
@@ -807,10 +1086,18 @@ phi::handle::shader_view Context::acquire_graphics_sv(uint64_t hash, const hasha
 phi::handle::shader_view Context::acquire_compute_sv(uint64_t hash, const hashable_storage<shader_view_info>& info_storage)
 {
     phi::handle::shader_view sv = mImpl->mCacheComputeSVs.acquire(hash);
-    if (!sv.is_valid())
+    if (sv.is_valid())
+    {
+        mImpl->count(sc_compute_sv_hits);
+    }
+    else
     {
+        mImpl->count(sc_compute_sv_misses);
+        mImpl->count(sc_shader_views_created);
+        PR_TRACE_SCOPE("shader view creation");
         shader_view_info const& info = info_storage.get();
         sv = mBackend->createShaderView(info.srvs, info.uavs, info.samplers, true);
+        mImpl->mCaptureRegistry.add_shader_view(sv, info.srvs, info.uavs, info.samplers, true);
         mImpl->mCacheComputeSVs.insert(sv, hash);
     }
     return sv;
@@ -838,6 +1125,78 @@ void Context::free_all(cc::span<const freeable_cached_obj> freeables)
     }
 }
 
+bool Context::get_last_resource_state(phi::handle::resource res, resource_state_entry& out_entry)
+{
+    return mImpl->mResourceStates.lookup(res, out_entry);
+}
+
+phi::handle::command_list Context::recordStateFixup(cc::span<const resource_state_entry> expected_states)
+{
+    if (expected_states.empty())
+        return phi::handle::null_command_list;
+
+    cc::alloc_vector<resource_state_entry> mismatches;
+    mImpl->mResourceStates.find_mismatches(expected_states, mismatches);
+
+    if (mismatches.empty())
+        return phi::handle::null_command_list;
+
+    size_t const num_cmds = (mismatches.size() + phi::limits::max_resource_transitions - 1) / phi::limits::max_resource_transitions;
+    growing_writer writer(num_cmds * sizeof(phi::cmd::transition_resources));
+
+    phi::cmd::transition_resources tcmd;
+    for (resource_state_entry const& e : mismatches)
+    {
+        if (tcmd.transitions.size() == phi::limits::max_resource_transitions)
+        {
+            writer.add_command(tcmd);
+            tcmd.transitions.clear();
+        }
+
+        tcmd.add(e.resource, e.state, e.dependency);
+    }
+    writer.add_command(tcmd);
+
+    return recordCommandStream(writer.current_chunk().buffer, writer.size());
+}
+
+phi::handle::command_list Context::recordCommandStream(std::byte* stream, size_t size)
+{
+    auto const start = std::chrono::steady_clock::now();
+    auto const res = mBackend->recordCommandList(stream, size); // intern. synced
+    auto const duration = std::chrono::steady_clock::now() - start;
+
+    mImpl->count(sc_bytes_compiled, size);
+    mImpl->count(sc_record_time_ns, uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+    return res;
+}
+
+context_stats Context::get_stats() const { return readStats(false); }
+
+context_stats Context::get_and_reset_stats() { return readStats(true); }
+
+context_stats Context::readStats(bool reset) const
+{
+    auto const read = [&](stat_counter counter) { return mImpl->read_counter(counter, reset); };
+
+    context_stats res;
+    res.cache_textures = {read(sc_texture_hits), read(sc_texture_misses)};
+    res.cache_buffers = {read(sc_buffer_hits), read(sc_buffer_misses)};
+    res.cache_graphics_psos = {read(sc_graphics_pso_hits), read(sc_graphics_pso_misses)};
+    res.cache_compute_psos = {read(sc_compute_pso_hits), read(sc_compute_pso_misses)};
+    res.cache_graphics_svs = {read(sc_graphics_sv_hits), read(sc_graphics_sv_misses)};
+    res.cache_compute_svs = {read(sc_compute_sv_hits), read(sc_compute_sv_misses)};
+    res.num_psos_created = read(sc_psos_created);
+    res.num_shader_views_created = read(sc_shader_views_created);
+    res.num_resources_created = read(sc_resources_created);
+    res.num_resources_freed = read(sc_resources_freed);
+    res.num_deferred_frees = read(sc_deferred_frees);
+    res.num_bytes_compiled = read(sc_bytes_compiled);
+    res.num_submits = read(sc_submits);
+    res.record_time_ns = read(sc_record_time_ns);
+    return res;
+}
+
 void Context::free_graphics_pso(uint64_t hash) { mImpl->mCacheGraphicsPSOs.free(hash, mImpl->mGpuEpochTracker.get_current_epoch_cpu()); }
 void Context::free_compute_pso(uint64_t hash) { mImpl->mCacheComputePSOs.free(hash, mImpl->mGpuEpochTracker.get_current_epoch_cpu()); }
 
@@ -849,6 +1208,100 @@ auto_buffer pr::Context::make_upload_buffer_for_texture(const texture& tex, uint
     return make_upload_buffer(calculate_texture_upload_size(tex, num_mips), 0, debug_name);
 }
 
+bool pr::Context::load_texture_container(const char* path, texture_file_upload& out_upload, const char* debug_name)
+{
+    PR_TRACE_SCOPE("Context::load_texture_container");
+
+    std::FILE* const file = std::fopen(path, "rb");
+    if (file == nullptr)
+    {
+        PR_LOG_WARN("unable to open texture container {}", path);
+        return false;
+    }
+
+    texture_container_header header;
+    cc::vector<texture_container_chunk> chunks;
+    if (!read_texture_container_header(file, mBackendType == pr::backend::d3d12, header, out_upload.layout, chunks))
+    {
+        PR_LOG_WARN("texture container {} not loaded", path);
+        std::fclose(file);
+        return false;
+    }
+
+    out_upload.upload_buffer = make_upload_buffer(uint32_t(header.data_size_bytes), 0, debug_name).disown();
+    std::byte* const upload_buffer_map = map_buffer(out_upload.upload_buffer, 0, 0); // no invalidate
+
+    bool read_ok;
+    if (chunks.empty())
+    {
+        // the data section is the upload buffer contents, read it in place
+        read_ok = header.data_size_bytes == 0 || std::fread(upload_buffer_map, size_t(header.data_size_bytes), 1, file) == 1;
+    }
+    else
+    {
+        // compressed chunks are decompressed in parallel to their place in the upload buffer
+        cc::vector<std::byte> stored_data;
+        stored_data.resize(size_t(header.stored_size_bytes));
+        read_ok = std::fread(stored_data.data(), stored_data.size(), 1, file) == 1
+                  && decompress_texture_container(header, chunks, stored_data.data(), upload_buffer_map);
+    }
+
+    unmap_buffer(out_upload.upload_buffer, 0, int32_t(header.data_size_bytes)); // flush written range
+    std::fclose(file);
+
+    if (!read_ok)
+    {
+        PR_LOG_WARN("texture container {} truncated or corrupted", path);
+        free(out_upload.upload_buffer);
+        return false;
+    }
+
+    out_upload.dest_texture = make_texture(get_texture_container_info(header), debug_name).disown();
+    return true;
+}
+
+bool pr::Context::load_texture_file(const char* path, texture_file_upload& out_upload, const char* debug_name)
+{
+    PR_TRACE_SCOPE("Context::load_texture_file");
+
+    std::FILE* const file = std::fopen(path, "rb");
+    if (file == nullptr)
+    {
+        PR_LOG_WARN("unable to open texture file {}", path);
+        return false;
+    }
+
+    // unbuffered, subresource reads go straight to the upload buffer instead of through the stdio buffer
+    std::setvbuf(file, nullptr, _IONBF, 0);
+
+    texture_info info;
+    cc::vector<size_t> subresource_offsets;
+    if (!parse_texture_file(file, info, subresource_offsets))
+    {
+        PR_LOG_WARN("texture file {} not loaded", path);
+        std::fclose(file);
+        return false;
+    }
+
+    out_upload.layout.initialize(info, info.num_mips, mBackendType == pr::backend::d3d12);
+    out_upload.upload_buffer = make_upload_buffer(uint32_t(out_upload.layout.dest_size_bytes), 0, debug_name).disown();
+
+    std::byte* const upload_buffer_map = map_buffer(out_upload.upload_buffer, 0, 0); // no invalidate
+    bool const read_ok = read_texture_file_subresources(file, out_upload.layout, subresource_offsets, upload_buffer_map);
+    unmap_buffer(out_upload.upload_buffer, 0, int32_t(out_upload.layout.dest_size_bytes)); // flush written range
+    std::fclose(file);
+
+    if (!read_ok)
+    {
+        PR_LOG_WARN("texture file {} truncated", path);
+        free(out_upload.upload_buffer);
+        return false;
+    }
+
+    out_upload.dest_texture = make_texture(info, debug_name).disown();
+    return true;
+}
+
 uint32_t pr::Context::calculate_texture_upload_size(const texture& texture, uint32_t num_mips) const
 {
     return calculate_texture_upload_size({texture.info.width, texture.info.height, int(texture.info.depth_or_array_size)}, texture.info.fmt, num_mips);
@@ -8,6 +8,7 @@
 #include <phantasm-hardware-interface/fwd.hh>
 
 #include <phantasm-renderer/common/api.hh>
+#include <phantasm-renderer/common/context_stats.hh>
 #include <phantasm-renderer/fwd.hh>
 #include <phantasm-renderer/resource_types.hh>
 
@@ -26,6 +27,7 @@ public:
     //
 
     /// start a frame, allowing command recording
+    /// initial_size: size of the first command chunk in bytes, the frame grows in chunks of at least 64 KB
     [[nodiscard]] raii::Frame make_frame(size_t initial_size = 2048, cc::allocator* alloc = cc::system_allocator);
 
     //
@@ -81,6 +83,17 @@ public:
     /// create a mapped upload buffer, with a size based on accomodating a given texture's contents
     [[nodiscard]] auto_buffer make_upload_buffer_for_texture(texture const& tex, uint32_t num_mips = 1, char const* debug_name = nullptr);
 
+    /// create a texture from a pre-aligned texture container (see pr::write_texture_container) and read its data
+    /// into a new upload buffer with a single file read, record the copies with Frame::upload_texture_file
+    /// compressed containers are decompressed on multiple threads directly into the upload buffer
+    /// the created texture is owned by the caller, returns false if the file is missing, invalid or built for the other backend
+    [[nodiscard]] bool load_texture_container(char const* path, texture_file_upload& out_upload, char const* debug_name = nullptr);
+
+    /// create a texture from a DDS or KTX2 file (see pr::parse_texture_file) and read each subresource from disk
+    /// directly into a new upload buffer at its pitched placement, record the copies with Frame::upload_texture_file
+    /// the created texture is owned by the caller, returns false if the file is missing, invalid or unsupported
+    [[nodiscard]] bool load_texture_file(char const* path, texture_file_upload& out_upload, char const* debug_name = nullptr);
+
     /// create a mapped readback buffer which can be directly read from CPU
     [[nodiscard]] auto_buffer make_readback_buffer(uint32_t size, uint32_t stride = 0, char const* debug_name = nullptr);
 
@@ -295,6 +308,32 @@ public:
         read_from_buffer_raw(buffer, cc::as_byte_span(out_data), offset_in_buffer);
     }
 
+    //
+    // asynchronous readback API
+    //   readbacks are recorded with raii::Frame::readback_async
+    //   all functions are synchronised
+    //
+
+    /// whether the frame of a readback completed on the GPU, never blocks
+    [[nodiscard]] bool is_readback_ready(readback const& rb);
+
+    /// whether the frame of a readback was discarded, it never completes
+    [[nodiscard]] bool is_readback_discarded(readback const& rb);
+
+    /// returns the (tightly packed) data of a completed readback, valid until it is freed
+    [[nodiscard]] cc::span<std::byte const> get_readback_data(readback const& rb);
+
+    /// sets a callback that poll_readbacks invokes once the readback completed, the readback is freed after the callback returns
+    void set_readback_callback(readback const& rb, readback_callback callback, void* userdata = nullptr);
+
+    /// invokes the callbacks of completed readbacks, returns the amount of invoked callbacks
+    /// call regularly, ex. once per frame
+    unsigned poll_readbacks();
+
+    /// frees a readback, its buffer is reused by later readbacks once no longer in flight
+    /// readbacks of discarded frames never complete and must be freed as well
+    void free(readback const& rb);
+
     //
     // fence API
     //
@@ -317,7 +356,7 @@ public:
     // command list submission
     //
 
-    /// compiles a frame (records the command list)
+    /// compiles a frame (records its command lists)
     /// heavy operation, try to thread this if possible
     [[nodiscard]] CompiledFrame compile(raii::Frame&& frame);
 
@@ -441,6 +480,17 @@ public:
         return (end - start) / (mGPUTimestampFrequency / 1'000'000);
     }
 
+    //
+    // performance counters
+    //   lock-free, cheap enough to stay enabled
+    //
+
+    /// returns the counters accumulated since initialization or the last reset
+    [[nodiscard]] context_stats get_stats() const;
+
+    /// returns the counters accumulated since initialization or the last reset, and resets them (ex. once per frame)
+    [[nodiscard]] context_stats get_and_reset_stats();
+
     /// returns the amount of bytes needed to store the contents of a texture (in a GPU buffer)
     /// ex. use case: allocating upload buffers of the right size to upload textures
     uint32_t calculate_texture_upload_size(tg::isize3 size, format fmt, uint32_t num_mips = 1) const;
@@ -470,6 +520,15 @@ public:
     /// ends a capture previously started with start_capture()
     bool stop_capture();
 
+    /// starts recording descriptions of all objects created from here on, which capture_frame requires
+    /// adds a small cost to every object creation once enabled
+    void enable_frame_capture();
+
+    /// writes the commands recorded so far in a frame, along with descriptions of all objects they reference, to a file
+    /// the frame is not modified and can be submitted afterwards, replay captures with pr::FrameReplayer
+    /// returns false if the frame references objects created before enable_frame_capture, or commands unsupported by captures
+    bool capture_frame(raii::Frame const& frame, char const* path);
+
     /// returns the underlying phantasm-hardware-interface backend
     phi::Backend& get_backend() { return *mBackend; }
     pr::backend get_backend_type() const { return mBackendType; }
@@ -552,6 +611,15 @@ private:
     texture acquireTexture(texture_info const& info);
     buffer acquireBuffer(buffer_info const& info);
 
+    /// records a command list from a contiguous stream, updating the performance counters
+    phi::handle::command_list recordCommandStream(std::byte* stream, size_t size);
+
+    context_stats readStats(bool reset) const;
+
+    // resource state tracking
+    /// records a command list restoring the expected states that are out of date, returns null if there are none
+    phi::handle::command_list recordStateFixup(cc::span<resource_state_entry const> expected_states);
+
     // internal RAII auto_destroyer API
 private:
     friend struct detail::auto_destroy_proxy;
@@ -574,6 +642,12 @@ private:
 
     void free_all(cc::span<freeable_cached_obj const> freeables);
 
+    /// returns true and writes the state the resource was left in by the most recent submit, if known
+    bool get_last_resource_state(phi::handle::resource res, resource_state_entry& out_entry);
+
+    readback addReadback(buffer const& buf, uint32_t row_size_bytes, uint32_t row_pitch_bytes, uint32_t num_rows);
+    void discardReadbacks(cc::span<readback const> readbacks);
+
     void free_graphics_pso(uint64_t hash);
     void free_compute_pso(uint64_t hash);
     void free_graphics_sv(uint64_t hash);
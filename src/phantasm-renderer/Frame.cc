@@ -1,7 +1,5 @@
 #include "Frame.hh"
 
-#include <algorithm> // std::sort
-
 #include <clean-core/hash_combine.hh>
 #include <clean-core/utility.hh>
 
@@ -12,6 +10,11 @@
 
 #include <phantasm-renderer/Context.hh>
 #include <phantasm-renderer/common/log.hh>
+#include <phantasm-renderer/common/mip_generation.hh>
+#include <phantasm-renderer/common/radix_sort.hh>
+#include <phantasm-renderer/common/rowwise_copy.hh>
+#include <phantasm-renderer/common/texture_file.hh>
+#include <phantasm-renderer/common/texture_upload.hh>
 
 #include "CompiledFrame.hh"
 
@@ -41,18 +44,22 @@ bool is_rowwise_copy_in_bounds(size_t dest_row_stride_bytes, size_t row_size_byt
     return is_in_bounds;
 }
 
-// returns bytes written to dest
-size_t rowwise_copy(std::byte const* __restrict src, std::byte* __restrict dest, size_t dest_row_stride_bytes, size_t row_size_bytes, unsigned num_rows)
+/// readback buffer sizes are 32 bit
+constexpr size_t gc_max_readback_size = uint32_t(-1);
+
+/// readback buffers are rounded up to powers of two so the buffer cache can reuse them across varying sizes
+/// sizes above 2^31 are used as is, rounding up would not fit the buffer size
+uint32_t get_pooled_readback_size(size_t size_bytes)
 {
-    // num_rows is the height in pixels for regular formats, but is lower for block compressed formats
-    for (auto y = 0u; y < num_rows; ++y)
-    {
-        auto const src_offset = y * row_size_bytes;
-        auto const dst_offset = y * dest_row_stride_bytes;
-        std::memcpy(dest + dst_offset, src + src_offset, row_size_bytes);
-    }
+    CC_ASSERT(size_bytes <= gc_max_readback_size && "readback too large");
+
+    if (size_bytes > (size_t(1) << 31))
+        return uint32_t(size_bytes);
 
-    return dest_row_stride_bytes * (num_rows - 1) + row_size_bytes;
+    size_t res = 256;
+    while (res < size_bytes)
+        res *= 2;
+    return uint32_t(res);
 }
 }
 
@@ -70,10 +77,18 @@ raii::Frame& raii::Frame::operator=(raii::Frame&& rhs) noexcept
         internalDestroy();
         mCtx = rhs.mCtx;
         mWriter = cc::move(rhs.mWriter);
+        mDrawStream = cc::move(rhs.mDrawStream);
         mPendingTransitionCommand = rhs.mPendingTransitionCommand;
+        mPendingBatchIndex = rhs.mPendingBatchIndex;
+        mTrackedStates = cc::move(rhs.mTrackedStates);
+        mTrackedStateIndices = cc::move(rhs.mTrackedStateIndices);
+        mAssumedStates = cc::move(rhs.mAssumedStates);
         mFreeables = cc::move(rhs.mFreeables);
+        mDeferredFreeResources = cc::move(rhs.mDeferredFreeResources);
+        mReadbacks = cc::move(rhs.mReadbacks);
         mFramebufferActive = rhs.mFramebufferActive;
         mPresentAfterSubmitRequest = rhs.mPresentAfterSubmitRequest;
+        mRecordingBeginNs = rhs.mRecordingBeginNs;
         rhs.mCtx = nullptr;
     }
 
@@ -94,12 +109,114 @@ void raii::Frame::transition(const texture& res, pr::state target, shader_flags
 
 void raii::Frame::transition(phi::handle::resource raw_resource, pr::state target, shader_flags dependency)
 {
+    tracked_state& ts = getTrackedState(raw_resource);
+    CC_ASSERT(!ts.has_split_transition && "resource used between begin_transition and end_transition");
+
+    if (ts.is_known && ts.current_state == target && ts.current_dependency == dependency)
+    {
+        // already in the target state
+        if (!ts.is_explicit)
+            recordStateAssumption(ts);
+
+        return;
+    }
+
+    if (ts.pending_batch == mPendingBatchIndex)
+    {
+        // already transitioned in the pending batch, collapse into a single transition
+        ts.current_state = target;
+        ts.current_dependency = dependency;
+
+        if (ts.batch_start_known && ts.batch_start_state == target && ts.batch_start_dependency == dependency)
+        {
+            // back to the state from before the batch, remove the transition entirely
+            phi::cmd::transition_resources remaining;
+            for (auto const& ti : mPendingTransitionCommand.transitions)
+            {
+                if (ti.resource != raw_resource)
+                    remaining.transitions.push_back(ti);
+            }
+
+            mPendingTransitionCommand = remaining;
+            ts.pending_batch = 0;
+            ts.is_explicit = ts.batch_start_explicit;
+
+            if (!ts.is_explicit)
+                recordStateAssumption(ts);
+        }
+        else
+        {
+            for (auto& ti : mPendingTransitionCommand.transitions)
+            {
+                if (ti.resource == raw_resource)
+                {
+                    ti.target_state = target;
+                    ti.dependent_shaders = dependency;
+                    break;
+                }
+            }
+        }
+
+        return;
+    }
+
     if (mPendingTransitionCommand.transitions.size() == phi::limits::max_resource_transitions)
         flushPendingTransitions();
 
+    ts.pending_batch = mPendingBatchIndex;
+    ts.batch_start_state = ts.current_state;
+    ts.batch_start_dependency = ts.current_dependency;
+    ts.batch_start_known = ts.is_known;
+    ts.batch_start_explicit = ts.is_explicit;
+
+    ts.current_state = target;
+    ts.current_dependency = dependency;
+    ts.is_known = true;
+    ts.is_explicit = true;
+
     mPendingTransitionCommand.add(raw_resource, target, dependency);
 }
 
+void raii::Frame::begin_transition(const buffer& res, pr::state target, shader_flags dependency)
+{
+    if (res.info.heap != resource_heap::gpu) // mapped buffers are never transitioned
+        return;
+
+    begin_transition(res.res.handle, target, dependency);
+}
+
+void raii::Frame::begin_transition(const texture& res, pr::state target, shader_flags dependency)
+{
+    begin_transition(res.res.handle, target, dependency);
+}
+
+void raii::Frame::begin_transition(phi::handle::resource raw_resource, pr::state target, shader_flags dependency)
+{
+    tracked_state& ts = getTrackedState(raw_resource);
+    CC_ASSERT(!ts.has_split_transition && "begin_transition called twice without end_transition");
+
+    ts.has_split_transition = true;
+    ts.split_target = target;
+    ts.split_dependency = dependency;
+}
+
+void raii::Frame::end_transition(const buffer& res)
+{
+    if (res.info.heap != resource_heap::gpu)
+        return;
+
+    end_transition(res.res.handle);
+}
+
+void raii::Frame::end_transition(phi::handle::resource raw_resource)
+{
+    tracked_state& ts = getTrackedState(raw_resource);
+    CC_ASSERT(ts.has_split_transition && "end_transition without prior begin_transition");
+
+    ts.has_split_transition = false;
+    transition(raw_resource, ts.split_target, ts.split_dependency);
+}
+
 void pr::raii::Frame::barrier_uav(cc::span<phi::handle::resource const> resources)
 {
     phi::cmd::barrier_uav bcmd;
@@ -226,68 +343,236 @@ void raii::Frame::resolve_queries(const query_range& src, const buffer& dest, un
     mWriter.add_command(rcmd);
 }
 
-void raii::Frame::upload_texture_data(cc::span<const std::byte> texture_data, const buffer& upload_buffer, const texture& dest_texture)
+pr::readback raii::Frame::readback_async(const buffer& src, size_t offset, size_t num_bytes)
+{
+    size_t const size = num_bytes > 0 ? num_bytes : src.info.size_bytes - offset;
+    CC_ASSERT(size > 0 && offset + size <= src.info.size_bytes && "readback out of bounds");
+
+    if (size > gc_max_readback_size)
+    {
+        PR_LOG_ERROR("readback of {} bytes exceeds the readback buffer size limit", size);
+        return {};
+    }
+
+    pr::buffer const dest = mCtx->get_readback_buffer(get_pooled_readback_size(size)).disown();
+    copy(src, dest, offset, 0, size);
+
+    readback const res = mCtx->addReadback(dest, uint32_t(size), uint32_t(size), 1);
+    mReadbacks.push_back(res);
+    return res;
+}
+
+pr::readback raii::Frame::readback_async(const texture& src, unsigned mip_index, unsigned array_index)
+{
+    CC_ASSERT(array_index < src.info.depth_or_array_size && "readback array index out of bounds");
+
+    // rows of block compressed formats are rows of blocks, d3d12 pads each row to 256 bytes
+    texture_subresource_upload subres;
+    subres.initialize(src.info, mip_index, array_index, mCtx->get_backend_type() == pr::backend::d3d12);
+
+    size_t const size = size_t(subres.dest_row_stride_bytes) * subres.num_rows;
+    if (size > gc_max_readback_size)
+    {
+        PR_LOG_ERROR("readback of {} bytes exceeds the readback buffer size limit", size);
+        return {};
+    }
+
+    pr::buffer const dest = mCtx->get_readback_buffer(get_pooled_readback_size(size)).disown();
+
+    transition(src, pr::state::copy_src);
+    transition(dest, pr::state::copy_dest);
+    flushPendingTransitions();
+
+    phi::cmd::copy_texture_to_buffer ccmd;
+    ccmd.init(src.res.handle, dest.res.handle, subres.width, subres.height, 0, mip_index, array_index);
+    mWriter.add_command(ccmd);
+
+    readback const res = mCtx->addReadback(dest, subres.row_size_bytes, subres.dest_row_stride_bytes, subres.num_rows);
+    mReadbacks.push_back(res);
+    return res;
+}
+
+void raii::Frame::upload_texture_data(cc::span<const std::byte> texture_data, const buffer& upload_buffer, const texture& dest_texture, unsigned num_mips)
 {
-    CC_ASSERT(dest_texture.info.depth_or_array_size == 1 && "array upload unimplemented");
     CC_ASSERT(upload_buffer.info.heap == resource_heap::upload && "buffer is not an upload buffer");
 
+    // all subresource offsets are known up front, the rows are then copied in one go
+    texture_upload_layout layout;
+    layout.initialize(dest_texture.info, num_mips, mCtx->get_backend_type() == pr::backend::d3d12);
+
+    CC_ASSERT(texture_data.size() >= layout.src_size_bytes && "[Frame::upload_texture_data] source data too small");
+    CC_ASSERT(upload_buffer.info.size_bytes >= layout.dest_size_bytes
+              && "[Frame::upload_texture_data] upload buffer too small, see Context::calculate_texture_upload_size");
+
     transition(dest_texture, pr::state::copy_dest);
     flushPendingTransitions();
 
-    auto const bytes_per_pixel = phi::util::get_format_size_bytes(dest_texture.info.fmt);
-    bool const use_d3d12_per_row_alignment = mCtx->get_backend_type() == pr::backend::d3d12;
+    std::byte* const upload_buffer_map = mCtx->map_buffer(upload_buffer, 0, 0); // no invalidate
+    copy_texture_upload_rows(layout, texture_data.data(), upload_buffer_map);
+    mCtx->unmap_buffer(upload_buffer, 0, int32_t(layout.dest_size_bytes)); // flush written range
 
-    phi::cmd::copy_buffer_to_texture command;
-    command.source = upload_buffer.res.handle;
-    command.destination = dest_texture.res.handle;
-    command.dest_width = unsigned(dest_texture.info.width);
-    command.dest_height = unsigned(dest_texture.info.height);
-    command.dest_mip_index = 0;
+    writeTextureUploadCommands(layout, upload_buffer, dest_texture);
+}
 
-    std::byte* const upload_buffer_map = mCtx->map_buffer(upload_buffer, 0, 0); // no invalidate
-    size_t accumulated_offset_bytes = 0u;
+void raii::Frame::auto_upload_texture_data(cc::span<const std::byte> texture_data, const texture& dest_texture, unsigned num_mips)
+{
+    // automatically create and free_deferred a matching upload buffer
+    pr::buffer upload_buffer = mCtx->make_upload_buffer_for_texture(dest_texture, num_mips, "Frame::auto_upload_texture_data - internal").disown();
 
-    for (auto a = 0u; a < dest_texture.info.depth_or_array_size; ++a)
+    upload_texture_data(texture_data, upload_buffer, dest_texture, num_mips);
+
+    free_deferred_after_submit(upload_buffer);
+}
+
+void raii::Frame::upload_texture_data_converted(
+    cc::span<const std::byte> texture_data, const pixel_conversion& conversion, const buffer& upload_buffer, const texture& dest_texture, unsigned num_mips)
+{
+    CC_ASSERT(upload_buffer.info.heap == resource_heap::upload && "buffer is not an upload buffer");
+
+    pixel_format dest_format;
+    if (!get_pixel_format(dest_texture.info.fmt, dest_format))
     {
-        command.dest_array_index = a;
-        command.source_offset_bytes = accumulated_offset_bytes;
+        PR_LOG_ERROR("Frame::upload_texture_data_converted: texture format {} has no CPU-side equivalent", unsigned(dest_texture.info.fmt));
+        return;
+    }
 
-        mWriter.add_command(command);
+    CC_ASSERT(dest_format == conversion.dest && "[Frame::upload_texture_data_converted] conversion does not match the texture format");
 
-        auto const row_size_bytes = bytes_per_pixel * command.dest_width;
-        auto row_stride_bytes = row_size_bytes;
+    texture_upload_layout layout;
+    layout.initialize(dest_texture.info, num_mips, mCtx->get_backend_type() == pr::backend::d3d12);
 
-        // texture (pixel) rows are 256-byte aligned per row in d3d12
-        if (use_d3d12_per_row_alignment)
-        {
-            row_stride_bytes = phi::util::align_up(row_stride_bytes, 256);
-        }
+    CC_ASSERT(texture_data.size() >= layout.src_size_bytes / get_pixel_format_size_bytes(conversion.dest) * get_pixel_format_size_bytes(conversion.src)
+              && "[Frame::upload_texture_data_converted] source data too small");
+    CC_ASSERT(upload_buffer.info.size_bytes >= layout.dest_size_bytes
+              && "[Frame::upload_texture_data_converted] upload buffer too small, see Context::calculate_texture_upload_size");
 
-        auto const offset_bytes = row_stride_bytes * command.dest_height;
-        accumulated_offset_bytes += offset_bytes;
+    transition(dest_texture, pr::state::copy_dest);
+    flushPendingTransitions();
+
+    // conversion is fused into the row copy, the source data is only read once
+    std::byte* const upload_buffer_map = mCtx->map_buffer(upload_buffer, 0, 0); // no invalidate
+    convert_texture_upload_rows(layout, conversion, texture_data.data(), upload_buffer_map);
+    mCtx->unmap_buffer(upload_buffer, 0, int32_t(layout.dest_size_bytes)); // flush written range
+
+    writeTextureUploadCommands(layout, upload_buffer, dest_texture);
+}
+
+void raii::Frame::auto_upload_texture_data_converted(cc::span<const std::byte> texture_data, const pixel_conversion& conversion, const texture& dest_texture, unsigned num_mips)
+{
+    pr::buffer upload_buffer = mCtx->make_upload_buffer_for_texture(dest_texture, num_mips, "Frame::auto_upload_texture_data_converted - internal").disown();
+
+    upload_texture_data_converted(texture_data, conversion, upload_buffer, dest_texture, num_mips);
+
+    free_deferred_after_submit(upload_buffer);
+}
+
+void raii::Frame::upload_texture_data_compressed(
+    cc::span<const std::byte> texture_data, const buffer& upload_buffer, const texture& dest_texture, bc_quality quality, unsigned num_mips)
+{
+    CC_ASSERT(upload_buffer.info.heap == resource_heap::upload && "buffer is not an upload buffer");
+    CC_ASSERT(is_bc_encodable(dest_texture.info.fmt) && "[Frame::upload_texture_data_compressed] texture format cannot be encoded, use bc1, bc3 or bc7");
 
-        CC_ASSERT(is_rowwise_copy_in_bounds(row_stride_bytes, row_size_bytes, command.dest_height, texture_data.size(),
-                                            upload_buffer.info.size_bytes - command.source_offset_bytes)
-                  && "[Frame::upload_texture_data] source data or destination buffer too small");
+    texture_upload_layout layout;
+    layout.initialize(dest_texture.info, num_mips, mCtx->get_backend_type() == pr::backend::d3d12);
 
-        rowwise_copy(texture_data.data(), upload_buffer_map + command.source_offset_bytes, row_stride_bytes, row_size_bytes, command.dest_height);
+    // RGBA8 source of the uploaded subresources
+    size_t src_size_bytes = 0;
+    for (texture_subresource_upload const& subres : layout.subresources)
+    {
+        tg::isize2 const mip_size = phi::util::get_mip_size({dest_texture.info.width, dest_texture.info.height}, int(subres.mip_index));
+        src_size_bytes += size_t(mip_size.width) * mip_size.height * 4;
     }
 
-    mCtx->unmap_buffer(upload_buffer); // full flush
+    CC_ASSERT(texture_data.size() >= src_size_bytes && "[Frame::upload_texture_data_compressed] source data too small");
+    CC_ASSERT(upload_buffer.info.size_bytes >= layout.dest_size_bytes
+              && "[Frame::upload_texture_data_compressed] upload buffer too small, see Context::calculate_texture_upload_size");
+
+    transition(dest_texture, pr::state::copy_dest);
+    flushPendingTransitions();
+
+    std::byte* const upload_buffer_map = mCtx->map_buffer(upload_buffer, 0, 0); // no invalidate
+    compress_texture_upload_rows(layout, dest_texture.info, quality, texture_data.data(), upload_buffer_map);
+    mCtx->unmap_buffer(upload_buffer, 0, int32_t(layout.dest_size_bytes)); // flush written range
+
+    writeTextureUploadCommands(layout, upload_buffer, dest_texture);
 }
 
-void raii::Frame::auto_upload_texture_data(cc::span<const std::byte> texture_data, const texture& dest_texture)
+void raii::Frame::auto_upload_texture_data_compressed(cc::span<const std::byte> texture_data, const texture& dest_texture, bc_quality quality, unsigned num_mips)
 {
-    CC_ASSERT(dest_texture.info.depth_or_array_size == 1 && "array upload unimplemented");
+    pr::buffer upload_buffer = mCtx->make_upload_buffer_for_texture(dest_texture, num_mips, "Frame::auto_upload_texture_data_compressed - internal").disown();
 
-    // automatically create and free_deferred a matching upload buffer
-    pr::buffer upload_buffer = mCtx->make_upload_buffer_for_texture(dest_texture, 1, "Frame::auto_upload_texture_data - internal").disown();
+    upload_texture_data_compressed(texture_data, upload_buffer, dest_texture, quality, num_mips);
+
+    free_deferred_after_submit(upload_buffer);
+}
+
+void raii::Frame::upload_texture_data_with_mips(cc::span<const std::byte> texture_data,
+                                                const buffer& upload_buffer,
+                                                const texture& dest_texture,
+                                                const mip_generation_config& config)
+{
+    CC_ASSERT(upload_buffer.info.heap == resource_heap::upload && "buffer is not an upload buffer");
+
+    pixel_format fmt;
+    if (!get_pixel_format(dest_texture.info.fmt, fmt))
+    {
+        PR_LOG_ERROR("Frame::upload_texture_data_with_mips: texture format {} cannot be filtered on the CPU", unsigned(dest_texture.info.fmt));
+        return;
+    }
+
+    // sRGB textures are filtered in linear space
+    mip_generation_config format_config = config;
+    format_config.is_srgb = is_srgb_format(dest_texture.info.fmt);
 
-    upload_texture_data(texture_data, upload_buffer, dest_texture);
+    texture_upload_layout layout;
+    layout.initialize(dest_texture.info, 0, mCtx->get_backend_type() == pr::backend::d3d12);
+
+    // texture data only contains mip 0 of each slice
+    size_t const mip0_size_bytes = size_t(layout.subresources[0].row_size_bytes) * layout.subresources[0].num_rows;
+    CC_ASSERT(texture_data.size() >= mip0_size_bytes * dest_texture.info.depth_or_array_size && "[Frame::upload_texture_data_with_mips] source data too small");
+    CC_ASSERT(upload_buffer.info.size_bytes >= layout.dest_size_bytes
+              && "[Frame::upload_texture_data_with_mips] upload buffer too small, see Context::calculate_texture_upload_size");
+
+    transition(dest_texture, pr::state::copy_dest);
+    flushPendingTransitions();
+
+    std::byte* const upload_buffer_map = mCtx->map_buffer(upload_buffer, 0, 0); // no invalidate
+
+    for (auto a = 0u; a < dest_texture.info.depth_or_array_size; ++a)
+    {
+        std::byte const* const mip0 = texture_data.data() + mip0_size_bytes * a;
+        texture_subresource_upload const& subres = layout.subresources[size_t(a) * layout.num_mips];
+
+        rowwise_copy_streaming(mip0, upload_buffer_map + subres.dest_offset_bytes, subres.dest_row_stride_bytes, subres.row_size_bytes, subres.num_rows);
+        generate_texture_upload_mips(layout, a, fmt, mip0, format_config, upload_buffer_map);
+    }
+
+    mCtx->unmap_buffer(upload_buffer, 0, int32_t(layout.dest_size_bytes)); // flush written range
+
+    writeTextureUploadCommands(layout, upload_buffer, dest_texture);
+}
+
+void raii::Frame::auto_upload_texture_data_with_mips(cc::span<const std::byte> texture_data, const texture& dest_texture, const mip_generation_config& config)
+{
+    pr::buffer upload_buffer = mCtx->make_upload_buffer_for_texture(dest_texture, 0, "Frame::auto_upload_texture_data_with_mips - internal").disown();
+
+    upload_texture_data_with_mips(texture_data, upload_buffer, dest_texture, config);
 
     free_deferred_after_submit(upload_buffer);
 }
 
+void raii::Frame::upload_texture_file(const texture_file_upload& upload)
+{
+    CC_ASSERT(upload.upload_buffer.info.heap == resource_heap::upload && "buffer is not an upload buffer");
+
+    transition(upload.dest_texture, pr::state::copy_dest);
+    flushPendingTransitions();
+
+    writeTextureUploadCommands(upload.layout, upload.upload_buffer, upload.dest_texture);
+
+    free_deferred_after_submit(upload.upload_buffer);
+}
+
 void raii::Frame::auto_upload_buffer_data(cc::span<std::byte const> data, buffer const& dest_buffer)
 {
     pr::buffer upload_buffer = mCtx->make_upload_buffer(data.size(), 0u, "Frame::auto_upload_buffer_data - internal").disown();
@@ -308,22 +593,25 @@ size_t raii::Frame::upload_texture_subresource(cc::span<const std::byte> texture
     CC_ASSERT(upload_buffer.info.heap == resource_heap::upload && "buffer is not an upload buffer");
     flushPendingTransitions();
 
-    tg::isize2 const mip_resolution = phi::util::get_mip_size({dest_texture.info.width, dest_texture.info.height}, dest_subres_index);
+    bool const use_d3d12_per_row_alignment = mCtx->get_backend_type() == pr::backend::d3d12;
+
+    // copy extent in whole blocks for block compressed formats
+    texture_subresource_upload subres;
+    subres.initialize(dest_texture.info, dest_subres_index, 0, use_d3d12_per_row_alignment);
 
     phi::cmd::copy_buffer_to_texture command;
     command.source = upload_buffer.res.handle;
     command.destination = dest_texture.res.handle;
     command.source_offset_bytes = buffer_offset_bytes;
-    command.dest_width = unsigned(mip_resolution.width);
-    command.dest_height = unsigned(mip_resolution.height);
+    command.dest_width = subres.width;
+    command.dest_height = subres.height;
     command.dest_mip_index = dest_subres_index;
     command.dest_array_index = 0;
     mWriter.add_command(command);
 
-    bool const use_d3d12_per_row_alignment = mCtx->get_backend_type() == pr::backend::d3d12;
     auto row_stride_bytes = row_size_bytes;
 
-    // texture (pixel) rows are 256-byte aligned per row in d3d12
+    // texture (pixel or block) rows are 256-byte aligned per row in d3d12
     if (use_d3d12_per_row_alignment)
     {
         row_stride_bytes = phi::util::align_up(row_stride_bytes, 256);
@@ -337,7 +625,7 @@ size_t raii::Frame::upload_texture_subresource(cc::span<const std::byte> texture
                                         upload_buffer.info.size_bytes - unsigned(command.source_offset_bytes))
               && "[Frame::upload_texture_subresource] source data or destination buffer too small");
 
-    auto const last_offset = rowwise_copy(texture_data.data(), upload_buffer_map + command.source_offset_bytes, row_stride_bytes, row_size_bytes, num_rows);
+    auto const last_offset = rowwise_copy_streaming(texture_data.data(), upload_buffer_map + command.source_offset_bytes, row_stride_bytes, row_size_bytes, num_rows);
 
     mCtx->unmap_buffer(upload_buffer, buffer_offset_bytes, buffer_offset_bytes + last_offset); // flush exact range
 
@@ -352,6 +640,11 @@ void raii::Frame::transition_slices(cc::span<const phi::cmd::transition_image_sl
     phi::cmd::transition_image_slices tcmd;
     for (auto const& ti : slices)
     {
+        // the state of the entire resource is no longer known
+        tracked_state& ts = getTrackedState(ti.resource);
+        ts.is_known = false;
+        ts.is_explicit = true;
+
         if (tcmd.transitions.full())
         {
             mWriter.add_command(tcmd);
@@ -393,6 +686,81 @@ void raii::Frame::flushPendingTransitions()
         CC_ASSERT(!mFramebufferActive && "No transitions allowed during active raii::Framebuffers");
         mWriter.add_command(mPendingTransitionCommand);
         mPendingTransitionCommand.transitions.clear();
+        ++mPendingBatchIndex;
+    }
+}
+
+raii::Frame::tracked_state& raii::Frame::getTrackedState(phi::handle::resource res)
+{
+    auto const key = uint64_t(uint32_t(res._value));
+    if (mTrackedStateIndices.contains_key(key))
+        return mTrackedStates[mTrackedStateIndices[key]];
+
+    // first use in this frame, seed from the state the Context last knew
+    mTrackedStateIndices[key] = uint32_t(mTrackedStates.size());
+    tracked_state& new_ts = mTrackedStates.emplace_back();
+    new_ts.resource = res;
+
+    resource_state_entry seed;
+    if (mCtx->get_last_resource_state(res, seed))
+    {
+        new_ts.current_state = seed.state;
+        new_ts.current_dependency = seed.dependency;
+        new_ts.is_known = true;
+    }
+
+    return new_ts;
+}
+
+void raii::Frame::recordStateAssumption(tracked_state& ts)
+{
+    // a transition was dropped based on a seeded state, which must still hold once this frame is submitted
+    if (!ts.is_assumption_recorded)
+    {
+        mAssumedStates.push_back({ts.resource, ts.current_state, ts.current_dependency});
+        ts.is_assumption_recorded = true;
+    }
+}
+
+void raii::Frame::onRawTransitions(const phi::cmd::transition_resources& tcmd)
+{
+    for (auto const& ti : tcmd.transitions)
+    {
+        tracked_state& ts = getTrackedState(ti.resource);
+        ts.current_state = ti.target_state;
+        ts.current_dependency = ti.dependent_shaders;
+        ts.is_known = true;
+        ts.is_explicit = true;
+    }
+}
+
+void raii::Frame::collectFinalStates(cc::alloc_vector<resource_state_entry>& out_states) const
+{
+    out_states.reset_reserve(mWriter.allocator(), mTrackedStates.size());
+    for (tracked_state const& ts : mTrackedStates)
+    {
+        if (!ts.is_explicit)
+            continue;
+
+        // resources in an unknown state are untracked by the Context
+        out_states.push_back({ts.resource, ts.is_known ? ts.current_state : state::unknown, ts.current_dependency});
+    }
+}
+
+void raii::Frame::writeTextureUploadCommands(const texture_upload_layout& layout, const buffer& upload_buffer, const texture& dest_texture)
+{
+    phi::cmd::copy_buffer_to_texture command;
+    command.source = upload_buffer.res.handle;
+    command.destination = dest_texture.res.handle;
+
+    for (texture_subresource_upload const& subres : layout.subresources)
+    {
+        command.source_offset_bytes = subres.dest_offset_bytes;
+        command.dest_width = subres.width;
+        command.dest_height = subres.height;
+        command.dest_mip_index = subres.mip_index;
+        command.dest_array_index = subres.array_index;
+        mWriter.add_command(command);
     }
 }
 
@@ -431,6 +799,7 @@ void raii::Frame::internalDestroy()
     if (mCtx != nullptr)
     {
         mCtx->free_all(mFreeables); // usually this is empty from a move during Context::compile(Frame&)
+        mCtx->discardReadbacks(mReadbacks);
         mCtx = nullptr;
     }
 }
@@ -493,18 +862,85 @@ void raii::Frame::framebufferOnJoin(const raii::Framebuffer&)
     phi::cmd::end_render_pass ecmd;
     mWriter.add_command(ecmd);
     mFramebufferActive = false;
+
+    // Context::compile can begin a new command list here
+    mDrawStream.add_split_point(mWriter.size());
 }
 
 void raii::Frame::framebufferOnSortByPSO(unsigned num_drawcalls)
 {
-    // sort previously recorded draw commands by PSO, directly in the command buffer
-    // requires strictly NOTHING but drawcalls recorded, but will catch any misuse
-    std::byte* const drawcall_start = mWriter.buffer_head() - sizeof(phi::cmd::draw) * num_drawcalls;
-    cc::span<phi::cmd::draw> const drawcalls_as_span = {reinterpret_cast<phi::cmd::draw*>(drawcall_start), num_drawcalls};
-    std::sort(drawcalls_as_span.begin(), drawcalls_as_span.end(), [](phi::cmd::draw const& a, phi::cmd::draw const& b) {
-        CC_ASSERT(a.s_internal_type == phi::cmd::detail::cmd_type::draw && "draw calls interleaved or different amount recorded");
-        return unsigned(a.pipeline_state._value) < unsigned(b.pipeline_state._value);
-    });
+    cc::alloc_vector<phi::cmd::draw> drawcalls;
+    decodeRecentDrawcalls(num_drawcalls, drawcalls);
+
+    cc::alloc_vector<uint64_t> sort_keys;
+    sort_keys.reset_reserve(mWriter.allocator(), num_drawcalls);
+    for (auto i = drawcalls.size() - num_drawcalls; i < drawcalls.size(); ++i)
+        sort_keys.push_back(uint64_t(unsigned(drawcalls[i].pipeline_state._value)));
+
+    sortRecentDrawcalls(drawcalls, sort_keys);
+}
+
+void raii::Frame::framebufferOnSortDrawcalls(cc::span<uint64_t const> sort_keys)
+{
+    cc::alloc_vector<phi::cmd::draw> drawcalls;
+    decodeRecentDrawcalls(unsigned(sort_keys.size()), drawcalls);
+    sortRecentDrawcalls(drawcalls, sort_keys);
+}
+
+void raii::Frame::decodeRecentDrawcalls(unsigned num_drawcalls, cc::alloc_vector<phi::cmd::draw>& out_drawcalls) const
+{
+    // requires strictly NOTHING but drawcalls recorded, ie. all of them are in the open run of the draw stream
+    CC_ASSERT(mDrawStream.get_num_draws_open_run(mWriter.size()) >= num_drawcalls && "draw calls interleaved or different amount recorded");
+    mDrawStream.decode_open_run(out_drawcalls);
+}
+
+void raii::Frame::sortRecentDrawcalls(cc::alloc_vector<phi::cmd::draw>& drawcalls, cc::span<uint64_t const> sort_keys)
+{
+    // drawcalls contains the entire open run, the last #sort_keys of them are sorted
+    auto const num_drawcalls = unsigned(sort_keys.size());
+    phi::cmd::draw* const first_sorted = drawcalls.data() + (drawcalls.size() - num_drawcalls);
+
+    // sort indices instead of the (large) commands themselves
+    cc::alloc_vector<uint32_t> indices;
+    cc::alloc_vector<uint32_t> scratch;
+    indices.reset_reserve(mWriter.allocator(), num_drawcalls);
+    scratch.reset_reserve(mWriter.allocator(), num_drawcalls);
+    for (auto i = 0u; i < num_drawcalls; ++i)
+    {
+        indices.push_back(0);
+        scratch.push_back(0);
+    }
+
+    radix_sort_indices(sort_keys, indices, scratch);
+
+    // apply the permutation in place by following its cycles, moving every command at most once
+    for (auto i = 0u; i < num_drawcalls; ++i)
+    {
+        if (indices[i] == i)
+            continue;
+
+        phi::cmd::draw temp;
+        std::memcpy(&temp, first_sorted + i, sizeof(phi::cmd::draw));
+
+        uint32_t j = i;
+        while (true)
+        {
+            uint32_t const src = indices[j];
+            indices[j] = j; // mark as placed
+
+            if (src == i)
+            {
+                std::memcpy(first_sorted + j, &temp, sizeof(phi::cmd::draw));
+                break;
+            }
+
+            std::memcpy(first_sorted + j, first_sorted + src, sizeof(phi::cmd::draw));
+            j = src;
+        }
+    }
+
+    // re-encode, sorted drawcalls usually delta-compress better
+    mDrawStream.rewrite_open_run(drawcalls);
 }
 
 phi::handle::pipeline_state raii::Frame::framebufferAcquireGraphicsPSO(const graphics_pass_info& gp, const framebuffer_info& fb, int fb_inferred_num_samples)
@@ -517,7 +953,7 @@ phi::handle::pipeline_state raii::Frame::framebufferAcquireGraphicsPSO(const gra
     return res;
 }
 
-void raii::Frame::passOnDraw(const phi::cmd::draw& dcmd) { mWriter.add_command(dcmd); }
+void raii::Frame::passOnDraw(const phi::cmd::draw& dcmd) { mDrawStream.add(dcmd, mWriter.size()); }
 
 void raii::Frame::passOnDispatch(const phi::cmd::dispatch& dcmd)
 {
@@ -541,4 +977,17 @@ phi::handle::shader_view raii::Frame::passAcquireComputeShaderView(const argumen
     return res;
 }
 
-void raii::Frame::finalize() { flushPendingTransitions(); }
+void raii::Frame::finalize()
+{
+    // complete split transitions that were never ended
+    for (auto i = 0u; i < mTrackedStates.size(); ++i)
+    {
+        if (mTrackedStates[i].has_split_transition)
+        {
+            CC_ASSERT(false && "begin_transition without matching end_transition");
+            end_transition(mTrackedStates[i].resource);
+        }
+    }
+
+    flushPendingTransitions();
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <type_traits>
+
 #include <clean-core/alloc_vector.hh>
 #include <clean-core/defer.hh>
+#include <clean-core/map.hh>
 #include <clean-core/span.hh>
 
 #include <typed-geometry/types/size.hh>
@@ -9,7 +12,12 @@
 #include <phantasm-hardware-interface/commands.hh>
 
 #include <phantasm-renderer/common/api.hh>
+#include <phantasm-renderer/common/bc_encode.hh>
+#include <phantasm-renderer/common/draw_delta_stream.hh>
 #include <phantasm-renderer/common/growing_writer.hh>
+#include <phantasm-renderer/common/mip_generation.hh>
+#include <phantasm-renderer/common/state_info.hh>
+#include <phantasm-renderer/common/trace.hh>
 #include <phantasm-renderer/enums.hh>
 #include <phantasm-renderer/fwd.hh>
 
@@ -64,11 +72,24 @@ public:
 
     //
     // transitions and present
+    //   transitions are state tracked: transitions into the current state are dropped,
+    //   repeated transitions of a resource before the next command collapse into one
 
     void transition(buffer const& res, state target, shader_flags dependency = {});
     void transition(texture const& res, state target, shader_flags dependency = {});
     void transition(phi::handle::resource raw_resource, state target, shader_flags dependency = {});
 
+    /// begin a split transition, the resource must not be used until the matching end_transition
+    /// phi exposes no split barriers, the transition is deferred to end_transition and batched with the transitions before it
+    void begin_transition(buffer const& res, state target, shader_flags dependency = {});
+    void begin_transition(texture const& res, state target, shader_flags dependency = {});
+    void begin_transition(phi::handle::resource raw_resource, state target, shader_flags dependency = {});
+
+    /// end a split transition started with begin_transition
+    void end_transition(buffer const& res);
+    void end_transition(texture const& res) { end_transition(res.res.handle); }
+    void end_transition(phi::handle::resource raw_resource);
+
     void barrier_uav(cc::span<phi::handle::resource const> resources);
 
     /// transition the backbuffer to present state and trigger a Context::present after this frame is submitted
@@ -108,6 +129,18 @@ public:
     /// resolve one or more queries in a range and write their contents to a buffer
     void resolve_queries(query_range const& src, buffer const& dest, unsigned first_query, unsigned num_queries, unsigned dest_offset_bytes = 0);
 
+    /// copy a buffer range to a pooled readback buffer, its data is available once this frame completes on the GPU
+    /// poll with Context::is_readback_ready or set a callback with Context::set_readback_callback
+    /// num_bytes 0: until the end of the buffer
+    /// returns an invalid readback if the range exceeds 4 GiB, the size limit of readback buffers
+    [[nodiscard]] readback readback_async(buffer const& src, size_t offset = 0, size_t num_bytes = 0);
+
+    /// copy a texture subresource to a pooled readback buffer, its data is available once this frame completes on the GPU
+    /// rows are tightly packed in the data, the D3D12 row pitch padding is removed
+    /// rows of block compressed formats are rows of 4x4 blocks
+    /// returns an invalid readback if the subresource exceeds 4 GiB, the size limit of readback buffers
+    [[nodiscard]] readback readback_async(texture const& src, unsigned mip_index = 0, unsigned array_index = 0);
+
     /// begin a debug label region (visible in renderdoc, nsight, gpa, pix, etc.)
     void begin_debug_label(char const* label) { write_raw_cmd(phi::cmd::begin_debug_label{label}); }
     void end_debug_label() { write_raw_cmd(phi::cmd::end_debug_label{}); }
@@ -123,14 +156,65 @@ public:
     // specials
 
     /// uploads texture data correctly to a destination texture, respecting rowwise alignment
-    /// transition cmd + copy_buf_to_tex cmd
+    /// uploads the first num_mips mip levels (0: all) of every array slice or cube face
+    /// texture data is tightly packed, ordered by array slice, then mip level
+    /// block compressed formats are rows of 4x4 blocks, with partial blocks at the edges of small mips stored whole
+    /// transition cmd + one copy_buf_to_tex cmd per subresource, rows of large textures are copied on multiple threads
     /// expects upload buffer with sufficient size (see Context::calculate_texture_upload_size)
-    void upload_texture_data(cc::span<std::byte const> texture_data, buffer const& upload_buffer, texture const& dest_texture);
+    void upload_texture_data(cc::span<std::byte const> texture_data, buffer const& upload_buffer, texture const& dest_texture, unsigned num_mips = 1);
 
     /// creates a suitable upload buffer and calls upload_texture_data
     /// (deferred freeing it afterwards)
-    void auto_upload_texture_data(cc::span<std::byte const> texture_data, texture const& dest_texture);
+    void auto_upload_texture_data(cc::span<std::byte const> texture_data, texture const& dest_texture, unsigned num_mips = 1);
+
+    /// same as upload_texture_data, but texture data is in the conversion's source format and converted while writing the upload buffer
+    /// conversion.dest must be the CPU-side equivalent of the texture format (see pr::get_pixel_format)
+    void upload_texture_data_converted(cc::span<std::byte const> texture_data,
+                                       pixel_conversion const& conversion,
+                                       buffer const& upload_buffer,
+                                       texture const& dest_texture,
+                                       unsigned num_mips = 1);
+
+    /// creates a suitable upload buffer and calls upload_texture_data_converted
+    /// (deferred freeing it afterwards)
+    void auto_upload_texture_data_converted(cc::span<std::byte const> texture_data, pixel_conversion const& conversion, texture const& dest_texture, unsigned num_mips = 1);
+
+    /// same as upload_texture_data, but texture data is RGBA8 pixels (of all uploaded mips) and block compressed while writing the upload buffer
+    /// the texture format must be bc1, bc3 or bc7 (see pr::is_bc_encodable), blocks are encoded on multiple threads
+    void upload_texture_data_compressed(cc::span<std::byte const> texture_data,
+                                        buffer const& upload_buffer,
+                                        texture const& dest_texture,
+                                        bc_quality quality = bc_quality::normal,
+                                        unsigned num_mips = 1);
+
+    /// creates a suitable upload buffer and calls upload_texture_data_compressed
+    /// (deferred freeing it afterwards)
+    void auto_upload_texture_data_compressed(cc::span<std::byte const> texture_data,
+                                             texture const& dest_texture,
+                                             bc_quality quality = bc_quality::normal,
+                                             unsigned num_mips = 1);
+
+    /// uploads mip 0 of every array slice or cube face and generates all further mips of the texture on the CPU
+    /// texture data is mip 0 of each array slice, tightly packed, in the CPU-side equivalent of the texture format (see pr::get_pixel_format)
+    /// levels are filtered and encoded directly into the upload buffer, large levels on multiple threads
+    /// textures with an sRGB format are filtered in linear space, config.is_srgb is ignored
+    /// expects upload buffer with sufficient size for the full mip chain (see Context::calculate_texture_upload_size, num_mips 0)
+    void upload_texture_data_with_mips(cc::span<std::byte const> texture_data,
+                                       buffer const& upload_buffer,
+                                       texture const& dest_texture,
+                                       mip_generation_config const& config = {});
+
+    /// creates a suitable upload buffer and calls upload_texture_data_with_mips
+    /// (deferred freeing it afterwards)
+    void auto_upload_texture_data_with_mips(cc::span<std::byte const> texture_data, texture const& dest_texture, mip_generation_config const& config = {});
 
+    /// records the copies of a texture file read by Context::load_texture_file, Context::load_texture_container or AsyncFileReader
+    /// one copy_buf_to_tex cmd per subresource, no CPU-side copying, the upload buffer is freed after submit
+    void upload_texture_file(texture_file_upload const& upload);
+
+    /// uploads a single mip level of the first array slice, texture data is tightly packed rows of row_size_bytes
+    /// for block compressed formats, rows are rows of 4x4 blocks
+    /// returns the amount of bytes written to the upload buffer, starting at buffer_offset_bytes
     size_t upload_texture_subresource(cc::span<std::byte const> texture_data,
                                       unsigned row_size_bytes,
                                       buffer const& upload_buffer,
@@ -157,11 +241,15 @@ public:
     // raw phi commands
 
     /// write a raw phi command
+    /// raw transition_resources commands are state tracked
     template <class CmdT>
     void write_raw_cmd(CmdT const& cmd)
     {
         flushPendingTransitions();
         mWriter.add_command(cmd);
+
+        if constexpr (std::is_same_v<CmdT, phi::cmd::transition_resources>)
+            onRawTransitions(cmd);
     }
 
     /// get a pointer to a buffer in order to write raw commands, must be written to immediately (before other writes)
@@ -171,12 +259,12 @@ public:
         return mWriter.write_raw_bytes(num_bytes);
     }
 
-    /// write multiple resource slice transitions - no state tracking
+    /// write multiple resource slice transitions - no state tracking, the involved resources are in an unknown state afterwards
     void transition_slices(cc::span<phi::cmd::transition_image_slices::slice_transition_info const> slices);
 
     Context& context() { return *mCtx; }
 
-    bool is_empty() const { return mWriter.is_empty(); }
+    bool is_empty() const { return mWriter.is_empty() && mDrawStream.is_empty(); }
 
 public:
     // redirect intuitive misuses
@@ -203,11 +291,18 @@ public:
     Frame(Frame&& rhs) noexcept
       : mCtx(rhs.mCtx),
         mWriter(cc::move(rhs.mWriter)),
+        mDrawStream(cc::move(rhs.mDrawStream)),
         mPendingTransitionCommand(rhs.mPendingTransitionCommand),
-        mFreeables(cc::move(rhs.mFramebufferActive)),
+        mPendingBatchIndex(rhs.mPendingBatchIndex),
+        mTrackedStates(cc::move(rhs.mTrackedStates)),
+        mTrackedStateIndices(cc::move(rhs.mTrackedStateIndices)),
+        mAssumedStates(cc::move(rhs.mAssumedStates)),
+        mFreeables(cc::move(rhs.mFreeables)),
         mDeferredFreeResources(cc::move(rhs.mDeferredFreeResources)),
+        mReadbacks(cc::move(rhs.mReadbacks)),
         mFramebufferActive(rhs.mFramebufferActive),
-        mPresentAfterSubmitRequest(rhs.mPresentAfterSubmitRequest)
+        mPresentAfterSubmitRequest(rhs.mPresentAfterSubmitRequest),
+        mRecordingBeginNs(rhs.mRecordingBeginNs)
     {
         rhs.mCtx = nullptr;
     }
@@ -223,7 +318,38 @@ private:
 
     void flushPendingTransitions();
 
+    // resource state tracking
+private:
+    struct tracked_state
+    {
+        phi::handle::resource resource;
+        state current_state = state::unknown;
+        shader_flags current_dependency = {};
+        bool is_known = false;    ///< false if the state was never known or is lost (raw slice transitions)
+        bool is_explicit = false; ///< true if the state was established by this frame, false if seeded from the Context
+        bool is_assumption_recorded = false;
+
+        // snapshot from before the pending transition batch
+        uint32_t pending_batch = 0; ///< index of the batch this resource has a pending transition in (0: none)
+        state batch_start_state = state::unknown;
+        shader_flags batch_start_dependency = {};
+        bool batch_start_known = false;
+        bool batch_start_explicit = false;
+
+        // split transition between begin_transition and end_transition
+        bool has_split_transition = false;
+        state split_target = state::unknown;
+        shader_flags split_dependency = {};
+    };
+
+    tracked_state& getTrackedState(phi::handle::resource res);
+    void recordStateAssumption(tracked_state& ts);
+
+    void onRawTransitions(phi::cmd::transition_resources const& tcmd);
+    void collectFinalStates(cc::alloc_vector<resource_state_entry>& out_states) const;
+
     void copyTextureInternal(phi::handle::resource src, phi::handle::resource dest, int w, int h, unsigned mip_index, unsigned first_array_index, unsigned num_array_slices);
+    void writeTextureUploadCommands(texture_upload_layout const& layout, buffer const& upload_buffer, texture const& dest_texture);
     void resolveTextureInternal(phi::handle::resource src, phi::handle::resource dest, int w, int h);
 
     phi::handle::pipeline_state acquireComputePSO(compute_pass_info const& cp);
@@ -240,6 +366,10 @@ private:
     friend class Framebuffer;
     void framebufferOnJoin(Framebuffer const&);
     void framebufferOnSortByPSO(unsigned num_drawcalls);
+    void framebufferOnSortDrawcalls(cc::span<uint64_t const> sort_keys);
+
+    void decodeRecentDrawcalls(unsigned num_drawcalls, cc::alloc_vector<phi::cmd::draw>& out_drawcalls) const;
+    void sortRecentDrawcalls(cc::alloc_vector<phi::cmd::draw>& drawcalls, cc::span<uint64_t const> sort_keys);
 
     phi::handle::pipeline_state framebufferAcquireGraphicsPSO(pr::graphics_pass_info const& gp, pr::framebuffer_info const& fb, int fb_inferred_num_samples);
 
@@ -258,22 +388,30 @@ private:
 private:
     friend Context;
     explicit Frame(Context* ctx, size_t size, cc::allocator* alloc)
-      : mCtx(ctx), mWriter(size, alloc), mFreeables(alloc), mDeferredFreeResources(alloc)
+      : mCtx(ctx), mWriter(size, alloc), mDrawStream(size, alloc), mTrackedStates(alloc), mAssumedStates(alloc), mFreeables(alloc), mDeferredFreeResources(alloc),
+        mReadbacks(alloc), mRecordingBeginNs(trace::begin_span())
     {
     }
 
     void finalize();
-    std::byte* getMemory() const { return mWriter.buffer(); }
-    size_t getSize() const { return mWriter.size(); }
+    growing_writer const& getWriter() const { return mWriter; }
+    draw_delta_stream const& getDrawStream() const { return mDrawStream; }
 
     // members
 private:
     Context* mCtx = nullptr;
     growing_writer mWriter;
+    draw_delta_stream mDrawStream; ///< drawcalls are kept out of mWriter and spliced in during Context::compile
     phi::cmd::transition_resources mPendingTransitionCommand;
+    uint32_t mPendingBatchIndex = 1;
+    cc::alloc_vector<tracked_state> mTrackedStates;          ///< states of all resources transitioned in this frame
+    cc::map<uint64_t, uint32_t> mTrackedStateIndices;        ///< index into mTrackedStates per resource handle
+    cc::alloc_vector<resource_state_entry> mAssumedStates; ///< seeded states that transitions were dropped based on, validated on submit
     cc::alloc_vector<freeable_cached_obj> mFreeables;
     cc::alloc_vector<phi::handle::resource> mDeferredFreeResources;
+    cc::alloc_vector<readback> mReadbacks; ///< completing once this frame is submitted
     bool mFramebufferActive = false;
     phi::handle::swapchain mPresentAfterSubmitRequest = phi::handle::null_swapchain;
+    uint64_t mRecordingBeginNs = 0; ///< trace span from creation to Context::compile, 0 if not traced
 };
 }
@@ -0,0 +1,204 @@
+#include "FrameReplayer.hh"
+
+#include <cstring>
+
+#include <clean-core/map.hh>
+#include <clean-core/utility.hh>
+
+#include <phantasm-hardware-interface/commands.hh>
+
+#include <phantasm-renderer/Context.hh>
+#include <phantasm-renderer/Frame.hh>
+#include <phantasm-renderer/common/log.hh>
+#include <phantasm-renderer/detail/frame_capture.hh>
+#include <phantasm-renderer/pass_info.hh>
+
+namespace
+{
+/// maps handles of the capturing Context to the recreated ones
+struct handle_remapper
+{
+    cc::map<uint64_t, uint64_t> resources;
+    cc::map<uint64_t, uint64_t> shader_views;
+    cc::map<uint64_t, uint64_t> psos;
+    cc::map<uint64_t, uint64_t> query_ranges;
+    bool is_complete = true;
+
+    template <class H>
+    void remap(cc::map<uint64_t, uint64_t>& map, H& h)
+    {
+        // recreated handles are stored +1, 0 is an unknown handle
+        uint64_t const mapped = map[uint64_t(h._value)];
+        if (mapped == 0)
+        {
+            is_complete = false;
+            return;
+        }
+
+        h._value = decltype(h._value)(mapped - 1);
+    }
+
+    template <class H>
+    static void add(cc::map<uint64_t, uint64_t>& map, uint64_t captured, H created)
+    {
+        map[captured] = uint64_t(created._value) + 1;
+    }
+
+    void operator()(phi::handle::resource& h) { remap(resources, h); }
+    void operator()(phi::handle::shader_view& h) { remap(shader_views, h); }
+    void operator()(phi::handle::pipeline_state& h) { remap(psos, h); }
+    void operator()(phi::handle::query_range& h) { remap(query_ranges, h); }
+};
+}
+
+bool pr::FrameReplayer::load(const char* path)
+{
+    unload();
+
+    frame_capture_data data;
+    if (!data.read(path))
+    {
+        PR_LOG_WARN("failed to load frame capture {}", path);
+        return false;
+    }
+
+    handle_remapper remapper;
+
+    mResources.reserve(data.resources.size());
+    for (frame_capture_data::resource const& res : data.resources)
+    {
+        raw_resource const created = mCtx->make_untyped_unlocked(res.info);
+        mResources.push_back(created);
+        handle_remapper::add(remapper.resources, res.handle, created.handle);
+
+        if (!res.contents.empty())
+            mCtx->write_to_buffer_raw(buffer{created, res.info.info_buffer}, res.contents);
+    }
+
+    mShaderViews.reserve(data.shader_views.size());
+    for (frame_capture_data::shader_view& sv : data.shader_views)
+    {
+        for (phi::resource_view& rv : sv.srvs)
+            remapper(rv.resource);
+        for (phi::resource_view& rv : sv.uavs)
+            remapper(rv.resource);
+
+        prebuilt_argument const created = sv.is_compute ? mCtx->make_compute_argument(sv.srvs, sv.uavs, sv.samplers).disown()
+                                                        : mCtx->make_graphics_argument(sv.srvs, sv.uavs, sv.samplers).disown();
+        mShaderViews.push_back(created._sv);
+        handle_remapper::add(remapper.shader_views, sv.handle, created._sv);
+    }
+
+    mPSOs.reserve(data.psos.size());
+    for (frame_capture_data::pipeline_state const& pso : data.psos)
+    {
+        phi::handle::pipeline_state created;
+
+        if (pso.is_compute)
+        {
+            compute_pass_info cp;
+            cp._storage.get() = pso.compute;
+            cp._shader = phi::arg::shader_binary{pso.shader_binaries[0].data(), pso.shader_binaries[0].size()};
+            created = mCtx->make_pipeline_state(cp).disown()._handle;
+        }
+        else
+        {
+            graphics_pass_info gp;
+            gp._storage.get() = pso.graphics;
+            for (auto i = 0u; i < pso.shader_binaries.size(); ++i)
+                gp._shaders.push_back(phi::arg::graphics_shader{{pso.shader_binaries[i].data(), pso.shader_binaries[i].size()}, pso.shader_stages[i]});
+
+            framebuffer_info fb;
+            fb._storage.get() = pso.framebuffer;
+            created = mCtx->make_pipeline_state(gp, fb).disown()._handle;
+        }
+
+        mPSOs.push_back(created);
+        handle_remapper::add(remapper.psos, pso.handle, created);
+    }
+
+    mQueryRanges.reserve(data.query_ranges.size());
+    for (frame_capture_data::query_range const& qr : data.query_ranges)
+    {
+        query_range const created = mCtx->make_query_range(qr.type, qr.num).disown();
+        mQueryRanges.push_back(created);
+        handle_remapper::add(remapper.query_ranges, qr.handle, created.handle);
+    }
+
+    // point the stream and initial states to the recreated objects
+    mStream = cc::move(data.stream);
+    phi::command_stream_parser parser(mStream.data(), mStream.size());
+    for (auto const& cmd : parser)
+    {
+        command_handle_visitor<handle_remapper> visitor = {remapper};
+        phi::cmd::detail::dynamic_dispatch(cmd, visitor);
+        remapper.is_complete &= !visitor.is_unsupported;
+    }
+
+    mInitialStates = cc::move(data.initial_states);
+    for (resource_state_entry& state : mInitialStates)
+        remapper(state.resource);
+
+    mIsLoaded = true;
+
+    if (!remapper.is_complete)
+    {
+        PR_LOG_WARN("frame capture {} references objects it does not contain", path);
+        unload();
+        return false;
+    }
+
+    return true;
+}
+
+void pr::FrameReplayer::unload()
+{
+    if (!mIsLoaded)
+        return;
+
+    mCtx->flush();
+
+    for (raw_resource const& res : mResources)
+        mCtx->free_untyped(res.handle);
+    mCtx->free_range(cc::span<phi::handle::shader_view const>(mShaderViews));
+    for (phi::handle::pipeline_state const pso : mPSOs)
+        mCtx->free(graphics_pipeline_state{{pso}});
+    for (query_range const& qr : mQueryRanges)
+        mCtx->free(qr);
+
+    mResources.clear();
+    mShaderViews.clear();
+    mPSOs.clear();
+    mQueryRanges.clear();
+    mInitialStates.clear();
+    mStream.clear();
+    mIsLoaded = false;
+}
+
+pr::gpu_epoch_t pr::FrameReplayer::replay()
+{
+    CC_ASSERT(mIsLoaded && "no frame capture loaded");
+
+    auto frame = mCtx->make_frame(mStream.size() + sizeof(phi::cmd::transition_resources));
+
+    // the captured frame relied on these states without transitioning to them
+    phi::cmd::transition_resources tcmd;
+    for (resource_state_entry const& state : mInitialStates)
+    {
+        if (tcmd.transitions.size() == phi::limits::max_resource_transitions)
+        {
+            frame.write_raw_cmd(tcmd);
+            tcmd = phi::cmd::transition_resources{};
+        }
+
+        tcmd.add(state.resource, state.state, state.dependency);
+    }
+
+    if (tcmd.transitions.size() > 0)
+        frame.write_raw_cmd(tcmd);
+
+    if (!mStream.empty())
+        std::memcpy(frame.write_raw_bytes(mStream.size()), mStream.data(), mStream.size());
+
+    return mCtx->submit(cc::move(frame));
+}
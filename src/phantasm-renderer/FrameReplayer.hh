@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+
+#include <clean-core/vector.hh>
+
+#include <phantasm-hardware-interface/handles.hh>
+
+#include <phantasm-renderer/common/api.hh>
+#include <phantasm-renderer/common/state_info.hh>
+#include <phantasm-renderer/fwd.hh>
+#include <phantasm-renderer/resource_types.hh>
+
+namespace pr
+{
+/// Replays frames written by Context::capture_frame
+/// loading recreates every object the captured frame references (with the contents of upload buffers), and remaps the command stream to them
+/// replays submit the stream unchanged, any amount of times
+///
+/// usage:
+///     FrameReplayer replayer(ctx);
+///     if (replayer.load("frame.prcap"))
+///         for (auto i = 0; i < 100; ++i)
+///             replayer.replay();
+///
+/// captures can only be loaded by builds with the same PHI struct layouts as the capturing build
+/// must be destroyed before the Context
+class PR_API FrameReplayer
+{
+public:
+    /// reads a capture and recreates the objects it references, unloads the previous capture
+    /// returns false if the file is missing, corrupted or written by an incompatible build
+    bool load(char const* path);
+
+    /// flushes the GPU and frees all recreated objects
+    void unload();
+
+    /// submits the captured frame, returns its epoch
+    /// resources are transitioned to their captured initial states first
+    gpu_epoch_t replay();
+
+    bool is_loaded() const { return mIsLoaded; }
+
+    /// size of the captured command stream in bytes
+    size_t get_stream_size() const { return mStream.size(); }
+
+public:
+    explicit FrameReplayer(Context& ctx) : mCtx(&ctx) {}
+
+    FrameReplayer(FrameReplayer const&) = delete;
+    FrameReplayer& operator=(FrameReplayer const&) = delete;
+
+    ~FrameReplayer() { unload(); }
+
+private:
+    Context* mCtx = nullptr;
+    bool mIsLoaded = false;
+
+    // recreated objects
+    cc::vector<raw_resource> mResources;
+    cc::vector<phi::handle::shader_view> mShaderViews;
+    cc::vector<phi::handle::pipeline_state> mPSOs;
+    cc::vector<query_range> mQueryRanges;
+
+    // remapped to the recreated objects
+    cc::vector<resource_state_entry> mInitialStates;
+    cc::vector<std::byte> mStream;
+};
+}
@@ -11,6 +11,8 @@ pr::raii::GraphicsPass pr::raii::Framebuffer::make_pass(const pr::graphics_pass_
 
 void pr::raii::Framebuffer::sort_drawcalls_by_pso(unsigned num_drawcalls) { mParent->framebufferOnSortByPSO(num_drawcalls); }
 
+void pr::raii::Framebuffer::sort_drawcalls(cc::span<const uint64_t> sort_keys) { mParent->framebufferOnSortDrawcalls(sort_keys); }
+
 void pr::raii::Framebuffer::destroy()
 {
     if (mParent)
@@ -8,6 +8,7 @@
 
 #include <phantasm-renderer/GraphicsPass.hh>
 #include <phantasm-renderer/common/api.hh>
+#include <phantasm-renderer/common/draw_sort_key.hh>
 #include <phantasm-renderer/enums.hh>
 #include <phantasm-renderer/fwd.hh>
 #include <phantasm-renderer/pass_info.hh>
@@ -41,6 +42,11 @@ public:
     /// requires #num_drawcalls contiguously recorded drawcalls
     void sort_drawcalls_by_pso(unsigned num_drawcalls);
 
+    /// sort previously recorded drawcalls by user-supplied 64 bit keys (ascending, stable) - advanced feature
+    /// requires #sort_keys.size() contiguously recorded drawcalls, sort_keys[i] belonging to the i-th of them in recording order
+    /// keys can be created using pr::make_draw_sort_key to minimize state changes along PSO, arguments, buffers and depth
+    void sort_drawcalls(cc::span<uint64_t const> sort_keys);
+
     /// returns the parent frame
     Frame& get_frame() const { return *mParent; }
 
@@ -0,0 +1,233 @@
+#include "GpuProfiler.hh"
+
+#include <chrono>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+#include <phantasm-renderer/Context.hh>
+#include <phantasm-renderer/Frame.hh>
+
+using namespace pr;
+
+namespace
+{
+/// the calibration offset is the tightest observed bound, relaxed slowly to follow clock drift
+constexpr double gc_calibration_relax_ms_per_frame = 0.001;
+}
+
+GpuProfiler::GpuProfiler(Context& ctx, uint32_t max_zones_per_frame, uint32_t num_frame_slots, cc::allocator* alloc)
+  : mCtx(&ctx), mAlloc(alloc), mMaxZones(max_zones_per_frame), mSlots(alloc), mZoneStack(alloc), mLatestResults(alloc)
+{
+    CC_ASSERT(max_zones_per_frame > 0 && num_frame_slots > 0 && "invalid GpuProfiler configuration");
+
+    mSlots.reset_reserve(alloc, num_frame_slots);
+    for (auto i = 0u; i < num_frame_slots; ++i)
+    {
+        frame_slot& slot = mSlots.emplace_back();
+        slot.queries = ctx.make_query_range(query_type::timestamp, max_zones_per_frame * 2).disown();
+        slot.readback = ctx.make_readback_buffer(uint32_t(max_zones_per_frame * 2 * sizeof(uint64_t)), 0, "GpuProfiler readback").disown();
+        slot.zones.reset_reserve(alloc, max_zones_per_frame);
+    }
+
+    mZoneStack.reset_reserve(alloc, 64);
+    mLatestResults.reset_reserve(alloc, max_zones_per_frame);
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    CC_ASSERT(mRecordingSlot == nullptr && "GpuProfiler destroyed while recording a frame");
+
+    for (frame_slot const& slot : mSlots)
+    {
+        mCtx->free(slot.queries);
+        mCtx->free(slot.readback);
+    }
+}
+
+void GpuProfiler::begin_frame(raii::Frame& frame)
+{
+    // the previous frame was never submitted
+    on_discard();
+
+    poll();
+
+    // take any slot not in flight, if there is none the frame is not profiled
+    for (frame_slot& slot : mSlots)
+    {
+        if (!slot.is_in_flight)
+        {
+            mRecordingSlot = &slot;
+            break;
+        }
+    }
+
+    if (mRecordingSlot != nullptr)
+    {
+        mRecordingSlot->zones.clear();
+        mRecordingSlot->frame_index = mNumFrames;
+    }
+
+    ++mNumFrames;
+    mZoneStack.clear();
+
+    begin_zone(frame, "frame");
+}
+
+void GpuProfiler::end_frame(raii::Frame& frame)
+{
+    end_zone(frame);
+    CC_ASSERT(mZoneStack.empty() && "zones left open at end_frame");
+
+    if (mRecordingSlot == nullptr)
+        return;
+
+    frame_slot& slot = *mRecordingSlot;
+    auto const num_queries = unsigned(slot.zones.size() * 2);
+    frame.resolve_queries(slot.queries, slot.readback, 0, num_queries);
+
+    // the root zone cannot begin on the GPU before this point, sampled before submit to keep the calibration bound valid
+    slot.end_frame_cpu_ms = get_cpu_time_ms();
+    slot.is_in_flight = true;
+    slot.is_submitted = false;
+    mEndedSlot = &slot;
+    mRecordingSlot = nullptr;
+}
+
+void GpuProfiler::on_submit(gpu_epoch_t epoch)
+{
+    if (mEndedSlot == nullptr)
+        return; // the frame was not profiled
+
+    mEndedSlot->epoch = epoch;
+    mEndedSlot->is_submitted = true;
+    mEndedSlot = nullptr;
+}
+
+void GpuProfiler::on_discard()
+{
+    // the timestamps are never written, the slot is free right away
+    if (mEndedSlot != nullptr)
+    {
+        mEndedSlot->is_in_flight = false;
+        mEndedSlot = nullptr;
+    }
+
+    mRecordingSlot = nullptr;
+    mZoneStack.clear();
+}
+
+void GpuProfiler::poll()
+{
+    for (frame_slot& slot : mSlots)
+    {
+        if (slot.is_in_flight && slot.is_submitted && mCtx->is_gpu_epoch_reached(slot.epoch))
+        {
+            readSlot(slot);
+            slot.is_in_flight = false;
+        }
+    }
+}
+
+void GpuProfiler::begin_zone(raii::Frame& frame, const char* name)
+{
+    if (mRecordingSlot == nullptr || mRecordingSlot->zones.size() == mMaxZones)
+    {
+        // not profiled or out of queries, drop the zone
+        mZoneStack.push_back(uint32_t(-1));
+        return;
+    }
+
+    frame_slot& slot = *mRecordingSlot;
+
+    // the parent is the innermost open zone that was not dropped
+    uint32_t parent = uint32_t(-1);
+    uint32_t depth = 0;
+    for (auto i = mZoneStack.size(); i > 0; --i)
+    {
+        if (mZoneStack[i - 1] != uint32_t(-1))
+        {
+            parent = mZoneStack[i - 1];
+            depth = slot.zones[parent].depth + 1;
+            break;
+        }
+    }
+
+    auto const index = uint32_t(slot.zones.size());
+    slot.zones.push_back({name, parent, depth});
+    mZoneStack.push_back(index);
+
+    frame.write_timestamp(slot.queries, index * 2);
+}
+
+void GpuProfiler::end_zone(raii::Frame& frame)
+{
+    CC_ASSERT(!mZoneStack.empty() && "end_zone without begin_zone");
+    uint32_t const index = mZoneStack.back();
+    mZoneStack.pop_back();
+
+    if (index == uint32_t(-1))
+        return;
+
+    frame.write_timestamp(mRecordingSlot->queries, index * 2 + 1);
+}
+
+double GpuProfiler::get_cpu_time_ms()
+{
+    auto const now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double, std::milli>(now).count();
+}
+
+void GpuProfiler::beginZoneWithLabel(raii::Frame& frame, const char* name)
+{
+    frame.begin_debug_label(name);
+    begin_zone(frame, name);
+}
+
+void GpuProfiler::endZoneWithLabel(raii::Frame& frame)
+{
+    end_zone(frame);
+    frame.end_debug_label();
+}
+
+void GpuProfiler::readSlot(frame_slot& slot)
+{
+    if (slot.frame_index < mLatestResultFrame || slot.zones.empty())
+        return; // results of a newer frame are already available
+
+    auto const num_bytes = int32_t(slot.zones.size() * 2 * sizeof(uint64_t));
+    auto const* const timestamps = reinterpret_cast<uint64_t const*>(mCtx->map_buffer(slot.readback, 0, num_bytes));
+    double const ms_per_tick = 1000. / double(mCtx->get_gpu_timestamp_frequency());
+
+    // the root zone cannot have started on the GPU before the frame was ended,
+    // the tightest such bound over recent frames is taken as the offset between the timelines
+    // (phi exposes no calibrated CPU/GPU timestamp pairs)
+    double const root_begin_gpu_ms = double(timestamps[0]) * ms_per_tick;
+    double const offset_bound = slot.end_frame_cpu_ms - root_begin_gpu_ms;
+
+    if (!mIsCalibrated)
+        mCalibrationOffsetMs = offset_bound;
+    else
+        mCalibrationOffsetMs = cc::max(offset_bound, mCalibrationOffsetMs - gc_calibration_relax_ms_per_frame);
+
+    mIsCalibrated = true;
+
+    mLatestResults.clear();
+    for (auto i = 0u; i < slot.zones.size(); ++i)
+    {
+        zone_record const& zone = slot.zones[i];
+        uint64_t const begin = timestamps[i * 2];
+        uint64_t const end = cc::max(timestamps[i * 2 + 1], begin);
+
+        gpu_zone_result& res = mLatestResults.emplace_back();
+        res.name = zone.name;
+        res.parent = zone.parent;
+        res.depth = zone.depth;
+        res.begin_ms = double(begin) * ms_per_tick + mCalibrationOffsetMs;
+        res.end_ms = double(end) * ms_per_tick + mCalibrationOffsetMs;
+        res.duration_ms = mCtx->get_timestamp_difference_milliseconds(begin, end);
+    }
+
+    mCtx->unmap_buffer(slot.readback, 0, 0); // flush nothing
+    mLatestResultFrame = slot.frame_index;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+
+#include <clean-core/alloc_vector.hh>
+#include <clean-core/allocator.hh>
+#include <clean-core/defer.hh>
+#include <clean-core/span.hh>
+
+#include <phantasm-renderer/common/api.hh>
+#include <phantasm-renderer/fwd.hh>
+#include <phantasm-renderer/resource_types.hh>
+
+namespace pr
+{
+/// timing of a single zone of a completed frame
+struct gpu_zone_result
+{
+    char const* name = nullptr;
+    uint32_t parent = uint32_t(-1); ///< index of the enclosing zone, -1 for the frame root
+    uint32_t depth = 0;
+    double begin_ms = 0.;    ///< on the CPU timeline (see GpuProfiler::get_cpu_time_ms), if calibrated
+    double end_ms = 0.;      ///< on the CPU timeline (see GpuProfiler::get_cpu_time_ms), if calibrated
+    double duration_ms = 0.; ///< GPU milliseconds
+};
+
+/// Hierarchical GPU timing of frames
+/// zones write timestamps into pooled per-frame query ranges, which are resolved into readback buffers
+/// results are read once the frame is reached on the GPU, some frames later, without stalling
+/// if all frame slots are still in flight, the frame is not profiled
+///
+/// usage:
+///     profiler.begin_frame(frame);
+///     {
+///         auto zone = profiler.scoped_zone(frame, "shadows");
+///         ...
+///     }
+///     profiler.end_frame(frame);
+///     profiler.on_submit(ctx.submit(cc::move(frame)));
+///
+/// must be destroyed before the Context and while no profiled frames are in flight
+class PR_API GpuProfiler
+{
+public:
+    //
+    // frames
+
+    /// start profiling a frame, reads back older frames that completed on the GPU
+    /// a previous frame that was begun or ended but never submitted is discarded
+    void begin_frame(raii::Frame& frame);
+
+    /// end profiling a frame, resolving its timestamps
+    void end_frame(raii::Frame& frame);
+
+    /// supply the epoch returned by Context::submit for the frame last ended
+    void on_submit(gpu_epoch_t epoch);
+
+    /// call instead of on_submit if the frame last ended or still recording is not submitted (Context::discard or destroyed)
+    /// frees its slot for the next frame
+    void on_discard();
+
+    /// read back frames that completed on the GPU, called in begin_frame
+    void poll();
+
+    //
+    // zones
+
+    /// begin a zone, zones must be properly nested
+    void begin_zone(raii::Frame& frame, char const* name);
+    void end_zone(raii::Frame& frame);
+
+    /// begin a zone and a debug label of the same name, ending both automatically with a RAII helper
+    [[nodiscard]] auto scoped_zone(raii::Frame& frame, char const* name)
+    {
+        beginZoneWithLabel(frame, name);
+        CC_RETURN_DEFER { this->endZoneWithLabel(frame); };
+    }
+
+    //
+    // results
+
+    /// zones of the most recent completed frame in the order they were begun, the first one is the frame root
+    cc::span<gpu_zone_result const> get_latest_results() const { return mLatestResults; }
+
+    /// index of the frame the latest results are from (counting begin_frame calls), -1 if there are none yet
+    int64_t get_latest_result_frame() const { return mLatestResultFrame; }
+
+    /// whether GPU timestamps were mapped onto the CPU timeline at least once
+    bool is_calibrated() const { return mIsCalibrated; }
+
+    /// milliseconds on the CPU timeline zone results are mapped to
+    static double get_cpu_time_ms();
+
+public:
+    explicit GpuProfiler(Context& ctx, uint32_t max_zones_per_frame = 256, uint32_t num_frame_slots = 4, cc::allocator* alloc = cc::system_allocator);
+
+    GpuProfiler(GpuProfiler const&) = delete;
+    GpuProfiler& operator=(GpuProfiler const&) = delete;
+
+    ~GpuProfiler();
+
+private:
+    struct zone_record
+    {
+        char const* name;
+        uint32_t parent;
+        uint32_t depth;
+    };
+
+    struct frame_slot
+    {
+        query_range queries;
+        buffer readback;
+        cc::alloc_vector<zone_record> zones;
+        int64_t frame_index = -1;
+        gpu_epoch_t epoch = 0;
+        double end_frame_cpu_ms = 0.; ///< before the frame can begin on the GPU
+        bool is_in_flight = false; ///< ended and not yet read back
+        bool is_submitted = false;
+    };
+
+    void beginZoneWithLabel(raii::Frame& frame, char const* name);
+    void endZoneWithLabel(raii::Frame& frame);
+
+    void readSlot(frame_slot& slot);
+
+private:
+    Context* mCtx = nullptr;
+    cc::allocator* mAlloc = nullptr;
+    uint32_t mMaxZones = 0;
+
+    cc::alloc_vector<frame_slot> mSlots;
+    frame_slot* mRecordingSlot = nullptr; ///< null if not between begin_frame and end_frame or if the frame is not profiled
+    frame_slot* mEndedSlot = nullptr;     ///< awaiting on_submit
+    cc::alloc_vector<uint32_t> mZoneStack;  ///< open zones, -1 for zones dropped due to the zone limit
+    int64_t mNumFrames = 0;
+
+    cc::alloc_vector<gpu_zone_result> mLatestResults;
+    int64_t mLatestResultFrame = -1;
+
+    // calibration, cpu_ms = gpu_ms + offset
+    double mCalibrationOffsetMs = 0.;
+    bool mIsCalibrated = false;
+};
+}
@@ -0,0 +1,422 @@
+#include "RenderGraph.hh"
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+#include <phantasm-renderer/Context.hh>
+#include <phantasm-renderer/Frame.hh>
+
+using namespace pr;
+
+graph_pass_builder& graph_pass_builder::read(graph_resource res, state read_state, shader_flags dependency)
+{
+    _parent->addAccess(_pass_index, res, read_state, dependency, false);
+    return *this;
+}
+
+graph_pass_builder& graph_pass_builder::write(graph_resource res, state write_state, shader_flags dependency)
+{
+    _parent->addAccess(_pass_index, res, write_state, dependency, true);
+    return *this;
+}
+
+graph_pass_builder& graph_pass_builder::side_effect()
+{
+    _parent->mPasses[_pass_index].has_side_effects = true;
+    return *this;
+}
+
+RenderGraph::RenderGraph(Context& ctx, cc::allocator* alloc) : mCtx(&ctx), mAlloc(alloc), mPasses(alloc), mAccesses(alloc), mResources(alloc), mAliasPool(alloc) {}
+
+graph_resource RenderGraph::create_texture(const texture_info& info, const char* name)
+{
+    resource_node node;
+    node.name = name;
+    node.tex.info = info;
+    node.is_texture = true;
+    return addResource(node);
+}
+
+graph_resource RenderGraph::create_buffer(const buffer_info& info, const char* name)
+{
+    resource_node node;
+    node.name = name;
+    node.buf.info = info;
+    return addResource(node);
+}
+
+graph_resource RenderGraph::import_texture(const texture& tex, const char* name)
+{
+    CC_ASSERT(tex.is_valid() && "imported invalid texture");
+    resource_node node;
+    node.name = name;
+    node.tex = tex;
+    node.is_texture = true;
+    node.is_imported = true;
+    return addResource(node);
+}
+
+graph_resource RenderGraph::import_buffer(const buffer& buf, const char* name)
+{
+    CC_ASSERT(buf.is_valid() && "imported invalid buffer");
+    resource_node node;
+    node.name = name;
+    node.buf = buf;
+    node.is_imported = true;
+    return addResource(node);
+}
+
+void RenderGraph::mark_output(graph_resource res)
+{
+    CC_ASSERT(res._index < mResources.size() && "invalid graph_resource");
+    mResources[res._index].is_output = true;
+}
+
+void RenderGraph::execute(raii::Frame& frame)
+{
+    cullPasses();
+    uint32_t const num_levels = assignLevels();
+
+    // order live passes by level, stable within a level (counting sort)
+    cc::alloc_vector<uint32_t> level_offsets;
+    level_offsets.reset_reserve(mAlloc, num_levels + 1);
+    for (auto i = 0u; i <= num_levels; ++i)
+        level_offsets.push_back(0);
+
+    for (pass_node const& pass : mPasses)
+    {
+        if (!pass.is_culled)
+            ++level_offsets[pass.level + 1];
+    }
+
+    for (auto i = 1u; i < level_offsets.size(); ++i)
+        level_offsets[i] += level_offsets[i - 1];
+
+    cc::alloc_vector<uint32_t> ordered_passes;
+    ordered_passes.reset_reserve(mAlloc, level_offsets[num_levels]);
+    for (auto i = 0u; i < level_offsets[num_levels]; ++i)
+        ordered_passes.push_back(0);
+
+    {
+        cc::alloc_vector<uint32_t> heads;
+        heads.reset_reserve(mAlloc, num_levels);
+        for (auto i = 0u; i < num_levels; ++i)
+            heads.push_back(level_offsets[i]);
+
+        for (auto i = 0u; i < mPasses.size(); ++i)
+        {
+            if (!mPasses[i].is_culled)
+                ordered_passes[heads[mPasses[i].level]++] = i;
+        }
+    }
+
+    for (auto level = 0u; level < num_levels; ++level)
+    {
+        cc::span<uint32_t const> const passes = cc::span<uint32_t const>(ordered_passes).subspan(level_offsets[level], level_offsets[level + 1] - level_offsets[level]);
+        executeLevel(frame, level, passes);
+    }
+
+    reset();
+}
+
+void RenderGraph::reset()
+{
+    for (resource_node& node : mResources)
+    {
+        if (!node.is_imported)
+            retireTransient(node);
+    }
+
+    releaseAliasPool();
+
+    for (pass_node const& pass : mPasses)
+        pass.callback.destroy(pass.callback.data, mAlloc);
+
+    mPasses.clear();
+    mAccesses.clear();
+    mResources.clear();
+}
+
+const texture& RenderGraph::get_texture(graph_resource res) const
+{
+    CC_ASSERT(res._index < mResources.size() && mResources[res._index].is_texture && "graph_resource is not a texture");
+    CC_ASSERT(mResources[res._index].tex.is_valid() && "graph texture accessed outside of a pass using it");
+    return mResources[res._index].tex;
+}
+
+const buffer& RenderGraph::get_buffer(graph_resource res) const
+{
+    CC_ASSERT(res._index < mResources.size() && !mResources[res._index].is_texture && "graph_resource is not a buffer");
+    CC_ASSERT(mResources[res._index].buf.is_valid() && "graph buffer accessed outside of a pass using it");
+    return mResources[res._index].buf;
+}
+
+graph_pass_builder RenderGraph::addPass(const char* name, const pass_callback& callback)
+{
+    pass_node& pass = mPasses.emplace_back();
+    pass.name = name;
+    pass.callback = callback;
+    pass.first_access = uint32_t(mAccesses.size());
+    return {this, uint32_t(mPasses.size() - 1)};
+}
+
+void RenderGraph::addAccess(uint32_t pass_index, graph_resource res, state target_state, shader_flags dependency, bool is_write)
+{
+    CC_ASSERT(res._index < mResources.size() && "invalid graph_resource");
+    CC_ASSERT(pass_index == mPasses.size() - 1 && "resource accesses must be declared before adding the next pass");
+
+    pass_node& pass = mPasses[pass_index];
+
+    // merge repeated accesses to the same resource
+    for (auto i = pass.first_access; i < pass.first_access + pass.num_accesses; ++i)
+    {
+        access_node& acc = mAccesses[i];
+        if (acc.resource == res._index)
+        {
+            CC_ASSERT(acc.target_state == target_state && "a pass can only access a resource in a single state");
+            acc.dependency |= dependency;
+            acc.is_write = acc.is_write || is_write;
+            return;
+        }
+    }
+
+    mAccesses.push_back({res._index, target_state, dependency, is_write});
+    ++pass.num_accesses;
+}
+
+graph_resource RenderGraph::addResource(const resource_node& node)
+{
+    mResources.push_back(node);
+    return {uint32_t(mResources.size() - 1)};
+}
+
+void RenderGraph::cullPasses()
+{
+    // resources visible outside of the graph are always required
+    for (resource_node& node : mResources)
+        node.is_required = node.is_imported || node.is_output;
+
+    // walk backwards, a pass is live if it writes a resource that is required by a later live pass or outside of the graph
+    for (auto i = mPasses.size(); i > 0; --i)
+    {
+        pass_node& pass = mPasses[i - 1];
+        pass.is_culled = !pass.has_side_effects;
+
+        for (auto a = pass.first_access; a < pass.first_access + pass.num_accesses && pass.is_culled; ++a)
+        {
+            access_node const& acc = mAccesses[a];
+            if (acc.is_write && mResources[acc.resource].is_required)
+                pass.is_culled = false;
+        }
+
+        if (pass.is_culled)
+            continue;
+
+        // unordered access writes can be partial and are treated as reads as well
+        for (auto a = pass.first_access; a < pass.first_access + pass.num_accesses; ++a)
+        {
+            access_node const& acc = mAccesses[a];
+            if (!acc.is_write || acc.target_state == state::unordered_access)
+                mResources[acc.resource].is_required = true;
+        }
+    }
+}
+
+uint32_t RenderGraph::assignLevels()
+{
+    // place every pass at the earliest level after all accesses it must be ordered behind
+    // writes and accesses in differing states are ordered, consecutive reads in the same state are not
+    uint32_t num_levels = 0;
+    for (pass_node& pass : mPasses)
+    {
+        if (pass.is_culled)
+            continue;
+
+        uint32_t level = 0;
+        for (auto a = pass.first_access; a < pass.first_access + pass.num_accesses; ++a)
+        {
+            access_node const& acc = mAccesses[a];
+            resource_node const& node = mResources[acc.resource];
+
+            if (!node.has_group)
+                continue;
+
+            bool const is_ordered = acc.is_write || node.group_writes || node.group_state != acc.target_state;
+            level = cc::max(level, is_ordered ? node.group_max_level + 1 : node.group_min_level);
+        }
+
+        pass.level = level;
+        num_levels = cc::max(num_levels, level + 1);
+
+        for (auto a = pass.first_access; a < pass.first_access + pass.num_accesses; ++a)
+        {
+            access_node const& acc = mAccesses[a];
+            resource_node& node = mResources[acc.resource];
+
+            bool const starts_group = !node.has_group || acc.is_write || node.group_writes || node.group_state != acc.target_state;
+            if (starts_group)
+            {
+                node.group_min_level = node.has_group ? node.group_max_level + 1 : 0;
+                node.group_max_level = level;
+                node.group_state = acc.target_state;
+                node.group_writes = acc.is_write;
+                node.has_group = true;
+            }
+            else
+            {
+                node.group_max_level = cc::max(node.group_max_level, level);
+            }
+
+            node.first_level = cc::min(node.first_level, level);
+            node.last_level = cc::max(node.last_level, level);
+        }
+    }
+
+    return num_levels;
+}
+
+void RenderGraph::executeLevel(raii::Frame& frame, uint32_t level, cc::span<const uint32_t> passes)
+{
+    // merge the accesses of all passes in this level, they share a single state per resource
+    cc::alloc_vector<uint32_t> level_resources;
+    level_resources.reset_reserve(mAlloc, 32);
+
+    for (uint32_t const pass_index : passes)
+    {
+        pass_node const& pass = mPasses[pass_index];
+        for (auto a = pass.first_access; a < pass.first_access + pass.num_accesses; ++a)
+        {
+            access_node const& acc = mAccesses[a];
+            resource_node& node = mResources[acc.resource];
+
+            if (node.level_mark != level)
+            {
+                node.level_mark = level;
+                node.level_state = acc.target_state;
+                node.level_dependency = acc.dependency;
+                node.level_writes = acc.is_write;
+                level_resources.push_back(acc.resource);
+            }
+            else
+            {
+                CC_ASSERT(node.level_state == acc.target_state && "graph scheduling error");
+                node.level_dependency |= acc.dependency;
+                node.level_writes = node.level_writes || acc.is_write;
+            }
+        }
+    }
+
+    // transition into the states of this level as one batch,
+    // UAV barriers are required between dependent unordered accesses that do not change state
+    cc::alloc_vector<phi::handle::resource> uav_barriers;
+    uav_barriers.reset_reserve(mAlloc, level_resources.size());
+
+    for (uint32_t const res_index : level_resources)
+    {
+        resource_node& node = mResources[res_index];
+
+        if (!node.is_imported && node.first_level == level)
+            acquireTransient(node);
+
+        phi::handle::resource const handle = node.is_texture ? node.tex.res.handle : node.buf.res.handle;
+
+        if (node.current_state == state::unordered_access && node.level_state == state::unordered_access && (node.current_writes || node.level_writes))
+            uav_barriers.push_back(handle);
+
+        frame.transition(handle, node.level_state, node.level_dependency);
+        node.current_state = node.level_state;
+        node.current_writes = node.level_writes;
+    }
+
+    if (!uav_barriers.empty())
+        frame.barrier_uav(uav_barriers);
+
+    for (uint32_t const pass_index : passes)
+    {
+        pass_node const& pass = mPasses[pass_index];
+
+        if (pass.name != nullptr)
+            frame.begin_debug_label(pass.name);
+
+        pass.callback.invoke(pass.callback.data, frame, *this);
+
+        if (pass.name != nullptr)
+            frame.end_debug_label();
+    }
+
+    for (uint32_t const res_index : level_resources)
+    {
+        resource_node& node = mResources[res_index];
+        if (!node.is_imported && node.last_level == level)
+            retireTransient(node);
+    }
+}
+
+void RenderGraph::acquireTransient(resource_node& node)
+{
+    bool is_aliased = false;
+
+    // reuse a retired transient of the same description
+    for (auto i = 0u; i < mAliasPool.size(); ++i)
+    {
+        retired_transient const& retired = mAliasPool[i];
+        if (retired.is_texture != node.is_texture)
+            continue;
+
+        if (node.is_texture ? !(retired.tex.info == node.tex.info) : !(retired.buf.info == node.buf.info))
+            continue;
+
+        node.tex = retired.tex;
+        node.buf = retired.buf;
+
+        // the previous user is treated as a write for the purposes of UAV barriers
+        node.current_state = retired.last_state;
+        node.current_writes = true;
+
+        mAliasPool[i] = mAliasPool.back();
+        mAliasPool.pop_back();
+        is_aliased = true;
+        break;
+    }
+
+    if (!is_aliased)
+    {
+        if (node.is_texture)
+            node.tex = mCtx->get_texture(node.tex.info).disown();
+        else
+            node.buf = mCtx->get_buffer(node.buf.info).disown();
+    }
+
+    if (node.name != nullptr)
+    {
+        if (node.is_texture)
+            mCtx->set_debug_name(node.tex, node.name);
+        else
+            mCtx->set_debug_name(node.buf, node.name);
+    }
+}
+
+void RenderGraph::retireTransient(resource_node& node)
+{
+    if (node.is_texture ? !node.tex.is_valid() : !node.buf.is_valid())
+        return;
+
+    mAliasPool.push_back({node.tex, node.buf, node.is_texture, node.current_state});
+    node.tex.invalidate();
+    node.buf.invalidate();
+}
+
+void RenderGraph::releaseAliasPool()
+{
+    // returning to the cache is safe while the frame is still recording,
+    // cache entries are not handed out again before the current CPU epoch is reached on the GPU
+    for (retired_transient const& retired : mAliasPool)
+    {
+        if (retired.is_texture)
+            mCtx->free_to_cache(retired.tex);
+        else
+            mCtx->free_to_cache(retired.buf);
+    }
+
+    mAliasPool.clear();
+}
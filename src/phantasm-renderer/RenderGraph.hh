@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include <clean-core/alloc_vector.hh>
+#include <clean-core/allocator.hh>
+#include <clean-core/forward.hh>
+#include <clean-core/span.hh>
+
+#include <phantasm-renderer/common/api.hh>
+#include <phantasm-renderer/enums.hh>
+#include <phantasm-renderer/fwd.hh>
+#include <phantasm-renderer/resource_types.hh>
+
+namespace pr
+{
+namespace raii
+{
+class Frame;
+}
+
+class RenderGraph;
+
+/// handle to a texture or buffer declared in a RenderGraph
+struct graph_resource
+{
+    uint32_t _index = uint32_t(-1);
+
+    bool is_valid() const { return _index != uint32_t(-1); }
+};
+
+/// declares the resource accesses of a pass, received from RenderGraph::add_pass
+struct graph_pass_builder
+{
+    /// the pass reads the resource in the given state
+    graph_pass_builder& read(graph_resource res, state read_state = state::shader_resource, shader_flags dependency = {});
+
+    /// the pass writes the resource in the given state
+    graph_pass_builder& write(graph_resource res, state write_state = state::render_target, shader_flags dependency = {});
+
+    /// the pass has effects outside of the graph and is never culled
+    graph_pass_builder& side_effect();
+
+private:
+    friend class RenderGraph;
+    graph_pass_builder(RenderGraph* parent, uint32_t pass_index) : _parent(parent), _pass_index(pass_index) {}
+
+    RenderGraph* _parent;
+    uint32_t _pass_index;
+};
+
+/// A declarative frame graph recorded into a raii::Frame
+/// passes declare the resources they read and write, the graph culls passes that do not contribute to an output,
+/// orders them, and inserts the required transitions
+/// transient resources are allocated at their first use and retired after their last,
+/// transients with disjoint lifetimes and identical descriptions alias the same resource
+/// built and executed once per frame, single threaded
+class PR_API RenderGraph
+{
+public:
+    //
+    // resources
+
+    /// declare a transient texture, allocated only for the span of passes using it
+    [[nodiscard]] graph_resource create_texture(texture_info const& info, char const* name = nullptr);
+
+    /// declare a transient buffer, allocated only for the span of passes using it
+    [[nodiscard]] graph_resource create_buffer(buffer_info const& info, char const* name = nullptr);
+
+    /// import a texture living outside of the graph, writes to it are outputs
+    [[nodiscard]] graph_resource import_texture(texture const& tex, char const* name = nullptr);
+
+    /// import a buffer living outside of the graph, writes to it are outputs
+    [[nodiscard]] graph_resource import_buffer(buffer const& buf, char const* name = nullptr);
+
+    /// mark a resource as an output, passes contributing to it are not culled
+    void mark_output(graph_resource res);
+
+    //
+    // passes
+
+    /// add a pass, func(raii::Frame&, RenderGraph const&) is called during execute if the pass is not culled
+    /// resource accesses are declared on the returned builder
+    template <class F>
+    graph_pass_builder add_pass(char const* name, F&& func)
+    {
+        using FuncT = std::decay_t<F>;
+        pass_callback cb;
+        cb.data = mAlloc->new_t<FuncT>(cc::forward<F>(func));
+        cb.invoke = [](void* data, raii::Frame& frame, RenderGraph const& graph) { (*static_cast<FuncT*>(data))(frame, graph); };
+        cb.destroy = [](void* data, cc::allocator* alloc) { alloc->delete_t(static_cast<FuncT*>(data)); };
+        return addPass(name, cb);
+    }
+
+    //
+    // execution
+
+    /// culls and orders the passes, then records them into the frame
+    /// the graph is reset afterwards and can be rebuilt for the next frame
+    void execute(raii::Frame& frame);
+
+    /// discard all passes and resources without executing
+    void reset();
+
+    /// access a resource from within a pass
+    texture const& get_texture(graph_resource res) const;
+    buffer const& get_buffer(graph_resource res) const;
+
+public:
+    explicit RenderGraph(Context& ctx, cc::allocator* alloc = cc::system_allocator);
+
+    RenderGraph(RenderGraph const&) = delete;
+    RenderGraph& operator=(RenderGraph const&) = delete;
+
+    ~RenderGraph() { reset(); }
+
+private:
+    friend struct graph_pass_builder;
+
+    struct pass_callback
+    {
+        void* data = nullptr;
+        void (*invoke)(void* data, raii::Frame& frame, RenderGraph const& graph) = nullptr;
+        void (*destroy)(void* data, cc::allocator* alloc) = nullptr;
+    };
+
+    struct pass_node
+    {
+        char const* name = nullptr;
+        pass_callback callback;
+        uint32_t first_access = 0;
+        uint32_t num_accesses = 0;
+        uint32_t level = 0; ///< passes in the same level are independent and share one transition batch
+        bool has_side_effects = false;
+        bool is_culled = true;
+    };
+
+    struct access_node
+    {
+        uint32_t resource;
+        state target_state;
+        shader_flags dependency;
+        bool is_write;
+    };
+
+    struct resource_node
+    {
+        char const* name = nullptr;
+        texture tex;
+        buffer buf;
+        bool is_texture = false;
+        bool is_imported = false;
+        bool is_output = false;
+        bool is_required = false; ///< read by a live pass or visible outside of the graph
+
+        // scheduling state, the current group is the latest run of accesses that need no ordering among each other
+        bool has_group = false;
+        bool group_writes = false;
+        state group_state = state::unknown;
+        uint32_t group_min_level = 0;
+        uint32_t group_max_level = 0;
+
+        // execution state
+        uint32_t first_level = uint32_t(-1);
+        uint32_t last_level = 0;
+        uint32_t level_mark = uint32_t(-1);
+        state level_state = state::unknown;
+        shader_flags level_dependency = {};
+        bool level_writes = false;
+        state current_state = state::unknown;
+        bool current_writes = false;
+    };
+
+    graph_pass_builder addPass(char const* name, pass_callback const& callback);
+    void addAccess(uint32_t pass_index, graph_resource res, state target_state, shader_flags dependency, bool is_write);
+
+    graph_resource addResource(resource_node const& node);
+
+    void cullPasses();
+    uint32_t assignLevels();
+
+    void executeLevel(raii::Frame& frame, uint32_t level, cc::span<uint32_t const> passes);
+
+    void acquireTransient(resource_node& node);
+    void retireTransient(resource_node& node);
+    void releaseAliasPool();
+
+private:
+    Context* mCtx = nullptr;
+    cc::allocator* mAlloc = nullptr;
+    cc::alloc_vector<pass_node> mPasses;
+    cc::alloc_vector<access_node> mAccesses; ///< accesses of all passes, contiguous per pass
+    cc::alloc_vector<resource_node> mResources;
+
+    // transients past their last use, reused by later transients of the same description
+    struct retired_transient
+    {
+        texture tex;
+        buffer buf;
+        bool is_texture;
+        state last_state;
+    };
+
+    cc::alloc_vector<retired_transient> mAliasPool;
+};
+}
@@ -0,0 +1,219 @@
+#include "VideoCapture.hh"
+
+#include <clean-core/assert.hh>
+
+#include <phantasm-renderer/Context.hh>
+#include <phantasm-renderer/Frame.hh>
+
+using namespace pr;
+
+namespace
+{
+bool is_supported_format(pr::format fmt) { return fmt == pr::format::bgra8un || fmt == pr::format::rgba8un || fmt == pr::format::rgba16f; }
+}
+
+VideoCapture::VideoCapture(Context& ctx, video_sink sink, void* userdata, video_capture_config const& config)
+  : mCtx(&ctx), mSink(sink), mSinkUserdata(userdata), mLayout(config.layout)
+{
+    CC_ASSERT(sink != nullptr && config.max_in_flight > 0 && config.num_workers > 0 && "invalid VideoCapture configuration");
+
+    mSlots.resize(config.max_in_flight);
+
+    mWorkers.reserve(config.num_workers);
+    for (auto i = 0u; i < config.num_workers; ++i)
+        mWorkers.push_back(std::thread([this] { workerMain(); }));
+}
+
+VideoCapture::~VideoCapture()
+{
+    flush();
+
+    {
+        auto lg = std::lock_guard(mMutex);
+        mIsShuttingDown = true;
+    }
+    mWorkAvailable.notify_all();
+
+    for (std::thread& worker : mWorkers)
+        worker.join();
+}
+
+bool VideoCapture::capture(raii::Frame& frame, const texture& target)
+{
+    CC_ASSERT(is_supported_format(target.info.fmt) && "VideoCapture supports bgra8un, rgba8un and rgba16f targets");
+    CC_ASSERT(target.info.num_samples == 1 && "VideoCapture targets must be resolved first");
+
+    poll();
+
+    auto lg = std::lock_guard(mMutex);
+
+    slot& s = mSlots[mNumCaptured % mSlots.size()];
+    if (s.state != slot_state::idle)
+    {
+        ++mNumDropped;
+        return false;
+    }
+
+    s.rb = frame.readback_async(target);
+    s.width = target.info.width;
+    s.height = target.info.height;
+    s.fmt = target.info.fmt;
+    s.index = mNumCaptured++;
+    s.state = slot_state::in_flight;
+    return true;
+}
+
+void VideoCapture::poll()
+{
+    bool has_new_work = false;
+
+    {
+        auto lg = std::lock_guard(mMutex);
+        for (slot& s : mSlots)
+        {
+            if (s.state != slot_state::in_flight)
+                continue;
+
+            if (mCtx->is_readback_ready(s.rb))
+            {
+                s.state = slot_state::queued;
+                has_new_work = true;
+            }
+            else if (mCtx->is_readback_discarded(s.rb))
+            {
+                // never completes, a worker skips it in delivery order
+                s.state = slot_state::discarded;
+                ++mNumDropped;
+                has_new_work = true;
+            }
+        }
+    }
+
+    if (has_new_work)
+        mWorkAvailable.notify_all();
+}
+
+void VideoCapture::flush()
+{
+    mCtx->flush();
+    poll();
+
+    // after the GPU flush, slots still in flight belong to frames that are not submitted yet,
+    // they and all later captures are delivered once that frame is submitted
+    auto lk = std::unique_lock(mMutex);
+    mSlotDelivered.wait(lk, [&] { return mNumRetired == mNumCaptured || mSlots[mNumRetired % mSlots.size()].state == slot_state::in_flight; });
+}
+
+uint64_t VideoCapture::get_num_delivered() const
+{
+    auto lg = std::lock_guard(mMutex);
+    return mNumDelivered;
+}
+
+void VideoCapture::workerMain()
+{
+    while (true)
+    {
+        slot* s = nullptr;
+        bool is_head_discarded = false;
+
+        {
+            auto lk = std::unique_lock(mMutex);
+            mWorkAvailable.wait(lk, [&] {
+                if (mIsShuttingDown)
+                    return true;
+
+                s = getQueuedSlot();
+                is_head_discarded = mSlots[mNumRetired % mSlots.size()].state == slot_state::discarded;
+                return s != nullptr || is_head_discarded;
+            });
+
+            if (s == nullptr && !is_head_discarded)
+                return;
+
+            if (s != nullptr)
+                s->state = slot_state::converting;
+        }
+
+        if (s != nullptr)
+        {
+            convertSlot(*s);
+
+            auto lg = std::lock_guard(mMutex);
+            s->state = slot_state::converted;
+        }
+
+        deliverConverted();
+    }
+}
+
+void VideoCapture::convertSlot(slot& s)
+{
+    // maps and removes the row padding of the readback, rows are tightly packed from here on
+    cc::span<std::byte const> const data = mCtx->get_readback_data(s.rb);
+    size_t const row_stride = data.size() / size_t(s.height);
+
+    s.converted.resize(get_yuv420_size_bytes(s.width, s.height));
+
+    if (s.fmt == pr::format::rgba16f)
+        convert_rgba16f_to_yuv420(data.data(), row_stride, s.width, s.height, mLayout, s.converted.data());
+    else
+        convert_rgba8_to_yuv420(data.data(), row_stride, s.width, s.height, s.fmt == pr::format::bgra8un, mLayout, s.converted.data());
+}
+
+void VideoCapture::deliverConverted()
+{
+    // whichever worker finishes the oldest frame delivers it and all converted frames following it
+    auto delivery_lg = std::lock_guard(mDeliveryMutex);
+
+    while (true)
+    {
+        slot* s;
+        bool is_discarded;
+
+        {
+            auto lg = std::lock_guard(mMutex);
+            s = &mSlots[mNumRetired % mSlots.size()];
+            if (s->state != slot_state::converted && s->state != slot_state::discarded)
+                return;
+
+            is_discarded = s->state == slot_state::discarded;
+        }
+
+        // converted and discarded slots are untouched by capture and the other workers
+        if (!is_discarded)
+        {
+            video_frame frame;
+            frame.data = s->converted;
+            frame.width = s->width;
+            frame.height = s->height;
+            frame.layout = mLayout;
+            frame.index = s->index;
+            mSink(frame, mSinkUserdata);
+        }
+
+        mCtx->free(s->rb);
+
+        {
+            auto lg = std::lock_guard(mMutex);
+            s->state = slot_state::idle;
+            ++mNumRetired;
+            if (!is_discarded)
+                ++mNumDelivered;
+        }
+        mSlotDelivered.notify_all();
+    }
+}
+
+VideoCapture::slot* VideoCapture::getQueuedSlot()
+{
+    // oldest first, the ring is ordered from the next frame to deliver
+    for (auto i = 0u; i < mSlots.size(); ++i)
+    {
+        slot& s = mSlots[(mNumRetired + i) % mSlots.size()];
+        if (s.state == slot_state::queued)
+            return &s;
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include <clean-core/span.hh>
+#include <clean-core/vector.hh>
+
+#include <phantasm-renderer/common/api.hh>
+#include <phantasm-renderer/common/yuv_convert.hh>
+#include <phantasm-renderer/fwd.hh>
+#include <phantasm-renderer/resource_types.hh>
+
+namespace pr
+{
+/// a converted frame, delivered to the video_sink
+struct video_frame
+{
+    cc::span<std::byte const> data; ///< YUV 4:2:0 in the configured layout, only valid during the sink call
+    int width = 0;
+    int height = 0;
+    yuv420_layout layout = yuv420_layout::nv12;
+    uint64_t index = 0; ///< counting successful VideoCapture::capture calls
+};
+
+/// receives converted frames in capture order, called from worker threads (never concurrently)
+using video_sink = void (*)(video_frame const& frame, void* userdata);
+
+struct video_capture_config
+{
+    yuv420_layout layout = yuv420_layout::nv12;
+    unsigned max_in_flight = 4; ///< frames between capture and delivery, further captures are dropped
+    unsigned num_workers = 2;   ///< conversion threads, each converts whole frames
+};
+
+/// Pipelined capture of render targets for video encoding
+/// captures are asynchronous readbacks, converted to YUV 4:2:0 on worker threads once they complete on the GPU
+/// the render thread never waits for the GPU or for conversions, if all slots are in flight the frame is dropped instead
+/// supports bgra8un, rgba8un and rgba16f targets, rgba16f holds linear values which are clamped to [0, 1] and sRGB encoded
+///
+/// usage:
+///     VideoCapture capture(ctx, &on_video_frame, encoder);
+///     ...
+///     capture.capture(frame, backbuffer);
+///     ctx.submit(cc::move(frame));
+///
+/// captures of discarded frames are skipped, captures of frames not yet submitted are delivered once they are
+/// must be destroyed before the Context, captures of frames still unsubmitted by then are never delivered
+class PR_API VideoCapture
+{
+public:
+    /// record a readback of the target into the frame, returns false if the frame was dropped
+    /// also polls completed captures
+    bool capture(raii::Frame& frame, texture const& target);
+
+    /// hand captures that completed on the GPU to the workers, never blocks
+    void poll();
+
+    /// waits for the GPU and delivers all captures of submitted frames
+    void flush();
+
+    /// captures dropped as all slots were in flight, or discarded along with their frame
+    uint64_t get_num_dropped() const { return mNumDropped; }
+    uint64_t get_num_delivered() const;
+
+public:
+    explicit VideoCapture(Context& ctx, video_sink sink, void* userdata = nullptr, video_capture_config const& config = {});
+
+    VideoCapture(VideoCapture const&) = delete;
+    VideoCapture& operator=(VideoCapture const&) = delete;
+
+    ~VideoCapture();
+
+private:
+    enum class slot_state : uint8_t
+    {
+        idle,
+        in_flight, ///< awaiting the GPU
+        queued,    ///< awaiting a worker
+        converting,
+        converted, ///< awaiting delivery
+        discarded  ///< the frame was discarded, skipped on delivery
+    };
+
+    struct slot
+    {
+        readback rb;
+        int width = 0;
+        int height = 0;
+        pr::format fmt = pr::format::rgba8un;
+        uint64_t index = 0;
+        slot_state state = slot_state::idle;
+        cc::vector<std::byte> converted;
+    };
+
+    void workerMain();
+    void convertSlot(slot& s);
+    /// delivers converted slots and skips discarded ones, in capture order
+    void deliverConverted();
+
+    /// the oldest queued slot, or null, requires mMutex
+    slot* getQueuedSlot();
+
+private:
+    Context* mCtx = nullptr;
+    video_sink mSink = nullptr;
+    void* mSinkUserdata = nullptr;
+    yuv420_layout mLayout = yuv420_layout::nv12;
+
+    // ring of slots in capture order, guarded by mMutex
+    cc::vector<slot> mSlots;
+    uint64_t mNumCaptured = 0;
+    uint64_t mNumRetired = 0; ///< delivered or skipped, the ring position of the next delivery
+    uint64_t mNumDelivered = 0;
+    uint64_t mNumDropped = 0; ///< not guarded, only written from the capturing thread
+
+    bool mIsShuttingDown = false;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mWorkAvailable;
+    std::condition_variable mSlotDelivered;
+    std::mutex mDeliveryMutex; ///< serializes sink calls
+    cc::vector<std::thread> mWorkers;
+};
+}
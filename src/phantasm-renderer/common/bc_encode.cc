@@ -0,0 +1,593 @@
+#include "bc_encode.hh"
+
+#include <cmath>
+#include <cstring>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+#include <phantasm-renderer/common/cpu_features.hh>
+
+#ifdef PR_CPU_X86
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+// interpolation weights of bc7 4 bit indices, in 64ths
+constexpr int gc_bc7_weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+/// 4x4 pixels as separate channels (RGBA) in [0, 255]
+struct pixel_block
+{
+    alignas(16) float channels[4][16];
+};
+
+void load_block(std::byte const* src, size_t src_row_stride, uint32_t width, uint32_t num_rows, pixel_block& out)
+{
+    for (auto y = 0u; y < 4; ++y)
+    {
+        std::byte const* row = src + cc::min(y, num_rows - 1) * src_row_stride;
+
+        // partial blocks repeat the last column
+        std::byte clamped_row[16];
+        if (width < 4)
+        {
+            for (auto x = 0u; x < 4; ++x)
+                std::memcpy(clamped_row + x * 4, row + cc::min(x, width - 1) * 4, 4);
+            row = clamped_row;
+        }
+
+#ifdef PR_CPU_X86
+        __m128i const pixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row));
+        __m128i const byte_mask = _mm_set1_epi32(0xFF);
+        _mm_store_ps(out.channels[0] + y * 4, _mm_cvtepi32_ps(_mm_and_si128(pixels, byte_mask)));
+        _mm_store_ps(out.channels[1] + y * 4, _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 8), byte_mask)));
+        _mm_store_ps(out.channels[2] + y * 4, _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 16), byte_mask)));
+        _mm_store_ps(out.channels[3] + y * 4, _mm_cvtepi32_ps(_mm_srli_epi32(pixels, 24)));
+#else
+        for (auto x = 0u; x < 4; ++x)
+            for (auto c = 0u; c < 4; ++c)
+                out.channels[c][y * 4 + x] = float(uint8_t(row[x * 4 + c]));
+#endif
+    }
+}
+
+/// sum of a[i] * b[i] over the 16 pixels of a block
+float dot_block(float const* a, float const* b)
+{
+#ifdef PR_CPU_X86
+    __m128 acc = _mm_mul_ps(_mm_load_ps(a), _mm_load_ps(b));
+    for (auto i = 4u; i < 16; i += 4)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_load_ps(a + i), _mm_load_ps(b + i)));
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    return _mm_cvtss_f32(acc);
+#else
+    float res = 0.f;
+    for (auto i = 0u; i < 16; ++i)
+        res += a[i] * b[i];
+    return res;
+#endif
+}
+
+/// endpoints spanning the pixels along their principal axis
+/// the channel count is a template parameter so the small loops are unrolled
+template <unsigned num_channels>
+void fit_principal_axis(pixel_block const& b, float (&e0)[4], float (&e1)[4])
+{
+    float mean[4] = {0.f, 0.f, 0.f, 0.f};
+    float min[4] = {255.f, 255.f, 255.f, 255.f};
+    float max[4] = {0.f, 0.f, 0.f, 0.f};
+    pixel_block centered;
+    for (auto c = 0u; c < num_channels; ++c)
+    {
+        for (auto i = 0u; i < 16; ++i)
+        {
+            mean[c] += b.channels[c][i];
+            min[c] = b.channels[c][i] < min[c] ? b.channels[c][i] : min[c];
+            max[c] = b.channels[c][i] > max[c] ? b.channels[c][i] : max[c];
+        }
+        mean[c] *= 1.f / 16.f;
+
+        for (auto i = 0u; i < 16; ++i)
+            centered.channels[c][i] = b.channels[c][i] - mean[c];
+    }
+
+    float cov[4][4] = {};
+    for (auto c0 = 0u; c0 < num_channels; ++c0)
+    {
+        for (auto c1 = c0; c1 < num_channels; ++c1)
+        {
+            cov[c0][c1] = dot_block(centered.channels[c0], centered.channels[c1]);
+            cov[c1][c0] = cov[c0][c1];
+        }
+    }
+
+    // power iteration, squaring the matrix three times applies it 8 times without a long dependency chain
+    // the trace normalization keeps the powers in float range
+    for (auto it = 0; it < 3; ++it)
+    {
+        float trace = 0.f;
+        for (auto c = 0u; c < num_channels; ++c)
+            trace += cov[c][c];
+
+        if (trace < 1e-6f)
+            break;
+
+        float squared[4][4] = {};
+        float const scale = 1.f / (trace * trace);
+        for (auto c0 = 0u; c0 < num_channels; ++c0)
+            for (auto c1 = 0u; c1 < num_channels; ++c1)
+            {
+                for (auto k = 0u; k < num_channels; ++k)
+                    squared[c0][c1] += cov[c0][k] * cov[k][c1];
+                squared[c0][c1] *= scale;
+            }
+
+        std::memcpy(cov, squared, sizeof(cov));
+    }
+
+    // starting along the bounding box diagonal
+    float axis[4] = {0.f, 0.f, 0.f, 0.f};
+    for (auto c0 = 0u; c0 < num_channels; ++c0)
+        for (auto c1 = 0u; c1 < num_channels; ++c1)
+            axis[c0] += cov[c0][c1] * (max[c1] - min[c1]);
+
+    float len2 = 0.f;
+    for (auto c = 0u; c < num_channels; ++c)
+        len2 += axis[c] * axis[c];
+
+    float t_min = 0.f;
+    float t_max = 0.f;
+    if (len2 > 1e-12f)
+    {
+        float t[16] = {};
+        for (auto c = 0u; c < num_channels; ++c)
+            for (auto i = 0u; i < 16; ++i)
+                t[i] += centered.channels[c][i] * axis[c];
+
+        t_min = t[0];
+        t_max = t[0];
+        for (auto i = 1u; i < 16; ++i)
+        {
+            t_min = t[i] < t_min ? t[i] : t_min;
+            t_max = t[i] > t_max ? t[i] : t_max;
+        }
+        t_min /= len2;
+        t_max /= len2;
+    }
+
+    for (auto c = 0u; c < num_channels; ++c)
+    {
+        e0[c] = cc::min(cc::max(mean[c] + t_min * axis[c], 0.f), 255.f);
+        e1[c] = cc::min(cc::max(mean[c] + t_max * axis[c], 0.f), 255.f);
+    }
+}
+
+/// steps[i] = round(max_step * t_i) of each pixel's projection t_i onto the segment e0 -> e1, clamped to [0, max_step]
+void project_onto_endpoints(
+    pixel_block const& b, unsigned first_channel, unsigned num_channels, float const* e0, float const* e1, int max_step, int (&steps)[16])
+{
+    float dir[4] = {0.f, 0.f, 0.f, 0.f};
+    float len2 = 0.f;
+    for (auto c = first_channel; c < first_channel + num_channels; ++c)
+    {
+        dir[c] = e1[c] - e0[c];
+        len2 += dir[c] * dir[c];
+    }
+
+    if (len2 < 1e-6f)
+    {
+        for (auto& s : steps)
+            s = 0;
+        return;
+    }
+
+    float const scale = float(max_step) / len2;
+
+#ifdef PR_CPU_X86
+    __m128 const zero = _mm_setzero_ps();
+    __m128 const upper = _mm_set1_ps(float(max_step));
+    for (auto i = 0u; i < 16; i += 4)
+    {
+        __m128 t = zero;
+        for (auto c = first_channel; c < first_channel + num_channels; ++c)
+            t = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(b.channels[c] + i), _mm_set1_ps(e0[c])), _mm_set1_ps(dir[c] * scale)));
+        t = _mm_min_ps(_mm_max_ps(t, zero), upper);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(steps + i), _mm_cvtps_epi32(t));
+    }
+#else
+    for (auto i = 0u; i < 16; ++i)
+    {
+        float t = 0.f;
+        for (auto c = first_channel; c < first_channel + num_channels; ++c)
+            t += (b.channels[c][i] - e0[c]) * dir[c] * scale;
+        steps[i] = int(std::lrint(cc::min(cc::max(t, 0.f), float(max_step))));
+    }
+#endif
+}
+
+/// least squares endpoints for fixed interpolation weights in [0, 1], returns false if the weights are degenerate
+bool refit_endpoints(pixel_block const& b, unsigned num_channels, float const (&weights)[16], float (&e0)[4], float (&e1)[4])
+{
+    float aa = 0.f, ab = 0.f, bb = 0.f;
+    float ap[4] = {0.f, 0.f, 0.f, 0.f};
+    float bp[4] = {0.f, 0.f, 0.f, 0.f};
+    for (auto i = 0u; i < 16; ++i)
+    {
+        float const w1 = weights[i];
+        float const w0 = 1.f - w1;
+        aa += w0 * w0;
+        ab += w0 * w1;
+        bb += w1 * w1;
+        for (auto c = 0u; c < num_channels; ++c)
+        {
+            ap[c] += w0 * b.channels[c][i];
+            bp[c] += w1 * b.channels[c][i];
+        }
+    }
+
+    float const det = aa * bb - ab * ab;
+    if (std::abs(det) < 1e-6f)
+        return false;
+
+    float const inv_det = 1.f / det;
+    for (auto c = 0u; c < num_channels; ++c)
+    {
+        e0[c] = cc::min(cc::max((bb * ap[c] - ab * bp[c]) * inv_det, 0.f), 255.f);
+        e1[c] = cc::min(cc::max((aa * bp[c] - ab * ap[c]) * inv_det, 0.f), 255.f);
+    }
+    return true;
+}
+
+int get_num_refinements(pr::bc_quality quality)
+{
+    switch (quality)
+    {
+    case pr::bc_quality::fast:
+        return 0;
+    case pr::bc_quality::normal:
+        return 1;
+    case pr::bc_quality::high:
+        return 4;
+    }
+    return 0;
+}
+
+//
+// bc1 color block, also the color part of bc3
+
+uint16_t quantize_565(float const (&e)[4])
+{
+    auto const q = [](float v, int max) { return unsigned(std::lrint(v * float(max) / 255.f)); };
+    return uint16_t(q(e[0], 31) << 11 | q(e[1], 63) << 5 | q(e[2], 31));
+}
+
+void dequantize_565(uint16_t v, float (&out)[4])
+{
+    unsigned const r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+    out[0] = float(r << 3 | r >> 2);
+    out[1] = float(g << 2 | g >> 4);
+    out[2] = float(b << 3 | b >> 2);
+    out[3] = 255.f;
+}
+
+float get_color_error(pixel_block const& b, float const (&d0)[4], float const (&d1)[4], int const (&steps)[16])
+{
+    float err = 0.f;
+    for (auto i = 0u; i < 16; ++i)
+    {
+        float const w = float(steps[i]) * (1.f / 3.f);
+        for (auto c = 0u; c < 3; ++c)
+        {
+            float const diff = d0[c] + (d1[c] - d0[c]) * w - b.channels[c][i];
+            err += diff * diff;
+        }
+    }
+    return err;
+}
+
+void encode_color_block(pixel_block const& b, pr::bc_quality quality, std::byte* dest)
+{
+    float e0[4], e1[4];
+    fit_principal_axis<3>(b, e0, e1);
+
+    uint16_t best_c0 = 0, best_c1 = 0;
+    int best_steps[16] = {};
+    float best_error = 1e30f;
+
+    for (auto it = 0, num_its = get_num_refinements(quality); it <= num_its; ++it)
+    {
+        // indices are chosen against the endpoints as the hardware decodes them
+        uint16_t const c0 = quantize_565(e0);
+        uint16_t const c1 = quantize_565(e1);
+        float d0[4], d1[4];
+        dequantize_565(c0, d0);
+        dequantize_565(c1, d1);
+
+        int steps[16];
+        project_onto_endpoints(b, 0, 3, d0, d1, 3, steps);
+
+        float const err = get_color_error(b, d0, d1, steps);
+        if (err < best_error)
+        {
+            best_error = err;
+            best_c0 = c0;
+            best_c1 = c1;
+            std::memcpy(best_steps, steps, sizeof(steps));
+        }
+
+        if (it == num_its)
+            break;
+
+        float weights[16];
+        for (auto i = 0u; i < 16; ++i)
+            weights[i] = float(steps[i]) * (1.f / 3.f);
+
+        if (!refit_endpoints(b, 3, weights, e0, e1))
+            break;
+    }
+
+    // color0 > color1 selects the 4 color mode, equal endpoints decode to the same color with every index
+    uint32_t indices = 0;
+    if (best_c0 != best_c1)
+    {
+        if (best_c0 < best_c1)
+        {
+            cc::swap(best_c0, best_c1);
+            for (auto& s : best_steps)
+                s = 3 - s;
+        }
+
+        // palette order is color0, color1, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1
+        constexpr uint32_t step_to_index[4] = {0, 2, 3, 1};
+        for (auto i = 0u; i < 16; ++i)
+            indices |= step_to_index[best_steps[i]] << (2 * i);
+    }
+
+    std::memcpy(dest, &best_c0, 2);
+    std::memcpy(dest + 2, &best_c1, 2);
+    std::memcpy(dest + 4, &indices, 4);
+}
+
+//
+// bc3 alpha block
+
+void encode_alpha_block(pixel_block const& b, std::byte* dest)
+{
+    float amin = 255.f;
+    float amax = 0.f;
+    for (auto i = 0u; i < 16; ++i)
+    {
+        amin = cc::min(amin, b.channels[3][i]);
+        amax = cc::max(amax, b.channels[3][i]);
+    }
+
+    // alpha0 > alpha1 selects 8 interpolated values, min and max are exact as the source is 8 bit
+    float e0[4] = {0.f, 0.f, 0.f, amax};
+    float e1[4] = {0.f, 0.f, 0.f, amin};
+    int steps[16];
+    project_onto_endpoints(b, 3, 1, e0, e1, 7, steps);
+
+    // palette order is alpha0, alpha1, then the 6 interpolated values from alpha0 to alpha1
+    uint64_t bits = uint64_t(uint8_t(amax)) | uint64_t(uint8_t(amin)) << 8;
+    for (auto i = 0u; i < 16; ++i)
+    {
+        int const s = steps[i];
+        uint64_t const index = s == 0 ? 0 : (s == 7 ? 1 : uint64_t(s + 1));
+        bits |= index << (16 + 3 * i);
+    }
+
+    std::memcpy(dest, &bits, 8);
+}
+
+//
+// bc7 mode 6: one RGBA subset, 7 bit endpoints with a p-bit each, 4 bit indices
+
+struct bc7_endpoint
+{
+    uint8_t values[4]; ///< 7 bit
+    uint8_t pbit;
+
+    int decoded(unsigned c) const { return values[c] << 1 | pbit; }
+};
+
+bc7_endpoint quantize_bc7_endpoint(float const (&e)[4])
+{
+    bc7_endpoint best = {};
+    float best_error = 1e30f;
+    for (uint8_t p = 0; p < 2; ++p)
+    {
+        bc7_endpoint candidate;
+        candidate.pbit = p;
+        float err = 0.f;
+        for (auto c = 0u; c < 4; ++c)
+        {
+            candidate.values[c] = uint8_t(cc::min(cc::max(std::lrint((e[c] - float(p)) * .5f), 0l), 127l));
+            float const diff = float(candidate.decoded(c)) - e[c];
+            err += diff * diff;
+        }
+
+        if (err < best_error)
+        {
+            best_error = err;
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+/// nearest bc7 index of each weight in 64ths
+struct bc7_index_table
+{
+    uint8_t indices[65];
+
+    bc7_index_table()
+    {
+        for (auto w = 0; w <= 64; ++w)
+        {
+            int best = 0;
+            for (auto i = 1; i < 16; ++i)
+                if (std::abs(gc_bc7_weights[i] - w) < std::abs(gc_bc7_weights[best] - w))
+                    best = i;
+            indices[w] = uint8_t(best);
+        }
+    }
+};
+
+void get_bc7_indices(pixel_block const& b, bc7_endpoint const& q0, bc7_endpoint const& q1, int (&indices)[16], float& out_error)
+{
+    static bc7_index_table const table;
+
+    float d0[4], d1[4];
+    for (auto c = 0u; c < 4; ++c)
+    {
+        d0[c] = float(q0.decoded(c));
+        d1[c] = float(q1.decoded(c));
+    }
+
+    int steps[16];
+    project_onto_endpoints(b, 0, 4, d0, d1, 64, steps);
+
+    out_error = 0.f;
+    for (auto i = 0u; i < 16; ++i)
+    {
+        indices[i] = table.indices[steps[i]];
+        int const w = gc_bc7_weights[indices[i]];
+        for (auto c = 0u; c < 4; ++c)
+        {
+            int const v = ((64 - w) * q0.decoded(c) + w * q1.decoded(c) + 32) >> 6;
+            float const diff = float(v) - b.channels[c][i];
+            out_error += diff * diff;
+        }
+    }
+}
+
+/// writes fields of up to 8 bits into a 128 bit block, least significant bit first
+struct bit_writer
+{
+    uint64_t words[2] = {0, 0};
+    unsigned pos = 0;
+
+    void write(uint64_t value, unsigned num_bits)
+    {
+        unsigned const word = pos / 64;
+        unsigned const shift = pos % 64;
+        words[word] |= value << shift;
+        if (shift + num_bits > 64)
+            words[1] |= value >> (64 - shift);
+        pos += num_bits;
+    }
+};
+
+void encode_bc7_block(pixel_block const& b, pr::bc_quality quality, std::byte* dest)
+{
+    float e0[4], e1[4];
+    fit_principal_axis<4>(b, e0, e1);
+
+    bc7_endpoint best_q0 = {}, best_q1 = {};
+    int best_indices[16] = {};
+    float best_error = 1e30f;
+
+    for (auto it = 0, num_its = get_num_refinements(quality); it <= num_its; ++it)
+    {
+        bc7_endpoint const q0 = quantize_bc7_endpoint(e0);
+        bc7_endpoint const q1 = quantize_bc7_endpoint(e1);
+
+        int indices[16];
+        float err;
+        get_bc7_indices(b, q0, q1, indices, err);
+
+        if (err < best_error)
+        {
+            best_error = err;
+            best_q0 = q0;
+            best_q1 = q1;
+            std::memcpy(best_indices, indices, sizeof(indices));
+        }
+
+        if (it == num_its)
+            break;
+
+        float weights[16];
+        for (auto i = 0u; i < 16; ++i)
+            weights[i] = float(gc_bc7_weights[indices[i]]) * (1.f / 64.f);
+
+        if (!refit_endpoints(b, 4, weights, e0, e1))
+            break;
+    }
+
+    // the anchor (first) index is stored with an implicit 0 msb
+    if (best_indices[0] >= 8)
+    {
+        cc::swap(best_q0, best_q1);
+        for (auto& i : best_indices)
+            i = 15 - i;
+    }
+
+    bit_writer w;
+    w.write(1 << 6, 7); // mode 6
+    for (auto c = 0u; c < 4; ++c)
+    {
+        w.write(best_q0.values[c], 7);
+        w.write(best_q1.values[c], 7);
+    }
+    w.write(best_q0.pbit, 1);
+    w.write(best_q1.pbit, 1);
+    w.write(uint64_t(best_indices[0]), 3);
+    for (auto i = 1u; i < 16; ++i)
+        w.write(uint64_t(best_indices[i]), 4);
+
+    CC_ASSERT(w.pos == 128 && "bc7 block layout mismatch");
+    std::memcpy(dest, w.words, 16);
+}
+}
+
+bool pr::is_bc_encodable(format fmt)
+{
+    switch (fmt)
+    {
+    case format::bc1_8un:
+    case format::bc1_8un_srgb:
+    case format::bc3_8un:
+    case format::bc3_8un_srgb:
+    case format::bc7_8un:
+    case format::bc7_8un_srgb:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void pr::encode_bc_block_row(
+    format fmt, bc_quality quality, const std::byte* __restrict src, size_t src_row_stride_bytes, uint32_t width, uint32_t num_pixel_rows, std::byte* __restrict dest)
+{
+    CC_ASSERT(is_bc_encodable(fmt) && "format cannot be encoded");
+    CC_ASSERT(width > 0 && num_pixel_rows > 0 && "empty block row");
+
+    for (auto x = 0u; x < width; x += 4)
+    {
+        pixel_block block;
+        load_block(src + size_t(x) * 4, src_row_stride_bytes, width - x, num_pixel_rows, block);
+
+        switch (fmt)
+        {
+        case format::bc1_8un:
+        case format::bc1_8un_srgb:
+            encode_color_block(block, quality, dest);
+            dest += 8;
+            break;
+        case format::bc3_8un:
+        case format::bc3_8un_srgb:
+            encode_alpha_block(block, dest);
+            encode_color_block(block, quality, dest + 8);
+            dest += 16;
+            break;
+        default:
+            encode_bc7_block(block, quality, dest);
+            dest += 16;
+            break;
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <phantasm-renderer/enums.hh>
+
+namespace pr
+{
+/// speed/quality tradeoff of block compression
+/// fast: principal axis endpoints, normal: one least squares refinement, high: several refinements keeping the best
+enum class bc_quality : uint8_t
+{
+    fast,
+    normal,
+    high
+};
+
+/// whether encode_bc_block_row supports a format: bc1, bc3 and bc7, linear and sRGB
+/// bc1 stores opaque RGB, bc7 uses mode 6 (a single RGBA subset with 4 bit indices)
+bool is_bc_encodable(format fmt);
+
+/// encodes a row of 4x4 blocks from RGBA8 pixels into tightly packed blocks
+/// width and num_pixel_rows are the remaining pixels of the source, partial blocks at the edges repeat the last row and column
+/// sRGB formats are encoded on the sRGB values as they are
+void encode_bc_block_row(format fmt, bc_quality quality, std::byte const* __restrict src, size_t src_row_stride_bytes, uint32_t width, uint32_t num_pixel_rows, std::byte* __restrict dest);
+}
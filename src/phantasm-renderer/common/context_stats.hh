@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pr
+{
+/// snapshot of the performance counters of a Context, see Context::get_stats
+struct context_stats
+{
+    struct cache_stats
+    {
+        uint64_t num_hits = 0;
+        uint64_t num_misses = 0;
+    };
+
+    // cache lookups
+    cache_stats cache_textures;
+    cache_stats cache_buffers;
+    cache_stats cache_graphics_psos;
+    cache_stats cache_compute_psos;
+    cache_stats cache_graphics_svs;
+    cache_stats cache_compute_svs;
+
+    // object lifetimes
+    uint64_t num_psos_created = 0;         ///< persisted and cached PSOs
+    uint64_t num_shader_views_created = 0; ///< persisted and cached shader views (arguments)
+    uint64_t num_resources_created = 0;    ///< textures and buffers, including cache misses
+    uint64_t num_resources_freed = 0;      ///< textures and buffers freed immediately or culled from caches
+    uint64_t num_deferred_frees = 0;       ///< deferred frees of resources, shader views and PSOs that were executed
+
+    // submission
+    uint64_t num_bytes_compiled = 0; ///< size of the command streams recorded in Context::compile
+    uint64_t num_submits = 0;        ///< submits of non-empty frames
+    uint64_t record_time_ns = 0;     ///< time spent in phi::Backend::recordCommandList
+};
+}
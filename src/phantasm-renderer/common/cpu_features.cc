@@ -0,0 +1,78 @@
+#include "cpu_features.hh"
+
+#include <cstdint>
+
+#ifdef PR_CPU_X86
+#ifdef _MSC_VER
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+#ifdef PR_CPU_X86
+void query_cpuid(unsigned leaf, unsigned subleaf, unsigned (&out)[4])
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuidex(regs, int(leaf), int(subleaf));
+    for (auto i = 0; i < 4; ++i)
+        out[i] = unsigned(regs[i]);
+#else
+    __cpuid_count(leaf, subleaf, out[0], out[1], out[2], out[3]);
+#endif
+}
+
+/// register state the OS saves on context switches
+uint64_t query_xcr0()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return uint64_t(edx) << 32 | eax;
+#endif
+}
+
+pr::cpu_features detect_cpu_features()
+{
+    pr::cpu_features res;
+
+    unsigned regs[4];
+    query_cpuid(0, 0, regs);
+    unsigned const max_leaf = regs[0];
+
+    query_cpuid(1, 0, regs);
+    res.ssse3 = (regs[2] & (1u << 9)) != 0;
+
+    // AVX instructions additionally require the OS to save the YMM (and ZMM) registers
+    bool const has_osxsave = (regs[2] & (1u << 27)) != 0;
+    uint64_t const xcr0 = has_osxsave ? query_xcr0() : 0;
+    bool const has_avx = (regs[2] & (1u << 28)) != 0 && (xcr0 & 0x6) == 0x6;
+    bool const has_avx512_state = (xcr0 & 0xE6) == 0xE6;
+
+    res.f16c = has_avx && (regs[2] & (1u << 29)) != 0;
+
+    if (max_leaf >= 7)
+    {
+        query_cpuid(7, 0, regs);
+        res.avx2 = has_avx && (regs[1] & (1u << 5)) != 0;
+        res.avx512f = has_avx && has_avx512_state && (regs[1] & (1u << 16)) != 0;
+    }
+
+    return res;
+}
+#else
+pr::cpu_features detect_cpu_features() { return {}; }
+#endif
+}
+
+pr::cpu_features const& pr::get_cpu_features()
+{
+    static cpu_features const features = detect_cpu_features();
+    return features;
+}
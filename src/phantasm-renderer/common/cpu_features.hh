@@ -0,0 +1,26 @@
+#pragma once
+
+// PR_CPU_X86: x86-64, where SSE2 is always available and wider instruction sets are detected at runtime
+// PR_TARGET_ISA: enables an instruction set for a single function, which must only be called if the CPU supports it
+#if defined(__x86_64__) || defined(_M_X64)
+#define PR_CPU_X86 1
+#ifdef _MSC_VER
+#define PR_TARGET_ISA(_isa_)
+#else
+#define PR_TARGET_ISA(_isa_) __attribute__((target(_isa_)))
+#endif
+#endif
+
+namespace pr
+{
+/// instruction sets supported by the CPU and the OS, detected once
+struct cpu_features
+{
+    bool ssse3 = false;
+    bool f16c = false;
+    bool avx2 = false;
+    bool avx512f = false;
+};
+
+cpu_features const& get_cpu_features();
+}
@@ -0,0 +1,240 @@
+#include "draw_delta_stream.hh"
+
+#include <cstring>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+pr::draw_delta_stream::draw_delta_stream(size_t initial_size, cc::allocator* alloc) : _encoded(initial_size, alloc), _runs(alloc), _splits(alloc)
+{
+    resetReference();
+}
+
+template <class F>
+void pr::draw_delta_stream::decode(size_t encoded_offset, size_t num_draws, const phi::cmd::draw& reference, F&& get_dest) const
+{
+    std::byte const* prev = reinterpret_cast<std::byte const*>(&reference);
+    size_t num_remaining = num_draws;
+    size_t chunk_start = 0;
+
+    _encoded.iterate_chunks([&](growing_writer::chunk const& c) {
+        size_t offset = encoded_offset > chunk_start ? encoded_offset - chunk_start : 0;
+        chunk_start += c.size;
+
+        // records never straddle chunks
+        while (num_remaining > 0 && offset < c.size)
+        {
+            uint64_t mask[num_mask_words];
+            std::memcpy(mask, c.buffer + offset, sizeof(mask));
+            offset += sizeof(mask);
+
+            std::byte* const dest = get_dest();
+            std::memcpy(dest, prev, sizeof(phi::cmd::draw));
+
+            for (auto i = 0u; i < num_words; ++i)
+            {
+                if (mask[i / 64] & (uint64_t(1) << (i % 64)))
+                {
+                    std::memcpy(dest + i * sizeof(uint32_t), c.buffer + offset, sizeof(uint32_t));
+                    offset += sizeof(uint32_t);
+                }
+            }
+
+            prev = dest;
+            --num_remaining;
+        }
+    });
+
+    CC_ASSERT(num_remaining == 0 && "encoded drawcall stream truncated");
+}
+
+void pr::draw_delta_stream::add(const phi::cmd::draw& dcmd, size_t phi_stream_offset)
+{
+    if (_runs.empty() || _runs.back().phi_stream_offset != phi_stream_offset)
+    {
+        // other commands were written since the last drawcall, start a new run
+        _runs.push_back({phi_stream_offset, _encoded.size(), 0});
+        std::memcpy(&_open_run_reference, &_last_draw, sizeof(phi::cmd::draw));
+    }
+
+    encode(dcmd);
+    ++_runs.back().num_draws;
+    ++_num_draws;
+}
+
+void pr::draw_delta_stream::expand(const growing_writer& phi_stream, std::byte* dest) const
+{
+    phi::cmd::draw reference;
+    std::memset(&reference, 0, sizeof(reference));
+
+    expandRange(phi_stream, {0, 0, 0}, {phi_stream.size(), _runs.size(), _num_draws}, reference, dest);
+}
+
+void pr::draw_delta_stream::add_split_point(size_t phi_stream_offset)
+{
+    split const previous = getPieceBegin(_splits.size());
+    size_t const piece_size = (phi_stream_offset - previous.phi_stream_offset) + (_num_draws - previous.num_draws) * sizeof(phi::cmd::draw);
+
+    if (piece_size >= min_piece_size)
+        _splits.push_back({phi_stream_offset, _runs.size(), _num_draws});
+}
+
+size_t pr::draw_delta_stream::get_expanded_piece_size(const growing_writer& phi_stream, size_t piece_index) const
+{
+    split const begin = getPieceBegin(piece_index);
+    split const end = getPieceEnd(phi_stream, piece_index);
+    return (end.phi_stream_offset - begin.phi_stream_offset) + (end.num_draws - begin.num_draws) * sizeof(phi::cmd::draw);
+}
+
+void pr::draw_delta_stream::expand_next_piece(const growing_writer& phi_stream, piece_cursor& cursor, std::byte* dest) const
+{
+    CC_ASSERT(cursor.piece_index < num_pieces() && "expanded past the last piece");
+    expandRange(phi_stream, getPieceBegin(cursor.piece_index), getPieceEnd(phi_stream, cursor.piece_index), cursor.reference, dest);
+    ++cursor.piece_index;
+}
+
+pr::draw_delta_stream::split pr::draw_delta_stream::getPieceBegin(size_t piece_index) const
+{
+    return piece_index == 0 ? split{0, 0, 0} : _splits[piece_index - 1];
+}
+
+pr::draw_delta_stream::split pr::draw_delta_stream::getPieceEnd(const growing_writer& phi_stream, size_t piece_index) const
+{
+    return piece_index < _splits.size() ? _splits[piece_index] : split{phi_stream.size(), _runs.size(), _num_draws};
+}
+
+void pr::draw_delta_stream::expandRange(const growing_writer& phi_stream, const split& begin, const split& end, phi::cmd::draw& reference, std::byte* dest) const
+{
+    cc::alloc_vector<growing_writer::chunk> chunks;
+    chunks.reset_reserve(phi_stream.allocator(), phi_stream.num_chunks());
+    phi_stream.iterate_chunks([&](growing_writer::chunk const& c) { chunks.push_back(c); });
+
+    // locate the chunk containing the beginning of the range
+    size_t num_phi_bytes_written = begin.phi_stream_offset;
+    size_t chunk_index = 0;
+    size_t offset_in_chunk = begin.phi_stream_offset;
+    while (chunk_index < chunks.size() && offset_in_chunk >= chunks[chunk_index].size)
+    {
+        offset_in_chunk -= chunks[chunk_index].size;
+        ++chunk_index;
+    }
+
+    auto const f_write_phi_until = [&](size_t phi_stream_offset) {
+        while (num_phi_bytes_written < phi_stream_offset)
+        {
+            growing_writer::chunk const& c = chunks[chunk_index];
+            size_t const num_bytes = cc::min(c.size - offset_in_chunk, phi_stream_offset - num_phi_bytes_written);
+
+            std::memcpy(dest, c.buffer + offset_in_chunk, num_bytes);
+            dest += num_bytes;
+            num_phi_bytes_written += num_bytes;
+            offset_in_chunk += num_bytes;
+
+            if (offset_in_chunk == c.size)
+            {
+                ++chunk_index;
+                offset_in_chunk = 0;
+            }
+        }
+    };
+
+    size_t const num_draws = end.num_draws - begin.num_draws;
+    if (num_draws > 0)
+    {
+        size_t run_index = begin.run_index;
+        unsigned num_remaining_in_run = 0;
+        std::byte* last_draw = nullptr;
+
+        decode(_runs[run_index].encoded_offset, num_draws, reference, [&]() -> std::byte* {
+            while (num_remaining_in_run == 0)
+            {
+                // entering the next run, write preceding phi commands first
+                f_write_phi_until(_runs[run_index].phi_stream_offset);
+                num_remaining_in_run = _runs[run_index].num_draws;
+                ++run_index;
+            }
+
+            --num_remaining_in_run;
+            last_draw = dest;
+            dest += sizeof(phi::cmd::draw);
+            return last_draw;
+        });
+
+        // the destination is reused for the next piece
+        std::memcpy(&reference, last_draw, sizeof(phi::cmd::draw));
+    }
+
+    f_write_phi_until(end.phi_stream_offset);
+}
+
+unsigned pr::draw_delta_stream::get_num_draws_open_run(size_t phi_stream_offset) const
+{
+    if (_runs.empty() || _runs.back().phi_stream_offset != phi_stream_offset)
+        return 0;
+
+    return _runs.back().num_draws;
+}
+
+void pr::draw_delta_stream::decode_open_run(cc::alloc_vector<phi::cmd::draw>& out_draws) const
+{
+    CC_ASSERT(!_runs.empty() && "no drawcalls recorded");
+    run const& open_run = _runs.back();
+
+    // reserve fully, references must not move
+    out_draws.reset_reserve(_encoded.allocator(), open_run.num_draws);
+
+    decode(open_run.encoded_offset, open_run.num_draws, _open_run_reference, [&]() -> std::byte* {
+        return reinterpret_cast<std::byte*>(&out_draws.emplace_back());
+    });
+}
+
+void pr::draw_delta_stream::rewrite_open_run(cc::span<const phi::cmd::draw> draws)
+{
+    CC_ASSERT(!_runs.empty() && "no drawcalls recorded");
+    run& open_run = _runs.back();
+
+    _encoded.rewind(open_run.encoded_offset);
+    std::memcpy(&_last_draw, &_open_run_reference, sizeof(phi::cmd::draw));
+    _num_draws -= open_run.num_draws;
+
+    for (phi::cmd::draw const& dcmd : draws)
+        encode(dcmd);
+
+    open_run.num_draws = unsigned(draws.size());
+    _num_draws += draws.size();
+}
+
+void pr::draw_delta_stream::encode(const phi::cmd::draw& dcmd)
+{
+    uint32_t words[num_words];
+    uint32_t reference_words[num_words];
+    std::memcpy(words, &dcmd, sizeof(words));
+    std::memcpy(reference_words, &_last_draw, sizeof(reference_words));
+
+    // record: bitmask of changed words, followed by the changed words
+    uint64_t mask[num_mask_words] = {};
+    uint32_t changed_words[num_words];
+    unsigned num_changed = 0;
+
+    for (auto i = 0u; i < num_words; ++i)
+    {
+        if (words[i] != reference_words[i])
+        {
+            mask[i / 64] |= uint64_t(1) << (i % 64);
+            changed_words[num_changed++] = words[i];
+        }
+    }
+
+    std::byte* const out = _encoded.write_raw_bytes(sizeof(mask) + num_changed * sizeof(uint32_t));
+    std::memcpy(out, mask, sizeof(mask));
+    std::memcpy(out + sizeof(mask), changed_words, num_changed * sizeof(uint32_t));
+
+    std::memcpy(&_last_draw, &dcmd, sizeof(phi::cmd::draw));
+}
+
+void pr::draw_delta_stream::resetReference()
+{
+    // compare bytewise against zero, including padding
+    std::memset(&_last_draw, 0, sizeof(_last_draw));
+    std::memset(&_open_run_reference, 0, sizeof(_open_run_reference));
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstring>
+
+#include <clean-core/alloc_vector.hh>
+#include <clean-core/span.hh>
+
+#include <phantasm-hardware-interface/commands.hh>
+
+#include <phantasm-renderer/common/growing_writer.hh>
+
+namespace pr
+{
+// compact stream of drawcalls, each stored as the 4-byte words that differ from the preceding drawcall
+// consecutive drawcalls form runs that are spliced into a phi command stream at their recorded offset on expansion
+// expansion reconstructs the exact bytes of each phi::cmd::draw
+// the expanded stream can be split into pieces at points outside of render passes, which are expanded and recorded one after another
+struct draw_delta_stream
+{
+    static_assert(sizeof(phi::cmd::draw) % sizeof(uint32_t) == 0, "phi::cmd::draw is not word-sized");
+    static constexpr unsigned num_words = sizeof(phi::cmd::draw) / sizeof(uint32_t);
+    static constexpr unsigned num_mask_words = (num_words + 63) / 64;
+
+    /// pieces of the expanded stream are at least this large, except for the last one
+    static constexpr size_t min_piece_size = 2 * 1024 * 1024;
+
+    /// state of a piecewise expansion, pieces are expanded in order
+    struct piece_cursor
+    {
+        size_t piece_index = 0;
+        phi::cmd::draw reference; ///< the last drawcall of the previous pieces
+
+        piece_cursor() { std::memset(&reference, 0, sizeof(reference)); }
+    };
+
+    draw_delta_stream() { resetReference(); }
+    draw_delta_stream(size_t initial_size, cc::allocator* alloc);
+
+    draw_delta_stream(draw_delta_stream&&) noexcept = default;
+    draw_delta_stream& operator=(draw_delta_stream&&) noexcept = default;
+
+    /// appends a drawcall belonging at the given offset of the phi command stream
+    void add(phi::cmd::draw const& dcmd, size_t phi_stream_offset);
+
+    size_t num_draws() const { return _num_draws; }
+    bool is_empty() const { return _num_draws == 0; }
+
+    /// size of the phi command stream with all drawcalls spliced in
+    size_t get_expanded_size(growing_writer const& phi_stream) const { return phi_stream.size() + _num_draws * sizeof(phi::cmd::draw); }
+
+    /// writes the phi command stream with all drawcalls spliced in to dest, which must be at least get_expanded_size() bytes large
+    void expand(growing_writer const& phi_stream, std::byte* dest) const;
+
+    /// marks an offset of the phi command stream outside of render passes where the expanded stream can be split
+    /// ignored if the piece ending at it would be smaller than min_piece_size
+    void add_split_point(size_t phi_stream_offset);
+
+    /// amount of pieces the expanded stream is split into
+    size_t num_pieces() const { return _splits.size() + 1; }
+
+    /// size of a piece of the expanded stream
+    size_t get_expanded_piece_size(growing_writer const& phi_stream, size_t piece_index) const;
+
+    /// writes the next piece of the expanded stream to dest, which must be at least get_expanded_piece_size() bytes large
+    void expand_next_piece(growing_writer const& phi_stream, piece_cursor& cursor, std::byte* dest) const;
+
+    /// amount of drawcalls in the most recent run if it is still open at the given phi stream offset, 0 otherwise
+    unsigned get_num_draws_open_run(size_t phi_stream_offset) const;
+
+    /// decodes all drawcalls of the most recent run
+    void decode_open_run(cc::alloc_vector<phi::cmd::draw>& out_draws) const;
+
+    /// replaces all drawcalls of the most recent run
+    void rewrite_open_run(cc::span<phi::cmd::draw const> draws);
+
+private:
+    struct run
+    {
+        size_t phi_stream_offset; ///< offset in the phi command stream the run is spliced in at
+        size_t encoded_offset;    ///< offset in _encoded of the first drawcall
+        unsigned num_draws;
+    };
+
+    /// the start of a piece of the expanded stream
+    struct split
+    {
+        size_t phi_stream_offset;
+        size_t run_index; ///< the first run in the piece
+        size_t num_draws; ///< drawcalls in all previous pieces
+    };
+
+    void encode(phi::cmd::draw const& dcmd);
+
+    split getPieceBegin(size_t piece_index) const;
+    split getPieceEnd(growing_writer const& phi_stream, size_t piece_index) const;
+
+    /// writes a range of the phi stream with the drawcalls of the given runs spliced in
+    /// reference is the drawcall preceding the first run, and receives the last expanded one
+    void expandRange(growing_writer const& phi_stream, split const& begin, split const& end, phi::cmd::draw& reference, std::byte* dest) const;
+
+    void resetReference();
+
+    // calls get_dest() for each decoded drawcall, which returns the location to write it to
+    // the previously written drawcall is the reference for the next, it must stay in place
+    template <class F>
+    void decode(size_t encoded_offset, size_t num_draws, phi::cmd::draw const& reference, F&& get_dest) const;
+
+private:
+    growing_writer _encoded;
+    cc::alloc_vector<run> _runs;
+    cc::alloc_vector<split> _splits;
+    size_t _num_draws = 0;
+    phi::cmd::draw _last_draw;          ///< the reference of the next encoded drawcall
+    phi::cmd::draw _open_run_reference; ///< the reference of the first drawcall in the most recent run
+};
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+#include <phantasm-hardware-interface/commands.hh>
+
+namespace pr
+{
+/// packs the state of a drawcall into a 64 bit key for Framebuffer::sort_drawcalls
+/// most to least significant: PSO (16 bit), first shader argument (16 bit), vertex and index buffer (16 bit), depth (16 bit)
+/// handles are truncated to their low bits, collisions only cost sort quality, not correctness
+/// depth is expected in [0, 1], ascending keys sort front to back (pass 1 - depth for back to front)
+[[nodiscard]] inline uint64_t make_draw_sort_key(phi::handle::pipeline_state pso,
+                                                 phi::handle::shader_view first_argument,
+                                                 phi::handle::resource vertex_buffer,
+                                                 phi::handle::resource index_buffer,
+                                                 float depth)
+{
+    auto const f_low16 = [](uint32_t value) -> uint64_t { return uint64_t(value & 0xFFFF); };
+
+    float const depth_clamped = depth < 0.f ? 0.f : (depth > 1.f ? 1.f : depth);
+    auto const depth_quantized = uint64_t(depth_clamped * 65535.f);
+    auto const buffers = uint32_t(vertex_buffer._value) ^ (uint32_t(index_buffer._value) << 8);
+
+    return (f_low16(uint32_t(pso._value)) << 48) | (f_low16(uint32_t(first_argument._value)) << 32) | (f_low16(buffers) << 16) | depth_quantized;
+}
+
+/// packs the state of a drawcall into a 64 bit key for Framebuffer::sort_drawcalls
+/// for draws recorded as raw phi commands, draws of a GraphicsPass use the overload above
+/// with the PSO, first argument and vertex / index buffer handles passed to the draw
+[[nodiscard]] inline uint64_t make_draw_sort_key(phi::cmd::draw const& dcmd, float depth)
+{
+    return make_draw_sort_key(dcmd.pipeline_state, dcmd.shader_arguments.empty() ? phi::handle::null_shader_view : dcmd.shader_arguments[0].shader_view,
+                              dcmd.vertex_buffers[0], dcmd.index_buffer, depth);
+}
+}
@@ -1,6 +1,12 @@
 #include "growing_writer.hh"
 
-pr::growing_writer::growing_writer(size_t initial_size, cc::allocator* alloc) : _alloc(alloc)
+#include <cstring>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+pr::growing_writer::growing_writer(size_t initial_size, cc::allocator* alloc)
+  : _full_chunks(alloc), _chunk_size(cc::max(initial_size, min_chunk_size)), _alloc(alloc)
 {
     CC_CONTRACT(alloc != nullptr);
     _writer.initialize(_alloc->alloc(initial_size), initial_size);
@@ -10,17 +16,87 @@ pr::growing_writer& pr::growing_writer::operator=(pr::growing_writer&& rhs) noex
 {
     if (this != &rhs)
     {
-        if (_writer.buffer() != nullptr)
-        {
-            _alloc->free(_writer.buffer());
-        }
+        freeAllChunks();
 
         _writer = rhs._writer;
+        _full_chunks = cc::move(rhs._full_chunks);
+        _size_full_chunks = rhs._size_full_chunks;
+        _chunk_size = rhs._chunk_size;
         _alloc = rhs._alloc;
         rhs._writer.exchange_buffer(nullptr, 0);
+        rhs._size_full_chunks = 0;
         rhs._alloc = cc::system_allocator;
     }
     return *this;
 }
 
-pr::growing_writer::~growing_writer() { _alloc->free(_writer.buffer()); }
+pr::growing_writer::~growing_writer() { freeAllChunks(); }
+
+void pr::growing_writer::reset()
+{
+    for (chunk const& c : _full_chunks)
+        _alloc->free(c.buffer);
+
+    _full_chunks.clear();
+    _size_full_chunks = 0;
+    _writer.reset();
+}
+
+void pr::growing_writer::rewind(size_t new_size)
+{
+    CC_ASSERT(new_size <= size() && "rewind beyond the end of the stream");
+
+    // reopen previous chunks until the new end lies in the current one
+    while (new_size < _size_full_chunks)
+    {
+        _alloc->free(_writer.buffer());
+
+        chunk const last = _full_chunks.back();
+        _full_chunks.pop_back();
+        _size_full_chunks -= last.size;
+
+        _writer.initialize(last.buffer, last.capacity);
+    }
+
+    _writer.reset();
+    _writer.advance_cursor(new_size - _size_full_chunks);
+}
+
+void pr::growing_writer::gather(std::byte* dest) const
+{
+    iterate_chunks([&](chunk const& c) {
+        std::memcpy(dest, c.buffer, c.size);
+        dest += c.size;
+    });
+}
+
+void pr::growing_writer::startNewChunk(size_t min_size)
+{
+    size_t const new_size = cc::max(_chunk_size, min_size);
+
+    if (_writer.empty())
+    {
+        // the current chunk is unused but too small, replace it - nothing to copy
+        _alloc->free(_writer.buffer());
+    }
+    else
+    {
+        // retire the current chunk, the unused tail is wasted (bounded by the largest command size)
+        _full_chunks.push_back(current_chunk());
+        _size_full_chunks += _writer.size();
+    }
+
+    _writer.initialize(_alloc->alloc(new_size), new_size);
+}
+
+void pr::growing_writer::freeAllChunks()
+{
+    for (chunk const& c : _full_chunks)
+        _alloc->free(c.buffer);
+
+    _full_chunks.clear();
+    _size_full_chunks = 0;
+
+    _alloc->free(_writer.buffer());
+    _writer.exchange_buffer(nullptr, 0);
+}
@@ -1,19 +1,39 @@
 #pragma once
 
+#include <clean-core/alloc_vector.hh>
 #include <clean-core/allocator.hh>
+#include <clean-core/move.hh>
 
 #include <phantasm-hardware-interface/commands.hh>
 
 namespace pr
 {
-// naive growing writer
+// chunked growing writer
+// commands are written into a list of fixed-size chunks and never straddle chunk boundaries
+// growing allocates a new chunk instead of reallocating (and copying) the entire stream
 struct growing_writer
 {
+    /// chunks following the first one are at least this large
+    static constexpr size_t min_chunk_size = 64 * 1024;
+
+    struct chunk
+    {
+        std::byte* buffer = nullptr;
+        size_t size = 0;     ///< amount of bytes written
+        size_t capacity = 0; ///< amount of bytes allocated
+    };
+
     growing_writer() = default;
     growing_writer(size_t initial_size, cc::allocator* alloc = cc::system_allocator);
-    growing_writer(growing_writer&& rhs) noexcept : _writer(rhs._writer), _alloc(rhs._alloc)
+    growing_writer(growing_writer&& rhs) noexcept
+      : _writer(rhs._writer),
+        _full_chunks(cc::move(rhs._full_chunks)),
+        _size_full_chunks(rhs._size_full_chunks),
+        _chunk_size(rhs._chunk_size),
+        _alloc(rhs._alloc)
     {
         rhs._writer.exchange_buffer(nullptr, 0);
+        rhs._size_full_chunks = 0;
         rhs._alloc = cc::system_allocator;
     }
 
@@ -21,7 +41,11 @@ struct growing_writer
 
     ~growing_writer();
 
-    void reset() { _writer.reset(); }
+    /// frees all chunks but the current one, and resets it
+    void reset();
+
+    /// discards everything written after the first new_size bytes (in total, across chunks)
+    void rewind(size_t new_size);
 
     template <class CmdT>
     void add_command(CmdT const& cmd)
@@ -38,26 +62,53 @@ struct growing_writer
         return res;
     }
 
-    size_t size() const { return _writer.size(); }
-    std::byte* buffer() const { return _writer.buffer(); }
+    /// total amount of bytes written, across all chunks
+    size_t size() const { return _size_full_chunks + _writer.size(); }
+    bool is_empty() const { return size() == 0; }
+
+    /// head of the current (last) chunk
     std::byte* buffer_head() const { return _writer.buffer_head(); }
-    size_t max_size() const { return _writer.max_size(); }
-    bool is_empty() const { return _writer.empty(); }
+
+    /// the current (last) chunk, the only one still written to
+    chunk current_chunk() const { return {_writer.buffer(), _writer.size(), _writer.max_size()}; }
+
+    /// amount of chunks containing commands
+    size_t num_chunks() const { return _full_chunks.size() + (_writer.empty() ? 0 : 1); }
+
+    /// calls func(chunk const&) for each chunk containing commands, in recording order
+    template <class F>
+    void iterate_chunks(F&& func) const
+    {
+        for (chunk const& c : _full_chunks)
+            func(c);
+
+        if (!_writer.empty())
+            func(current_chunk());
+    }
+
+    /// copies the contents of all chunks contiguously to dest, which must be at least size() bytes large
+    void gather(std::byte* dest) const;
 
     void accomodate(size_t cmd_size)
     {
         if (!_writer.can_accomodate(cmd_size))
         {
-            size_t const new_size = (_writer.max_size() + cmd_size) << 1;
-            std::byte* const new_buffer = _alloc->realloc(_writer.buffer(), _writer.max_size(), new_size);
-            _writer.exchange_buffer(new_buffer, new_size);
+            startNewChunk(cmd_size);
         }
     }
 
-    phi::command_stream_writer& raw_writer() { return _writer; }
+    cc::allocator* allocator() const { return _alloc; }
+
+private:
+    void startNewChunk(size_t min_size);
+
+    void freeAllChunks();
 
 private:
-    phi::command_stream_writer _writer;
+    phi::command_stream_writer _writer;   ///< writes to the current chunk
+    cc::alloc_vector<chunk> _full_chunks; ///< previous chunks, in recording order
+    size_t _size_full_chunks = 0;
+    size_t _chunk_size = min_chunk_size;
     cc::allocator* _alloc = cc::system_allocator;
 };
 
@@ -0,0 +1,257 @@
+#include "lz4_block.hh"
+
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+constexpr size_t gc_min_match = 4;
+constexpr size_t gc_last_literals = 5; ///< the last bytes of a block are always literals
+constexpr size_t gc_match_find_limit = 12; ///< the last match starts at least this many bytes before the end
+constexpr size_t gc_max_offset = 65535;
+constexpr unsigned gc_hash_log = 12;
+
+uint32_t read_u32(std::byte const* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hash_sequence(uint32_t sequence) { return (sequence * 2654435761u) >> (32 - gc_hash_log); }
+
+/// writes the 255-run extension of a length field, the token nibble holds the first 15
+std::byte* write_length_extension(std::byte* op, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        *op++ = std::byte(255);
+    *op++ = std::byte(length);
+    return op;
+}
+
+/// reads the extension of a length field whose token nibble was 15, returns false on truncated input
+bool read_length_extension(std::byte const*& ip, std::byte const* iend, size_t& length)
+{
+    uint8_t b;
+    do
+    {
+        if (ip >= iend)
+            return false;
+
+        b = uint8_t(*ip++);
+        length += b;
+    } while (b == 255);
+
+    return true;
+}
+
+/// worst case size of a sequence
+size_t get_sequence_bound(size_t num_literals, size_t match_length)
+{
+    return 1 + num_literals / 255 + 1 + num_literals + 2 + (match_length >= 19 ? (match_length - 19) / 255 + 1 : 0);
+}
+
+std::byte* write_sequence(std::byte* op, std::byte const* literals, size_t num_literals, size_t offset, size_t match_length)
+{
+    size_t const match_code = match_length - gc_min_match;
+
+    std::byte* const token = op++;
+    uint8_t token_value = uint8_t((num_literals >= 15 ? 15 : num_literals) << 4);
+    if (num_literals >= 15)
+        op = write_length_extension(op, num_literals - 15);
+
+    std::memcpy(op, literals, num_literals);
+    op += num_literals;
+
+    op[0] = std::byte(offset & 0xFF);
+    op[1] = std::byte(offset >> 8);
+    op += 2;
+
+    token_value |= uint8_t(match_code >= 15 ? 15 : match_code);
+    if (match_code >= 15)
+        op = write_length_extension(op, match_code - 15);
+
+    *token = std::byte(token_value);
+    return op;
+}
+}
+
+size_t pr::lz4_compress_block(const std::byte* src, size_t src_size, std::byte* dest, size_t dest_capacity)
+{
+    std::byte* op = dest;
+    std::byte* const oend = dest + dest_capacity;
+
+    std::byte const* anchor = src;
+    std::byte const* const iend = src + src_size;
+
+    if (src_size > gc_match_find_limit)
+    {
+        // positions relative to src, zero initialized entries are verified like any other candidate
+        uint32_t hash_table[1u << gc_hash_log] = {};
+
+        std::byte const* const match_find_end = iend - gc_match_find_limit;
+        std::byte const* const match_extend_end = iend - gc_last_literals;
+
+        std::byte const* ip = src + 1;
+        unsigned num_misses = 0;
+
+        while (ip < match_find_end)
+        {
+            uint32_t const sequence = read_u32(ip);
+            uint32_t const h = hash_sequence(sequence);
+            std::byte const* match = src + hash_table[h];
+            hash_table[h] = uint32_t(ip - src);
+
+            if (match >= ip || size_t(ip - match) > gc_max_offset || read_u32(match) != sequence)
+            {
+                // skip faster through incompressible data
+                ip += 1 + (num_misses++ >> 6);
+                continue;
+            }
+            num_misses = 0;
+
+            // extend backwards into the pending literals
+            while (ip > anchor && match > src && ip[-1] == match[-1])
+            {
+                --ip;
+                --match;
+            }
+
+            std::byte const* match_end = ip + gc_min_match;
+            std::byte const* ref_end = match + gc_min_match;
+            while (match_end < match_extend_end && *match_end == *ref_end)
+            {
+                ++match_end;
+                ++ref_end;
+            }
+
+            size_t const num_literals = size_t(ip - anchor);
+            size_t const match_length = size_t(match_end - ip);
+            if (get_sequence_bound(num_literals, match_length) > size_t(oend - op))
+                return 0;
+
+            op = write_sequence(op, anchor, num_literals, size_t(ip - match), match_length);
+
+            ip = match_end;
+            anchor = ip;
+
+            if (ip < match_find_end)
+                hash_table[hash_sequence(read_u32(ip - 2))] = uint32_t(ip - 2 - src);
+        }
+    }
+
+    // the last literals
+    size_t const num_literals = size_t(iend - anchor);
+    if (1 + num_literals / 255 + 1 + num_literals > size_t(oend - op))
+        return 0;
+
+    *op++ = std::byte((num_literals >= 15 ? 15 : num_literals) << 4);
+    if (num_literals >= 15)
+        op = write_length_extension(op, num_literals - 15);
+
+    std::memcpy(op, anchor, num_literals);
+    op += num_literals;
+
+    return size_t(op - dest);
+}
+
+bool pr::lz4_decompress_block(const std::byte* src, size_t src_size, std::byte* dest, size_t dest_size)
+{
+    std::byte const* ip = src;
+    std::byte const* const iend = src + src_size;
+    std::byte* op = dest;
+    std::byte* const oend = dest + dest_size;
+
+    while (true)
+    {
+        if (ip >= iend)
+            return false;
+
+        uint8_t const token = uint8_t(*ip++);
+
+        // literals
+        size_t num_literals = token >> 4;
+        if (num_literals <= 14 && size_t(iend - ip) >= 16 && size_t(oend - op) >= 16)
+        {
+            // short literals, copy a fixed 16 bytes, the excess is overwritten by what follows
+            std::memcpy(op, ip, 16);
+        }
+        else
+        {
+            if (num_literals == 15 && !read_length_extension(ip, iend, num_literals))
+                return false;
+
+            if (num_literals > size_t(iend - ip) || num_literals > size_t(oend - op))
+                return false;
+
+            if (size_t(iend - ip) >= num_literals + 16 && size_t(oend - op) >= num_literals + 16)
+            {
+                // whole chunks, overcopying up to 15 bytes
+                for (size_t i = 0; i < num_literals; i += 16)
+                    std::memcpy(op + i, ip + i, 16);
+            }
+            else
+            {
+                std::memcpy(op, ip, num_literals);
+            }
+        }
+        ip += num_literals;
+        op += num_literals;
+
+        // the last sequence has no match
+        if (ip == iend)
+            return op == oend;
+
+        // match
+        if (iend - ip < 2)
+            return false;
+
+        size_t const offset = size_t(uint8_t(ip[0])) | size_t(uint8_t(ip[1])) << 8;
+        ip += 2;
+
+        if (offset == 0 || offset > size_t(op - dest))
+            return false;
+
+        size_t match_length = token & 15u;
+        if (match_length == 15 && !read_length_extension(ip, iend, match_length))
+            return false;
+        match_length += gc_min_match;
+
+        if (match_length > size_t(oend - op))
+            return false;
+
+        std::byte const* match = op - offset;
+        std::byte* const match_end = op + match_length;
+
+        if (offset >= 16 && size_t(oend - op) >= match_length + 16)
+        {
+            // whole chunks, overcopying up to 15 bytes, chunks never overlap their source
+            do
+            {
+                std::memcpy(op, match, 16);
+                op += 16;
+                match += 16;
+            } while (op < match_end);
+        }
+        else if (offset >= 8 && size_t(oend - op) >= match_length + 8)
+        {
+            do
+            {
+                std::memcpy(op, match, 8);
+                op += 8;
+                match += 8;
+            } while (op < match_end);
+        }
+        else
+        {
+            // repeating pattern (or the end of the block), the copyable distance doubles with every copy
+            while (op < match_end)
+            {
+                size_t const num_bytes = size_t(op - match) < size_t(match_end - op) ? size_t(op - match) : size_t(match_end - op);
+                std::memcpy(op, match, num_bytes);
+                op += num_bytes;
+            }
+        }
+        op = match_end;
+    }
+}
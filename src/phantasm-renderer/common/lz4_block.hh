@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+// LZ4 block format (no frame header, no checksums), compatible with LZ4_compress_default / LZ4_decompress_safe
+namespace pr
+{
+/// the largest compressed size of num_bytes of input
+constexpr size_t get_lz4_compress_bound(size_t num_bytes) { return num_bytes + num_bytes / 255 + 16; }
+
+/// compresses src into dest (greedy, single hash probe), returns the compressed size, or 0 if it does not fit dest_capacity
+size_t lz4_compress_block(std::byte const* src, size_t src_size, std::byte* dest, size_t dest_capacity);
+
+/// decompresses a block that decodes to exactly dest_size bytes, returns false for malformed or truncated input
+/// never reads or writes out of bounds, dest is read back by matches and should not be write-combined memory
+bool lz4_decompress_block(std::byte const* src, size_t src_size, std::byte* dest, size_t dest_size);
+}
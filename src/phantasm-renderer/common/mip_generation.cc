@@ -0,0 +1,378 @@
+#include "mip_generation.hh"
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+#include <clean-core/vector.hh>
+
+#include <phantasm-renderer/common/cpu_features.hh>
+#include <phantasm-renderer/common/rowwise_copy.hh>
+#include <phantasm-renderer/common/texture_upload.hh>
+
+#ifdef PR_CPU_X86
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+// levels below this amount of pixels per thread are processed on the calling thread
+constexpr size_t gc_parallel_mip_pixels_per_thread = 32u << 10;
+constexpr unsigned gc_max_mip_threads = 8;
+// horizontally filtered source rows kept per thread, covers the vertical taps of one output row
+constexpr int gc_row_cache_size = 8;
+constexpr unsigned gc_max_filter_taps = 6;
+// binary search steps of the alpha coverage scale
+constexpr unsigned gc_alpha_scale_iterations = 16;
+
+using float4 = float[4];
+
+/// separable downsampling filter, output pixel x reads source pixels 2x + offsets[i]
+struct filter_taps
+{
+    int offsets[gc_max_filter_taps];
+    float weights[gc_max_filter_taps];
+    unsigned num_taps;
+};
+
+double bessel_i0(double x)
+{
+    // power series, converges quickly for the small arguments used here
+    double sum = 1.;
+    double term = 1.;
+    for (auto k = 1; k < 32; ++k)
+    {
+        double const f = x / (2. * k);
+        term *= f * f;
+        sum += term;
+    }
+    return sum;
+}
+
+filter_taps make_kaiser_taps()
+{
+    // sinc with a cutoff at half the source frequency, windowed to a radius of 3 source pixels
+    constexpr double pi = 3.14159265358979323846;
+    constexpr double alpha = 4.;
+    constexpr double radius = 3.;
+
+    filter_taps res;
+    res.num_taps = 6;
+
+    double weights[6];
+    double sum = 0.;
+    for (auto i = 0; i < 6; ++i)
+    {
+        // source pixels 2x and 2x + 1 straddle the center of output pixel x
+        res.offsets[i] = i - 2;
+        double const d = std::abs(double(i - 2) - 0.5);
+        double const t = d / radius;
+
+        double const sinc = std::sin(pi * d * 0.5) / (pi * d * 0.5);
+        double const window = bessel_i0(alpha * std::sqrt(1. - t * t)) / bessel_i0(alpha);
+        weights[i] = sinc * window;
+        sum += weights[i];
+    }
+
+    for (auto i = 0; i < 6; ++i)
+        res.weights[i] = float(weights[i] / sum);
+
+    return res;
+}
+
+filter_taps const& get_filter_taps(pr::mip_filter filter)
+{
+    static filter_taps const box = {{0, 1}, {.5f, .5f}, 2};
+    static filter_taps const kaiser = make_kaiser_taps();
+    return filter == pr::mip_filter::kaiser ? kaiser : box;
+}
+
+int clamp_coord(int v, int size) { return v < 0 ? 0 : (v >= size ? size - 1 : v); }
+
+/// out[x] = sum of weights[i] * in[2x + offsets[i]], clamped to the edge
+void filter_row_horizontal(filter_taps const& taps, float4 const* __restrict in, int in_width, float4* __restrict out, int out_width)
+{
+    for (auto x = 0; x < out_width; ++x)
+    {
+#ifdef PR_CPU_X86
+        __m128 acc = _mm_setzero_ps();
+        for (auto i = 0u; i < taps.num_taps; ++i)
+        {
+            float const* const p = in[clamp_coord(2 * x + taps.offsets[i], in_width)];
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(p), _mm_set1_ps(taps.weights[i])));
+        }
+        _mm_storeu_ps(out[x], acc);
+#else
+        float acc[4] = {0.f, 0.f, 0.f, 0.f};
+        for (auto i = 0u; i < taps.num_taps; ++i)
+        {
+            float const* const p = in[clamp_coord(2 * x + taps.offsets[i], in_width)];
+            for (auto c = 0; c < 4; ++c)
+                acc[c] += p[c] * taps.weights[i];
+        }
+        for (auto c = 0; c < 4; ++c)
+            out[x][c] = acc[c];
+#endif
+    }
+}
+
+/// out[x] = sum of weights[i] * rows[i][x]
+void filter_rows_vertical(filter_taps const& taps, float4 const* const* rows, float4* __restrict out, int width)
+{
+    // the filter is the same for every channel, process rows as flat float arrays
+    int const num_floats = width * 4;
+    int x = 0;
+
+#ifdef PR_CPU_X86
+    for (; x + 4 <= num_floats; x += 4)
+    {
+        __m128 acc = _mm_setzero_ps();
+        for (auto i = 0u; i < taps.num_taps; ++i)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&rows[i][0][0] + x), _mm_set1_ps(taps.weights[i])));
+        _mm_storeu_ps(&out[0][0] + x, acc);
+    }
+#endif
+
+    for (; x < num_floats; ++x)
+    {
+        float acc = 0.f;
+        for (auto i = 0u; i < taps.num_taps; ++i)
+            acc += (&rows[i][0][0])[x] * taps.weights[i];
+        (&out[0][0])[x] = acc;
+    }
+}
+
+/// source and destination of filtering one mip level
+struct level_filter
+{
+    filter_taps const* taps = nullptr;
+
+    // source level, either encoded mip 0 (decoded row by row) or a previously filtered level
+    pr::pixel_format src_format = pr::pixel_format::rgba8un;
+    bool src_srgb = false;
+    std::byte const* src_encoded = nullptr;
+    float4 const* src_decoded = nullptr;
+    int src_width = 0;
+    int src_height = 0;
+
+    float4* dest = nullptr;
+    int dest_width = 0;
+};
+
+void filter_level_rows(level_filter const& job, int first_row, int end_row)
+{
+    filter_taps const& taps = *job.taps;
+    uint32_t const src_pixel_size = job.src_encoded ? pr::get_pixel_format_size_bytes(job.src_format) : 0;
+
+    // ring cache of horizontally filtered source rows, keyed by row index modulo its size
+    // the taps of one output row span at most 6 consecutive source rows, which never collide
+    cc::vector<float> cache;
+    cache.resize(size_t(gc_row_cache_size) * job.dest_width * 4);
+    int cached_rows[gc_row_cache_size];
+    for (auto& r : cached_rows)
+        r = -1;
+
+    cc::vector<float> decoded_row;
+    if (job.src_encoded)
+        decoded_row.resize(size_t(job.src_width) * 4);
+
+    float4 const* rows[gc_max_filter_taps];
+
+    for (auto y = first_row; y < end_row; ++y)
+    {
+        for (auto i = 0u; i < taps.num_taps; ++i)
+        {
+            int const sy = clamp_coord(2 * y + taps.offsets[i], job.src_height);
+            int const slot = sy % gc_row_cache_size;
+            float4* const cached = reinterpret_cast<float4*>(cache.data()) + size_t(slot) * job.dest_width;
+
+            if (cached_rows[slot] != sy)
+            {
+                float4 const* src_row;
+                if (job.src_encoded)
+                {
+                    float4* const decoded = reinterpret_cast<float4*>(decoded_row.data());
+                    pr::decode_pixels(job.src_format, job.src_encoded + size_t(sy) * job.src_width * src_pixel_size, uint32_t(job.src_width), decoded, job.src_srgb);
+                    src_row = decoded;
+                }
+                else
+                {
+                    src_row = job.src_decoded + size_t(sy) * job.src_width;
+                }
+
+                filter_row_horizontal(taps, src_row, job.src_width, cached, job.dest_width);
+                cached_rows[slot] = sy;
+            }
+
+            rows[i] = cached;
+        }
+
+        filter_rows_vertical(taps, rows, job.dest + size_t(y) * job.dest_width, job.dest_width);
+    }
+}
+
+/// calls f_rows(begin, end) for contiguous ranges of [0, num_rows), on multiple threads for large levels
+template <class F>
+void for_each_row_range_parallel(int num_rows, size_t num_pixels, F&& f_rows)
+{
+    unsigned num_threads = cc::min(cc::max(std::thread::hardware_concurrency(), 1u), gc_max_mip_threads);
+    num_threads = cc::min(num_threads, unsigned(num_pixels / gc_parallel_mip_pixels_per_thread));
+    num_threads = cc::min(num_threads, unsigned(num_rows));
+
+    if (num_threads <= 1)
+    {
+        f_rows(0, num_rows);
+        return;
+    }
+
+    // the calling thread processes the last range
+    int const rows_per_thread = (num_rows + int(num_threads) - 1) / int(num_threads);
+
+    std::thread workers[gc_max_mip_threads];
+    for (auto i = 0u; i < num_threads - 1; ++i)
+    {
+        int const first_row = int(i) * rows_per_thread;
+        int const end_row = cc::min(first_row + rows_per_thread, num_rows);
+        workers[i] = std::thread([&f_rows, first_row, end_row] { f_rows(first_row, end_row); });
+    }
+
+    f_rows(cc::min(int(num_threads - 1) * rows_per_thread, num_rows), num_rows);
+
+    for (auto i = 0u; i < num_threads - 1; ++i)
+        workers[i].join();
+}
+
+size_t count_alpha_coverage(float4 const* pixels, size_t num_pixels, float reference, float scale)
+{
+    size_t res = 0;
+    for (auto i = 0u; i < num_pixels; ++i)
+        res += cc::min(pixels[i][3] * scale, 1.f) > reference ? 1 : 0;
+    return res;
+}
+
+float get_mip0_alpha_coverage(pr::pixel_format fmt, std::byte const* mip0, int width, int height, float reference)
+{
+    uint32_t const pixel_size = pr::get_pixel_format_size_bytes(fmt);
+    std::atomic<size_t> num_covered = {0};
+
+    for_each_row_range_parallel(height, size_t(width) * height, [&](int begin, int end) {
+        cc::vector<float> row;
+        row.resize(size_t(width) * 4);
+        float4* const decoded = reinterpret_cast<float4*>(row.data());
+
+        size_t local_covered = 0;
+        for (auto y = begin; y < end; ++y)
+        {
+            pr::decode_pixels(fmt, mip0 + size_t(y) * width * pixel_size, uint32_t(width), decoded);
+            local_covered += count_alpha_coverage(decoded, size_t(width), reference, 1.f);
+        }
+        num_covered += local_covered;
+    });
+
+    return float(num_covered.load()) / float(size_t(width) * height);
+}
+
+/// alpha scale that restores the coverage of a filtered level, see Castano, "Computing Alpha Mipmaps"
+float find_alpha_coverage_scale(float4 const* pixels, size_t num_pixels, float reference, float target_coverage)
+{
+    auto const get_coverage = [&](float scale) { return float(count_alpha_coverage(pixels, num_pixels, reference, scale)) / float(num_pixels); };
+
+    // coverage grows monotonically with the scale, but in steps, so the target is usually between two scales
+    float min_scale = 0.f;
+    float max_scale = 4.f;
+    for (auto i = 0u; i < gc_alpha_scale_iterations; ++i)
+    {
+        float const scale = (min_scale + max_scale) * .5f;
+        if (get_coverage(scale) < target_coverage)
+            min_scale = scale;
+        else
+            max_scale = scale;
+    }
+
+    return target_coverage - get_coverage(min_scale) < get_coverage(max_scale) - target_coverage ? min_scale : max_scale;
+}
+}
+
+void pr::generate_texture_upload_mips(const texture_upload_layout& layout,
+                                      unsigned array_index,
+                                      pixel_format fmt,
+                                      const std::byte* __restrict mip0,
+                                      const mip_generation_config& config,
+                                      std::byte* __restrict dest)
+{
+    CC_ASSERT(size_t(array_index + 1) * layout.num_mips <= layout.subresources.size() && "array slice out of bounds");
+
+    if (layout.num_mips <= 1)
+        return;
+
+    texture_subresource_upload const* const subresources = layout.subresources.data() + size_t(array_index) * layout.num_mips;
+    uint32_t const pixel_size = get_pixel_format_size_bytes(fmt);
+
+    level_filter job;
+    job.taps = &get_filter_taps(config.filter);
+    job.src_format = fmt;
+    job.src_srgb = config.is_srgb;
+    job.src_encoded = mip0;
+    job.src_width = int(subresources[0].row_size_bytes / pixel_size);
+    job.src_height = int(subresources[0].num_rows);
+
+    bool const preserve_coverage = config.alpha_coverage_reference >= 0.f;
+    float const target_coverage = preserve_coverage ? get_mip0_alpha_coverage(fmt, mip0, job.src_width, job.src_height, config.alpha_coverage_reference) : 0.f;
+
+    // linear float levels, each is filtered from the previous one
+    cc::vector<float> levels[2];
+
+    for (auto mip = 1u; mip < layout.num_mips; ++mip)
+    {
+        texture_subresource_upload const& subres = subresources[mip];
+        int const width = cc::max(job.src_width / 2, 1);
+        int const height = cc::max(job.src_height / 2, 1);
+        size_t const num_pixels = size_t(width) * height;
+        CC_ASSERT(subres.row_size_bytes == uint32_t(width) * pixel_size && subres.num_rows == uint32_t(height) && "unexpected mip size");
+
+        cc::vector<float>& level = levels[mip & 1];
+        level.resize(num_pixels * 4);
+        job.dest = reinterpret_cast<float4*>(level.data());
+        job.dest_width = width;
+
+        for_each_row_range_parallel(height, num_pixels, [&job](int begin, int end) { filter_level_rows(job, begin, end); });
+
+        float const alpha_scale = preserve_coverage ? find_alpha_coverage_scale(job.dest, num_pixels, config.alpha_coverage_reference, target_coverage) : 1.f;
+
+        // encode each row into a cached scratch row, then stream it into the upload buffer
+        float4 const* const pixels = job.dest;
+        for_each_row_range_parallel(height, num_pixels, [&](int begin, int end) {
+            cc::vector<float> scaled_row;
+            cc::vector<std::byte> encoded_row;
+            scaled_row.resize(size_t(width) * 4);
+            encoded_row.resize(subres.row_size_bytes);
+
+            for (auto y = begin; y < end; ++y)
+            {
+                float4 const* row = pixels + size_t(y) * width;
+                if (alpha_scale != 1.f)
+                {
+                    float4* const scaled = reinterpret_cast<float4*>(scaled_row.data());
+                    for (auto x = 0; x < width; ++x)
+                    {
+                        for (auto c = 0; c < 3; ++c)
+                            scaled[x][c] = row[x][c];
+                        scaled[x][3] = row[x][3] * alpha_scale;
+                    }
+                    row = scaled;
+                }
+
+                encode_pixels(fmt, row, uint32_t(width), encoded_row.data(), config.is_srgb);
+                rowwise_copy_streaming(encoded_row.data(), dest + subres.dest_offset_bytes + size_t(y) * subres.dest_row_stride_bytes,
+                                       subres.dest_row_stride_bytes, subres.row_size_bytes, 1);
+            }
+        });
+
+        job.src_encoded = nullptr;
+        job.src_decoded = pixels;
+        job.src_width = width;
+        job.src_height = height;
+    }
+}
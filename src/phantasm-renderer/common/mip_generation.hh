@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <phantasm-renderer/common/pixel_convert.hh>
+
+namespace pr
+{
+struct texture_upload_layout;
+
+enum class mip_filter : uint8_t
+{
+    box,   ///< 2x2 average, odd sizes drop the last row and column
+    kaiser ///< 6 tap Kaiser-windowed sinc, sharper and without aliasing
+};
+
+struct mip_generation_config
+{
+    mip_filter filter = mip_filter::box;
+
+    /// color channels of 8 bit formats are sRGB encoded, filtering happens in linear space
+    /// Frame::upload_texture_data_with_mips derives this from the texture format
+    bool is_srgb = false;
+
+    /// alpha test reference of cutout textures, the alpha of every mip level is scaled
+    /// to keep the coverage (fraction of pixels passing the test) of mip 0, negative disables
+    float alpha_coverage_reference = -1.f;
+};
+
+/// generates mip levels 1 and up of a single array slice, writing them into a mapped upload buffer at their place in the layout
+/// mip0 is tightly packed, fmt must be the CPU-side equivalent of the texture format
+/// intermediate levels are kept in float, large levels are filtered on multiple threads
+void generate_texture_upload_mips(texture_upload_layout const& layout,
+                                  unsigned array_index,
+                                  pixel_format fmt,
+                                  std::byte const* __restrict mip0,
+                                  mip_generation_config const& config,
+                                  std::byte* __restrict dest);
+}
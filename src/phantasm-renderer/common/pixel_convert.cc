@@ -0,0 +1,601 @@
+#include "pixel_convert.hh"
+
+#include <cmath>
+#include <cstring>
+
+#include <clean-core/assert.hh>
+
+#include "cpu_features.hh"
+
+#ifdef PR_CPU_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+using row_kernel = void (*)(std::byte const* __restrict src, std::byte* __restrict dest, uint32_t num_pixels);
+
+struct pixel_format_info
+{
+    uint32_t num_channels;
+    uint32_t bytes_per_channel;
+};
+
+pixel_format_info get_info(pr::pixel_format fmt)
+{
+    switch (fmt)
+    {
+    case pr::pixel_format::r8un:
+        return {1, 1};
+    case pr::pixel_format::rgb8un:
+        return {3, 1};
+    case pr::pixel_format::rgba8un:
+    case pr::pixel_format::bgra8un:
+        return {4, 1};
+    case pr::pixel_format::r16un:
+    case pr::pixel_format::r16f:
+        return {1, 2};
+    case pr::pixel_format::r32f:
+        return {1, 4};
+    case pr::pixel_format::rgb32f:
+        return {3, 4};
+    case pr::pixel_format::rgba16f:
+        return {4, 2};
+    case pr::pixel_format::rgba32f:
+        return {4, 4};
+    }
+
+    CC_UNREACHABLE("invalid pixel format");
+}
+
+template <class T>
+T load(std::byte const* p)
+{
+    T res;
+    std::memcpy(&res, p, sizeof(T));
+    return res;
+}
+
+template <class T>
+void store(std::byte* p, T value)
+{
+    std::memcpy(p, &value, sizeof(T));
+}
+
+float as_float(uint32_t bits)
+{
+    float res;
+    std::memcpy(&res, &bits, sizeof(res));
+    return res;
+}
+
+uint32_t as_bits(float f)
+{
+    uint32_t res;
+    std::memcpy(&res, &f, sizeof(res));
+    return res;
+}
+
+float saturate(float f) { return f > 0.f ? (f < 1.f ? f : 1.f) : 0.f; } // NaN becomes 0
+
+uint8_t to_unorm8(float f) { return uint8_t(saturate(f) * 255.f + .5f); }
+uint16_t to_unorm16(float f) { return uint16_t(saturate(f) * 65535.f + .5f); }
+
+//
+// sRGB encoding
+
+/// linear values from 0 to 1.0 are bucketed by their 16 upper float bits (exponent and 7 mantissa bits)
+/// buckets are narrower than the distance between two sRGB thresholds, so the bucket start value is off by at most one
+constexpr uint32_t gc_srgb_num_buckets = (0x3F800000u >> 16) + 1;
+
+struct srgb_tables
+{
+    uint8_t bucket_start[gc_srgb_num_buckets];
+    float thresholds[256]; ///< linear value from which on the encoded value is larger than i, the last one is never reached
+
+    srgb_tables()
+    {
+        for (auto i = 0u; i < 255; ++i)
+        {
+            // midpoint between i and i+1 in sRGB space
+            double const s = (double(i) + .5) / 255.;
+            double const linear = s <= 0.04045 ? s / 12.92 : std::pow((s + 0.055) / 1.055, 2.4);
+
+            // smallest float not below the exact threshold
+            float threshold = float(linear);
+            if (double(threshold) < linear)
+                threshold = std::nextafter(threshold, 2.f);
+            thresholds[i] = threshold;
+        }
+        thresholds[255] = 2.f;
+
+        uint32_t value = 0;
+        for (auto b = 0u; b < gc_srgb_num_buckets; ++b)
+        {
+            float const start = as_float(b << 16);
+            while (start >= thresholds[value])
+                ++value;
+            bucket_start[b] = uint8_t(value);
+        }
+    }
+};
+
+srgb_tables const& get_srgb_tables()
+{
+    static srgb_tables const tables;
+    return tables;
+}
+
+uint8_t encode_srgb8(srgb_tables const& tables, float f)
+{
+    if (!(f > 0.f)) // also catches NaN
+        return 0;
+    if (f >= 1.f)
+        return 255;
+
+    uint32_t const value = tables.bucket_start[as_bits(f) >> 16];
+    return uint8_t(value + (f >= tables.thresholds[value] ? 1 : 0));
+}
+
+struct srgb_decode_table
+{
+    float values[256];
+
+    srgb_decode_table()
+    {
+        for (auto i = 0u; i < 256; ++i)
+        {
+            double const s = double(i) / 255.;
+            values[i] = float(s <= 0.04045 ? s / 12.92 : std::pow((s + 0.055) / 1.055, 2.4));
+        }
+    }
+};
+
+srgb_decode_table const& get_srgb_decode_table()
+{
+    static srgb_decode_table const table;
+    return table;
+}
+
+/// generic path, pixels are decoded to RGBA floats
+void convert_generic(pr::pixel_conversion const& conv, std::byte const* src, std::byte* dest, uint32_t num_pixels)
+{
+    constexpr uint32_t chunk_size = 64;
+    float decoded[chunk_size][4];
+
+    uint32_t const src_pixel_size = pr::get_pixel_format_size_bytes(conv.src);
+    uint32_t const dest_pixel_size = pr::get_pixel_format_size_bytes(conv.dest);
+
+    for (auto i = 0u; i < num_pixels; i += chunk_size)
+    {
+        uint32_t const n = num_pixels - i < chunk_size ? num_pixels - i : chunk_size;
+        pr::decode_pixels(conv.src, src + i * src_pixel_size, n, decoded);
+
+        if (conv.has_swizzle())
+        {
+            for (auto p = 0u; p < n; ++p)
+            {
+                float v[4];
+                for (auto c = 0u; c < 4; ++c)
+                {
+                    uint8_t const sw = conv.swizzle[c];
+                    v[c] = sw < 4 ? decoded[p][sw] : (sw == 4 ? 0.f : 1.f);
+                }
+                std::memcpy(decoded[p], v, sizeof(v));
+            }
+        }
+
+        pr::encode_pixels(conv.dest, decoded, n, dest + i * dest_pixel_size, conv.srgb_encode);
+    }
+}
+
+//
+// fast paths, the scalar versions are exact equivalents of the generic path
+
+void expand_rgb8_scalar(std::byte const* src, std::byte* dest, uint32_t first, uint32_t num_pixels, bool is_bgra)
+{
+    for (auto i = first; i < num_pixels; ++i)
+    {
+        std::byte const* const s = src + i * 3;
+        std::byte* const d = dest + i * 4;
+        d[0] = s[is_bgra ? 2 : 0];
+        d[1] = s[1];
+        d[2] = s[is_bgra ? 0 : 2];
+        d[3] = std::byte(255);
+    }
+}
+
+void swap_red_blue_scalar(std::byte const* src, std::byte* dest, uint32_t first, uint32_t num_pixels)
+{
+    for (auto i = first; i < num_pixels; ++i)
+    {
+        uint32_t const v = load<uint32_t>(src + i * 4);
+        store(dest + i * 4, (v & 0xFF00FF00u) | ((v >> 16) & 0xFFu) | ((v & 0xFFu) << 16)); // little endian
+    }
+}
+
+void floats_to_halfs_scalar(std::byte const* src, std::byte* dest, uint32_t first, uint32_t num_values)
+{
+    for (auto i = first; i < num_values; ++i)
+        store(dest + i * 2, pr::float_to_half(load<float>(src + i * 4)));
+}
+
+void halfs_to_floats_scalar(std::byte const* src, std::byte* dest, uint32_t first, uint32_t num_values)
+{
+    for (auto i = first; i < num_values; ++i)
+        store(dest + i * 4, pr::half_to_float(load<uint16_t>(src + i * 2)));
+}
+
+void unorm16_to_halfs_scalar(std::byte const* src, std::byte* dest, uint32_t first, uint32_t num_values)
+{
+    for (auto i = first; i < num_values; ++i)
+        store(dest + i * 2, pr::float_to_half(float(load<uint16_t>(src + i * 2)) * (1.f / 65535.f)));
+}
+
+#ifdef PR_CPU_X86
+template <bool IsBGRA>
+PR_TARGET_ISA("ssse3") void expand_rgb8_ssse3(std::byte const* src, std::byte* dest, uint32_t num_pixels)
+{
+    __m128i const shuffle = IsBGRA ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1) //
+                                   : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m128i const alpha = _mm_set1_epi32(int(0xFF000000u));
+
+    // 16 pixels per iteration, the last load reads 4 bytes past them
+    uint32_t i = 0;
+    for (; (i + 16) * 3 + 4 <= num_pixels * 3; i += 16)
+    {
+        std::byte const* const s = src + i * 3;
+        for (auto j = 0; j < 4; ++j)
+        {
+            __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s + j * 12));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + (i + j * 4) * 4), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+        }
+    }
+
+    expand_rgb8_scalar(src, dest, i, num_pixels, IsBGRA);
+}
+
+PR_TARGET_ISA("ssse3") void swap_red_blue_ssse3(std::byte const* src, std::byte* dest, uint32_t num_pixels)
+{
+    __m128i const shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    uint32_t i = 0;
+    for (; i + 4 <= num_pixels; i += 4)
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i * 4), _mm_shuffle_epi8(v, shuffle));
+    }
+
+    swap_red_blue_scalar(src, dest, i, num_pixels);
+}
+
+PR_TARGET_ISA("avx,f16c") void floats_to_halfs_f16c(std::byte const* src, std::byte* dest, uint32_t num_values)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= num_values; i += 8)
+    {
+        __m256 const v = _mm256_loadu_ps(reinterpret_cast<float const*>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i * 2), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+
+    floats_to_halfs_scalar(src, dest, i, num_values);
+}
+
+PR_TARGET_ISA("avx,f16c") void halfs_to_floats_f16c(std::byte const* src, std::byte* dest, uint32_t num_values)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= num_values; i += 8)
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * 2));
+        _mm256_storeu_ps(reinterpret_cast<float*>(dest + i * 4), _mm256_cvtph_ps(v));
+    }
+
+    halfs_to_floats_scalar(src, dest, i, num_values);
+}
+
+PR_TARGET_ISA("avx,f16c") void unorm16_to_halfs_f16c(std::byte const* src, std::byte* dest, uint32_t num_values)
+{
+    __m128i const zero = _mm_setzero_si128();
+    __m256 const scale = _mm256_set1_ps(1.f / 65535.f);
+
+    uint32_t i = 0;
+    for (; i + 8 <= num_values; i += 8)
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * 2));
+        __m256i const v32 = _mm256_setr_m128i(_mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero));
+        __m256 const f = _mm256_mul_ps(_mm256_cvtepi32_ps(v32), scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i * 2), _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+    }
+
+    unorm16_to_halfs_scalar(src, dest, i, num_values);
+}
+#endif
+
+/// fast paths, scalar if the CPU lacks the instruction sets
+struct fast_kernels
+{
+    row_kernel rgb8_to_rgba8 = [](std::byte const* src, std::byte* dest, uint32_t n) { expand_rgb8_scalar(src, dest, 0, n, false); };
+    row_kernel rgb8_to_bgra8 = [](std::byte const* src, std::byte* dest, uint32_t n) { expand_rgb8_scalar(src, dest, 0, n, true); };
+    row_kernel swap_red_blue = [](std::byte const* src, std::byte* dest, uint32_t n) { swap_red_blue_scalar(src, dest, 0, n); };
+    row_kernel floats_to_halfs = [](std::byte const* src, std::byte* dest, uint32_t n) { floats_to_halfs_scalar(src, dest, 0, n); };
+    row_kernel halfs_to_floats = [](std::byte const* src, std::byte* dest, uint32_t n) { halfs_to_floats_scalar(src, dest, 0, n); };
+    row_kernel unorm16_to_halfs = [](std::byte const* src, std::byte* dest, uint32_t n) { unorm16_to_halfs_scalar(src, dest, 0, n); };
+
+    fast_kernels()
+    {
+#ifdef PR_CPU_X86
+        pr::cpu_features const& cpu = pr::get_cpu_features();
+        if (cpu.ssse3)
+        {
+            rgb8_to_rgba8 = expand_rgb8_ssse3<false>;
+            rgb8_to_bgra8 = expand_rgb8_ssse3<true>;
+            swap_red_blue = swap_red_blue_ssse3;
+        }
+
+        if (cpu.f16c)
+        {
+            floats_to_halfs = floats_to_halfs_f16c;
+            halfs_to_floats = halfs_to_floats_f16c;
+            unorm16_to_halfs = unorm16_to_halfs_f16c;
+        }
+#endif
+    }
+};
+
+fast_kernels const& get_fast_kernels()
+{
+    static fast_kernels const kernels;
+    return kernels;
+}
+
+/// the kernel for a conversion without sRGB encoding or swizzles, and the amount of values it processes per pixel
+/// kernels converting floats and halfs count values, the others pixels
+row_kernel find_fast_kernel(pr::pixel_format src, pr::pixel_format dest, uint32_t& out_values_per_pixel)
+{
+    using pf = pr::pixel_format;
+    fast_kernels const& k = get_fast_kernels();
+    out_values_per_pixel = 1;
+
+    if (src == pf::rgb8un && dest == pf::rgba8un)
+        return k.rgb8_to_rgba8;
+    if (src == pf::rgb8un && dest == pf::bgra8un)
+        return k.rgb8_to_bgra8;
+    if ((src == pf::rgba8un && dest == pf::bgra8un) || (src == pf::bgra8un && dest == pf::rgba8un))
+        return k.swap_red_blue;
+    if (src == pf::r16un && dest == pf::r16f)
+        return k.unorm16_to_halfs;
+
+    if ((src == pf::rgba32f && dest == pf::rgba16f) || (src == pf::r32f && dest == pf::r16f))
+    {
+        out_values_per_pixel = get_info(src).num_channels;
+        return k.floats_to_halfs;
+    }
+
+    if ((src == pf::rgba16f && dest == pf::rgba32f) || (src == pf::r16f && dest == pf::r32f))
+    {
+        out_values_per_pixel = get_info(src).num_channels;
+        return k.halfs_to_floats;
+    }
+
+    return nullptr;
+}
+}
+
+uint32_t pr::get_pixel_format_size_bytes(pixel_format fmt)
+{
+    pixel_format_info const info = get_info(fmt);
+    return info.num_channels * info.bytes_per_channel;
+}
+
+bool pr::get_pixel_format(format fmt, pixel_format& out_fmt)
+{
+    switch (fmt)
+    {
+    case format::r8un:
+        out_fmt = pixel_format::r8un;
+        return true;
+    case format::rgba8un:
+    case format::rgba8un_srgb:
+        out_fmt = pixel_format::rgba8un;
+        return true;
+    case format::bgra8un:
+    case format::bgra8un_srgb:
+        out_fmt = pixel_format::bgra8un;
+        return true;
+    case format::r16f:
+        out_fmt = pixel_format::r16f;
+        return true;
+    case format::r32f:
+        out_fmt = pixel_format::r32f;
+        return true;
+    case format::rgb32f:
+        out_fmt = pixel_format::rgb32f;
+        return true;
+    case format::rgba16f:
+        out_fmt = pixel_format::rgba16f;
+        return true;
+    case format::rgba32f:
+        out_fmt = pixel_format::rgba32f;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool pr::is_srgb_format(format fmt) { return fmt == format::rgba8un_srgb || fmt == format::bgra8un_srgb; }
+
+void pr::convert_pixel_row(const pixel_conversion& conv, const std::byte* __restrict src, std::byte* __restrict dest, uint32_t num_pixels)
+{
+    if (!conv.srgb_encode && !conv.has_swizzle())
+    {
+        if (conv.src == conv.dest)
+        {
+            std::memcpy(dest, src, size_t(num_pixels) * get_pixel_format_size_bytes(conv.src));
+            return;
+        }
+
+        uint32_t values_per_pixel;
+        if (row_kernel const kernel = find_fast_kernel(conv.src, conv.dest, values_per_pixel))
+        {
+            kernel(src, dest, num_pixels * values_per_pixel);
+            return;
+        }
+    }
+
+    convert_generic(conv, src, dest, num_pixels);
+}
+
+void pr::decode_pixels(pixel_format fmt, const std::byte* __restrict src, uint32_t num_pixels, float (*__restrict out)[4], bool srgb_decode)
+{
+    pixel_format_info const info = get_info(fmt);
+    uint32_t const pixel_size = info.num_channels * info.bytes_per_channel;
+    srgb_decode_table const* const srgb = srgb_decode && info.bytes_per_channel == 1 ? &get_srgb_decode_table() : nullptr;
+
+    for (auto i = 0u; i < num_pixels; ++i)
+    {
+        std::byte const* const p = src + i * pixel_size;
+        float* const o = out[i];
+        o[0] = o[1] = o[2] = 0.f;
+        o[3] = 1.f;
+
+        for (auto c = 0u; c < info.num_channels; ++c)
+        {
+            std::byte const* const pc = p + c * info.bytes_per_channel;
+            switch (fmt)
+            {
+            case pixel_format::r8un:
+            case pixel_format::rgb8un:
+            case pixel_format::rgba8un:
+            case pixel_format::bgra8un:
+                o[c] = srgb != nullptr && c < 3 ? srgb->values[load<uint8_t>(pc)] : float(load<uint8_t>(pc)) * (1.f / 255.f);
+                break;
+            case pixel_format::r16un:
+                o[c] = float(load<uint16_t>(pc)) * (1.f / 65535.f);
+                break;
+            case pixel_format::r16f:
+            case pixel_format::rgba16f:
+                o[c] = half_to_float(load<uint16_t>(pc));
+                break;
+            case pixel_format::r32f:
+            case pixel_format::rgb32f:
+            case pixel_format::rgba32f:
+                o[c] = load<float>(pc);
+                break;
+            }
+        }
+
+        if (fmt == pixel_format::bgra8un)
+        {
+            float const b = o[0];
+            o[0] = o[2];
+            o[2] = b;
+        }
+    }
+}
+
+void pr::encode_pixels(pixel_format fmt, float const (*__restrict in)[4], uint32_t num_pixels, std::byte* __restrict dest, bool srgb_encode)
+{
+    pixel_format_info const info = get_info(fmt);
+    uint32_t const pixel_size = info.num_channels * info.bytes_per_channel;
+    srgb_tables const* const srgb = srgb_encode && info.bytes_per_channel == 1 ? &get_srgb_tables() : nullptr;
+
+    for (auto i = 0u; i < num_pixels; ++i)
+    {
+        std::byte* const p = dest + i * pixel_size;
+
+        float v[4] = {in[i][0], in[i][1], in[i][2], in[i][3]};
+        if (fmt == pixel_format::bgra8un)
+        {
+            v[0] = in[i][2];
+            v[2] = in[i][0];
+        }
+
+        for (auto c = 0u; c < info.num_channels; ++c)
+        {
+            std::byte* const pc = p + c * info.bytes_per_channel;
+            switch (fmt)
+            {
+            case pixel_format::r8un:
+            case pixel_format::rgb8un:
+            case pixel_format::rgba8un:
+            case pixel_format::bgra8un:
+                store(pc, srgb != nullptr && c < 3 ? encode_srgb8(*srgb, v[c]) : to_unorm8(v[c]));
+                break;
+            case pixel_format::r16un:
+                store(pc, to_unorm16(v[c]));
+                break;
+            case pixel_format::r16f:
+            case pixel_format::rgba16f:
+                store(pc, float_to_half(v[c]));
+                break;
+            case pixel_format::r32f:
+            case pixel_format::rgb32f:
+            case pixel_format::rgba32f:
+                store(pc, v[c]);
+                break;
+            }
+        }
+    }
+}
+
+uint16_t pr::float_to_half(float f)
+{
+    uint32_t const f32_infinity = 255u << 23;
+    uint32_t const f16_overflow = (127u + 16u) << 23;
+    uint32_t const denorm_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+    uint32_t x = as_bits(f);
+    uint32_t const sign = x & 0x80000000u;
+    x ^= sign;
+
+    uint16_t res;
+    if (x >= f16_overflow)
+    {
+        // infinity or NaN (quiet)
+        res = x > f32_infinity ? 0x7E00 : 0x7C00;
+    }
+    else if (x < (113u << 23))
+    {
+        // denormal or zero, the float addition rounds to nearest even
+        res = uint16_t(as_bits(as_float(x) + as_float(denorm_magic)) - denorm_magic);
+    }
+    else
+    {
+        // normal, rebias the exponent and round to nearest even
+        uint32_t const mantissa_odd = (x >> 13) & 1u;
+        x += (uint32_t(15 - 127) << 23) + 0xFFFu;
+        x += mantissa_odd;
+        res = uint16_t(x >> 13);
+    }
+
+    return uint16_t(res | (sign >> 16));
+}
+
+float pr::half_to_float(uint16_t h)
+{
+    uint32_t const shifted_exponent = 0x7C00u << 13;
+
+    uint32_t bits = uint32_t(h & 0x7FFF) << 13;
+    uint32_t const exponent = bits & shifted_exponent;
+    bits += (127u - 15u) << 23;
+
+    float res;
+    if (exponent == shifted_exponent)
+    {
+        // infinity or NaN
+        res = as_float(bits + ((128u - 16u) << 23));
+    }
+    else if (exponent == 0)
+    {
+        // denormal, renormalize with a float subtraction
+        res = as_float(bits + (1u << 23)) - as_float(113u << 23);
+    }
+    else
+    {
+        res = as_float(bits);
+    }
+
+    return as_float(as_bits(res) | uint32_t(h & 0x8000) << 16);
+}
+
+uint8_t pr::linear_to_srgb8(float f) { return encode_srgb8(get_srgb_tables(), f); }
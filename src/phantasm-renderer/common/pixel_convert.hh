@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <phantasm-renderer/enums.hh>
+
+namespace pr
+{
+/// CPU-side pixel formats of converting texture uploads
+/// un: unsigned normalized integer, f: float (16 bit: half)
+enum class pixel_format : uint8_t
+{
+    r8un,
+    rgb8un,
+    rgba8un,
+    bgra8un,
+    r16un,
+    r16f,
+    r32f,
+    rgb32f,
+    rgba16f,
+    rgba32f
+};
+
+uint32_t get_pixel_format_size_bytes(pixel_format fmt);
+
+/// the CPU-side equivalent of a texture format, returns false if there is none
+/// sRGB formats map to their 8 bit equivalent, see is_srgb_format
+bool get_pixel_format(format fmt, pixel_format& out_fmt);
+
+/// true for the sRGB variants of formats with a CPU-side equivalent
+bool is_srgb_format(format fmt);
+
+/// a conversion between two pixel formats
+/// missing color channels become 0 and missing alpha becomes 1, values are clamped to the range of normalized destinations
+struct pixel_conversion
+{
+    pixel_format src = pixel_format::rgba8un;
+    pixel_format dest = pixel_format::rgba8un;
+
+    /// encode linear RGB to sRGB when writing 8 bit destinations, alpha stays linear
+    bool srgb_encode = false;
+
+    /// destination channel i (in RGBA order) receives source channel swizzle[i], 4 writes 0 and 5 writes 1
+    uint8_t swizzle[4] = {0, 1, 2, 3};
+
+    bool has_swizzle() const { return swizzle[0] != 0 || swizzle[1] != 1 || swizzle[2] != 2 || swizzle[3] != 3; }
+};
+
+/// converts a row of pixels
+/// RGB expansion, RGBA/BGRA swaps and float/half conversions use SIMD kernels (SSSE3, F16C) where available
+void convert_pixel_row(pixel_conversion const& conv, std::byte const* __restrict src, std::byte* __restrict dest, uint32_t num_pixels);
+
+/// decodes pixels to RGBA floats, missing color channels are 0 and missing alpha is 1
+/// srgb_decode linearizes the color channels of 8 bit formats
+void decode_pixels(pixel_format fmt, std::byte const* __restrict src, uint32_t num_pixels, float (*__restrict out)[4], bool srgb_decode = false);
+
+/// encodes RGBA floats, values are clamped to the range of normalized formats
+/// srgb_encode encodes the color channels of 8 bit formats to sRGB
+void encode_pixels(pixel_format fmt, float const (*__restrict in)[4], uint32_t num_pixels, std::byte* __restrict dest, bool srgb_encode = false);
+
+/// IEEE half precision conversions, rounding to nearest even
+uint16_t float_to_half(float f);
+float half_to_float(uint16_t h);
+
+/// encodes a linear value in [0, 1] to 8 bit sRGB, rounding to nearest
+uint8_t linear_to_srgb8(float f);
+}
@@ -0,0 +1,62 @@
+#include "radix_sort.hh"
+
+#include <cstring>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+void pr::radix_sort_indices(cc::span<const uint64_t> keys, cc::span<uint32_t> out_indices, cc::span<uint32_t> scratch)
+{
+    CC_ASSERT(out_indices.size() == keys.size() && scratch.size() == keys.size() && "radix_sort_indices: size mismatch");
+
+    auto const num_keys = uint32_t(keys.size());
+
+    for (auto i = 0u; i < num_keys; ++i)
+        out_indices[i] = i;
+
+    if (num_keys < 2)
+        return;
+
+    // build all 8 digit histograms in a single pass over the keys
+    uint32_t histograms[8][256];
+    std::memset(histograms, 0, sizeof(histograms));
+
+    for (uint64_t const key : keys)
+    {
+        for (auto d = 0u; d < 8; ++d)
+            ++histograms[d][(key >> (d * 8)) & 0xFF];
+    }
+
+    uint32_t* src = out_indices.data();
+    uint32_t* dest = scratch.data();
+
+    for (auto d = 0u; d < 8; ++d)
+    {
+        uint32_t* const histogram = histograms[d];
+
+        // skip digits on which all keys agree
+        if (histogram[(keys[0] >> (d * 8)) & 0xFF] == num_keys)
+            continue;
+
+        // exclusive prefix sum
+        uint32_t offset = 0;
+        for (auto b = 0u; b < 256; ++b)
+        {
+            uint32_t const count = histogram[b];
+            histogram[b] = offset;
+            offset += count;
+        }
+
+        for (auto i = 0u; i < num_keys; ++i)
+        {
+            uint32_t const index = src[i];
+            dest[histogram[(keys[index] >> (d * 8)) & 0xFF]++] = index;
+        }
+
+        cc::swap(src, dest);
+    }
+
+    // an odd amount of passes leaves the result in scratch
+    if (src != out_indices.data())
+        std::memcpy(out_indices.data(), src, sizeof(uint32_t) * num_keys);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+#include <clean-core/span.hh>
+
+namespace pr
+{
+/// sorts indices by 64 bit keys (ascending, stable) using a LSD radix sort on 8 bit digits
+/// keys are not modified, out_indices receives the permutation (out_indices[i] = index of the i-th smallest key)
+/// out_indices and scratch must have the same size as keys
+/// digits on which all keys agree are skipped, so keys only using few bits sort in few passes
+void radix_sort_indices(cc::span<uint64_t const> keys, cc::span<uint32_t> out_indices, cc::span<uint32_t> scratch);
+}
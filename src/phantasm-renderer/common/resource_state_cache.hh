@@ -0,0 +1,92 @@
+#pragma once
+
+#include <mutex>
+
+#include <clean-core/alloc_vector.hh>
+#include <clean-core/map.hh>
+#include <clean-core/span.hh>
+
+#include <phantasm-renderer/common/state_info.hh>
+
+namespace pr
+{
+// last known states of resources as of the most recent submit
+// frames are seeded from this, and write back the states they leave resources in on submit
+// internally synchronized
+struct resource_state_cache
+{
+    void reserve(size_t num_elems) { _map.reserve(num_elems); }
+
+    /// returns true and writes the last known state if the resource is tracked
+    [[nodiscard]] bool lookup(phi::handle::resource res, resource_state_entry& out_entry)
+    {
+        auto lg = std::lock_guard(_mutex);
+        uint64_t const key = key_of(res);
+        if (!_map.contains_key(key))
+            return false;
+
+        entry const& elem = _map[key];
+        out_entry = {res, elem.state, elem.dependency};
+        return true;
+    }
+
+    /// appends an entry for each expected state that does not match the last known state
+    void find_mismatches(cc::span<resource_state_entry const> expected, cc::alloc_vector<resource_state_entry>& out_mismatches)
+    {
+        auto lg = std::lock_guard(_mutex);
+        for (resource_state_entry const& exp : expected)
+        {
+            // untracked resources are in an unknown state, checked before operator[] which would insert them
+            uint64_t const key = key_of(exp.resource);
+            if (!_map.contains_key(key))
+            {
+                out_mismatches.push_back(exp);
+                continue;
+            }
+
+            entry const& elem = _map[key];
+            if (elem.state != exp.state || elem.dependency != exp.dependency)
+                out_mismatches.push_back(exp);
+        }
+    }
+
+    /// set the last known states, entries with state unknown are no longer tracked
+    void update_range(cc::span<resource_state_entry const> entries)
+    {
+        auto lg = std::lock_guard(_mutex);
+        for (resource_state_entry const& e : entries)
+        {
+            if (e.state == phi::resource_state::unknown)
+                _map.remove_key(key_of(e.resource));
+            else
+                _map[key_of(e.resource)] = {e.state, e.dependency};
+        }
+    }
+
+    /// stop tracking resources (after they were freed or their state changed externally)
+    void forget(phi::handle::resource res)
+    {
+        auto lg = std::lock_guard(_mutex);
+        _map.remove_key(key_of(res));
+    }
+
+    void forget_range(cc::span<phi::handle::resource const> resources)
+    {
+        auto lg = std::lock_guard(_mutex);
+        for (phi::handle::resource const res : resources)
+            _map.remove_key(key_of(res));
+    }
+
+private:
+    struct entry
+    {
+        phi::resource_state state = phi::resource_state::unknown;
+        phi::shader_stage_flags_t dependency = {};
+    };
+
+    static uint64_t key_of(phi::handle::resource res) { return uint64_t(uint32_t(res._value)); }
+
+    cc::map<uint64_t, entry> _map;
+    std::mutex _mutex;
+};
+}
@@ -0,0 +1,183 @@
+#include "rowwise_copy.hh"
+
+#include <cstdint>
+#include <cstring>
+
+#include "cpu_features.hh"
+
+#ifdef PR_CPU_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define PR_ROWWISE_COPY_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+using row_copy_func = void (*)(std::byte const* __restrict src, std::byte* __restrict dest, size_t size);
+
+/// plain copies until dest is aligned to Align, returns the amount of copied bytes
+template <size_t Align>
+size_t copy_unaligned_head(std::byte const* __restrict src, std::byte* __restrict dest, size_t size)
+{
+    size_t head = (Align - (uintptr_t(dest) & (Align - 1))) & (Align - 1);
+    head = head < size ? head : size;
+    std::memcpy(dest, src, head);
+    return head;
+}
+
+void copy_row_memcpy(std::byte const* __restrict src, std::byte* __restrict dest, size_t size) { std::memcpy(dest, src, size); }
+
+#ifdef PR_CPU_X86
+void stream_row_sse2(std::byte const* __restrict src, std::byte* __restrict dest, size_t size)
+{
+    size_t i = copy_unaligned_head<16>(src, dest, size);
+
+    for (; i + 64 <= size; i += 64)
+    {
+        __m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+        __m128i const b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i + 16));
+        __m128i const c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i + 32));
+        __m128i const d = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dest + i), a);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dest + i + 16), b);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dest + i + 32), c);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dest + i + 48), d);
+    }
+
+    for (; i + 16 <= size; i += 16)
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dest + i), _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i)));
+
+    std::memcpy(dest + i, src + i, size - i);
+}
+
+PR_TARGET_ISA("avx2") void stream_row_avx2(std::byte const* __restrict src, std::byte* __restrict dest, size_t size)
+{
+    size_t i = copy_unaligned_head<32>(src, dest, size);
+
+    for (; i + 128 <= size; i += 128)
+    {
+        __m256i const a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+        __m256i const b = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i + 32));
+        __m256i const c = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i + 64));
+        __m256i const d = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i + 96));
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + i), a);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + i + 32), b);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + i + 64), c);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + i + 96), d);
+    }
+
+    for (; i + 32 <= size; i += 32)
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + i), _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i)));
+
+    std::memcpy(dest + i, src + i, size - i);
+}
+
+PR_TARGET_ISA("avx512f") void stream_row_avx512(std::byte const* __restrict src, std::byte* __restrict dest, size_t size)
+{
+    size_t i = copy_unaligned_head<64>(src, dest, size);
+
+    for (; i + 256 <= size; i += 256)
+    {
+        __m512i const a = _mm512_loadu_si512(src + i);
+        __m512i const b = _mm512_loadu_si512(src + i + 64);
+        __m512i const c = _mm512_loadu_si512(src + i + 128);
+        __m512i const d = _mm512_loadu_si512(src + i + 192);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + i), a);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + i + 64), b);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + i + 128), c);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + i + 192), d);
+    }
+
+    for (; i + 64 <= size; i += 64)
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + i), _mm512_loadu_si512(src + i));
+
+    std::memcpy(dest + i, src + i, size - i);
+}
+#endif
+
+#ifdef PR_ROWWISE_COPY_NEON
+// AArch64 has no non-temporal store intrinsics, wide stores still combine well on write-combined memory
+void stream_row_neon(std::byte const* __restrict src, std::byte* __restrict dest, size_t size)
+{
+    auto const* const s = reinterpret_cast<uint8_t const*>(src);
+    auto* const d = reinterpret_cast<uint8_t*>(dest);
+
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64)
+    {
+        uint8x16x4_t const v = vld1q_u8_x4(s + i);
+        vst1q_u8_x4(d + i, v);
+    }
+
+    for (; i + 16 <= size; i += 16)
+        vst1q_u8(d + i, vld1q_u8(s + i));
+
+    std::memcpy(dest + i, src + i, size - i);
+}
+#endif
+
+struct streaming_impl
+{
+    row_copy_func copy_row = copy_row_memcpy;
+    char const* isa = "memcpy";
+};
+
+streaming_impl const& get_streaming_impl()
+{
+    static streaming_impl const impl = [] {
+        streaming_impl res;
+#if defined(PR_CPU_X86)
+        pr::cpu_features const& cpu = pr::get_cpu_features();
+        if (cpu.avx512f)
+            res = {stream_row_avx512, "avx512"};
+        else if (cpu.avx2)
+            res = {stream_row_avx2, "avx2"};
+        else
+            res = {stream_row_sse2, "sse2"};
+#elif defined(PR_ROWWISE_COPY_NEON)
+        res = {stream_row_neon, "neon"};
+#endif
+        return res;
+    }();
+
+    return impl;
+}
+}
+
+size_t pr::rowwise_copy(std::byte const* __restrict src, std::byte* __restrict dest, size_t dest_row_stride_bytes, size_t row_size_bytes, unsigned num_rows)
+{
+    for (auto y = 0u; y < num_rows; ++y)
+    {
+        auto const src_offset = y * row_size_bytes;
+        auto const dst_offset = y * dest_row_stride_bytes;
+        std::memcpy(dest + dst_offset, src + src_offset, row_size_bytes);
+    }
+
+    return dest_row_stride_bytes * (num_rows - 1) + row_size_bytes;
+}
+
+size_t pr::rowwise_copy_streaming(std::byte const* __restrict src, std::byte* __restrict dest, size_t dest_row_stride_bytes, size_t row_size_bytes, unsigned num_rows)
+{
+    streaming_impl const& impl = get_streaming_impl();
+
+    if (dest_row_stride_bytes == row_size_bytes)
+    {
+        // unpadded rows are a single contiguous copy
+        impl.copy_row(src, dest, row_size_bytes * num_rows);
+    }
+    else
+    {
+        for (auto y = 0u; y < num_rows; ++y)
+            impl.copy_row(src + y * row_size_bytes, dest + y * dest_row_stride_bytes, row_size_bytes);
+    }
+
+#ifdef PR_CPU_X86
+    // streaming stores are weakly ordered, make them visible before the buffer is unmapped or submitted
+    _mm_sfence();
+#endif
+
+    return dest_row_stride_bytes * (num_rows - 1) + row_size_bytes;
+}
+
+char const* pr::get_rowwise_copy_streaming_isa() { return get_streaming_impl().isa; }
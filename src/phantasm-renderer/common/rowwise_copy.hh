@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+namespace pr
+{
+/// copies num_rows rows of row_size_bytes from a tightly packed src to dest, where rows are dest_row_stride_bytes apart
+/// num_rows is the height in pixels for regular formats, but is lower for block compressed formats
+/// returns the amount of bytes spanned in dest
+size_t rowwise_copy(std::byte const* __restrict src, std::byte* __restrict dest, size_t dest_row_stride_bytes, size_t row_size_bytes, unsigned num_rows);
+
+/// same as rowwise_copy, but writes dest with non-temporal (streaming) stores which bypass the cache
+/// meant for write-combined destinations like mapped upload buffers, which are never read back on the CPU
+/// padding between rows is left untouched, the implementation is picked on first use (AVX-512, AVX2, SSE2 or NEON)
+size_t rowwise_copy_streaming(std::byte const* __restrict src, std::byte* __restrict dest, size_t dest_row_stride_bytes, size_t row_size_bytes, unsigned num_rows);
+
+/// name of the instruction set rowwise_copy_streaming uses on this CPU
+char const* get_rowwise_copy_streaming_isa();
+}
@@ -23,6 +23,14 @@ struct freeable_cached_obj
     uint64_t hash;
 };
 
+// the last known state of a resource
+struct resource_state_entry
+{
+    phi::handle::resource resource;
+    phi::resource_state state;
+    phi::shader_stage_flags_t dependency;
+};
+
 // for economic reasons, SRVs, UAVs and Samplers are limited for cache-access shader views
 struct shader_view_info
 {
@@ -0,0 +1,329 @@
+#include "texture_container.hh"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+#include <clean-core/vector.hh>
+
+#include <phantasm-hardware-interface/common/byte_util.hh>
+
+#include <phantasm-renderer/common/log.hh>
+#include <phantasm-renderer/common/lz4_block.hh>
+#include <phantasm-renderer/common/rowwise_copy.hh>
+
+namespace
+{
+// containers below this size are decompressed on the calling thread
+constexpr size_t gc_parallel_decompress_bytes_per_thread = 2u << 20;
+constexpr unsigned gc_max_decompress_threads = 8;
+
+size_t get_num_chunks(pr::texture_container_header const& header)
+{
+    if (header.compression == uint32_t(pr::texture_container_compression::none))
+        return 0;
+
+    return size_t((header.data_size_bytes + header.chunk_size_bytes - 1) / header.chunk_size_bytes);
+}
+
+/// validates the texture description of a header read from a file before any layout is built from it
+bool is_valid_container_texture(pr::texture_container_header const& header)
+{
+    if (header.format == uint32_t(phi::format::none) || header.format >= uint32_t(phi::format::MAX_FORMAT_RANGE))
+    {
+        PR_LOG_WARN("texture container format {} invalid", header.format);
+        return false;
+    }
+
+    // layouts of 3D textures with depth are unsupported, copy commands address whole array slices
+    bool const is_valid_dimension = (header.dimension == uint32_t(phi::texture_dimension::t1d) && header.height == 1)
+                                    || header.dimension == uint32_t(phi::texture_dimension::t2d)
+                                    || (header.dimension == uint32_t(phi::texture_dimension::t3d) && header.depth_or_array_size == 1);
+    if (!is_valid_dimension)
+    {
+        PR_LOG_WARN("texture container dimension {} invalid for size {}x{}x{}", header.dimension, header.width, header.height, header.depth_or_array_size);
+        return false;
+    }
+
+    // negative extents wrap to out of range values
+    return pr::is_valid_texture_file_extent("texture container", uint32_t(header.width), uint32_t(header.height), header.num_mips, header.depth_or_array_size);
+}
+
+/// the header and subresource table of a container for a layout, the stored size of compressed containers is left to the caller
+void fill_container_header(pr::texture_info const& info,
+                           pr::texture_upload_layout const& layout,
+                           bool is_d3d12_layout,
+                           pr::texture_container_compression compression,
+                           pr::texture_container_header& out_header,
+                           cc::vector<pr::texture_container_subresource>& out_subresources)
+{
+    out_header = {};
+    out_header.magic = pr::gc_texture_container_magic;
+    out_header.version = pr::gc_texture_container_version;
+    out_header.is_d3d12_layout = is_d3d12_layout ? 1 : 0;
+    out_header.num_subresources = uint32_t(layout.subresources.size());
+    out_header.format = uint32_t(info.fmt);
+    out_header.dimension = uint32_t(info.dim);
+    out_header.width = info.width;
+    out_header.height = info.height;
+    out_header.depth_or_array_size = info.depth_or_array_size;
+    out_header.num_mips = layout.num_mips;
+    out_header.compression = uint32_t(compression);
+    out_header.chunk_size_bytes = compression == pr::texture_container_compression::none ? 0 : pr::gc_texture_container_chunk_size;
+    out_header.data_size_bytes = layout.dest_size_bytes;
+    out_header.stored_size_bytes = layout.dest_size_bytes;
+
+    size_t const table_end = sizeof(pr::texture_container_header) + layout.subresources.size() * sizeof(pr::texture_container_subresource)
+                             + get_num_chunks(out_header) * sizeof(pr::texture_container_chunk);
+    out_header.data_offset_bytes = phi::util::align_up(uint64_t(table_end), pr::gc_texture_container_data_alignment);
+
+    out_subresources.clear();
+    out_subresources.reserve(layout.subresources.size());
+    for (pr::texture_subresource_upload const& subres : layout.subresources)
+    {
+        pr::texture_container_subresource entry;
+        entry.offset_bytes = subres.dest_offset_bytes;
+        entry.row_stride_bytes = subres.dest_row_stride_bytes;
+        entry.num_rows = subres.num_rows;
+        entry.width = subres.width;
+        entry.height = subres.height;
+        entry.mip_index = subres.mip_index;
+        entry.array_index = subres.array_index;
+        out_subresources.push_back(entry);
+    }
+}
+
+/// compresses the data section in chunks, chunks that do not compress are stored as is
+void compress_container_data(cc::span<std::byte const> data, cc::vector<pr::texture_container_chunk>& out_chunks, cc::vector<std::byte>& out_stored)
+{
+    cc::vector<std::byte> compressed;
+    compressed.resize(pr::get_lz4_compress_bound(pr::gc_texture_container_chunk_size));
+
+    out_stored.reserve(data.size());
+    for (size_t offset = 0; offset < data.size(); offset += pr::gc_texture_container_chunk_size)
+    {
+        size_t const size = cc::min(size_t(pr::gc_texture_container_chunk_size), data.size() - offset);
+
+        // must save at least a byte
+        size_t const compressed_size = pr::lz4_compress_block(data.data() + offset, size, compressed.data(), size - 1);
+        std::byte const* const stored = compressed_size > 0 ? compressed.data() : data.data() + offset;
+        size_t const stored_size = compressed_size > 0 ? compressed_size : size;
+
+        pr::texture_container_chunk chunk;
+        chunk.stored_offset_bytes = out_stored.size();
+        chunk.stored_size_bytes = uint32_t(stored_size);
+        chunk.size_bytes = uint32_t(size);
+        out_chunks.push_back(chunk);
+
+        out_stored.resize(out_stored.size() + stored_size);
+        std::memcpy(out_stored.data() + chunk.stored_offset_bytes, stored, stored_size);
+    }
+}
+}
+
+pr::texture_info pr::get_texture_container_info(const texture_container_header& header)
+{
+    return texture_info::create_tex(format(header.format), {header.width, header.height}, header.num_mips, phi::texture_dimension(header.dimension),
+                                    header.depth_or_array_size, false);
+}
+
+bool pr::write_texture_container(
+    const char* path, const texture_info& info, cc::span<const std::byte> texture_data, bool is_d3d12_layout, texture_container_compression compression)
+{
+    texture_upload_layout layout;
+    layout.initialize(info, 0, is_d3d12_layout);
+
+    if (texture_data.size() < layout.src_size_bytes)
+    {
+        PR_LOG_WARN("texture container not written, texture data too small ({} of {} bytes)", texture_data.size(), layout.src_size_bytes);
+        return false;
+    }
+
+    texture_container_header header;
+    cc::vector<texture_container_subresource> subresources;
+    fill_container_header(info, layout, is_d3d12_layout, compression, header, subresources);
+
+    // the data section is the upload buffer contents, padding bytes are zero
+    cc::vector<std::byte> data;
+    data.resize(layout.dest_size_bytes);
+    std::memset(data.data(), 0, data.size());
+    copy_texture_upload_rows(layout, texture_data.data(), data.data());
+
+    cc::vector<texture_container_chunk> chunks;
+    cc::vector<std::byte> stored_data;
+    if (compression == texture_container_compression::lz4)
+    {
+        compress_container_data(data, chunks, stored_data);
+        header.stored_size_bytes = stored_data.size();
+    }
+    else
+    {
+        stored_data = cc::move(data);
+    }
+
+    std::FILE* const file = std::fopen(path, "wb");
+    if (file == nullptr)
+    {
+        PR_LOG_WARN("texture container not written, unable to open {} for writing", path);
+        return false;
+    }
+
+    size_t const table_size = subresources.size() * sizeof(texture_container_subresource);
+    size_t const chunk_table_size = chunks.size() * sizeof(texture_container_chunk);
+    size_t const padding_size = size_t(header.data_offset_bytes) - sizeof(header) - table_size - chunk_table_size;
+    std::byte const padding[gc_texture_container_data_alignment] = {};
+
+    bool is_ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    is_ok &= table_size == 0 || std::fwrite(subresources.data(), table_size, 1, file) == 1;
+    is_ok &= chunk_table_size == 0 || std::fwrite(chunks.data(), chunk_table_size, 1, file) == 1;
+    is_ok &= padding_size == 0 || std::fwrite(padding, padding_size, 1, file) == 1;
+    is_ok &= stored_data.empty() || std::fwrite(stored_data.data(), stored_data.size(), 1, file) == 1;
+    is_ok &= std::fclose(file) == 0;
+
+    if (!is_ok)
+        PR_LOG_WARN("texture container not written, error writing {}", path);
+
+    return is_ok;
+}
+
+bool pr::read_texture_container_header(
+    std::FILE* file, bool is_d3d12, texture_container_header& out_header, texture_upload_layout& out_layout, cc::vector<texture_container_chunk>& out_chunks)
+{
+    out_chunks.clear();
+
+    if (std::fread(&out_header, sizeof(out_header), 1, file) != 1)
+        return false;
+
+    if (out_header.magic != gc_texture_container_magic || out_header.version != gc_texture_container_version
+        || out_header.compression > uint32_t(texture_container_compression::lz4))
+    {
+        PR_LOG_WARN("texture container invalid or of an unsupported version");
+        return false;
+    }
+
+    if (out_header.is_d3d12_layout != (is_d3d12 ? 1u : 0u))
+    {
+        PR_LOG_WARN("texture container was built for the {} backend", out_header.is_d3d12_layout ? "d3d12" : "vulkan");
+        return false;
+    }
+
+    if (!is_valid_container_texture(out_header))
+        return false;
+
+    // the stored placement must be exactly what the current build computes, the data is copied without any fixups
+    out_layout.initialize(get_texture_container_info(out_header), out_header.num_mips, is_d3d12);
+
+    texture_container_header expected_header;
+    cc::vector<texture_container_subresource> expected_subresources;
+    fill_container_header(get_texture_container_info(out_header), out_layout, is_d3d12, texture_container_compression(out_header.compression),
+                          expected_header, expected_subresources);
+    if (out_header.compression != uint32_t(texture_container_compression::none))
+        expected_header.stored_size_bytes = out_header.stored_size_bytes;
+
+    if (std::memcmp(&expected_header, &out_header, sizeof(out_header)) != 0)
+    {
+        PR_LOG_WARN("texture container layout does not match, rebuild it");
+        return false;
+    }
+
+    cc::vector<texture_container_subresource> subresources;
+    subresources.resize(out_header.num_subresources);
+    size_t const table_size = subresources.size() * sizeof(texture_container_subresource);
+    if (table_size > 0 && std::fread(subresources.data(), table_size, 1, file) != 1)
+        return false;
+
+    if (std::memcmp(subresources.data(), expected_subresources.data(), table_size) != 0)
+    {
+        PR_LOG_WARN("texture container layout does not match, rebuild it");
+        return false;
+    }
+
+    out_chunks.resize(get_num_chunks(out_header));
+    size_t const chunk_table_size = out_chunks.size() * sizeof(texture_container_chunk);
+    if (chunk_table_size > 0 && std::fread(out_chunks.data(), chunk_table_size, 1, file) != 1)
+        return false;
+
+    // chunks are consecutive in the file and cover the upload buffer in order
+    uint64_t stored_offset = 0;
+    uint64_t offset = 0;
+    for (texture_container_chunk const& chunk : out_chunks)
+    {
+        uint64_t const expected_size = cc::min(uint64_t(out_header.chunk_size_bytes), out_header.data_size_bytes - offset);
+        if (chunk.stored_offset_bytes != stored_offset || chunk.size_bytes != expected_size || chunk.stored_size_bytes > chunk.size_bytes)
+        {
+            PR_LOG_WARN("texture container chunk table corrupted");
+            return false;
+        }
+
+        stored_offset += chunk.stored_size_bytes;
+        offset += chunk.size_bytes;
+    }
+
+    if (!out_chunks.empty() && stored_offset != out_header.stored_size_bytes)
+    {
+        PR_LOG_WARN("texture container chunk table corrupted");
+        return false;
+    }
+
+    return std::fseek(file, long(out_header.data_offset_bytes), SEEK_SET) == 0;
+}
+
+bool pr::decompress_texture_container_chunk(
+    texture_container_compression compression, const texture_container_chunk& chunk, const std::byte* stored_chunk, std::byte* dest, cc::vector<std::byte>& scratch)
+{
+    if (chunk.stored_size_bytes == chunk.size_bytes)
+    {
+        rowwise_copy_streaming(stored_chunk, dest, chunk.size_bytes, chunk.size_bytes, 1);
+        return true;
+    }
+
+    CC_ASSERT(compression == texture_container_compression::lz4 && "unknown texture container compression");
+
+    if (scratch.size() < chunk.size_bytes)
+        scratch.resize(chunk.size_bytes);
+
+    if (!lz4_decompress_block(stored_chunk, chunk.stored_size_bytes, scratch.data(), chunk.size_bytes))
+        return false;
+
+    rowwise_copy_streaming(scratch.data(), dest, chunk.size_bytes, chunk.size_bytes, 1);
+    return true;
+}
+
+bool pr::decompress_texture_container(const texture_container_header& header,
+                                      cc::span<const texture_container_chunk> chunks,
+                                      const std::byte* stored_data,
+                                      std::byte* upload_buffer_map)
+{
+    auto const compression = texture_container_compression(header.compression);
+
+    // threads take the next chunk until none are left, chunks vary in decompression cost
+    std::atomic<size_t> next_chunk = {0};
+    std::atomic<bool> is_ok = {true};
+    auto const f_decompress_chunks = [&] {
+        cc::vector<std::byte> scratch;
+        for (size_t i = next_chunk++; i < chunks.size(); i = next_chunk++)
+        {
+            texture_container_chunk const& chunk = chunks[i];
+            if (!decompress_texture_container_chunk(compression, chunk, stored_data + chunk.stored_offset_bytes,
+                                                    upload_buffer_map + i * size_t(header.chunk_size_bytes), scratch))
+                is_ok = false;
+        }
+    };
+
+    unsigned num_threads = cc::min(cc::max(std::thread::hardware_concurrency(), 1u), gc_max_decompress_threads);
+    num_threads = cc::min(num_threads, unsigned(header.data_size_bytes / gc_parallel_decompress_bytes_per_thread));
+
+    // the calling thread decompresses as well
+    std::thread workers[gc_max_decompress_threads];
+    for (auto i = 0u; i + 1 < num_threads; ++i)
+        workers[i] = std::thread(f_decompress_chunks);
+
+    f_decompress_chunks();
+
+    for (auto i = 0u; i + 1 < num_threads; ++i)
+        workers[i].join();
+
+    return is_ok;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <clean-core/span.hh>
+#include <clean-core/vector.hh>
+
+#include <phantasm-renderer/common/resource_info.hh>
+#include <phantasm-renderer/common/texture_file.hh>
+#include <phantasm-renderer/common/texture_upload.hh>
+
+// pre-aligned texture containers (.prtc)
+// the data section is the exact upload buffer contents of one backend: rows are pitched and subresources placed as
+// the backend requires, so loading is a single read into an upload buffer and one copy command per subresource
+//
+// compressed containers store the data section in independently compressed chunks of chunk_size_bytes,
+// decompressed in parallel straight to their place in the upload buffer
+//
+// file layout:
+//   texture_container_header
+//   texture_container_subresource[num_subresources], ordered by array slice, then mip level
+//   texture_container_chunk[num_chunks], compressed containers only
+//   padding to data_offset_bytes
+//   data, stored_size_bytes
+namespace pr
+{
+inline constexpr uint32_t gc_texture_container_magic = 0x43545250; // "PRTC"
+inline constexpr uint32_t gc_texture_container_version = 2;
+/// alignment of the data section in the file, allows unbuffered reads
+inline constexpr uint64_t gc_texture_container_data_alignment = 4096;
+/// uncompressed size of the chunks of compressed containers, the decompressed chunk stays in L2
+inline constexpr uint32_t gc_texture_container_chunk_size = 256u << 10;
+
+enum class texture_container_compression : uint32_t
+{
+    none,
+    lz4 ///< LZ4 block format, see lz4_block.hh
+};
+
+struct texture_container_header
+{
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t is_d3d12_layout = 0; ///< 1: d3d12 row pitch and placement, 0: vulkan
+    uint32_t num_subresources = 0;
+
+    // mirror of the texture_info, containers always create sampled textures without UAV support
+    uint32_t format = 0; ///< phi::format value
+    uint32_t dimension = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    uint32_t depth_or_array_size = 0;
+    uint32_t num_mips = 0; ///< number of stored mips, each array slice has all of them
+
+    uint32_t compression = 0;      ///< texture_container_compression value
+    uint32_t chunk_size_bytes = 0; ///< uncompressed size of all but the last chunk, 0 if uncompressed
+
+    uint64_t data_offset_bytes = 0; ///< from the start of the file
+    uint64_t data_size_bytes = 0;   ///< required upload buffer size
+    uint64_t stored_size_bytes = 0; ///< size of the data section in the file, data_size_bytes if uncompressed
+};
+
+struct texture_container_subresource
+{
+    uint64_t offset_bytes = 0; ///< from the start of the data section
+    uint32_t row_stride_bytes = 0;
+    uint32_t num_rows = 0;
+    uint32_t width = 0;  ///< extent of the copy command
+    uint32_t height = 0; ///< extent of the copy command
+    uint32_t mip_index = 0;
+    uint32_t array_index = 0;
+};
+
+/// a chunk of the data section of a compressed container
+struct texture_container_chunk
+{
+    uint64_t stored_offset_bytes = 0; ///< from the start of the data section in the file
+    uint32_t stored_size_bytes = 0;   ///< equal to size_bytes if the chunk did not compress and is stored as is
+    uint32_t size_bytes = 0;          ///< decompressed, placed at chunk index * chunk_size_bytes in the upload buffer
+};
+
+/// the texture_info a container header describes
+texture_info get_texture_container_info(texture_container_header const& header);
+
+/// offline conversion, writes texture data (tightly packed, ordered by array slice, then mip level, see Frame::upload_texture_data)
+/// into a container laid out for the given backend, info.num_mips 0 expects the full mip chain
+/// returns false if the data is too small or the file cannot be written
+bool write_texture_container(char const* path,
+                             texture_info const& info,
+                             cc::span<std::byte const> texture_data,
+                             bool is_d3d12_layout,
+                             texture_container_compression compression = texture_container_compression::none);
+
+/// reads and validates the header, subresource and chunk table, leaving the file at the start of the data section
+/// out_layout receives the subresource placement, containers built for the other backend (or an outdated alignment) are rejected
+/// out_chunks is empty for uncompressed containers
+bool read_texture_container_header(std::FILE* file,
+                                   bool is_d3d12,
+                                   texture_container_header& out_header,
+                                   texture_upload_layout& out_layout,
+                                   cc::vector<texture_container_chunk>& out_chunks);
+
+/// writes one chunk to its place in the upload buffer, dest is chunk.size_bytes
+/// LZ4 chunks are decompressed to scratch (resized as needed, reusable) first, matches read back their output and
+/// the upload buffer is write-combined, scratch is then streamed to dest
+/// returns false for corrupted chunks
+bool decompress_texture_container_chunk(texture_container_compression compression,
+                                        texture_container_chunk const& chunk,
+                                        std::byte const* stored_chunk,
+                                        std::byte* dest,
+                                        cc::vector<std::byte>& scratch);
+
+/// decompresses all chunks of a data section (stored_size_bytes at stored_data) into the upload buffer on multiple threads
+/// returns false if any chunk is corrupted
+bool decompress_texture_container(texture_container_header const& header,
+                                  cc::span<texture_container_chunk const> chunks,
+                                  std::byte const* stored_data,
+                                  std::byte* upload_buffer_map);
+}
@@ -0,0 +1,533 @@
+#include "texture_file.hh"
+
+#include <cstring>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+#include <phantasm-renderer/common/log.hh>
+
+namespace
+{
+//
+// DDS, see the DirectX documentation of DDS_HEADER and DDS_HEADER_DXT10
+
+constexpr uint32_t make_four_cc(char a, char b, char c, char d) { return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24; }
+
+constexpr uint32_t gc_dds_magic = make_four_cc('D', 'D', 'S', ' ');
+
+constexpr uint32_t gc_ddpf_alpha_pixels = 0x1;
+constexpr uint32_t gc_ddpf_four_cc = 0x4;
+constexpr uint32_t gc_ddpf_rgb = 0x40;
+constexpr uint32_t gc_ddpf_luminance = 0x20000;
+constexpr uint32_t gc_ddsd_mip_map_count = 0x20000;
+constexpr uint32_t gc_ddscaps2_cubemap = 0x200;
+constexpr uint32_t gc_ddscaps2_volume = 0x200000;
+constexpr uint32_t gc_dds_resource_misc_texturecube = 0x4;
+constexpr uint32_t gc_dds_dimension_texture1d = 2;
+constexpr uint32_t gc_dds_dimension_texture3d = 4;
+
+struct dds_pixel_format
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t four_cc;
+    uint32_t rgb_bit_count;
+    uint32_t r_mask;
+    uint32_t g_mask;
+    uint32_t b_mask;
+    uint32_t a_mask;
+};
+
+struct dds_header
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitch_or_linear_size;
+    uint32_t depth;
+    uint32_t mip_map_count;
+    uint32_t reserved1[11];
+    dds_pixel_format pixel_format;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+
+struct dds_header_dxt10
+{
+    uint32_t dxgi_format;
+    uint32_t resource_dimension;
+    uint32_t misc_flag;
+    uint32_t array_size;
+    uint32_t misc_flags2;
+};
+
+static_assert(sizeof(dds_header) == 124, "DDS header layout mismatch");
+
+bool get_format_from_dxgi(uint32_t dxgi_format, pr::format& out_format)
+{
+    using pr::format;
+    switch (dxgi_format)
+    {
+    case 2: // R32G32B32A32_FLOAT
+        out_format = format::rgba32f;
+        return true;
+    case 6: // R32G32B32_FLOAT
+        out_format = format::rgb32f;
+        return true;
+    case 10: // R16G16B16A16_FLOAT
+        out_format = format::rgba16f;
+        return true;
+    case 11: // R16G16B16A16_UNORM
+        out_format = format::rgba16un;
+        return true;
+    case 16: // R32G32_FLOAT
+        out_format = format::rg32f;
+        return true;
+    case 28: // R8G8B8A8_UNORM
+        out_format = format::rgba8un;
+        return true;
+    case 29: // R8G8B8A8_UNORM_SRGB
+        out_format = format::rgba8un_srgb;
+        return true;
+    case 34: // R16G16_FLOAT
+        out_format = format::rg16f;
+        return true;
+    case 41: // R32_FLOAT
+        out_format = format::r32f;
+        return true;
+    case 49: // R8G8_UNORM
+        out_format = format::rg8un;
+        return true;
+    case 54: // R16_FLOAT
+        out_format = format::r16f;
+        return true;
+    case 56: // R16_UNORM
+        out_format = format::r16un;
+        return true;
+    case 61: // R8_UNORM
+        out_format = format::r8un;
+        return true;
+    case 71: // BC1_UNORM
+        out_format = format::bc1_8un;
+        return true;
+    case 72: // BC1_UNORM_SRGB
+        out_format = format::bc1_8un_srgb;
+        return true;
+    case 74: // BC2_UNORM
+        out_format = format::bc2_8un;
+        return true;
+    case 75: // BC2_UNORM_SRGB
+        out_format = format::bc2_8un_srgb;
+        return true;
+    case 77: // BC3_UNORM
+        out_format = format::bc3_8un;
+        return true;
+    case 78: // BC3_UNORM_SRGB
+        out_format = format::bc3_8un_srgb;
+        return true;
+    case 87: // B8G8R8A8_UNORM
+        out_format = format::bgra8un;
+        return true;
+    case 95: // BC6H_UF16
+        out_format = format::bc6h_16uf;
+        return true;
+    case 96: // BC6H_SF16
+        out_format = format::bc6h_16f;
+        return true;
+    case 98: // BC7_UNORM
+        out_format = format::bc7_8un;
+        return true;
+    case 99: // BC7_UNORM_SRGB
+        out_format = format::bc7_8un_srgb;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// formats of DDS files without the DX10 extension header
+bool get_format_from_dds_pixel_format(dds_pixel_format const& pf, pr::format& out_format)
+{
+    using pr::format;
+    if (pf.flags & gc_ddpf_four_cc)
+    {
+        switch (pf.four_cc)
+        {
+        case make_four_cc('D', 'X', 'T', '1'):
+            out_format = format::bc1_8un;
+            return true;
+        case make_four_cc('D', 'X', 'T', '2'):
+        case make_four_cc('D', 'X', 'T', '3'):
+            out_format = format::bc2_8un;
+            return true;
+        case make_four_cc('D', 'X', 'T', '4'):
+        case make_four_cc('D', 'X', 'T', '5'):
+            out_format = format::bc3_8un;
+            return true;
+        // D3DFORMAT values stored as FourCC
+        case 111: // D3DFMT_R16F
+            out_format = format::r16f;
+            return true;
+        case 113: // D3DFMT_A16B16G16R16F
+            out_format = format::rgba16f;
+            return true;
+        case 114: // D3DFMT_R32F
+            out_format = format::r32f;
+            return true;
+        case 116: // D3DFMT_A32B32G32R32F
+            out_format = format::rgba32f;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    if ((pf.flags & gc_ddpf_rgb) && pf.rgb_bit_count == 32)
+    {
+        bool const has_alpha = (pf.flags & gc_ddpf_alpha_pixels) != 0;
+        if (pf.r_mask == 0xFF && pf.g_mask == 0xFF00 && pf.b_mask == 0xFF0000 && (!has_alpha || pf.a_mask == 0xFF000000))
+        {
+            out_format = format::rgba8un;
+            return true;
+        }
+
+        if (pf.r_mask == 0xFF0000 && pf.g_mask == 0xFF00 && pf.b_mask == 0xFF && (!has_alpha || pf.a_mask == 0xFF000000))
+        {
+            out_format = format::bgra8un;
+            return true;
+        }
+    }
+
+    if ((pf.flags & (gc_ddpf_rgb | gc_ddpf_luminance)) && pf.rgb_bit_count == 8 && pf.r_mask == 0xFF)
+    {
+        out_format = format::r8un;
+        return true;
+    }
+
+    return false;
+}
+
+//
+// KTX2, see the Khronos KTX File Format Specification 2.0
+
+constexpr uint8_t gc_ktx2_identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+struct ktx2_header
+{
+    uint8_t identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+
+    // index
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+};
+
+struct ktx2_level
+{
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+};
+
+static_assert(sizeof(ktx2_header) == 80, "KTX2 header layout mismatch");
+
+bool get_format_from_vk(uint32_t vk_format, pr::format& out_format)
+{
+    using pr::format;
+    switch (vk_format)
+    {
+    case 9: // R8_UNORM
+        out_format = format::r8un;
+        return true;
+    case 16: // R8G8_UNORM
+        out_format = format::rg8un;
+        return true;
+    case 37: // R8G8B8A8_UNORM
+        out_format = format::rgba8un;
+        return true;
+    case 43: // R8G8B8A8_SRGB
+        out_format = format::rgba8un_srgb;
+        return true;
+    case 44: // B8G8R8A8_UNORM
+        out_format = format::bgra8un;
+        return true;
+    case 70: // R16_UNORM
+        out_format = format::r16un;
+        return true;
+    case 76: // R16_SFLOAT
+        out_format = format::r16f;
+        return true;
+    case 83: // R16G16_SFLOAT
+        out_format = format::rg16f;
+        return true;
+    case 91: // R16G16B16A16_UNORM
+        out_format = format::rgba16un;
+        return true;
+    case 97: // R16G16B16A16_SFLOAT
+        out_format = format::rgba16f;
+        return true;
+    case 100: // R32_SFLOAT
+        out_format = format::r32f;
+        return true;
+    case 103: // R32G32_SFLOAT
+        out_format = format::rg32f;
+        return true;
+    case 106: // R32G32B32_SFLOAT
+        out_format = format::rgb32f;
+        return true;
+    case 109: // R32G32B32A32_SFLOAT
+        out_format = format::rgba32f;
+        return true;
+    case 131: // BC1_RGB_UNORM_BLOCK
+    case 133: // BC1_RGBA_UNORM_BLOCK
+        out_format = format::bc1_8un;
+        return true;
+    case 132: // BC1_RGB_SRGB_BLOCK
+    case 134: // BC1_RGBA_SRGB_BLOCK
+        out_format = format::bc1_8un_srgb;
+        return true;
+    case 135: // BC2_UNORM_BLOCK
+        out_format = format::bc2_8un;
+        return true;
+    case 136: // BC2_SRGB_BLOCK
+        out_format = format::bc2_8un_srgb;
+        return true;
+    case 137: // BC3_UNORM_BLOCK
+        out_format = format::bc3_8un;
+        return true;
+    case 138: // BC3_SRGB_BLOCK
+        out_format = format::bc3_8un_srgb;
+        return true;
+    case 143: // BC6H_UFLOAT_BLOCK
+        out_format = format::bc6h_16uf;
+        return true;
+    case 144: // BC6H_SFLOAT_BLOCK
+        out_format = format::bc6h_16f;
+        return true;
+    case 145: // BC7_UNORM_BLOCK
+        out_format = format::bc7_8un;
+        return true;
+    case 146: // BC7_SRGB_BLOCK
+        out_format = format::bc7_8un_srgb;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool read_exact(std::FILE* file, void* dest, size_t size) { return std::fread(dest, size, 1, file) == 1; }
+
+/// the tightly packed placement of all subresources, as stored in DDS files and within KTX2 levels
+void get_packed_layout(pr::texture_info const& info, pr::texture_upload_layout& out_layout) { out_layout.initialize(info, info.num_mips, false); }
+
+bool parse_dds(std::FILE* file, pr::texture_info& out_info, cc::vector<size_t>& out_subresource_offsets)
+{
+    dds_header header;
+    if (!read_exact(file, &header, sizeof(header)) || header.size != sizeof(dds_header))
+        return false;
+
+    size_t data_offset = sizeof(uint32_t) + sizeof(dds_header);
+    uint32_t const num_mips = (header.flags & gc_ddsd_mip_map_count) && header.mip_map_count > 0 ? header.mip_map_count : 1;
+    uint64_t num_array_slices = 1;
+    auto dim = phi::texture_dimension::t2d;
+    pr::format fmt;
+
+    if ((header.pixel_format.flags & gc_ddpf_four_cc) && header.pixel_format.four_cc == make_four_cc('D', 'X', '1', '0'))
+    {
+        dds_header_dxt10 ext;
+        if (!read_exact(file, &ext, sizeof(ext)))
+            return false;
+
+        data_offset += sizeof(ext);
+
+        if (!get_format_from_dxgi(ext.dxgi_format, fmt))
+        {
+            PR_LOG_WARN("DDS format (DXGI_FORMAT {}) unsupported", ext.dxgi_format);
+            return false;
+        }
+
+        if (ext.resource_dimension == gc_dds_dimension_texture3d)
+        {
+            PR_LOG_WARN("DDS volume textures unsupported");
+            return false;
+        }
+
+        if (ext.resource_dimension == gc_dds_dimension_texture1d)
+            dim = phi::texture_dimension::t1d;
+
+        // array sizes of cube textures count whole cubes
+        num_array_slices = uint64_t(cc::max(ext.array_size, 1u)) * ((ext.misc_flag & gc_dds_resource_misc_texturecube) ? 6 : 1);
+    }
+    else
+    {
+        if (!get_format_from_dds_pixel_format(header.pixel_format, fmt))
+        {
+            PR_LOG_WARN("DDS pixel format unsupported");
+            return false;
+        }
+
+        if (header.caps2 & gc_ddscaps2_volume)
+        {
+            PR_LOG_WARN("DDS volume textures unsupported");
+            return false;
+        }
+
+        // legacy cube maps must contain all six faces
+        if (header.caps2 & gc_ddscaps2_cubemap)
+            num_array_slices = 6;
+    }
+
+    if (!pr::is_valid_texture_file_extent("DDS", header.width, header.height, num_mips, num_array_slices))
+        return false;
+
+    out_info = pr::texture_info::create_tex(fmt, {int(header.width), int(header.height)}, num_mips, dim, unsigned(num_array_slices), false);
+
+    // data is ordered by array slice (face), then mip level
+    pr::texture_upload_layout packed;
+    get_packed_layout(out_info, packed);
+
+    out_subresource_offsets.clear();
+    out_subresource_offsets.reserve(packed.subresources.size());
+    for (pr::texture_subresource_upload const& subres : packed.subresources)
+        out_subresource_offsets.push_back(data_offset + subres.src_offset_bytes);
+
+    return true;
+}
+
+bool parse_ktx2(std::FILE* file, pr::texture_info& out_info, cc::vector<size_t>& out_subresource_offsets)
+{
+    // the header includes the identifier, which keeps its 64 bit fields aligned
+    ktx2_header header;
+    if (std::fseek(file, 0, SEEK_SET) != 0 || !read_exact(file, &header, sizeof(header)))
+        return false;
+
+    if (header.supercompression_scheme != 0)
+    {
+        PR_LOG_WARN("supercompressed KTX2 files unsupported");
+        return false;
+    }
+
+    if (header.pixel_depth > 1)
+    {
+        PR_LOG_WARN("KTX2 volume textures unsupported");
+        return false;
+    }
+
+    pr::format fmt;
+    if (!get_format_from_vk(header.vk_format, fmt))
+    {
+        PR_LOG_WARN("KTX2 format (VkFormat {}) unsupported", header.vk_format);
+        return false;
+    }
+
+    if (header.face_count != 1 && header.face_count != 6)
+    {
+        PR_LOG_WARN("KTX2 face count {} invalid", header.face_count);
+        return false;
+    }
+
+    // level count 0 requests mip generation on load, only the base level is stored
+    // 1D textures have a pixel height of 0
+    uint32_t const num_levels = cc::max(header.level_count, 1u);
+    uint32_t const height = cc::max(header.pixel_height, 1u);
+    uint64_t const num_array_slices = uint64_t(cc::max(header.layer_count, 1u)) * header.face_count;
+    if (!pr::is_valid_texture_file_extent("KTX2", header.pixel_width, height, num_levels, num_array_slices))
+        return false;
+
+    cc::vector<ktx2_level> levels;
+    levels.resize(num_levels);
+    if (!read_exact(file, levels.data(), levels.size() * sizeof(ktx2_level)))
+        return false;
+
+    auto const dim = header.pixel_height == 0 ? phi::texture_dimension::t1d : phi::texture_dimension::t2d;
+    out_info = pr::texture_info::create_tex(fmt, {int(header.pixel_width), int(height)}, num_levels, dim, unsigned(num_array_slices), false);
+
+    // each level contains the images of all layers and faces, in the same order as array slices
+    pr::texture_upload_layout packed;
+    get_packed_layout(out_info, packed);
+
+    out_subresource_offsets.clear();
+    out_subresource_offsets.reserve(packed.subresources.size());
+    for (pr::texture_subresource_upload const& subres : packed.subresources)
+    {
+        size_t const image_size = size_t(subres.row_size_bytes) * subres.num_rows;
+        ktx2_level const& level = levels[subres.mip_index];
+        if (level.byte_length < image_size * num_array_slices)
+        {
+            PR_LOG_WARN("KTX2 level {} too small", subres.mip_index);
+            return false;
+        }
+
+        out_subresource_offsets.push_back(size_t(level.byte_offset) + image_size * subres.array_index);
+    }
+
+    return true;
+}
+}
+
+bool pr::parse_texture_file(std::FILE* file, texture_info& out_info, cc::vector<size_t>& out_subresource_offsets)
+{
+    uint8_t identifier[sizeof(gc_ktx2_identifier)];
+    if (!read_exact(file, identifier, sizeof(uint32_t)))
+        return false;
+
+    uint32_t magic;
+    std::memcpy(&magic, identifier, sizeof(magic));
+    if (magic == gc_dds_magic)
+        return parse_dds(file, out_info, out_subresource_offsets);
+
+    if (read_exact(file, identifier + sizeof(uint32_t), sizeof(identifier) - sizeof(uint32_t))
+        && std::memcmp(identifier, gc_ktx2_identifier, sizeof(identifier)) == 0)
+        return parse_ktx2(file, out_info, out_subresource_offsets);
+
+    PR_LOG_WARN("texture file is neither DDS nor KTX2");
+    return false;
+}
+
+bool pr::read_texture_file_subresources(std::FILE* file, const texture_upload_layout& layout, const cc::vector<size_t>& subresource_offsets, std::byte* dest)
+{
+    CC_ASSERT(layout.subresources.size() == subresource_offsets.size() && "layout does not match the texture file");
+
+    for (auto i = 0u; i < layout.subresources.size(); ++i)
+    {
+        texture_subresource_upload const& subres = layout.subresources[i];
+        if (std::fseek(file, long(subresource_offsets[i]), SEEK_SET) != 0)
+            return false;
+
+        std::byte* const subres_dest = dest + subres.dest_offset_bytes;
+
+        // unpitched subresources are read in one go, otherwise each row lands at its pitched offset
+        if (subres.dest_row_stride_bytes == subres.row_size_bytes)
+        {
+            if (!read_exact(file, subres_dest, size_t(subres.row_size_bytes) * subres.num_rows))
+                return false;
+        }
+        else
+        {
+            for (auto y = 0u; y < subres.num_rows; ++y)
+            {
+                if (!read_exact(file, subres_dest + size_t(y) * subres.dest_row_stride_bytes, subres.row_size_bytes))
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
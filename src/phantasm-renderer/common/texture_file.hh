@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <clean-core/vector.hh>
+
+#include <phantasm-renderer/common/resource_info.hh>
+#include <phantasm-renderer/common/texture_upload.hh>
+#include <phantasm-renderer/resource_types.hh>
+
+namespace pr
+{
+/// a texture file read into an upload buffer by Context::load_texture_file or Context::load_texture_container,
+/// uploaded with Frame::upload_texture_file
+struct texture_file_upload
+{
+    texture dest_texture;         ///< created by the load, owned by the caller
+    buffer upload_buffer;         ///< freed by the upload
+    texture_upload_layout layout; ///< placement of the subresources in the upload buffer
+};
+
+/// parses a DDS or KTX2 header: 1D, 2D, array and cube textures, uncompressed and BC1-3, BC6H and BC7 formats
+/// out_subresource_offsets receives the file offset of every subresource, ordered by array slice, then mip level
+/// subresources are tightly packed in the file, rows of 4x4 blocks for block compressed formats
+/// returns false for unsupported files (volume textures, supercompressed KTX2, unknown formats)
+bool parse_texture_file(std::FILE* file, texture_info& out_info, cc::vector<size_t>& out_subresource_offsets);
+
+/// reads the subresources of a parsed texture file into a mapped upload buffer, row by row if the layout pitches rows
+bool read_texture_file_subresources(std::FILE* file, texture_upload_layout const& layout, cc::vector<size_t> const& subresource_offsets, std::byte* dest);
+}
@@ -0,0 +1,260 @@
+#include "texture_upload.hh"
+
+#include <numeric>
+#include <thread>
+
+#include <clean-core/assert.hh>
+#include <clean-core/utility.hh>
+
+#include <phantasm-hardware-interface/common/byte_util.hh>
+#include <phantasm-hardware-interface/common/format_size.hh>
+#include <phantasm-hardware-interface/util.hh>
+
+#include <phantasm-renderer/common/log.hh>
+#include <phantasm-renderer/common/rowwise_copy.hh>
+
+namespace
+{
+// uploads below this size are copied on the calling thread
+constexpr size_t gc_parallel_copy_min_bytes = 4u << 20;
+// smallest share of a single worker
+constexpr size_t gc_parallel_copy_bytes_per_thread = 2u << 20;
+constexpr unsigned gc_max_copy_threads = 8;
+// block compression is roughly this much slower than a copy per source byte
+constexpr size_t gc_bc_encode_cost_factor = 64;
+
+unsigned get_full_mip_chain_length(int width, int height)
+{
+    auto const largest = unsigned(cc::max(width, height));
+    unsigned res = 1;
+    while ((largest >> res) > 0)
+        ++res;
+    return res;
+}
+
+/// calls f_rows(subres, begin, end) for the rows [first_row, end_row) counted across all subresources
+template <class F>
+void for_each_row_range(pr::texture_upload_layout const& layout, size_t first_row, size_t end_row, F&& f_rows)
+{
+    size_t subres_first_row = 0;
+    for (pr::texture_subresource_upload const& subres : layout.subresources)
+    {
+        size_t const subres_end_row = subres_first_row + subres.num_rows;
+        if (subres_end_row <= first_row)
+        {
+            subres_first_row = subres_end_row;
+            continue;
+        }
+
+        if (subres_first_row >= end_row)
+            break;
+
+        size_t const begin = cc::max(first_row, subres_first_row) - subres_first_row;
+        size_t const end = cc::min(end_row, subres_end_row) - subres_first_row;
+        f_rows(subres, uint32_t(begin), uint32_t(end));
+
+        subres_first_row = subres_end_row;
+    }
+}
+
+/// splits the rows of all subresources into contiguous ranges, processed on multiple threads for large uploads
+/// work_size_bytes is the cost of all rows in bytes copied
+template <class F>
+void for_each_row_range_parallel(pr::texture_upload_layout const& layout, size_t work_size_bytes, F&& f_rows)
+{
+    size_t num_rows = 0;
+    for (pr::texture_subresource_upload const& subres : layout.subresources)
+        num_rows += subres.num_rows;
+
+    unsigned num_threads = 1;
+    if (work_size_bytes >= gc_parallel_copy_min_bytes)
+    {
+        num_threads = cc::min(cc::max(std::thread::hardware_concurrency(), 1u), gc_max_copy_threads);
+        num_threads = cc::min(num_threads, unsigned(work_size_bytes / gc_parallel_copy_bytes_per_thread));
+    }
+
+    if (num_threads <= 1)
+    {
+        for_each_row_range(layout, 0, num_rows, f_rows);
+        return;
+    }
+
+    // the calling thread processes the last range
+    size_t const rows_per_thread = (num_rows + num_threads - 1) / num_threads;
+
+    std::thread workers[gc_max_copy_threads];
+    for (auto i = 0u; i < num_threads - 1; ++i)
+    {
+        size_t const first_row = i * rows_per_thread;
+        size_t const end_row = cc::min(first_row + rows_per_thread, num_rows);
+        workers[i] = std::thread([&layout, &f_rows, first_row, end_row] { for_each_row_range(layout, first_row, end_row, f_rows); });
+    }
+
+    for_each_row_range(layout, cc::min((num_threads - 1) * rows_per_thread, num_rows), num_rows, f_rows);
+
+    for (auto i = 0u; i < num_threads - 1; ++i)
+        workers[i].join();
+}
+}
+
+pr::format_block_info pr::get_format_block_info(format fmt)
+{
+    switch (fmt)
+    {
+    case format::bc1_8un:
+    case format::bc1_8un_srgb:
+        return {4, 4, 8};
+    case format::bc2_8un:
+    case format::bc2_8un_srgb:
+    case format::bc3_8un:
+    case format::bc3_8un_srgb:
+    case format::bc6h_16f:
+    case format::bc6h_16uf:
+    case format::bc7_8un:
+    case format::bc7_8un_srgb:
+        return {4, 4, 16};
+    default:
+        return {1, 1, uint32_t(phi::util::get_format_size_bytes(fmt))};
+    }
+}
+
+bool pr::is_valid_texture_file_extent(char const* file_type, uint32_t width, uint32_t height, uint32_t num_mips, uint64_t num_array_slices)
+{
+    if (width == 0 || height == 0 || width > gc_max_texture_file_size || height > gc_max_texture_file_size)
+    {
+        PR_LOG_WARN("{} texture size {}x{} invalid", file_type, width, height);
+        return false;
+    }
+
+    if (num_mips == 0 || num_mips > get_full_mip_chain_length(int(width), int(height)))
+    {
+        PR_LOG_WARN("{} mip count {} invalid for size {}x{}", file_type, num_mips, width, height);
+        return false;
+    }
+
+    if (num_array_slices == 0 || num_array_slices > gc_max_texture_file_array_size)
+    {
+        PR_LOG_WARN("{} array size {} invalid", file_type, num_array_slices);
+        return false;
+    }
+
+    return true;
+}
+
+void pr::texture_subresource_upload::initialize(const texture_info& info, unsigned mip, unsigned array, bool is_d3d12)
+{
+    format_block_info const block = get_format_block_info(info.fmt);
+    tg::isize2 const mip_size = phi::util::get_mip_size({info.width, info.height}, int(mip));
+
+    // partial blocks at the edges of small mips are stored as whole blocks
+    uint32_t const num_block_columns = (uint32_t(mip_size.width) + block.block_width - 1) / block.block_width;
+    uint32_t const num_block_rows = (uint32_t(mip_size.height) + block.block_height - 1) / block.block_height;
+
+    // d3d12 footprints span whole blocks, vulkan copy extents end at the subresource edge
+    width = is_d3d12 ? num_block_columns * block.block_width : uint32_t(mip_size.width);
+    height = is_d3d12 ? num_block_rows * block.block_height : uint32_t(mip_size.height);
+    mip_index = mip;
+    array_index = array;
+
+    // d3d12: rows are 256 byte aligned
+    row_size_bytes = num_block_columns * block.bytes_per_block;
+    dest_row_stride_bytes = is_d3d12 ? phi::util::align_up(row_size_bytes, 256) : row_size_bytes;
+    num_rows = num_block_rows;
+}
+
+void pr::texture_upload_layout::initialize(const texture_info& info, unsigned num_mips, bool is_d3d12)
+{
+    CC_ASSERT((info.dim != phi::texture_dimension::t3d || info.depth_or_array_size == 1) && "3D texture upload unsupported, copy commands address whole array slices");
+
+    if (num_mips == 0)
+        num_mips = info.num_mips > 0 ? info.num_mips : get_full_mip_chain_length(info.width, info.height);
+
+    this->num_mips = num_mips;
+
+    // d3d12: subresources are 512 byte aligned
+    // vulkan: buffer offsets must be multiples of both 4 and the texel (block) size, which is not a power of two for 3-channel formats
+    size_t const subresource_alignment = is_d3d12 ? 512 : std::lcm(size_t(4), size_t(get_format_block_info(info.fmt).bytes_per_block));
+
+    subresources.clear();
+    subresources.reserve(size_t(info.depth_or_array_size) * num_mips);
+    src_size_bytes = 0;
+    dest_size_bytes = 0;
+
+    for (auto a = 0u; a < info.depth_or_array_size; ++a)
+    {
+        for (auto mip = 0u; mip < num_mips; ++mip)
+        {
+            texture_subresource_upload subres;
+            subres.initialize(info, mip, a, is_d3d12);
+
+            subres.src_offset_bytes = src_size_bytes;
+            subres.dest_offset_bytes = (dest_size_bytes + subresource_alignment - 1) / subresource_alignment * subresource_alignment;
+
+            src_size_bytes += size_t(subres.row_size_bytes) * subres.num_rows;
+            dest_size_bytes = subres.dest_offset_bytes + size_t(subres.dest_row_stride_bytes) * subres.num_rows;
+
+            subresources.push_back(subres);
+        }
+    }
+}
+
+void pr::copy_texture_upload_rows(const texture_upload_layout& layout, const std::byte* __restrict src, std::byte* __restrict dest)
+{
+    for_each_row_range_parallel(layout, layout.src_size_bytes, [src, dest](texture_subresource_upload const& subres, uint32_t begin, uint32_t end) {
+        // upload buffers are write-combined, stream the rows past the cache
+        rowwise_copy_streaming(src + subres.src_offset_bytes + size_t(begin) * subres.row_size_bytes,
+                               dest + subres.dest_offset_bytes + size_t(begin) * subres.dest_row_stride_bytes, subres.dest_row_stride_bytes,
+                               subres.row_size_bytes, end - begin);
+    });
+}
+
+void pr::convert_texture_upload_rows(const texture_upload_layout& layout, const pixel_conversion& conv, const std::byte* __restrict src, std::byte* __restrict dest)
+{
+    uint32_t const src_pixel_size = get_pixel_format_size_bytes(conv.src);
+    uint32_t const dest_pixel_size = get_pixel_format_size_bytes(conv.dest);
+
+    for_each_row_range_parallel(layout, layout.src_size_bytes, [&](texture_subresource_upload const& subres, uint32_t begin, uint32_t end) {
+        // the layout describes texture data in the destination format, source offsets scale with the pixel size
+        size_t const src_offset = subres.src_offset_bytes / dest_pixel_size * src_pixel_size;
+        size_t const src_row_size = size_t(subres.row_size_bytes) / dest_pixel_size * src_pixel_size;
+        uint32_t const num_pixels = subres.row_size_bytes / dest_pixel_size;
+
+        for (auto y = begin; y < end; ++y)
+            convert_pixel_row(conv, src + src_offset + y * src_row_size, dest + subres.dest_offset_bytes + size_t(y) * subres.dest_row_stride_bytes, num_pixels);
+    });
+}
+
+void pr::compress_texture_upload_rows(
+    const texture_upload_layout& layout, const texture_info& info, bc_quality quality, const std::byte* __restrict src, std::byte* __restrict dest)
+{
+    CC_ASSERT(is_bc_encodable(info.fmt) && "format cannot be encoded");
+
+    // offsets of the subresources in the tightly packed RGBA8 source
+    cc::vector<size_t> src_offsets;
+    src_offsets.reserve(layout.subresources.size());
+    size_t src_size_bytes = 0;
+    for (texture_subresource_upload const& subres : layout.subresources)
+    {
+        tg::isize2 const mip_size = phi::util::get_mip_size({info.width, info.height}, int(subres.mip_index));
+        src_offsets.push_back(src_size_bytes);
+        src_size_bytes += size_t(mip_size.width) * mip_size.height * 4;
+    }
+
+    for_each_row_range_parallel(layout, src_size_bytes * gc_bc_encode_cost_factor, [&](texture_subresource_upload const& subres, uint32_t begin, uint32_t end) {
+        tg::isize2 const mip_size = phi::util::get_mip_size({info.width, info.height}, int(subres.mip_index));
+        size_t const src_row_stride = size_t(mip_size.width) * 4;
+        std::byte const* const subres_src = src + src_offsets[size_t(&subres - layout.subresources.data())];
+
+        // blocks are encoded into a cached row first, the upload buffer is only written with streaming stores
+        cc::vector<std::byte> block_row;
+        block_row.resize(subres.row_size_bytes);
+
+        for (auto y = begin; y < end; ++y)
+        {
+            encode_bc_block_row(info.fmt, quality, subres_src + size_t(y) * 4 * src_row_stride, src_row_stride, uint32_t(mip_size.width),
+                                uint32_t(mip_size.height) - y * 4, block_row.data());
+            rowwise_copy_streaming(block_row.data(), dest + subres.dest_offset_bytes + size_t(y) * subres.dest_row_stride_bytes,
+                                   subres.dest_row_stride_bytes, subres.row_size_bytes, 1);
+        }
+    });
+}
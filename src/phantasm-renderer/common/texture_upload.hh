@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <clean-core/span.hh>
+#include <clean-core/vector.hh>
+
+#include <phantasm-renderer/common/bc_encode.hh>
+#include <phantasm-renderer/common/pixel_convert.hh>
+#include <phantasm-renderer/common/resource_info.hh>
+#include <phantasm-renderer/enums.hh>
+
+namespace pr
+{
+/// pixel blocks of a format, 1x1 pixels for uncompressed formats and 4x4 for BC formats
+struct format_block_info
+{
+    uint32_t block_width = 1;
+    uint32_t block_height = 1;
+    uint32_t bytes_per_block = 0;
+
+    bool is_block_compressed() const { return block_width > 1; }
+};
+
+format_block_info get_format_block_info(format fmt);
+
+/// D3D12 resource limits, texture files exceeding them are malformed
+inline constexpr uint32_t gc_max_texture_file_size = 16384;
+inline constexpr uint32_t gc_max_texture_file_array_size = 2048;
+
+/// validates the values of a texture file header a layout is built from, logs and returns false if out of range
+/// array slices are passed as 64 bit to catch overflowing products
+bool is_valid_texture_file_extent(char const* file_type, uint32_t width, uint32_t height, uint32_t num_mips, uint64_t num_array_slices);
+
+/// placement of a single subresource (mip level of an array slice) in texture data and in an upload buffer
+/// rows are rows of blocks, fewer than the height in pixels for block compressed formats
+struct texture_subresource_upload
+{
+    size_t src_offset_bytes = 0;  ///< in the tightly packed texture data
+    size_t dest_offset_bytes = 0; ///< in the upload buffer
+    uint32_t row_size_bytes = 0;
+    uint32_t dest_row_stride_bytes = 0;
+    uint32_t num_rows = 0;
+    uint32_t width = 0;  ///< extent of the copy command, rounded up to whole blocks on D3D12
+    uint32_t height = 0; ///< extent of the copy command, rounded up to whole blocks on D3D12
+    uint32_t mip_index = 0;
+    uint32_t array_index = 0;
+
+    /// sizes and row pitch of a mip level, offsets are left zero
+    void initialize(texture_info const& info, unsigned mip, unsigned array, bool is_d3d12);
+};
+
+/// placement of all uploaded subresources of a texture, computed up front
+/// texture data is tightly packed and ordered by array slice (cube face), then mip level
+/// in the upload buffer, rows and subresources are aligned as required by the backend
+struct texture_upload_layout
+{
+    cc::vector<texture_subresource_upload> subresources;
+    size_t src_size_bytes = 0;  ///< expected size of the texture data
+    size_t dest_size_bytes = 0; ///< required size of the upload buffer
+    unsigned num_mips = 0;      ///< per array slice, subresource (mip, array) is at index array * num_mips + mip
+
+    /// num_mips 0 uploads the full mip chain of the texture
+    void initialize(texture_info const& info, unsigned num_mips, bool is_d3d12);
+};
+
+/// copies the rows of all subresources from texture data into a mapped upload buffer
+/// large uploads are split across worker threads
+void copy_texture_upload_rows(texture_upload_layout const& layout, std::byte const* __restrict src, std::byte* __restrict dest);
+
+/// same as copy_texture_upload_rows, but texture data is in the source format of the conversion, rows are converted while writing them
+/// the layout must be initialized for the destination format, which cannot be block compressed
+void convert_texture_upload_rows(texture_upload_layout const& layout, pixel_conversion const& conv, std::byte const* __restrict src, std::byte* __restrict dest);
+
+/// same as copy_texture_upload_rows, but texture data is RGBA8 and block compressed while writing the upload buffer
+/// the layout must be initialized for info, whose format must be encodable (see pr::is_bc_encodable)
+void compress_texture_upload_rows(
+    texture_upload_layout const& layout, texture_info const& info, bc_quality quality, std::byte const* __restrict src, std::byte* __restrict dest);
+}
@@ -0,0 +1,202 @@
+#include "trace.hh"
+
+#include <chrono>
+#include <cstdio>
+
+#include <clean-core/assert.hh>
+#include <clean-core/vector.hh>
+
+#include <phantasm-renderer/GpuProfiler.hh>
+
+namespace
+{
+struct trace_event
+{
+    char const* name;
+    uint64_t begin_ns;
+    uint64_t end_ns; ///< equal to begin_ns for instant events
+    uint64_t arg;
+    bool is_instant;
+};
+
+struct thread_buffer
+{
+    trace_event* events = nullptr;
+    uint32_t capacity = 0;
+    uint32_t thread_index = 0;
+    uint64_t num_written = 0;            ///< total, only written by the owning thread
+    std::atomic<uint32_t> session = {0}; ///< trace::enable call the events belong to, only written by the owning thread
+};
+
+struct trace_registry
+{
+    std::mutex mutex;
+    cc::vector<thread_buffer*> buffers;
+    uint32_t num_events_per_thread = 1u << 16;
+    std::atomic<uint32_t> generation = {1}; ///< incremented on shutdown, invalidating thread-local buffer pointers
+    std::atomic<uint32_t> session = {0};    ///< incremented by trace::enable, buffers of older sessions are reset by their owning thread
+};
+
+trace_registry& get_registry()
+{
+    static trace_registry registry;
+    return registry;
+}
+
+struct thread_local_state
+{
+    thread_buffer* buffer = nullptr;
+    uint32_t generation = 0;
+};
+
+thread_local thread_local_state tl_state;
+
+thread_buffer* get_thread_buffer()
+{
+    trace_registry& reg = get_registry();
+    uint32_t const gen = reg.generation.load(std::memory_order_acquire);
+
+    if (tl_state.generation != gen)
+    {
+        auto lg = std::lock_guard(reg.mutex);
+
+        auto* const buf = new thread_buffer();
+        buf->capacity = reg.num_events_per_thread;
+        buf->events = new trace_event[buf->capacity];
+        buf->thread_index = uint32_t(reg.buffers.size());
+        buf->session.store(reg.session.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        reg.buffers.push_back(buf);
+
+        tl_state.buffer = buf;
+        tl_state.generation = gen;
+    }
+
+    return tl_state.buffer;
+}
+
+void write_event(trace_event const& ev)
+{
+    thread_buffer* const buf = get_thread_buffer();
+
+    // enable was called since the last write of this thread, the events of the previous session are dropped
+    uint32_t const session = get_registry().session.load(std::memory_order_relaxed);
+    if (buf->session.load(std::memory_order_relaxed) != session)
+    {
+        buf->num_written = 0;
+        buf->session.store(session, std::memory_order_relaxed);
+    }
+
+    buf->events[buf->num_written % buf->capacity] = ev;
+    ++buf->num_written;
+}
+
+void write_escaped(std::FILE* file, char const* str)
+{
+    for (; *str != '\0'; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+            std::fputc('\\', file);
+        std::fputc(*str, file);
+    }
+}
+}
+
+std::atomic<bool> pr::trace::detail::g_is_enabled = {false};
+
+uint64_t pr::trace::detail::now_ns()
+{
+    auto const now = std::chrono::steady_clock::now().time_since_epoch();
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()) | 1; // never 0, which means "not traced"
+}
+
+void pr::trace::detail::record_span(const char* name, uint64_t begin_ns, uint64_t end_ns) { write_event({name, begin_ns, end_ns, 0, false}); }
+
+void pr::trace::detail::record_instant(const char* name, uint64_t arg, uint64_t time_ns) { write_event({name, time_ns, time_ns, arg, true}); }
+
+void pr::trace::enable(uint32_t num_events_per_thread)
+{
+    CC_ASSERT(num_events_per_thread > 0 && "invalid trace buffer size");
+    trace_registry& reg = get_registry();
+    {
+        auto lg = std::lock_guard(reg.mutex);
+        reg.num_events_per_thread = num_events_per_thread; // only affects buffers allocated from now on
+    }
+
+    // buffers are owned by their writing threads, which reset them lazily
+    reg.session.fetch_add(1, std::memory_order_relaxed);
+
+    detail::g_is_enabled.store(true, std::memory_order_relaxed);
+}
+
+void pr::trace::disable() { detail::g_is_enabled.store(false, std::memory_order_relaxed); }
+
+void pr::trace::shutdown()
+{
+    disable();
+
+    trace_registry& reg = get_registry();
+    auto lg = std::lock_guard(reg.mutex);
+    reg.generation.fetch_add(1, std::memory_order_release);
+
+    for (thread_buffer* buf : reg.buffers)
+    {
+        delete[] buf->events;
+        delete buf;
+    }
+
+    reg.buffers.clear();
+}
+
+bool pr::trace::write_chrome_trace(const char* path, cc::span<const gpu_zone_result> gpu_zones)
+{
+    std::FILE* const file = std::fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+    std::fputs(R"({"ph":"M","pid":1,"tid":0,"name":"process_name","args":{"name":"CPU"}})", file);
+    std::fputs(",\n" R"({"ph":"M","pid":2,"tid":0,"name":"process_name","args":{"name":"GPU"}})", file);
+
+    trace_registry& reg = get_registry();
+    {
+        auto lg = std::lock_guard(reg.mutex);
+        uint32_t const session = reg.session.load(std::memory_order_relaxed);
+
+        for (thread_buffer const* buf : reg.buffers)
+        {
+            std::fprintf(file, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"thread %u\"}}", buf->thread_index, buf->thread_index);
+
+            // threads that did not write since the last enable still hold events of the previous session
+            uint64_t const num_written = buf->session.load(std::memory_order_relaxed) == session ? buf->num_written : 0;
+
+            // the ring holds the most recent events, oldest first starting at the write position
+            uint64_t const num_events = num_written < buf->capacity ? num_written : buf->capacity;
+            uint64_t const first_event = num_written - num_events;
+
+            for (auto i = first_event; i < num_written; ++i)
+            {
+                trace_event const& ev = buf->events[i % buf->capacity];
+
+                std::fputs(",\n{\"name\":\"", file);
+                write_escaped(file, ev.name);
+
+                if (ev.is_instant)
+                    std::fprintf(file, "\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"epoch\":%llu}}", buf->thread_index,
+                                 double(ev.begin_ns) / 1000., static_cast<unsigned long long>(ev.arg));
+                else
+                    std::fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", buf->thread_index, double(ev.begin_ns) / 1000.,
+                                 double(ev.end_ns - ev.begin_ns) / 1000.);
+            }
+        }
+    }
+
+    for (gpu_zone_result const& zone : gpu_zones)
+    {
+        std::fputs(",\n{\"name\":\"", file);
+        write_escaped(file, zone.name != nullptr ? zone.name : "zone");
+        std::fprintf(file, "\",\"ph\":\"X\",\"pid\":2,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}", zone.begin_ms * 1000., (zone.end_ms - zone.begin_ms) * 1000.);
+    }
+
+    std::fputs("\n]}\n", file);
+    return std::fclose(file) == 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <clean-core/macros.hh>
+#include <clean-core/span.hh>
+
+#include <phantasm-renderer/common/api.hh>
+#include <phantasm-renderer/fwd.hh>
+
+namespace pr
+{
+struct gpu_zone_result;
+}
+
+// opt-in CPU timeline tracing, written as Chrome trace JSON (loadable in chrome://tracing and the Perfetto UI)
+// every thread records into its own bounded, preallocated ring of events, the oldest events are overwritten
+// disabled tracing costs a single relaxed atomic load per span
+namespace pr::trace
+{
+namespace detail
+{
+extern PR_API std::atomic<bool> g_is_enabled;
+
+PR_API uint64_t now_ns();
+PR_API void record_span(char const* name, uint64_t begin_ns, uint64_t end_ns);
+PR_API void record_instant(char const* name, uint64_t arg, uint64_t time_ns);
+}
+
+/// start tracing, allocating num_events_per_thread events for each thread on its first traced span
+/// discards previously recorded events
+PR_API void enable(uint32_t num_events_per_thread = 1u << 16);
+
+/// stop tracing, recorded events are kept until the next enable or shutdown
+PR_API void disable();
+
+/// free all event buffers, must not be called while other threads are tracing
+PR_API void shutdown();
+
+inline bool is_enabled() { return detail::g_is_enabled.load(std::memory_order_relaxed); }
+
+/// writes all recorded events and the given GPU zones as Chrome trace JSON, returns false if the file could not be written
+/// GPU zones are expected on the CPU timeline (see GpuProfiler)
+/// must not be called while other threads are tracing (ex. after disable)
+PR_API bool write_chrome_trace(char const* path, cc::span<gpu_zone_result const> gpu_zones = {});
+
+/// records a frame boundary, called on each Context::submit
+inline void frame_marker(gpu_epoch_t epoch)
+{
+    if (is_enabled())
+        detail::record_instant("submit", epoch, detail::now_ns());
+}
+
+/// manually delimited span, returns 0 if tracing is disabled
+inline uint64_t begin_span() { return is_enabled() ? detail::now_ns() : 0; }
+
+/// ends a span begun with begin_span, name must be a string literal (or outlive the trace)
+inline void end_span(char const* name, uint64_t begin_ns)
+{
+    if (begin_ns != 0)
+        detail::record_span(name, begin_ns, detail::now_ns());
+}
+
+/// records a span from construction to destruction, name must be a string literal (or outlive the trace)
+struct scope
+{
+    explicit scope(char const* name) : _name(name), _begin_ns(begin_span()) {}
+
+    ~scope() { end_span(_name, _begin_ns); }
+
+    scope(scope const&) = delete;
+    scope& operator=(scope const&) = delete;
+
+private:
+    char const* _name;
+    uint64_t _begin_ns;
+};
+
+/// locks a mutex, recording the time spent waiting for it
+template <class MutexT>
+[[nodiscard]] std::unique_lock<MutexT> lock(MutexT& mutex, char const* name)
+{
+    scope s(name);
+    return std::unique_lock<MutexT>(mutex);
+}
+}
+
+#define PR_TRACE_SCOPE(_name_) ::pr::trace::scope CC_MACRO_JOIN(_pr_trace_scope_, __COUNTER__)(_name_)
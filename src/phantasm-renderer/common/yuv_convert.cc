@@ -0,0 +1,338 @@
+#include "yuv_convert.hh"
+
+#include <cmath>
+#include <cstring>
+
+#include <clean-core/vector.hh>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PR_YUV_SSE2 1
+#include <emmintrin.h>
+#else
+#define PR_YUV_SSE2 0
+#endif
+
+namespace
+{
+// BT.709 limited range coefficients, scaled by 256
+constexpr int gc_y_r = 47, gc_y_g = 157, gc_y_b = 16;
+constexpr int gc_u_r = -26, gc_u_g = -87, gc_u_b = 112;
+constexpr int gc_v_r = 112, gc_v_g = -102, gc_v_b = -10;
+
+struct yuv_planes
+{
+    uint8_t* y;
+    uint8_t* u;      ///< i420 only
+    uint8_t* v;      ///< i420 only
+    uint8_t* uv;     ///< nv12 only
+};
+
+yuv_planes get_planes(std::byte* dest, int width, int height, pr::yuv420_layout layout)
+{
+    auto* const base = reinterpret_cast<uint8_t*>(dest);
+    size_t const luma_size = size_t(width) * size_t(height);
+    size_t const chroma_plane_size = size_t((width + 1) / 2) * size_t((height + 1) / 2);
+
+    yuv_planes res = {};
+    res.y = base;
+    if (layout == pr::yuv420_layout::nv12)
+    {
+        res.uv = base + luma_size;
+    }
+    else
+    {
+        res.u = base + luma_size;
+        res.v = base + luma_size + chroma_plane_size;
+    }
+    return res;
+}
+
+inline uint8_t avg_u8(unsigned a, unsigned b) { return uint8_t((a + b + 1) >> 1); } // same rounding as _mm_avg_epu8
+
+inline uint8_t luma(int r, int g, int b) { return uint8_t(((gc_y_r * r + gc_y_g * g + gc_y_b * b + 128) >> 8) + 16); }
+inline uint8_t chroma_u(int r, int g, int b) { return uint8_t(((gc_u_r * r + gc_u_g * g + gc_u_b * b + 128) >> 8) + 128); }
+inline uint8_t chroma_v(int r, int g, int b) { return uint8_t(((gc_v_r * r + gc_v_g * g + gc_v_b * b + 128) >> 8) + 128); }
+
+/// converts pixels [first_x, width) of a pair of rows, row1 equals row0 on the last row of odd heights
+/// y_row1 is null in that case
+void convert_row_pair_scalar(uint8_t const* row0, uint8_t const* row1, int first_x, int width, int ri, int bi, uint8_t* y_row0, uint8_t* y_row1, uint8_t* u_row, uint8_t* v_row, uint8_t* uv_row)
+{
+    for (auto x = first_x; x < width; x += 2)
+    {
+        int const x1 = x + 1 < width ? x + 1 : x;
+        uint8_t const* const p00 = row0 + x * 4;
+        uint8_t const* const p01 = row0 + x1 * 4;
+        uint8_t const* const p10 = row1 + x * 4;
+        uint8_t const* const p11 = row1 + x1 * 4;
+
+        y_row0[x] = luma(p00[ri], p00[1], p00[bi]);
+        if (x1 != x)
+            y_row0[x1] = luma(p01[ri], p01[1], p01[bi]);
+
+        if (y_row1 != nullptr)
+        {
+            y_row1[x] = luma(p10[ri], p10[1], p10[bi]);
+            if (x1 != x)
+                y_row1[x1] = luma(p11[ri], p11[1], p11[bi]);
+        }
+
+        // average vertically, then horizontally, matching the SIMD path
+        int avg[3];
+        for (auto c = 0; c < 3; ++c)
+            avg[c] = avg_u8(avg_u8(p00[c], p10[c]), avg_u8(p01[c], p11[c]));
+
+        int const r = avg[ri];
+        int const g = avg[1];
+        int const b = avg[bi];
+
+        if (uv_row != nullptr)
+        {
+            uv_row[x] = chroma_u(r, g, b);
+            uv_row[x + 1] = chroma_v(r, g, b);
+        }
+        else
+        {
+            u_row[x / 2] = chroma_u(r, g, b);
+            v_row[x / 2] = chroma_v(r, g, b);
+        }
+    }
+}
+
+#if PR_YUV_SSE2
+/// weighted sums of the first three channels of 4 pixels, coeffs holds the weights of both pixels per 64 bit half
+inline __m128i weighted_sum4(__m128i pixels, __m128i coeffs)
+{
+    __m128i const zero = _mm_setzero_si128();
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coeffs);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coeffs);
+
+    // add the two partial sums per pixel, results are in 32 bit lanes 0 and 2
+    lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+    hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+
+    lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+    hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+    return _mm_unpacklo_epi64(lo, hi);
+}
+
+/// luma of 16 pixels
+inline __m128i luma16(uint8_t const* row, __m128i coeffs)
+{
+    __m128i const round = _mm_set1_epi32(128);
+    __m128i const offset = _mm_set1_epi16(16);
+
+    __m128i y[4];
+    for (auto i = 0; i < 4; ++i)
+    {
+        __m128i const px = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row + i * 16));
+        y[i] = _mm_srai_epi32(_mm_add_epi32(weighted_sum4(px, coeffs), round), 8);
+    }
+
+    __m128i const lo = _mm_add_epi16(_mm_packs_epi32(y[0], y[1]), offset);
+    __m128i const hi = _mm_add_epi16(_mm_packs_epi32(y[2], y[3]), offset);
+    return _mm_packus_epi16(lo, hi);
+}
+
+/// 2x2 averages of 4 pixel columns in two rows, as 2 pixels in the lower 64 bit
+inline __m128i average_blocks(uint8_t const* row0, uint8_t const* row1)
+{
+    __m128i const v = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(row0)), _mm_loadu_si128(reinterpret_cast<__m128i const*>(row1)));
+    __m128i const h = _mm_avg_epu8(v, _mm_srli_si128(v, 4));
+    return _mm_shuffle_epi32(h, _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+/// chroma of 4 averaged pixels, as 32 bit values
+inline __m128i chroma4(__m128i blocks, __m128i coeffs)
+{
+    return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(weighted_sum4(blocks, coeffs), _mm_set1_epi32(128)), 8), _mm_set1_epi32(128));
+}
+
+/// converts the pixels of a pair of rows in blocks of 16, returns the amount of converted pixels
+int convert_row_pair_sse2(uint8_t const* row0, uint8_t const* row1, int width, bool is_bgra, uint8_t* y_row0, uint8_t* y_row1, uint8_t* u_row, uint8_t* v_row, uint8_t* uv_row)
+{
+    auto const make_coeffs = [&](int r, int g, int b) {
+        short const c0 = short(is_bgra ? b : r);
+        short const c2 = short(is_bgra ? r : b);
+        return _mm_setr_epi16(c0, short(g), c2, 0, c0, short(g), c2, 0);
+    };
+
+    __m128i const y_coeffs = make_coeffs(gc_y_r, gc_y_g, gc_y_b);
+    __m128i const u_coeffs = make_coeffs(gc_u_r, gc_u_g, gc_u_b);
+    __m128i const v_coeffs = make_coeffs(gc_v_r, gc_v_g, gc_v_b);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8_t const* const p0 = row0 + x * 4;
+        uint8_t const* const p1 = row1 + x * 4;
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y_row0 + x), luma16(p0, y_coeffs));
+        if (y_row1 != nullptr)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(y_row1 + x), luma16(p1, y_coeffs));
+
+        // 8 chroma samples from 4 groups of 4 pixel columns
+        __m128i const blocks_lo = _mm_unpacklo_epi64(average_blocks(p0, p1), average_blocks(p0 + 16, p1 + 16));
+        __m128i const blocks_hi = _mm_unpacklo_epi64(average_blocks(p0 + 32, p1 + 32), average_blocks(p0 + 48, p1 + 48));
+
+        __m128i const u16 = _mm_packs_epi32(chroma4(blocks_lo, u_coeffs), chroma4(blocks_hi, u_coeffs));
+        __m128i const v16 = _mm_packs_epi32(chroma4(blocks_lo, v_coeffs), chroma4(blocks_hi, v_coeffs));
+        __m128i const u8 = _mm_packus_epi16(u16, u16);
+        __m128i const v8 = _mm_packus_epi16(v16, v16);
+
+        if (uv_row != nullptr)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(uv_row + x), _mm_unpacklo_epi8(u8, v8));
+        }
+        else
+        {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(u_row + x / 2), u8);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(v_row + x / 2), v8);
+        }
+    }
+
+    return x;
+}
+#endif
+
+void convert_row_pair(uint8_t const* row0, uint8_t const* row1, int width, bool is_bgra, uint8_t* y_row0, uint8_t* y_row1, uint8_t* u_row, uint8_t* v_row, uint8_t* uv_row)
+{
+    int first_x = 0;
+#if PR_YUV_SSE2
+    first_x = convert_row_pair_sse2(row0, row1, width, is_bgra, y_row0, y_row1, u_row, v_row, uv_row);
+#endif
+    convert_row_pair_scalar(row0, row1, first_x, width, is_bgra ? 2 : 0, is_bgra ? 0 : 2, y_row0, y_row1, u_row, v_row, uv_row);
+}
+
+template <class F>
+void for_each_row_pair(uint8_t const* src, size_t src_row_stride_bytes, int width, int height, pr::yuv420_layout layout, std::byte* dest, F&& f_convert)
+{
+    yuv_planes const planes = get_planes(dest, width, height, layout);
+    size_t const chroma_width = size_t((width + 1) / 2);
+
+    for (auto y = 0; y < height; y += 2)
+    {
+        bool const has_row1 = y + 1 < height;
+        uint8_t const* const row0 = src + size_t(y) * src_row_stride_bytes;
+        uint8_t const* const row1 = has_row1 ? row0 + src_row_stride_bytes : row0;
+        size_t const chroma_row = size_t(y / 2);
+
+        f_convert(row0, row1, planes.y + size_t(y) * size_t(width), has_row1 ? planes.y + size_t(y + 1) * size_t(width) : nullptr,
+                  planes.u != nullptr ? planes.u + chroma_row * chroma_width : nullptr, planes.v != nullptr ? planes.v + chroma_row * chroma_width : nullptr,
+                  planes.uv != nullptr ? planes.uv + chroma_row * chroma_width * 2 : nullptr);
+    }
+}
+
+// linear values are quantized to this many steps before the sRGB encoding, below one unorm8 step even at the steep start of the curve
+constexpr int gc_srgb_lut_size = 4096;
+
+/// sRGB encoded unorm8 values of the quantized linear values [0, 1]
+struct srgb_encode_lut
+{
+    uint8_t values[gc_srgb_lut_size];
+
+    srgb_encode_lut()
+    {
+        for (auto i = 0; i < gc_srgb_lut_size; ++i)
+        {
+            float const linear = float(i) / float(gc_srgb_lut_size - 1);
+            float const encoded = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.f / 2.4f) - 0.055f;
+            values[i] = uint8_t(int(encoded * 255.f + 0.5f));
+        }
+    }
+};
+
+srgb_encode_lut const& get_srgb_encode_lut()
+{
+    static srgb_encode_lut const lut;
+    return lut;
+}
+
+/// index of a half float value into the sRGB LUT, clamped to [0, 1]
+inline int half_to_lut_index(uint16_t h)
+{
+    if (h & 0x8000)
+        return 0;
+
+    // shift into float position and rebias the exponent (2^112), this also handles denormals
+    uint32_t const bits = uint32_t(h & 0x7FFF) << 13;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    f *= 5.192296858534828e+33f;
+
+    if (!(f < 1.f)) // also catches inf and NaN
+        return gc_srgb_lut_size - 1;
+
+    return int(f * float(gc_srgb_lut_size - 1) + 0.5f);
+}
+
+/// converts a row of linear RGBA16F pixels to sRGB encoded RGBA8
+void convert_row_half_to_unorm8(uint16_t const* src, int width, uint8_t const* lut, uint8_t* dest)
+{
+    int const num_values = width * 4;
+    int i = 0;
+
+#if PR_YUV_SSE2
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const sign_mask = _mm_set1_epi32(0x8000);
+    __m128i const value_mask = _mm_set1_epi32(0x7FFF);
+    __m128 const rebias = _mm_set1_ps(5.192296858534828e+33f);
+    __m128 const one = _mm_set1_ps(1.f);
+    __m128 const scale = _mm_set1_ps(float(gc_srgb_lut_size - 1));
+    __m128 const half = _mm_set1_ps(.5f);
+
+    auto const f_convert4 = [&](__m128i h32) {
+        __m128i const is_negative = _mm_cmpeq_epi32(_mm_and_si128(h32, sign_mask), sign_mask);
+        __m128 f = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h32, value_mask), 13)), rebias);
+        f = _mm_min_ps(f, one); // NaN yields the second operand
+        f = _mm_andnot_ps(_mm_castsi128_ps(is_negative), f);
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(f, scale), half));
+    };
+
+    // indices are computed 8 at a time, SSE2 has no gather for the lookups
+    alignas(16) uint16_t indices[8];
+    for (; i + 8 <= num_values; i += 8)
+    {
+        __m128i const h = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices), _mm_packs_epi32(f_convert4(_mm_unpacklo_epi16(h, zero)), f_convert4(_mm_unpackhi_epi16(h, zero))));
+
+        for (auto j = 0; j < 8; ++j)
+            dest[i + j] = lut[indices[j]];
+    }
+#endif
+
+    for (; i < num_values; ++i)
+        dest[i] = lut[half_to_lut_index(src[i])];
+}
+}
+
+size_t pr::get_yuv420_size_bytes(int width, int height)
+{
+    return size_t(width) * size_t(height) + 2 * size_t((width + 1) / 2) * size_t((height + 1) / 2);
+}
+
+void pr::convert_rgba8_to_yuv420(std::byte const* __restrict src, size_t src_row_stride_bytes, int width, int height, bool is_bgra, yuv420_layout layout, std::byte* __restrict dest)
+{
+    for_each_row_pair(reinterpret_cast<uint8_t const*>(src), src_row_stride_bytes, width, height, layout, dest,
+                      [&](uint8_t const* row0, uint8_t const* row1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, uint8_t* uv) {
+                          convert_row_pair(row0, row1, width, is_bgra, y0, y1, u, v, uv);
+                      });
+}
+
+void pr::convert_rgba16f_to_yuv420(std::byte const* __restrict src, size_t src_row_stride_bytes, int width, int height, yuv420_layout layout, std::byte* __restrict dest)
+{
+    // convert each pair of rows to sRGB encoded RGBA8 first
+    uint8_t const* const lut = get_srgb_encode_lut().values;
+    cc::vector<uint8_t> scratch;
+    scratch.resize(size_t(width) * 4 * 2);
+    uint8_t* const scratch0 = scratch.data();
+    uint8_t* const scratch1 = scratch.data() + size_t(width) * 4;
+
+    for_each_row_pair(reinterpret_cast<uint8_t const*>(src), src_row_stride_bytes, width, height, layout, dest,
+                      [&](uint8_t const* row0, uint8_t const* row1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, uint8_t* uv) {
+                          convert_row_half_to_unorm8(reinterpret_cast<uint16_t const*>(row0), width, lut, scratch0);
+                          if (row1 != row0)
+                              convert_row_half_to_unorm8(reinterpret_cast<uint16_t const*>(row1), width, lut, scratch1);
+
+                          convert_row_pair(scratch0, row1 != row0 ? scratch1 : scratch0, width, false, y0, y1, u, v, uv);
+                      });
+}
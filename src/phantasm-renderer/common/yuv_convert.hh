@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pr
+{
+/// memory layout of 4:2:0 subsampled YUV images
+enum class yuv420_layout : uint8_t
+{
+    nv12, ///< Y plane, followed by an interleaved UV plane
+    i420  ///< Y plane, followed by a U plane and a V plane
+};
+
+/// size of a YUV 4:2:0 image in bytes, chroma planes are rounded up for odd sizes
+size_t get_yuv420_size_bytes(int width, int height);
+
+/// converts 8-bit RGBA or BGRA pixels to BT.709 limited range YUV 4:2:0, chroma is averaged over 2x2 blocks
+/// rows of src are src_row_stride_bytes apart, dest is tightly packed and must be at least get_yuv420_size_bytes large
+/// uses SSE2 where available
+void convert_rgba8_to_yuv420(std::byte const* __restrict src,
+                             size_t src_row_stride_bytes,
+                             int width,
+                             int height,
+                             bool is_bgra,
+                             yuv420_layout layout,
+                             std::byte* __restrict dest);
+
+/// converts linear RGBA16F pixels to BT.709 limited range YUV 4:2:0
+/// values are clamped to [0, 1] without any tonemapping and sRGB encoded, matching 8-bit sRGB targets
+/// same as convert_rgba8_to_yuv420 otherwise
+void convert_rgba16f_to_yuv420(std::byte const* __restrict src,
+                               size_t src_row_stride_bytes,
+                               int width,
+                               int height,
+                               yuv420_layout layout,
+                               std::byte* __restrict dest);
+}
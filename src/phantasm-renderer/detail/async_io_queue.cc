@@ -0,0 +1,438 @@
+#include "async_io_queue.hh"
+
+#include <cstring>
+
+#include <clean-core/assert.hh>
+#include <clean-core/macros.hh>
+#include <clean-core/utility.hh>
+
+#ifdef CC_OS_WINDOWS
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define PR_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#else
+#define PR_HAS_IO_URING 0
+#endif
+
+#if PR_HAS_IO_URING
+namespace
+{
+int io_uring_setup(unsigned entries, io_uring_params* params) { return int(::syscall(__NR_io_uring_setup, entries, params)); }
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return int(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+}
+
+struct pr::async_io_queue::io_uring_state
+{
+    int fd = -1;
+
+    void* sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void* cq_ring = nullptr; ///< same as sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    /// written to the SQ ring, not yet consumed by the kernel
+    unsigned num_unsubmitted = 0;
+
+    bool initialize(unsigned num_entries)
+    {
+        io_uring_params params = {};
+        fd = io_uring_setup(num_entries, &params);
+        if (fd < 0)
+            return false; // old kernels, or forbidden by seccomp in containers
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        bool const is_single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (is_single_mmap)
+            sq_ring_size = cq_ring_size = cc::max(sq_ring_size, cq_ring_size);
+
+        sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED)
+        {
+            sq_ring = nullptr;
+            return false;
+        }
+
+        if (is_single_mmap)
+        {
+            cq_ring = sq_ring;
+        }
+        else
+        {
+            cq_ring = ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cq_ring == MAP_FAILED)
+            {
+                cq_ring = nullptr;
+                return false;
+            }
+        }
+
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* const sqes_map = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes_map == MAP_FAILED)
+            return false;
+        sqes = static_cast<io_uring_sqe*>(sqes_map);
+
+        auto* const sq_bytes = static_cast<std::byte*>(sq_ring);
+        sq_tail = reinterpret_cast<unsigned*>(sq_bytes + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq_bytes + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq_bytes + params.sq_off.array);
+
+        auto* const cq_bytes = static_cast<std::byte*>(cq_ring);
+        cq_head = reinterpret_cast<unsigned*>(cq_bytes + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq_bytes + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq_bytes + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq_bytes + params.cq_off.cqes);
+        return true;
+    }
+
+    void destroy()
+    {
+        if (sqes != nullptr)
+            ::munmap(sqes, sqes_size);
+        if (cq_ring != nullptr && cq_ring != sq_ring)
+            ::munmap(cq_ring, cq_ring_size);
+        if (sq_ring != nullptr)
+            ::munmap(sq_ring, sq_ring_size);
+        if (fd >= 0)
+            ::close(fd);
+    }
+};
+#else
+struct pr::async_io_queue::io_uring_state
+{
+    bool initialize(unsigned) { return false; }
+    void destroy() {}
+};
+#endif
+
+void pr::async_io_queue::initialize(unsigned queue_depth, unsigned num_workers, bool allow_io_uring)
+{
+    CC_ASSERT(queue_depth > 0 && "async_io_queue requires a queue depth");
+#ifndef CC_OS_WINDOWS
+    static_assert(sizeof(row_span) == sizeof(iovec) && alignof(row_span) == alignof(iovec), "row_span must match iovec");
+#endif
+
+    slots.resize(queue_depth);
+    queued_slots = circular_buffer<uint32_t>(queue_depth);
+    free_slots.reserve(queue_depth);
+    for (auto i = queue_depth; i > 0; --i)
+        free_slots.push_back(i - 1);
+
+    if (allow_io_uring)
+    {
+        uring = new io_uring_state();
+        // at most queue_depth reads are in flight, the CQ ring (twice the SQ entries) cannot overflow
+        if (!uring->initialize(queue_depth))
+        {
+            uring->destroy();
+            delete uring;
+            uring = nullptr;
+        }
+    }
+
+    if (uring == nullptr)
+    {
+        CC_ASSERT(num_workers > 0 && "async_io_queue requires workers without io_uring");
+        completed_slots.reserve(queue_depth);
+
+        workers.reserve(num_workers);
+        for (auto i = 0u; i < num_workers; ++i)
+            workers.push_back(std::thread([this] { _worker_main(); }));
+    }
+}
+
+void pr::async_io_queue::destroy()
+{
+    // in-flight reads write to memory owned by the caller, they must complete first
+    async_io_completion completions[32];
+    while (get_num_in_flight() > 0)
+        reap(completions, true);
+
+    if (uring != nullptr)
+    {
+        uring->destroy();
+        delete uring;
+        uring = nullptr;
+    }
+
+    if (!workers.empty())
+    {
+        {
+            auto lg = std::lock_guard(mutex);
+            is_shutting_down = true;
+        }
+        work_available.notify_all();
+
+        for (std::thread& worker : workers)
+            worker.join();
+
+        workers.clear();
+    }
+}
+
+void pr::async_io_queue::submit(cc::span<const async_io_read> reads)
+{
+    CC_ASSERT(reads.size() <= free_slots.size() && "too many reads submitted");
+
+    for (async_io_read const& read : reads)
+    {
+        CC_ASSERT(read.num_rows > 0 && read.num_rows <= gc_async_io_max_rows && "invalid row count");
+
+        uint32_t const slot_index = free_slots.back();
+        free_slots.pop_back();
+
+        slot& s = slots[slot_index];
+        s.file = read.file;
+        s.file_offset = read.file_offset;
+        s.num_rows = read.num_rows;
+        s.user_data = read.user_data;
+        s.result = 0;
+        for (auto i = 0u; i < read.num_rows; ++i)
+            s.rows[i] = row_span{read.dest + size_t(i) * read.dest_row_stride_bytes, read.row_size_bytes};
+
+        if (uring != nullptr)
+        {
+            _submit_uring(slot_index);
+        }
+        else
+        {
+            {
+                auto lg = std::lock_guard(mutex);
+                queued_slots.enqueue(slot_index);
+            }
+            work_available.notify_one();
+        }
+    }
+
+    if (uring != nullptr)
+        _flush_uring_submissions(false);
+}
+
+unsigned pr::async_io_queue::reap(cc::span<async_io_completion> out_completions, bool wait)
+{
+    if (out_completions.empty())
+        return 0;
+
+    unsigned num_reaped = 0;
+
+    if (uring != nullptr)
+    {
+        num_reaped = _reap_uring(out_completions);
+        if (num_reaped == 0 && wait && get_num_in_flight() > 0)
+        {
+            _flush_uring_submissions(true);
+            num_reaped = _reap_uring(out_completions);
+        }
+        else
+        {
+            // retry submissions the kernel could not take earlier
+            _flush_uring_submissions(false);
+        }
+    }
+    else
+    {
+        auto lk = std::unique_lock(mutex);
+        if (wait && get_num_in_flight() > 0)
+            work_completed.wait(lk, [&] { return !completed_slots.empty(); });
+
+        while (num_reaped < out_completions.size() && !completed_slots.empty())
+        {
+            uint32_t const slot_index = completed_slots.back();
+            completed_slots.pop_back();
+
+            out_completions[num_reaped++] = async_io_completion{slots[slot_index].user_data, slots[slot_index].result};
+            free_slots.push_back(slot_index);
+        }
+    }
+
+    return num_reaped;
+}
+
+pr::native_file_t pr::async_io_queue::open_file(const char* path)
+{
+#ifdef CC_OS_WINDOWS
+    HANDLE const handle = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    return handle == INVALID_HANDLE_VALUE ? gc_invalid_native_file : native_file_t(handle);
+#else
+    int const fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    return fd < 0 ? gc_invalid_native_file : native_file_t(fd);
+#endif
+}
+
+void pr::async_io_queue::close_file(native_file_t file)
+{
+#ifdef CC_OS_WINDOWS
+    ::CloseHandle(HANDLE(file));
+#else
+    ::close(int(file));
+#endif
+}
+
+#if PR_HAS_IO_URING
+void pr::async_io_queue::_submit_uring(uint32_t slot_index)
+{
+    slot const& s = slots[slot_index];
+
+    // the calling thread is the only producer, the kernel only reads the tail
+    unsigned const tail = *uring->sq_tail;
+    unsigned const sqe_index = tail & *uring->sq_mask;
+
+    io_uring_sqe& sqe = uring->sqes[sqe_index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = int(s.file);
+    sqe.addr = uint64_t(reinterpret_cast<uintptr_t>(s.rows));
+    sqe.len = s.num_rows;
+    sqe.off = s.file_offset;
+    sqe.user_data = slot_index;
+
+    uring->sq_array[sqe_index] = sqe_index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++uring->num_unsubmitted;
+}
+
+void pr::async_io_queue::_flush_uring_submissions(bool wait_for_completion)
+{
+    unsigned const flags = wait_for_completion ? IORING_ENTER_GETEVENTS : 0u;
+    unsigned const min_complete = wait_for_completion ? 1u : 0u;
+
+    while (uring->num_unsubmitted > 0 || wait_for_completion)
+    {
+        int const res = io_uring_enter(uring->fd, uring->num_unsubmitted, min_complete, flags);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // EAGAIN / EBUSY: kernel resources are exhausted, the entries stay in the ring and are retried on the next call
+            // a wait on the other hand must not spin, completions are pending in that case
+            return;
+        }
+
+        uring->num_unsubmitted -= cc::min(unsigned(res), uring->num_unsubmitted);
+        if (wait_for_completion)
+            return;
+    }
+}
+
+unsigned pr::async_io_queue::_reap_uring(cc::span<async_io_completion> out_completions)
+{
+    unsigned head = *uring->cq_head;
+    unsigned const tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+    unsigned num_reaped = 0;
+    while (head != tail && num_reaped < out_completions.size())
+    {
+        io_uring_cqe const& cqe = uring->cqes[head & *uring->cq_mask];
+        uint32_t const slot_index = uint32_t(cqe.user_data);
+
+        out_completions[num_reaped++] = async_io_completion{slots[slot_index].user_data, int64_t(cqe.res)};
+        free_slots.push_back(slot_index);
+        ++head;
+    }
+
+    __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+    return num_reaped;
+}
+#else
+void pr::async_io_queue::_submit_uring(uint32_t) { CC_UNREACHABLE("io_uring unavailable"); }
+void pr::async_io_queue::_flush_uring_submissions(bool) { CC_UNREACHABLE("io_uring unavailable"); }
+unsigned pr::async_io_queue::_reap_uring(cc::span<async_io_completion>) { CC_UNREACHABLE("io_uring unavailable"); }
+#endif
+
+void pr::async_io_queue::_worker_main()
+{
+    while (true)
+    {
+        uint32_t slot_index;
+
+        {
+            auto lk = std::unique_lock(mutex);
+            work_available.wait(lk, [&] { return is_shutting_down || !queued_slots.empty(); });
+
+            if (queued_slots.empty())
+                return;
+
+            slot_index = queued_slots.get_tail();
+            queued_slots.pop_tail();
+        }
+
+        // the slot is untouched by the submitting thread until it is completed
+        _read_blocking(slots[slot_index]);
+
+        {
+            auto lg = std::lock_guard(mutex);
+            completed_slots.push_back(slot_index);
+        }
+        work_completed.notify_one();
+    }
+}
+
+void pr::async_io_queue::_read_blocking(slot& s)
+{
+#ifdef CC_OS_WINDOWS
+    int64_t num_read_total = 0;
+    for (auto i = 0u; i < s.num_rows; ++i)
+    {
+        uint64_t const offset = s.file_offset + uint64_t(num_read_total);
+
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = DWORD(offset);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+
+        DWORD num_read = 0;
+        if (!::ReadFile(HANDLE(s.file), s.rows[i].base, DWORD(s.rows[i].size), &num_read, &overlapped))
+        {
+            s.result = ::GetLastError() == ERROR_HANDLE_EOF ? num_read_total : -1;
+            return;
+        }
+
+        num_read_total += num_read;
+        if (num_read < s.rows[i].size)
+            break;
+    }
+    s.result = num_read_total;
+#else
+    while (true)
+    {
+        ssize_t const res = ::preadv(int(s.file), reinterpret_cast<iovec const*>(s.rows), int(s.num_rows), off_t(s.file_offset));
+        if (res >= 0 || errno != EINTR)
+        {
+            s.result = res >= 0 ? int64_t(res) : -int64_t(errno);
+            return;
+        }
+    }
+#endif
+}
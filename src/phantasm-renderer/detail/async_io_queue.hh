@@ -0,0 +1,109 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include <clean-core/span.hh>
+#include <clean-core/vector.hh>
+
+#include <phantasm-renderer/common/circular_buffer.hh>
+
+namespace pr
+{
+/// a file descriptor, or a HANDLE on Windows
+using native_file_t = intptr_t;
+inline constexpr native_file_t gc_invalid_native_file = -1;
+
+/// reads at most this many rows with a single request
+inline constexpr uint32_t gc_async_io_max_rows = 256;
+
+/// a positioned read of consecutive file bytes into rows of memory
+struct async_io_read
+{
+    native_file_t file = gc_invalid_native_file;
+    uint64_t file_offset = 0;
+    std::byte* dest = nullptr;
+    uint32_t row_size_bytes = 0;
+    uint32_t dest_row_stride_bytes = 0;
+    uint32_t num_rows = 1; ///< at most gc_async_io_max_rows
+    uint64_t user_data = 0;
+};
+
+struct async_io_completion
+{
+    uint64_t user_data = 0;
+    int64_t num_bytes = 0; ///< read bytes, can be less than requested, negative on errors
+};
+
+/// queue of positioned reads with a fixed amount in flight
+/// on Linux, reads are submitted to an io_uring (without liburing), elsewhere or if io_uring setup fails, a pool of threads performs them
+/// submission and completion are unsynchronized, the pool threads only touch the slot they work on
+struct async_io_queue
+{
+    /// falls back to num_workers threads if io_uring is disallowed or unavailable
+    void initialize(unsigned queue_depth, unsigned num_workers, bool allow_io_uring);
+    void destroy();
+
+    /// the amount of reads that can be submitted right now
+    unsigned get_num_free() const { return unsigned(free_slots.size()); }
+    unsigned get_num_in_flight() const { return unsigned(slots.size() - free_slots.size()); }
+
+    /// submits reads, at most get_num_free()
+    void submit(cc::span<async_io_read const> reads);
+
+    /// writes completed reads to out_completions, waits for at least one if requested and any are in flight
+    /// returns the amount of written completions
+    unsigned reap(cc::span<async_io_completion> out_completions, bool wait);
+
+    bool is_using_io_uring() const { return uring != nullptr; }
+
+    static native_file_t open_file(char const* path);
+    static void close_file(native_file_t file);
+
+private:
+    /// memory layout of a POSIX iovec
+    struct row_span
+    {
+        void* base;
+        size_t size;
+    };
+
+    struct slot
+    {
+        native_file_t file = gc_invalid_native_file;
+        uint64_t file_offset = 0;
+        uint32_t num_rows = 0;
+        uint64_t user_data = 0;
+        int64_t result = 0;
+        row_span rows[gc_async_io_max_rows];
+    };
+
+    struct io_uring_state;
+
+    void _submit_uring(uint32_t slot_index);
+    void _flush_uring_submissions(bool wait_for_completion);
+    unsigned _reap_uring(cc::span<async_io_completion> out_completions);
+
+    void _worker_main();
+    /// performs the read of a slot on the calling thread, writes its result
+    static void _read_blocking(slot& s);
+
+private:
+    cc::vector<slot> slots;
+    cc::vector<uint32_t> free_slots;
+
+    io_uring_state* uring = nullptr;
+
+    // thread pool fallback
+    cc::vector<std::thread> workers;
+    circular_buffer<uint32_t> queued_slots; ///< guarded by mutex
+    cc::vector<uint32_t> completed_slots;   ///< guarded by mutex
+    bool is_shutting_down = false;          ///< guarded by mutex
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_completed;
+};
+}
@@ -6,46 +6,52 @@
 
 #include <phantasm-renderer/Context.hh>
 #include <phantasm-renderer/common/log.hh>
+#include <phantasm-renderer/common/trace.hh>
 
-void pr::deferred_destruction_queue::free(pr::Context& ctx, phi::handle::shader_view sv)
+unsigned pr::deferred_destruction_queue::free(pr::Context& ctx, phi::handle::shader_view sv)
 {
     auto lg = std::lock_guard(mutex);
-    _free_pending_unsynced(ctx);
+    auto const num_freed = _free_pending_unsynced(ctx);
     pending_svs_new.push_back(sv);
+    return num_freed;
 }
 
-void pr::deferred_destruction_queue::free(pr::Context& ctx, phi::handle::resource res)
+unsigned pr::deferred_destruction_queue::free(pr::Context& ctx, phi::handle::resource res)
 {
     auto lg = std::lock_guard(mutex);
-    _free_pending_unsynced(ctx);
+    auto const num_freed = _free_pending_unsynced(ctx);
     pending_res_new.push_back(res);
+    return num_freed;
 }
 
-void pr::deferred_destruction_queue::free(pr::Context& ctx, phi::handle::pipeline_state pso)
+unsigned pr::deferred_destruction_queue::free(pr::Context& ctx, phi::handle::pipeline_state pso)
 {
     auto lg = std::lock_guard(mutex);
-    _free_pending_unsynced(ctx);
+    auto const num_freed = _free_pending_unsynced(ctx);
     pending_psos_new.push_back(pso);
+    return num_freed;
 }
 
-void pr::deferred_destruction_queue::free_range(pr::Context& ctx, cc::span<const phi::handle::resource> res_range)
+unsigned pr::deferred_destruction_queue::free_range(pr::Context& ctx, cc::span<const phi::handle::resource> res_range)
 {
     auto lg = std::lock_guard(mutex);
-    _free_pending_unsynced(ctx);
+    auto const num_freed = _free_pending_unsynced(ctx);
     if (res_range.size() > 0)
     {
         pending_res_new.push_back_range(res_range);
     }
+    return num_freed;
 }
 
-void pr::deferred_destruction_queue::free_range(pr::Context& ctx, cc::span<const phi::handle::shader_view> sv_range)
+unsigned pr::deferred_destruction_queue::free_range(pr::Context& ctx, cc::span<const phi::handle::shader_view> sv_range)
 {
     auto lg = std::lock_guard(mutex);
-    _free_pending_unsynced(ctx);
+    auto const num_freed = _free_pending_unsynced(ctx);
     if (sv_range.size() > 0)
     {
         pending_svs_new.push_back_range(sv_range);
     }
+    return num_freed;
 }
 
 
@@ -101,6 +107,8 @@ unsigned pr::deferred_destruction_queue::_free_pending_unsynced(pr::Context& ctx
     // which requires this safety buffer - or it's an overzelaous validation layer
     if (epoch_gpu >= gpu_epoch_old + 2)
     {
+        PR_TRACE_SCOPE("deferred frees");
+
         // can free old
         if (pending_svs_old.size() > 0)
         {
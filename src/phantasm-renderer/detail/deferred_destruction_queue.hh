@@ -15,11 +15,12 @@ namespace pr
 /// synchronised
 struct deferred_destruction_queue
 {
-    void free(pr::Context& ctx, phi::handle::shader_view sv);
-    void free(pr::Context& ctx, phi::handle::resource res);
-    void free(pr::Context& ctx, phi::handle::pipeline_state pso);
-    void free_range(pr::Context& ctx, cc::span<phi::handle::resource const> res_range);
-    void free_range(pr::Context& ctx, cc::span<phi::handle::shader_view const> res_range);
+    /// enqueue for destruction, returns the amount of older pending elements that were freed
+    unsigned free(pr::Context& ctx, phi::handle::shader_view sv);
+    unsigned free(pr::Context& ctx, phi::handle::resource res);
+    unsigned free(pr::Context& ctx, phi::handle::pipeline_state pso);
+    unsigned free_range(pr::Context& ctx, cc::span<phi::handle::resource const> res_range);
+    unsigned free_range(pr::Context& ctx, cc::span<phi::handle::shader_view const> res_range);
 
     unsigned free_all_pending(pr::Context& ctx);
 
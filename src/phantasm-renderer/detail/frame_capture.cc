@@ -0,0 +1,558 @@
+#include "frame_capture.hh"
+
+#include <cstdio>
+#include <cstring>
+
+#include <clean-core/xxHash.hh>
+
+#include <phantasm-renderer/Context.hh>
+#include <phantasm-renderer/common/log.hh>
+#include <phantasm-renderer/pass_info.hh>
+#include <phantasm-renderer/resource_types.hh>
+
+namespace
+{
+constexpr uint32_t gc_capture_magic = 0x43465250; // "PRFC"
+constexpr uint32_t gc_capture_version = 1;
+
+/// captures contain raw PHI structs, they can only be replayed by builds with identical layouts
+uint64_t get_layout_hash()
+{
+    size_t const sizes[] = {sizeof(pr::generic_resource_info),
+                            sizeof(phi::resource_view),
+                            sizeof(phi::sampler_config),
+                            sizeof(pr::graphics_pass_info_data),
+                            sizeof(pr::compute_pass_info_data),
+                            sizeof(phi::arg::framebuffer_config),
+                            sizeof(pr::resource_state_entry),
+                            sizeof(phi::cmd::begin_render_pass),
+                            sizeof(phi::cmd::transition_resources),
+                            sizeof(phi::cmd::draw),
+                            sizeof(phi::cmd::dispatch),
+                            sizeof(phi::cmd::copy_buffer_to_texture)};
+    return cc::hash_xxh3(cc::as_byte_span(sizes), 0);
+}
+
+struct capture_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t layout_hash;
+    uint32_t num_resources;
+    uint32_t num_shader_views;
+    uint32_t num_psos;
+    uint32_t num_query_ranges;
+    uint32_t num_initial_states;
+    uint32_t _padding;
+    uint64_t stream_size;
+};
+
+template <class H>
+H to_handle(uint64_t value)
+{
+    H res;
+    res._value = decltype(res._value)(value);
+    return res;
+}
+
+struct file_writer
+{
+    std::FILE* file = nullptr;
+    bool is_ok = true;
+
+    void write(void const* data, size_t size)
+    {
+        if (size > 0)
+            is_ok &= std::fwrite(data, 1, size, file) == size;
+    }
+
+    template <class T>
+    void write_pod(T const& val)
+    {
+        write(&val, sizeof(T));
+    }
+
+    template <class T>
+    void write_vector(cc::vector<T> const& vec)
+    {
+        write_pod(uint64_t(vec.size()));
+        write(vec.data(), vec.size() * sizeof(T));
+    }
+};
+
+struct memory_reader
+{
+    std::byte const* pos = nullptr;
+    std::byte const* end = nullptr;
+    bool is_ok = true;
+
+    void read(void* dest, size_t size)
+    {
+        if (size_t(end - pos) < size)
+        {
+            is_ok = false;
+            return;
+        }
+
+        std::memcpy(dest, pos, size);
+        pos += size;
+    }
+
+    template <class T>
+    void read_pod(T& out_val)
+    {
+        read(&out_val, sizeof(T));
+    }
+
+    template <class T>
+    void read_vector(cc::vector<T>& out_vec)
+    {
+        uint64_t size = 0;
+        read_pod(size);
+        if (!is_ok || size_t(end - pos) / sizeof(T) < size)
+        {
+            is_ok = false;
+            return;
+        }
+
+        out_vec.resize(size);
+        read(out_vec.data(), size * sizeof(T));
+    }
+
+    /// resizes a vector of records read from a count in the file, fails if the remaining bytes cannot hold that many
+    template <class T>
+    void resize_records(cc::vector<T>& out_vec, uint64_t count, size_t min_record_size)
+    {
+        if (!is_ok || size_t(end - pos) / min_record_size < count)
+        {
+            is_ok = false;
+            return;
+        }
+
+        out_vec.resize(count);
+    }
+};
+
+// the smallest size of each record as written by frame_capture::write, vectors stored empty
+constexpr size_t gc_min_resource_record_size = sizeof(uint64_t) + sizeof(pr::generic_resource_info) + sizeof(uint64_t);
+constexpr size_t gc_min_shader_view_record_size = sizeof(uint64_t) + sizeof(uint8_t) + 3 * sizeof(uint64_t);
+constexpr size_t gc_min_pso_record_size = sizeof(uint64_t) + sizeof(uint8_t) + sizeof(pr::graphics_pass_info_data) + sizeof(phi::arg::framebuffer_config)
+                                          + sizeof(pr::compute_pass_info_data) + 2 * sizeof(uint64_t); // at least one shader
+constexpr size_t gc_min_query_range_record_size = sizeof(uint64_t) + sizeof(pr::query_type) + sizeof(uint32_t);
+
+bool is_valid_resource_type(pr::generic_resource_info const& info)
+{
+    return info.type == phi::arg::resource_description::e_resource_texture || info.type == phi::arg::resource_description::e_resource_buffer;
+}
+
+bool is_valid_query_type(pr::query_type type)
+{
+    return type == pr::query_type::timestamp || type == pr::query_type::occlusion || type == pr::query_type::pipeline_stats;
+}
+
+/// collects every handle referenced by a command stream once
+struct handle_collector
+{
+    cc::map<uint64_t, bool> seen_resources;
+    cc::map<uint64_t, bool> seen_shader_views;
+    cc::map<uint64_t, bool> seen_psos;
+    cc::map<uint64_t, bool> seen_query_ranges;
+
+    cc::vector<uint64_t> resources;
+    cc::vector<uint64_t> shader_views;
+    cc::vector<uint64_t> psos;
+    cc::vector<uint64_t> query_ranges;
+
+    static void add(cc::map<uint64_t, bool>& seen, cc::vector<uint64_t>& list, uint64_t value)
+    {
+        bool& is_seen = seen[value];
+        if (!is_seen)
+        {
+            is_seen = true;
+            list.push_back(value);
+        }
+    }
+
+    void operator()(phi::handle::resource& h) { add(seen_resources, resources, uint64_t(h._value)); }
+    void operator()(phi::handle::shader_view& h) { add(seen_shader_views, shader_views, uint64_t(h._value)); }
+    void operator()(phi::handle::pipeline_state& h) { add(seen_psos, psos, uint64_t(h._value)); }
+    void operator()(phi::handle::query_range& h) { add(seen_query_ranges, query_ranges, uint64_t(h._value)); }
+};
+
+template <class T>
+void copy_span(cc::span<T const> src, cc::vector<T>& dest)
+{
+    dest.clear();
+    dest.reserve(src.size());
+    for (T const& elem : src)
+        dest.push_back(elem);
+}
+
+void copy_binary(std::byte const* data, size_t size, cc::vector<std::byte>& dest)
+{
+    dest.resize(size);
+    if (size > 0)
+        std::memcpy(dest.data(), data, size);
+}
+}
+
+void pr::capture_registry::add_resource(phi::handle::resource res, const generic_resource_info& info)
+{
+    if (!is_enabled() || !res.is_valid())
+        return;
+
+    auto lg = std::lock_guard(_mutex);
+    resource_entry& entry = _resources[uint64_t(res._value)];
+    entry.info = info;
+    entry.is_valid = true;
+}
+
+void pr::capture_registry::add_texture(phi::handle::resource res, const texture_info& info)
+{
+    generic_resource_info generic = {};
+    generic.type = phi::arg::resource_description::e_resource_texture;
+    generic.info_texture = info;
+    add_resource(res, generic);
+}
+
+void pr::capture_registry::add_buffer(phi::handle::resource res, const buffer_info& info)
+{
+    generic_resource_info generic = {};
+    generic.type = phi::arg::resource_description::e_resource_buffer;
+    generic.info_buffer = info;
+    add_resource(res, generic);
+}
+
+void pr::capture_registry::add_shader_view(phi::handle::shader_view sv,
+                                           cc::span<const phi::resource_view> srvs,
+                                           cc::span<const phi::resource_view> uavs,
+                                           cc::span<const phi::sampler_config> samplers,
+                                           bool is_compute)
+{
+    if (!is_enabled() || !sv.is_valid())
+        return;
+
+    auto lg = std::lock_guard(_mutex);
+    shader_view_entry& entry = _shader_views[uint64_t(sv._value)];
+    copy_span(srvs, entry.srvs);
+    copy_span(uavs, entry.uavs);
+    copy_span(samplers, entry.samplers);
+    entry.is_compute = is_compute;
+    entry.is_valid = true;
+}
+
+void pr::capture_registry::add_graphics_pso(phi::handle::pipeline_state pso, const graphics_pass_info& gp, const framebuffer_info& fb)
+{
+    if (!is_enabled() || !pso.is_valid())
+        return;
+
+    auto lg = std::lock_guard(_mutex);
+    pipeline_state_entry& entry = _psos[uint64_t(pso._value)];
+    entry.graphics = gp._storage.get();
+    entry.framebuffer = fb._storage.get();
+    entry.is_compute = false;
+    entry.is_valid = true;
+
+    entry.shader_binaries.resize(gp._shaders.size());
+    entry.shader_stages.clear();
+    for (auto i = 0u; i < gp._shaders.size(); ++i)
+    {
+        copy_binary(gp._shaders[i].binary.data, gp._shaders[i].binary.size, entry.shader_binaries[i]);
+        entry.shader_stages.push_back(gp._shaders[i].stage);
+    }
+}
+
+void pr::capture_registry::add_compute_pso(phi::handle::pipeline_state pso, const compute_pass_info& cp)
+{
+    if (!is_enabled() || !pso.is_valid())
+        return;
+
+    auto lg = std::lock_guard(_mutex);
+    pipeline_state_entry& entry = _psos[uint64_t(pso._value)];
+    entry.compute = cp._storage.get();
+    entry.is_compute = true;
+    entry.is_valid = true;
+
+    entry.shader_binaries.resize(1);
+    copy_binary(cp._shader.data, cp._shader.size, entry.shader_binaries[0]);
+    entry.shader_stages.clear();
+    entry.shader_stages.push_back(phi::shader_stage::compute);
+}
+
+void pr::capture_registry::add_query_range(phi::handle::query_range qr, query_type type, uint32_t num)
+{
+    if (!is_enabled() || !qr.is_valid())
+        return;
+
+    auto lg = std::lock_guard(_mutex);
+    query_range_entry& entry = _query_ranges[uint64_t(qr._value)];
+    entry.type = type;
+    entry.num = num;
+    entry.is_valid = true;
+}
+
+bool pr::capture_registry::write_capture(pr::Context& ctx, cc::span<const std::byte> stream, cc::span<const resource_state_entry> initial_states, const char* path)
+{
+    CC_ASSERT(is_enabled() && "frame capture must be enabled before creating the objects used by captured frames");
+
+    // copy the stream without debug labels (their strings are not part of it), collect referenced handles
+    cc::vector<std::byte> out_stream;
+    out_stream.reserve(stream.size());
+    handle_collector collector;
+
+    phi::command_stream_parser parser(const_cast<std::byte*>(stream.data()), stream.size());
+    for (auto const& cmd : parser)
+    {
+        command_handle_visitor<handle_collector> visitor = {collector};
+        phi::cmd::detail::dynamic_dispatch(cmd, visitor);
+
+        if (visitor.is_unsupported)
+        {
+            PR_LOG_WARN("frame capture failed, the frame contains a command type not supported by captures");
+            return false;
+        }
+
+        if (visitor.is_debug_label)
+            continue;
+
+        auto const* const cmd_bytes = reinterpret_cast<std::byte const*>(&cmd);
+        size_t const offset = out_stream.size();
+        out_stream.resize(offset + visitor.cmd_size);
+        std::memcpy(out_stream.data() + offset, cmd_bytes, visitor.cmd_size);
+    }
+
+    for (resource_state_entry const& state : initial_states)
+        collector(const_cast<phi::handle::resource&>(state.resource));
+
+    auto lg = std::lock_guard(_mutex);
+
+    // resources referenced by shader views must exist on replay as well
+    for (uint64_t const sv : collector.shader_views)
+    {
+        shader_view_entry const& entry = _shader_views[sv];
+        if (!entry.is_valid)
+        {
+            PR_LOG_WARN("frame capture failed, the frame references a shader view created before capture was enabled");
+            return false;
+        }
+
+        for (phi::resource_view const& rv : entry.srvs)
+            collector(const_cast<phi::handle::resource&>(rv.resource));
+        for (phi::resource_view const& rv : entry.uavs)
+            collector(const_cast<phi::handle::resource&>(rv.resource));
+    }
+
+    for (uint64_t const res : collector.resources)
+    {
+        if (!_resources[res].is_valid)
+        {
+            PR_LOG_WARN("frame capture failed, the frame references a resource created before capture was enabled");
+            return false;
+        }
+    }
+
+    for (uint64_t const pso : collector.psos)
+    {
+        if (!_psos[pso].is_valid)
+        {
+            PR_LOG_WARN("frame capture failed, the frame references a pipeline state created before capture was enabled");
+            return false;
+        }
+    }
+
+    for (uint64_t const qr : collector.query_ranges)
+    {
+        if (!_query_ranges[qr].is_valid)
+        {
+            PR_LOG_WARN("frame capture failed, the frame references a query range created before capture was enabled");
+            return false;
+        }
+    }
+
+    file_writer writer;
+    writer.file = std::fopen(path, "wb");
+    if (writer.file == nullptr)
+    {
+        PR_LOG_WARN("frame capture failed, unable to open {} for writing", path);
+        return false;
+    }
+
+    capture_header header = {};
+    header.magic = gc_capture_magic;
+    header.version = gc_capture_version;
+    header.layout_hash = get_layout_hash();
+    header.num_resources = uint32_t(collector.resources.size());
+    header.num_shader_views = uint32_t(collector.shader_views.size());
+    header.num_psos = uint32_t(collector.psos.size());
+    header.num_query_ranges = uint32_t(collector.query_ranges.size());
+    header.num_initial_states = uint32_t(initial_states.size());
+    header.stream_size = out_stream.size();
+    writer.write_pod(header);
+
+    for (uint64_t const res : collector.resources)
+    {
+        generic_resource_info const& info = _resources[res].info;
+        writer.write_pod(res);
+        writer.write_pod(info);
+
+        // upload buffers are written by the CPU, their current contents are part of the capture
+        bool const has_contents = info.type == phi::arg::resource_description::e_resource_buffer && info.info_buffer.heap == phi::resource_heap::upload;
+        uint64_t const contents_size = has_contents ? info.info_buffer.size_bytes : 0;
+        writer.write_pod(contents_size);
+
+        if (has_contents)
+        {
+            buffer const buf = {{to_handle<phi::handle::resource>(res), 0}, info.info_buffer};
+            std::byte const* const map = ctx.map_buffer(buf);
+            writer.write(map, contents_size);
+            ctx.unmap_buffer(buf, 0, 0); // flush nothing
+        }
+    }
+
+    for (uint64_t const sv : collector.shader_views)
+    {
+        shader_view_entry const& entry = _shader_views[sv];
+        writer.write_pod(sv);
+        writer.write_pod(uint8_t(entry.is_compute));
+        writer.write_vector(entry.srvs);
+        writer.write_vector(entry.uavs);
+        writer.write_vector(entry.samplers);
+    }
+
+    for (uint64_t const pso : collector.psos)
+    {
+        pipeline_state_entry const& entry = _psos[pso];
+        writer.write_pod(pso);
+        writer.write_pod(uint8_t(entry.is_compute));
+        writer.write_pod(entry.graphics);
+        writer.write_pod(entry.framebuffer);
+        writer.write_pod(entry.compute);
+        writer.write_vector(entry.shader_stages);
+        for (cc::vector<std::byte> const& binary : entry.shader_binaries)
+            writer.write_vector(binary);
+    }
+
+    for (uint64_t const qr : collector.query_ranges)
+    {
+        query_range_entry const& entry = _query_ranges[qr];
+        writer.write_pod(qr);
+        writer.write_pod(entry.type);
+        writer.write_pod(entry.num);
+    }
+
+    writer.write(initial_states.data(), initial_states.size() * sizeof(resource_state_entry));
+    writer.write(out_stream.data(), out_stream.size());
+
+    std::fclose(writer.file);
+
+    if (!writer.is_ok)
+    {
+        PR_LOG_WARN("frame capture failed, error writing {}", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool pr::frame_capture_data::read(const char* path)
+{
+    std::FILE* const file = std::fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+
+    std::fseek(file, 0, SEEK_END);
+    long const file_size = std::ftell(file);
+    std::fseek(file, 0, SEEK_SET);
+
+    cc::vector<std::byte> contents;
+    if (file_size > 0)
+        contents.resize(size_t(file_size));
+
+    bool const read_ok = file_size > 0 && std::fread(contents.data(), 1, contents.size(), file) == contents.size();
+    std::fclose(file);
+
+    if (!read_ok)
+        return false;
+
+    memory_reader reader;
+    reader.pos = contents.data();
+    reader.end = contents.data() + contents.size();
+
+    capture_header header = {};
+    reader.read_pod(header);
+    if (!reader.is_ok || header.magic != gc_capture_magic || header.version != gc_capture_version || header.layout_hash != get_layout_hash())
+        return false;
+
+    // counts are checked against the remaining bytes before allocating, types before the replayer switches on them
+    reader.resize_records(resources, header.num_resources, gc_min_resource_record_size);
+    for (resource& res : resources)
+    {
+        reader.read_pod(res.handle);
+        reader.read_pod(res.info);
+        reader.read_vector(res.contents);
+
+        if (!reader.is_ok || !is_valid_resource_type(res.info))
+            return false;
+    }
+
+    reader.resize_records(shader_views, header.num_shader_views, gc_min_shader_view_record_size);
+    for (shader_view& sv : shader_views)
+    {
+        if (!reader.is_ok)
+            return false;
+
+        uint8_t is_compute = 0;
+        reader.read_pod(sv.handle);
+        reader.read_pod(is_compute);
+        reader.read_vector(sv.srvs);
+        reader.read_vector(sv.uavs);
+        reader.read_vector(sv.samplers);
+        sv.is_compute = is_compute != 0;
+    }
+
+    reader.resize_records(psos, header.num_psos, gc_min_pso_record_size);
+    for (pipeline_state& pso : psos)
+    {
+        if (!reader.is_ok)
+            return false;
+
+        uint8_t is_compute = 0;
+        reader.read_pod(pso.handle);
+        reader.read_pod(is_compute);
+        reader.read_pod(pso.graphics);
+        reader.read_pod(pso.framebuffer);
+        reader.read_pod(pso.compute);
+        reader.read_vector(pso.shader_stages);
+        pso.is_compute = is_compute != 0;
+
+        size_t const max_shaders = pso.is_compute ? 1 : phi::limits::num_graphics_shader_stages;
+        if (!reader.is_ok || pso.shader_stages.empty() || pso.shader_stages.size() > max_shaders)
+            return false;
+
+        pso.shader_binaries.resize(pso.shader_stages.size());
+        for (cc::vector<std::byte>& binary : pso.shader_binaries)
+            reader.read_vector(binary);
+    }
+
+    reader.resize_records(query_ranges, header.num_query_ranges, gc_min_query_range_record_size);
+    for (query_range& qr : query_ranges)
+    {
+        reader.read_pod(qr.handle);
+        reader.read_pod(qr.type);
+        reader.read_pod(qr.num);
+
+        if (!reader.is_ok || !is_valid_query_type(qr.type))
+            return false;
+    }
+
+    if (!reader.is_ok || size_t(reader.end - reader.pos) != header.num_initial_states * sizeof(resource_state_entry) + header.stream_size)
+        return false;
+
+    initial_states.resize(header.num_initial_states);
+    reader.read(initial_states.data(), initial_states.size() * sizeof(resource_state_entry));
+
+    stream.resize(header.stream_size);
+    reader.read(stream.data(), stream.size());
+
+    return reader.is_ok;
+}
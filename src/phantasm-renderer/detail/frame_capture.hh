@@ -0,0 +1,281 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <clean-core/map.hh>
+#include <clean-core/span.hh>
+#include <clean-core/vector.hh>
+
+#include <phantasm-hardware-interface/arguments.hh>
+#include <phantasm-hardware-interface/commands.hh>
+#include <phantasm-hardware-interface/handles.hh>
+
+#include <phantasm-renderer/common/resource_info.hh>
+#include <phantasm-renderer/common/state_info.hh>
+#include <phantasm-renderer/enums.hh>
+#include <phantasm-renderer/fwd.hh>
+
+namespace pr
+{
+/// descriptions of all objects a Context creates, recorded so frames referencing them can be captured (see Context::capture_frame)
+/// inactive until enabled, entries are overwritten when PHI reuses a handle
+/// synchronised
+struct capture_registry
+{
+    void enable() { _is_enabled.store(true, std::memory_order_release); }
+    bool is_enabled() const { return _is_enabled.load(std::memory_order_relaxed); }
+
+    // registration, no-ops if not enabled
+    void add_resource(phi::handle::resource res, generic_resource_info const& info);
+    void add_texture(phi::handle::resource res, texture_info const& info);
+    void add_buffer(phi::handle::resource res, buffer_info const& info);
+    void add_shader_view(phi::handle::shader_view sv,
+                         cc::span<phi::resource_view const> srvs,
+                         cc::span<phi::resource_view const> uavs,
+                         cc::span<phi::sampler_config const> samplers,
+                         bool is_compute);
+    void add_graphics_pso(phi::handle::pipeline_state pso, graphics_pass_info const& gp, framebuffer_info const& fb);
+    void add_compute_pso(phi::handle::pipeline_state pso, compute_pass_info const& cp);
+    void add_query_range(phi::handle::query_range qr, query_type type, uint32_t num);
+
+    /// writes a capture of the given contiguous PHI command stream and all objects it references to a file
+    /// initial_states are transitioned to before the stream on replay
+    /// returns false if the stream references unknown objects or unsupported commands
+    bool write_capture(pr::Context& ctx, cc::span<std::byte const> stream, cc::span<resource_state_entry const> initial_states, char const* path);
+
+private:
+    struct resource_entry
+    {
+        generic_resource_info info;
+        bool is_valid = false;
+    };
+
+    struct shader_view_entry
+    {
+        cc::vector<phi::resource_view> srvs;
+        cc::vector<phi::resource_view> uavs;
+        cc::vector<phi::sampler_config> samplers;
+        bool is_compute = false;
+        bool is_valid = false;
+    };
+
+    struct pipeline_state_entry
+    {
+        graphics_pass_info_data graphics = {};
+        phi::arg::framebuffer_config framebuffer = {};
+        compute_pass_info_data compute = {};
+        cc::vector<cc::vector<std::byte>> shader_binaries;
+        cc::vector<phi::shader_stage> shader_stages;
+        bool is_compute = false;
+        bool is_valid = false;
+    };
+
+    struct query_range_entry
+    {
+        query_type type;
+        uint32_t num = 0;
+        bool is_valid = false;
+    };
+
+    // keyed by handle value
+    cc::map<uint64_t, resource_entry> _resources;
+    cc::map<uint64_t, shader_view_entry> _shader_views;
+    cc::map<uint64_t, pipeline_state_entry> _psos;
+    cc::map<uint64_t, query_range_entry> _query_ranges;
+
+    std::atomic<bool> _is_enabled = {false};
+    std::mutex _mutex;
+};
+
+/// the contents of a capture file, with handles as they were in the capturing Context
+struct frame_capture_data
+{
+    struct resource
+    {
+        uint64_t handle;
+        generic_resource_info info;
+        cc::vector<std::byte> contents; ///< upload heap buffers only
+    };
+
+    struct shader_view
+    {
+        uint64_t handle;
+        cc::vector<phi::resource_view> srvs;
+        cc::vector<phi::resource_view> uavs;
+        cc::vector<phi::sampler_config> samplers;
+        bool is_compute;
+    };
+
+    struct pipeline_state
+    {
+        uint64_t handle;
+        graphics_pass_info_data graphics;
+        phi::arg::framebuffer_config framebuffer;
+        compute_pass_info_data compute;
+        cc::vector<cc::vector<std::byte>> shader_binaries;
+        cc::vector<phi::shader_stage> shader_stages;
+        bool is_compute;
+    };
+
+    struct query_range
+    {
+        uint64_t handle;
+        query_type type;
+        uint32_t num;
+    };
+
+    cc::vector<resource> resources;
+    cc::vector<shader_view> shader_views;
+    cc::vector<pipeline_state> psos;
+    cc::vector<query_range> query_ranges;
+    cc::vector<resource_state_entry> initial_states;
+    cc::vector<std::byte> stream;
+
+    /// returns false if the file is missing, truncated or written by an incompatible build
+    bool read(char const* path);
+};
+
+/// calls on_handle(handle&) for every handle referenced by a PHI command
+/// unsupported commands (not emitted by pr itself) are flagged, debug labels are flagged so they can be stripped
+template <class F>
+struct command_handle_visitor
+{
+    F& on_handle;
+    size_t cmd_size = 0;
+    bool is_unsupported = false;
+    bool is_debug_label = false;
+
+    template <class H>
+    void visit(H const& handle)
+    {
+        if (handle.is_valid())
+            on_handle(const_cast<H&>(handle)); // the visited stream is always owned and mutable
+    }
+
+    template <class CmdT>
+    void execute(CmdT const&)
+    {
+        cmd_size = sizeof(CmdT);
+        is_unsupported = true;
+    }
+
+    void execute(phi::cmd::begin_render_pass const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        for (auto const& rt : cmd.render_targets)
+            visit(rt.rv.resource);
+        visit(cmd.depth_target.rv.resource);
+    }
+
+    void execute(phi::cmd::end_render_pass const& cmd) { cmd_size = sizeof(cmd); }
+
+    void execute(phi::cmd::transition_resources const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        for (auto const& ti : cmd.transitions)
+            visit(ti.resource);
+    }
+
+    void execute(phi::cmd::transition_image_slices const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        for (auto const& ti : cmd.transitions)
+            visit(ti.resource);
+    }
+
+    void execute(phi::cmd::barrier_uav const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        for (auto const& res : cmd.resources)
+            visit(res);
+    }
+
+    void execute(phi::cmd::copy_buffer const& cmd) { visit_copy(cmd); }
+    void execute(phi::cmd::copy_texture const& cmd) { visit_copy(cmd); }
+    void execute(phi::cmd::copy_buffer_to_texture const& cmd) { visit_copy(cmd); }
+    void execute(phi::cmd::copy_texture_to_buffer const& cmd) { visit_copy(cmd); }
+    void execute(phi::cmd::resolve_texture const& cmd) { visit_copy(cmd); }
+
+    void execute(phi::cmd::draw const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        visit(cmd.pipeline_state);
+        for (auto const& vb : cmd.vertex_buffers)
+            visit(vb);
+        visit(cmd.index_buffer);
+        visit_arguments(cmd.shader_arguments);
+    }
+
+    void execute(phi::cmd::draw_indirect const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        visit(cmd.pipeline_state);
+        for (auto const& vb : cmd.vertex_buffers)
+            visit(vb);
+        visit(cmd.index_buffer);
+        visit(cmd.indirect_argument_buffer);
+        visit_arguments(cmd.shader_arguments);
+    }
+
+    void execute(phi::cmd::dispatch const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        visit(cmd.pipeline_state);
+        visit_arguments(cmd.shader_arguments);
+    }
+
+    void execute(phi::cmd::dispatch_indirect const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        visit(cmd.pipeline_state);
+        visit(cmd.argument_buffer_addr.buffer);
+        visit_arguments(cmd.shader_arguments);
+    }
+
+    void execute(phi::cmd::write_timestamp const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        visit(cmd.query_range);
+    }
+
+    void execute(phi::cmd::resolve_queries const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        visit(cmd.dest_buffer);
+        visit(cmd.src_query_range);
+    }
+
+    void execute(phi::cmd::begin_debug_label const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        is_debug_label = true;
+    }
+
+    void execute(phi::cmd::end_debug_label const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        is_debug_label = true;
+    }
+
+private:
+    template <class CmdT>
+    void visit_copy(CmdT const& cmd)
+    {
+        cmd_size = sizeof(cmd);
+        visit(cmd.source);
+        visit(cmd.destination);
+    }
+
+    template <class ArgsT>
+    void visit_arguments(ArgsT const& args)
+    {
+        for (auto const& arg : args)
+        {
+            visit(arg.constant_buffer);
+            visit(arg.shader_view);
+        }
+    }
+};
+}
@@ -0,0 +1,198 @@
+#include "readback_pool.hh"
+
+#include <cstring>
+
+#include <clean-core/vector.hh>
+
+#include <phantasm-hardware-interface/Backend.hh>
+
+#include <phantasm-renderer/Context.hh>
+
+pr::readback pr::readback_pool::add(const buffer& buf, const readback_layout& layout)
+{
+    auto lg = std::lock_guard(mutex);
+
+    uint32_t index;
+    if (!free_slots.empty())
+    {
+        index = free_slots.back();
+        free_slots.pop_back();
+    }
+    else
+    {
+        index = uint32_t(slots.size());
+        slots.emplace_back();
+    }
+
+    slot& s = slots[index];
+    s.buf = buf;
+    s.layout = layout;
+    s.epoch = never_completes;
+    s.is_live = true;
+    s.is_submitted = false;
+    s.map = nullptr;
+    s.callback = nullptr;
+    s.callback_userdata = nullptr;
+
+    return readback{index, s.generation};
+}
+
+void pr::readback_pool::on_submit(cc::span<const readback> readbacks, gpu_epoch_t epoch)
+{
+    auto lg = std::lock_guard(mutex);
+    for (readback const rb : readbacks)
+    {
+        slot& s = _get_slot_unsynced(rb);
+        s.epoch = epoch;
+        s.is_submitted = true;
+    }
+}
+
+void pr::readback_pool::on_discard(cc::span<const readback> readbacks)
+{
+    auto lg = std::lock_guard(mutex);
+    for (readback const rb : readbacks)
+    {
+        slot& s = _get_slot_unsynced(rb);
+        s.epoch = never_completes;
+        s.is_submitted = true;
+    }
+}
+
+bool pr::readback_pool::is_ready(readback rb, gpu_epoch_t current_epoch_gpu)
+{
+    auto lg = std::lock_guard(mutex);
+    return current_epoch_gpu >= _get_slot_unsynced(rb).epoch;
+}
+
+bool pr::readback_pool::is_discarded(readback rb)
+{
+    auto lg = std::lock_guard(mutex);
+    slot const& s = _get_slot_unsynced(rb);
+    return s.is_submitted && s.epoch == never_completes;
+}
+
+cc::span<const std::byte> pr::readback_pool::get_data(pr::Context& ctx, readback rb, gpu_epoch_t current_epoch_gpu)
+{
+    auto lg = std::lock_guard(mutex);
+    slot& s = _get_slot_unsynced(rb);
+    CC_ASSERT(current_epoch_gpu >= s.epoch && "readback data accessed before completion, check Context::is_readback_ready first");
+    (void)current_epoch_gpu;
+    return _get_data_unsynced(ctx, s);
+}
+
+void pr::readback_pool::set_callback(readback rb, readback_callback callback, void* userdata)
+{
+    auto lg = std::lock_guard(mutex);
+    slot& s = _get_slot_unsynced(rb);
+    s.callback = callback;
+    s.callback_userdata = userdata;
+}
+
+unsigned pr::readback_pool::poll(pr::Context& ctx, gpu_epoch_t current_epoch_gpu)
+{
+    struct completed_readback
+    {
+        readback rb;
+        cc::span<std::byte const> data;
+        readback_callback callback;
+        void* userdata;
+    };
+
+    cc::vector<completed_readback> completed;
+
+    {
+        auto lg = std::lock_guard(mutex);
+        for (auto i = 0u; i < slots.size(); ++i)
+        {
+            slot& s = slots[i];
+            if (!s.is_live || s.callback == nullptr || current_epoch_gpu < s.epoch)
+                continue;
+
+            completed.push_back({readback{i, s.generation}, _get_data_unsynced(ctx, s), s.callback, s.callback_userdata});
+            s.callback = nullptr; // claimed, concurrent polls skip it
+        }
+    }
+
+    // callbacks run unlocked, they are free to record and access other readbacks
+    for (completed_readback const& c : completed)
+        c.callback(c.data, c.userdata);
+
+    {
+        auto lg = std::lock_guard(mutex);
+        for (completed_readback const& c : completed)
+            _free_unsynced(ctx, c.rb);
+    }
+
+    return unsigned(completed.size());
+}
+
+void pr::readback_pool::free(pr::Context& ctx, readback rb)
+{
+    auto lg = std::lock_guard(mutex);
+    _free_unsynced(ctx, rb);
+}
+
+void pr::readback_pool::initialize(cc::allocator* alloc, unsigned num_reserved)
+{
+    slots.reset_reserve(alloc, num_reserved);
+    free_slots.reset_reserve(alloc, num_reserved);
+}
+
+void pr::readback_pool::destroy(pr::Context& ctx)
+{
+    auto lg = std::lock_guard(mutex);
+    for (slot const& s : slots)
+    {
+        if (s.is_live)
+            ctx.get_backend().free(s.buf.res.handle);
+    }
+
+    slots = {};
+    free_slots = {};
+}
+
+pr::readback_pool::slot& pr::readback_pool::_get_slot_unsynced(readback rb)
+{
+    CC_ASSERT(rb._index < slots.size() && "invalid readback");
+    slot& s = slots[rb._index];
+    CC_ASSERT(s.is_live && s.generation == rb._generation && "readback used after it was freed");
+    return s;
+}
+
+cc::span<const std::byte> pr::readback_pool::_get_data_unsynced(pr::Context& ctx, slot& s)
+{
+    readback_layout const& layout = s.layout;
+
+    if (s.map == nullptr)
+    {
+        s.map = ctx.map_buffer(s.buf); // invalidate the whole range
+
+        // remove the row padding in place, rows only ever move towards the start
+        if (layout.row_pitch_bytes != layout.row_size_bytes)
+        {
+            for (auto row = 1u; row < layout.num_rows; ++row)
+                std::memmove(s.map + row * layout.row_size_bytes, s.map + row * layout.row_pitch_bytes, layout.row_size_bytes);
+        }
+    }
+
+    return {s.map, size_t(layout.row_size_bytes) * layout.num_rows};
+}
+
+void pr::readback_pool::_free_unsynced(pr::Context& ctx, readback rb)
+{
+    slot& s = _get_slot_unsynced(rb);
+    CC_ASSERT(s.is_submitted && "readbacks must not be freed before their frame is submitted or discarded");
+
+    if (s.map != nullptr)
+        ctx.unmap_buffer(s.buf, 0, 0); // flush nothing
+
+    // the buffer is no longer in flight once completed or discarded, otherwise the cache waits for the current epoch
+    ctx.free_to_cache(s.buf);
+
+    s.is_live = false;
+    s.map = nullptr;
+    s.callback = nullptr;
+    ++s.generation;
+    free_slots.push_back(rb._index);
+}
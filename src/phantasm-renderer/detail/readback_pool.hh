@@ -0,0 +1,80 @@
+#pragma once
+
+#include <mutex>
+
+#include <clean-core/alloc_vector.hh>
+#include <clean-core/span.hh>
+
+#include <phantasm-renderer/fwd.hh>
+#include <phantasm-renderer/resource_types.hh>
+
+namespace pr
+{
+/// layout of readback data in its buffer, rows are padded on D3D12
+struct readback_layout
+{
+    uint32_t row_size_bytes = 0;
+    uint32_t row_pitch_bytes = 0;
+    uint32_t num_rows = 1;
+};
+
+/// persistent pool of asynchronous readbacks
+/// readback buffers come from the Context buffer cache and go back to it once freed
+/// synchronised
+struct readback_pool
+{
+    /// register a readback into a disowned buffer, which the pool owns from here on
+    readback add(buffer const& buf, readback_layout const& layout);
+
+    /// set the epoch the readbacks of a frame complete at, once submitted
+    void on_submit(cc::span<readback const> readbacks, gpu_epoch_t epoch);
+
+    /// mark the readbacks of a discarded frame, they never complete
+    void on_discard(cc::span<readback const> readbacks);
+
+    bool is_ready(readback rb, gpu_epoch_t current_epoch_gpu);
+
+    /// whether the frame of a readback was discarded
+    bool is_discarded(readback rb);
+
+    /// maps and (on first access) de-pads the data of a completed readback
+    cc::span<std::byte const> get_data(pr::Context& ctx, readback rb, gpu_epoch_t current_epoch_gpu);
+
+    void set_callback(readback rb, readback_callback callback, void* userdata);
+
+    /// invokes the callbacks of all completed readbacks that have one, and frees them afterwards
+    /// returns the amount of invoked callbacks
+    unsigned poll(pr::Context& ctx, gpu_epoch_t current_epoch_gpu);
+
+    void free(pr::Context& ctx, readback rb);
+
+    void initialize(cc::allocator* alloc, unsigned num_reserved = 32);
+    void destroy(pr::Context& ctx);
+
+private:
+    static constexpr gpu_epoch_t never_completes = gpu_epoch_t(-1);
+
+    struct slot
+    {
+        buffer buf;
+        readback_layout layout;
+        gpu_epoch_t epoch = never_completes; ///< the epoch the data is available at, set on submit
+        uint32_t generation = 0;
+        bool is_live = false;
+        bool is_submitted = false;
+        std::byte* map = nullptr; ///< non-null once mapped and de-padded
+        readback_callback callback = nullptr;
+        void* callback_userdata = nullptr;
+    };
+
+    slot& _get_slot_unsynced(readback rb);
+    cc::span<std::byte const> _get_data_unsynced(pr::Context& ctx, slot& s);
+    void _free_unsynced(pr::Context& ctx, readback rb);
+
+private:
+    cc::alloc_vector<slot> slots;
+    cc::alloc_vector<uint32_t> free_slots;
+
+    std::mutex mutex;
+};
+}
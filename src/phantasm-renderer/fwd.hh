@@ -46,6 +46,10 @@ struct shader_view_info;
 struct graphics_pass_info_data;
 struct compute_pass_info_data;
 struct freeable_cached_obj;
+struct resource_state_entry;
+struct pixel_conversion;
+struct texture_upload_layout;
+struct texture_file_upload;
 
 // shaders, PSOs, fences, query ranges
 struct shader_binary;
@@ -55,6 +59,7 @@ struct compute_pipeline_state;
 struct fence;
 struct query_range;
 struct swapchain;
+struct readback;
 using auto_shader_binary = auto_destroyer<shader_binary, auto_mode::destroy>;
 using auto_graphics_pipeline_state = auto_destroyer<graphics_pipeline_state, auto_mode::guard>;
 using auto_compute_pipeline_state = auto_destroyer<compute_pipeline_state, auto_mode::guard>;
@@ -78,6 +83,12 @@ class ComputePass;
 }
 
 class CompiledFrame;
+class FrameReplayer;
+class RenderGraph;
+struct graph_resource;
+class GpuProfiler;
+class VideoCapture;
+class AsyncFileReader;
 template <class T>
 struct hashable_storage;
 
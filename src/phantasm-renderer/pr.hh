@@ -6,11 +6,16 @@
 #include "enums.hh"
 #include "fwd.hh"
 
+#include "AsyncFileReader.hh"
 #include "CompiledFrame.hh"
 #include "ComputePass.hh"
 #include "Frame.hh"
+#include "FrameReplayer.hh"
 #include "Framebuffer.hh"
+#include "GpuProfiler.hh"
 #include "GraphicsPass.hh"
+#include "RenderGraph.hh"
+#include "VideoCapture.hh"
 #include "argument.hh"
 #include "pass_info.hh"
 
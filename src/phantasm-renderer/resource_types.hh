@@ -1,5 +1,7 @@
 #pragma once
 
+#include <clean-core/span.hh>
+
 #include <typed-geometry/types/size.hh>
 
 #include <phantasm-hardware-interface/handles.hh>
@@ -92,6 +94,19 @@ struct swapchain
     phi::handle::swapchain handle = phi::handle::null_swapchain;
 };
 
+/// an asynchronous GPU to CPU readback, see raii::Frame::readback_async
+/// must be freed via the Context, unless a completion callback is set
+struct readback
+{
+    uint32_t _index = uint32_t(-1);
+    uint32_t _generation = 0;
+
+    bool is_valid() const { return _index != uint32_t(-1); }
+};
+
+/// called from Context::poll_readbacks with the (tightly packed) data of a completed readback
+using readback_callback = void (*)(cc::span<std::byte const> data, void* userdata);
+
 //
 // auto_ and cached_ aliases
 